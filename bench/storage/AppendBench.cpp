@@ -0,0 +1,54 @@
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "Common.h"
+
+using namespace Afina::Bench;
+
+// Log style workload: few keys keep growing by small records. Measures cost of a single append depending on
+// size value grows up to, native Append against emulation by Get and Put the way append command used to work.
+// Native one should stay flat since it only copies appended bytes
+int main(int argc, char **argv) {
+    const size_t max_value = argc > 1 ? std::stoul(argv[1]) : 256 * 1024;
+    const size_t keys = 4;
+    const std::string record(64, 'r');
+
+    std::cout << "storage       value       ns/append(Get+Put)  ns/append(Append)" << std::endl;
+    for (auto type : {"map_global", "flat_hash", "clock_rw", "slab"}) {
+        for (size_t value_size = 1024; value_size <= max_value; value_size *= 4) {
+            const size_t appends = value_size / record.size();
+            double results[2];
+
+            for (int native = 0; native < 2; native++) {
+                auto storage = MakeStorage(type, 64 << 20);
+                for (size_t k = 0; k < keys; k++) {
+                    storage->Put(MakeKey(k), "");
+                }
+
+                std::string value;
+                auto begin = std::chrono::steady_clock::now();
+                for (size_t i = 0; i < appends; i++) {
+                    for (size_t k = 0; k < keys; k++) {
+                        if (native) {
+                            storage->Append(MakeKey(k), record);
+                        } else {
+                            storage->Get(MakeKey(k), value);
+                            storage->Put(MakeKey(k), value + record);
+                        }
+                    }
+                }
+                results[native] = Elapsed(begin) * 1e9 / (appends * keys);
+
+                if (!storage->Get(MakeKey(0), value) || value.size() != value_size) {
+                    std::cerr << "Lost append in " << type << std::endl;
+                    return 1;
+                }
+            }
+
+            std::cout << std::left << std::setw(14) << type << std::setw(12) << value_size << std::fixed
+                      << std::setprecision(1) << std::setw(20) << results[0] << results[1] << std::endl;
+        }
+    }
+    return 0;
+}
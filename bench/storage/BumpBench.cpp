@@ -0,0 +1,56 @@
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "Common.h"
+
+using namespace Afina::Bench;
+
+// Readers hit small hot key set, every hit is an LRU promotion. Reports total gets per second
+static double run(Afina::Storage &storage, size_t threads, size_t keys, size_t ops) {
+    std::atomic<bool> start(false);
+    std::vector<std::thread> workers;
+
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            Random rnd(t + 1);
+            std::string out;
+            while (!start.load()) {
+            }
+
+            for (size_t i = 0; i < ops; i++) {
+                storage.Get(MakeKey(rnd.Next() % keys), out);
+            }
+        });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start.store(true);
+    for (auto &w : workers) {
+        w.join();
+    }
+    return threads * ops / Elapsed(begin);
+}
+
+int main(int argc, char **argv) {
+    const size_t keys = argc > 1 ? std::stoul(argv[1]) : 1000;
+    const size_t ops = 200000;
+
+    std::cout << "storage       threads  gets/s" << std::endl;
+    for (auto type : {"map_global", "map_striped", "clock_rw", "cuckoo"}) {
+        for (size_t threads = 1; threads <= 64; threads *= 2) {
+            auto storage = MakeStorage(type, 64 * 1024 * 1024);
+            std::string value(100, 'v');
+            for (size_t i = 0; i < keys; i++) {
+                storage->Put(MakeKey(i), value);
+            }
+
+            double rate = run(*storage, threads, keys, ops);
+            std::cout << std::left << std::setw(14) << type << std::setw(9) << threads << std::fixed
+                      << std::setprecision(0) << rate << std::endl;
+        }
+    }
+    return 0;
+}
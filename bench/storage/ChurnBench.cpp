@@ -0,0 +1,78 @@
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <unistd.h>
+
+#include "Common.h"
+
+using namespace Afina::Bench;
+
+// Resident set size of the process in bytes
+static size_t rss() {
+    size_t pages = 0, resident = 0;
+    std::ifstream statm("/proc/self/statm");
+    statm >> pages >> resident;
+    return resident * size_t(sysconf(_SC_PAGESIZE));
+}
+
+// Stat of the storage as number, 0 if storage doesn't report it
+static double stat(const Afina::Storage &storage, const std::string &name) {
+    std::vector<std::pair<std::string, std::string>> stats;
+    storage.GetStats(stats);
+    for (auto &s : stats) {
+        if (s.first == name) {
+            return std::stod(s.second);
+        }
+    }
+    return 0;
+}
+
+// Overwrites random keys with values of random size, so that items of every size class keep getting
+// replaced and evicted, and reports how far RSS grows past the configured budget. Each storage runs in its
+// own process, otherwise memory kept by malloc after previous run would be counted. Key space is small enough
+// to fit into the budget when number of keys is given, so that items are replaced rather than evicted.
+//
+// Storages that compact memory in background also report the lowest share of their memory taken by data over
+// the second half of the run, when memory is full already, and CPU time cleaner took relative to the whole run
+int main(int argc, char **argv) {
+    const std::string type = argc > 1 ? argv[1] : "slab";
+    const size_t budget = (argc > 2 ? std::stoul(argv[2]) : 64) * 1024 * 1024;
+    const size_t ops = argc > 3 ? std::stoul(argv[3]) : 10000000;
+    const size_t keys = argc > 4 ? std::stoul(argv[4]) : 1000000;
+
+    size_t rss_before = rss();
+    auto storage = MakeStorage(type, budget);
+    storage->Start();
+    std::clock_t cpu_before = std::clock();
+
+    Random random(1);
+    std::string value(4096, 'v');
+    size_t peak = 0;
+    double utilization = 1;
+    for (size_t i = 0; i < ops; i++) {
+        uint64_t r = random.Next();
+        storage->Put(MakeKey(r % keys), value.substr(0, 16 + (r >> 32) % 4000));
+        if (i % 100000 == 0) {
+            peak = std::max(peak, rss() - rss_before);
+            double used = stat(*storage, "segment_bytes");
+            if (i >= ops / 2 && used > 0) {
+                utilization = std::min(utilization, stat(*storage, "bytes") / used);
+            }
+        }
+    }
+    peak = std::max(peak, rss() - rss_before);
+    double cpu = double(std::clock() - cpu_before) / CLOCKS_PER_SEC;
+    storage->Stop();
+
+    std::cout << std::left << std::setw(16) << type << "budget " << budget / 1024 / 1024 << "MB, peak rss "
+              << std::fixed << std::setprecision(1) << double(peak) / 1024 / 1024 << "MB ("
+              << 100.0 * double(peak) / budget << "%)";
+    if (stat(*storage, "segments") > 0) {
+        double cleaner = stat(*storage, "cleaner_cpu_usec") / 1000000;
+        std::cout << ", utilization " << 100.0 * utilization << "%, cleaner cpu " << std::setprecision(2)
+                  << cleaner << "s (" << std::setprecision(1) << 100.0 * cleaner / cpu << "% of " << cpu << "s)";
+    }
+    std::cout << std::endl;
+    return 0;
+}
@@ -0,0 +1,117 @@
+#ifndef AFINA_BENCH_STORAGE_COMMON_H
+#define AFINA_BENCH_STORAGE_COMMON_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <afina/Storage.h>
+
+#include <storage/ArtImpl.h>
+#include <storage/ClockRWLockImpl.h>
+#include <storage/CuckooImpl.h>
+#include <storage/FlatHashImpl.h>
+#include <storage/LogStructuredImpl.h>
+#include <storage/MapBasedGlobalLockImpl.h>
+#include <storage/SkipListImpl.h>
+#include <storage/SlabImpl.h>
+#include <storage/StripedLockImpl.h>
+
+namespace Afina {
+namespace Bench {
+
+/**
+ * Builds storage of the given type, names are the same as for --storage option of the server
+ */
+inline std::shared_ptr<Afina::Storage> MakeStorage(const std::string &type, size_t max_size) {
+    if (type == "map_global") {
+        return std::make_shared<Afina::Backend::MapBasedGlobalLockImpl>(max_size);
+    } else if (type == "map_striped") {
+        return std::make_shared<Afina::Backend::StripedLockImpl>(max_size, 64);
+    } else if (type == "flat_hash") {
+        return std::make_shared<Afina::Backend::FlatHashImpl>(max_size);
+    } else if (type == "art") {
+        return std::make_shared<Afina::Backend::ArtImpl>(max_size);
+    } else if (type == "clock_rw") {
+        return std::make_shared<Afina::Backend::ClockRWLockImpl>(max_size);
+    } else if (type == "slab") {
+        return std::make_shared<Afina::Backend::SlabImpl>(max_size);
+    } else if (type == "cuckoo") {
+        return std::make_shared<Afina::Backend::CuckooImpl>(max_size);
+    } else if (type == "skiplist") {
+        return std::make_shared<Afina::Backend::SkipListImpl>(max_size);
+    } else if (type == "log_structured") {
+        return std::make_shared<Afina::Backend::LogStructuredImpl>(max_size);
+    }
+    throw std::runtime_error("Unknown storage type: " + type);
+}
+
+/**
+ * Key used by benchmarks, padded to a fixed length so that all keys cost the same
+ */
+inline std::string MakeKey(size_t i, size_t length = 16) {
+    std::string key = "key:" + std::to_string(i);
+    key.resize(length, '.');
+    return key;
+}
+
+/**
+ * Fast thread local pseudo random generator, std::rand takes a global lock and would dominate
+ * any multithreaded benchmark
+ */
+class Random {
+public:
+    Random(uint64_t seed) : _state(seed * 0x9E3779B97F4A7C15ULL + 1) {}
+
+    uint64_t Next() {
+        _state ^= _state << 13;
+        _state ^= _state >> 7;
+        _state ^= _state << 17;
+        return _state;
+    }
+
+private:
+    uint64_t _state;
+};
+
+/**
+ * Zipfian distributed key ids in [0, n): id i is drawn with probability proportional to 1 / (i + 1)^theta
+ */
+class Zipf {
+public:
+    Zipf(size_t n, double theta = 0.99) : _cdf(n) {
+        double sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            sum += 1.0 / std::pow(double(i + 1), theta);
+            _cdf[i] = sum;
+        }
+        for (auto &c : _cdf) {
+            c /= sum;
+        }
+    }
+
+    size_t Next(Random &random) {
+        double u = double(random.Next() >> 11) / double(uint64_t(1) << 53);
+        return std::min(size_t(std::lower_bound(_cdf.begin(), _cdf.end(), u) - _cdf.begin()), _cdf.size() - 1);
+    }
+
+private:
+    std::vector<double> _cdf;
+};
+
+/**
+ * Seconds elapsed since given time point
+ */
+inline double Elapsed(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+} // namespace Bench
+} // namespace Afina
+
+#endif // AFINA_BENCH_STORAGE_COMMON_H
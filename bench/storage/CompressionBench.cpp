@@ -0,0 +1,85 @@
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "Common.h"
+
+using namespace Afina::Bench;
+
+// JSON array of alike records, the kind of document that compresses several times
+static std::string document(size_t id) {
+    std::string value = "[";
+    for (size_t r = 0; r < 8; r++) {
+        value += "{\"id\":" + std::to_string(id * 8 + r) + ",\"name\":\"user" + std::to_string(id) +
+                 "\",\"active\":true,\"score\":" + std::to_string(id % 97) + ",\"roles\":[\"reader\",\"writer\"]},";
+    }
+    value.back() = ']';
+    return value;
+}
+
+// Stat of the storage
+static std::string stat(const Afina::Storage &storage, const std::string &name) {
+    std::vector<std::pair<std::string, std::string>> stats;
+    storage.GetStats(stats);
+    for (auto &s : stats) {
+        if (s.first == name) {
+            return s.second;
+        }
+    }
+    return "";
+}
+
+// Replays Zipfian trace against map_global that keeps given percent of memory uncompressed: each request is a
+// Get followed by Put on miss. Prints hit ratio, entries that fit, CPU spent on compression and share of hits
+// that had to decompress
+static void replay(size_t hot, size_t max_size, const std::vector<size_t> &trace) {
+    Afina::Backend::MapBasedGlobalLockImpl storage(max_size, 100, 0, hot == 100 ? SIZE_MAX : max_size * hot / 100);
+    std::string res;
+
+    size_t hits = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t id : trace) {
+        std::string key = MakeKey(id);
+        if (storage.Get(key, res)) {
+            hits++;
+        } else {
+            storage.Put(key, document(id));
+        }
+    }
+    double seconds = Elapsed(start);
+
+    double cpu = (std::stod(stat(storage, "compress_cpu_usec")) + std::stod(stat(storage, "decompress_cpu_usec"))) /
+                 1e6;
+    std::cout << std::left << std::setw(6) << std::to_string(hot) + "%" << std::fixed << std::setprecision(3)
+              << std::setw(8) << double(hits) / trace.size() << std::setw(10) << stat(storage, "curr_items")
+              << std::setw(13) << stat(storage, "compressed_percent") + "%" << std::setw(14)
+              << stat(storage, "compressed_hit_percent") + "%" << std::setprecision(1) << std::setw(8)
+              << 100 * cpu / seconds << std::setprecision(2) << trace.size() / seconds / 1e6 << std::endl;
+}
+
+// Compares map_global with all memory uncompressed and with only the most recent part of it uncompressed, under
+// the same memory limit of 20% of the data set. Compression column is size of compressed values relative to
+// the original, CPU is the share of run time spent compressing and decompressing
+int main(int argc, char **argv) {
+    const size_t keys = argc > 1 ? std::stoul(argv[1]) : 100000;
+    const size_t requests = argc > 2 ? std::stoul(argv[2]) : 2000000;
+
+    Random random(1);
+    Zipf zipf(keys);
+    std::vector<size_t> trace;
+    for (size_t i = 0; i < requests; i++) {
+        trace.push_back(zipf.Next(random));
+    }
+
+    size_t data = 0;
+    for (size_t id = 0; id < keys; id++) {
+        data += MakeKey(id).size() + document(id).size();
+    }
+
+    std::cout << "hot   hits    items     compressed   cold hits     cpu%    Mops" << std::endl;
+    for (size_t hot : {100, 50, 20, 10}) {
+        replay(hot, data / 5, trace);
+    }
+    return 0;
+}
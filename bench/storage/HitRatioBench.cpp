@@ -0,0 +1,67 @@
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "Common.h"
+
+using namespace Afina::Bench;
+
+// Replays trace against flat_hash with the given policy: each request is a Get followed by Put on miss.
+// Returns hit ratio over requests of the Zipfian part of the trace only
+static double replay(const std::string &policy, size_t max_size, const std::vector<size_t> &trace, size_t keys) {
+    Afina::Backend::FlatHashImpl storage(max_size, policy);
+    std::string value(100, 'v');
+    std::string res;
+
+    size_t hits = 0, requests = 0;
+    for (size_t id : trace) {
+        std::string key = MakeKey(id);
+        bool hit = storage.Get(key, res);
+        if (!hit) {
+            storage.Put(key, value);
+        }
+        if (id < keys) {
+            requests++;
+            hits += hit ? 1 : 0;
+        }
+    }
+    return double(hits) / requests;
+}
+
+// Compares hit ratio of eviction policies on a plain Zipfian trace and on the same trace interleaved with
+// sequential scans over keys that are never requested again, e.g nightly batch jobs
+int main(int argc, char **argv) {
+    const size_t keys = argc > 1 ? std::stoul(argv[1]) : 100000;
+    const size_t requests = argc > 2 ? std::stoul(argv[2]) : 2000000;
+
+    // Scan over keys / 10 new keys after every keys / 5 requests, that is as large as the largest cache tried
+    Random random(1);
+    Zipf zipf(keys);
+    std::vector<size_t> plain, scans;
+    size_t scanned = keys;
+    for (size_t i = 0; i < requests; i++) {
+        size_t id = zipf.Next(random);
+        plain.push_back(id);
+        scans.push_back(id);
+        if (i % (keys / 5) == 0) {
+            for (size_t j = 0; j < keys / 10; j++) {
+                scans.push_back(scanned++);
+            }
+        }
+    }
+
+    const size_t item_size = 16 + 100;
+    std::cout << "workload  cache   lru     slru    arc     tinylfu" << std::endl;
+    for (auto workload : {"zipf", "scan"}) {
+        for (size_t percent : {1, 5, 10}) {
+            std::cout << std::left << std::setw(10) << workload << std::setw(8) << std::to_string(percent) + "%";
+            for (auto policy : {"lru", "slru", "arc", "tinylfu"}) {
+                double ratio = replay(policy, keys * percent / 100 * item_size,
+                                      std::string(workload) == "zipf" ? plain : scans, keys);
+                std::cout << std::fixed << std::setprecision(3) << std::setw(8) << ratio;
+            }
+            std::cout << std::endl;
+        }
+    }
+    return 0;
+}
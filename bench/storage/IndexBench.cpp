@@ -0,0 +1,87 @@
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Common.h"
+
+using namespace Afina::Bench;
+
+// Resident set size of the process in bytes
+static size_t rss() {
+    size_t pages = 0, resident = 0;
+    std::ifstream statm("/proc/self/statm");
+    statm >> pages >> resident;
+    return resident * size_t(sysconf(_SC_PAGESIZE));
+}
+
+// Stat of the storage, empty if storage doesn't report it
+static std::string stat(const Afina::Storage &storage, const std::string &name) {
+    std::vector<std::pair<std::string, std::string>> stats;
+    storage.GetStats(stats);
+    for (auto &s : stats) {
+        if (s.first == name) {
+            return s.second;
+        }
+    }
+    return "";
+}
+
+// Fills storage with small items and prints resident bytes per item on top of raw key and value bytes, and
+// share of the index in it when storage reports index size
+static void run(const std::string &type, size_t items) {
+    const size_t key_size = 16;
+    const size_t value_size = 16;
+
+    size_t rss_before = rss();
+    auto storage = MakeStorage(type, items * 64 + (64 << 20));
+    std::string value(value_size, 'v');
+    for (size_t i = 0; i < items; i++) {
+        storage->Put(MakeKey(i, key_size), value);
+    }
+
+    double bytes = double(rss() - rss_before) / items;
+    std::string index = stat(*storage, "index_bytes");
+    std::cout << std::left << std::setw(16) << type << std::setw(12) << items << std::fixed << std::setprecision(1)
+              << std::setw(12) << bytes << std::setw(15) << bytes - key_size - value_size;
+    if (!index.empty()) {
+        std::cout << double(std::stoul(index)) / items;
+    } else {
+        std::cout << "-";
+    }
+    std::cout << std::endl;
+}
+
+// Reports memory overhead per item for 16B keys and 16B values at the given numbers of items, 10M, 100M and
+// 200M by default. Each run takes its own process, so that memory kept by malloc after previous one is not
+// counted. Key and value bytes alone take 3.2 GB at 100M items, log_structured needs about 6 GB of RAM there
+// and 12 GB at 200M, map_global about 27 GB at 100M. Runs that don't fit are reported as failed when address
+// space is limited by ulimit -v, otherwise they end up killed by the OOM killer
+int main(int argc, char **argv) {
+    std::vector<size_t> counts;
+    for (int i = 1; i < argc; i++) {
+        counts.push_back(std::stoul(argv[i]));
+    }
+    if (counts.empty()) {
+        counts = {10000000, 100000000, 200000000};
+    }
+
+    std::cout << "storage         items       bytes/item  overhead/item  index/item" << std::endl;
+    for (size_t items : counts) {
+        for (auto type : {"map_global", "flat_hash", "log_structured"}) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                run(type, items);
+                _exit(0);
+            }
+
+            int status;
+            waitpid(pid, &status, 0);
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                std::cout << std::left << std::setw(16) << type << std::setw(12) << items << "failed" << std::endl;
+            }
+        }
+    }
+    return 0;
+}
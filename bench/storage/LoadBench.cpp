@@ -0,0 +1,65 @@
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <unistd.h>
+
+#include <storage/Snapshot.h>
+#include <storage/SnapshotLoader.h>
+
+#include "Common.h"
+
+using namespace Afina::Bench;
+
+// Warm start from a dump: time till the whole file is in the storage, sequential reader putting items one by
+// one against SnapshotLoader with growing number of workers. File is read once before measuring, so it comes
+// from page cache and numbers show the cost of parsing and inserting rather than of the disk
+int main(int argc, char **argv) {
+    const size_t items = argc > 1 ? std::stoul(argv[1]) : 2000000;
+    const std::string path = "/tmp/afina_load_bench_" + std::to_string(getpid());
+    const std::string value(100, 'v');
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "Failed to create " << path << std::endl;
+        return 1;
+    }
+    Afina::Backend::SnapshotWriter writer(fd);
+    for (size_t i = 0; i < items; i++) {
+        writer.Add(MakeKey(i), value, 0);
+    }
+    writer.Finish();
+    close(fd);
+
+    std::cout << "storage       Put(Mitems/s)  Load x1      x2           x4           x8" << std::endl;
+    for (auto type : {"map_global", "map_striped", "flat_hash", "clock_rw", "slab"}) {
+        std::cout << std::left << std::setw(14) << type << std::fixed << std::setprecision(2);
+        for (size_t threads : {0, 1, 2, 4, 8}) {
+            auto storage = MakeStorage(type, 1024 << 20);
+            auto begin = std::chrono::steady_clock::now();
+            if (threads == 0) {
+                Afina::Backend::SnapshotReader reader(path);
+                std::string key, data;
+                uint32_t expire_at;
+                while (reader.Next(key, data, expire_at)) {
+                    storage->Put(key, data);
+                }
+            } else {
+                Afina::Backend::SnapshotLoader loader(*storage, path, threads);
+                loader.Start();
+                loader.Wait();
+            }
+            double seconds = Elapsed(begin);
+
+            std::string check;
+            if (!storage->Get(MakeKey(items - 1), check) || check != value) {
+                std::cerr << "Lost item in " << type << std::endl;
+                return 1;
+            }
+            std::cout << std::setw(threads == 0 ? 15 : 13) << items / seconds / 1e6;
+        }
+        std::cout << std::endl;
+    }
+
+    unlink(path.c_str());
+    return 0;
+}
@@ -0,0 +1,87 @@
+#include <atomic>
+#include <dirent.h>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+
+#include <storage/LoggedStorage.h>
+
+#include "Common.h"
+
+using namespace Afina::Bench;
+
+// Log directory left by the previous run
+static void remove_dir(const std::string &dir) {
+    if (DIR *d = opendir(dir.c_str())) {
+        while (struct dirent *entry = readdir(d)) {
+            unlink((dir + "/" + entry->d_name).c_str());
+        }
+        closedir(d);
+        rmdir(dir.c_str());
+    }
+}
+
+static std::string stat_value(const Afina::Storage &storage, const std::string &name) {
+    std::vector<std::pair<std::string, std::string>> stats;
+    storage.GetStats(stats);
+    for (auto &s : stats) {
+        if (s.first == name) {
+            return s.second;
+        }
+    }
+    return "";
+}
+
+// Durable writes: N writers doing Put of 100 byte values as fast as replies come back, without log and with
+// operation log synced every write on its own or by group commit with 1ms and 5ms windows. Each writer waits for
+// its record to be synced, so throughput of a single writer is bound by sync latency and group commit pays off
+// only with many of them
+int main(int argc, char **argv) {
+    const size_t threads = argc > 1 ? std::stoul(argv[1]) : 16;
+    const double seconds = 2;
+    const std::string dir = argc > 2 ? argv[2] : "/tmp/afina_log_bench_" + std::to_string(getpid());
+    const std::string value(100, 'v');
+
+    std::cout << "sync          writes/s     us/write     records/sync" << std::endl;
+    for (long window : {-1, 0, 1, 5}) {
+        std::shared_ptr<Afina::Storage> storage = MakeStorage("flat_hash", 1024 << 20);
+        if (window >= 0) {
+            remove_dir(dir);
+            storage = std::make_shared<Afina::Backend::LoggedStorage>(storage, dir, std::chrono::milliseconds(window));
+        }
+        storage->Start();
+
+        std::atomic<bool> stop(false);
+        std::atomic<uint64_t> writes(0);
+        std::vector<std::thread> writers;
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t t = 0; t < threads; t++) {
+            writers.emplace_back([&, t]() {
+                Random random(t);
+                uint64_t done = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    storage->Put(MakeKey(random.Next() % 100000), value);
+                    done++;
+                }
+                writes += done;
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+        stop = true;
+        for (auto &w : writers) {
+            w.join();
+        }
+        double elapsed = Elapsed(begin);
+
+        std::cout << std::left << std::setw(14)
+                  << (window < 0 ? "none" : window == 0 ? "every write" : std::to_string(window) + "ms") << std::fixed
+                  << std::setprecision(0) << std::setw(13) << writes / elapsed << std::setw(13)
+                  << elapsed * threads * 1e6 / writes
+                  << (window < 0 ? "-" : stat_value(*storage, "wal_records_per_sync")) << std::endl;
+        storage->Stop();
+    }
+
+    remove_dir(dir);
+    return 0;
+}
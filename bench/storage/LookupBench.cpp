@@ -0,0 +1,46 @@
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "Common.h"
+
+using namespace Afina::Bench;
+
+// Measures average latency of a random hit Get on a storage filled with the given number of keys. Keys are
+// prepared up front so that only storage lookup itself is measured
+int main(int argc, char **argv) {
+    const size_t max_keys = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    const size_t lookups = 1000000;
+
+    std::cout << "storage       keys        ns/get" << std::endl;
+    for (size_t keys = 1000; keys <= max_keys; keys *= 10) {
+        std::vector<std::string> probe;
+        Random rnd(keys);
+        for (size_t i = 0; i < lookups; i++) {
+            probe.push_back(MakeKey(rnd.Next() % keys));
+        }
+
+        for (auto type : {"map_global", "flat_hash"}) {
+            auto storage = MakeStorage(type, size_t(-1));
+            std::string value(16, 'v'), out;
+            for (size_t i = 0; i < keys; i++) {
+                storage->Put(MakeKey(i), value);
+            }
+
+            size_t found = 0;
+            auto begin = std::chrono::steady_clock::now();
+            for (auto &key : probe) {
+                found += storage->Get(key, out);
+            }
+            double ns = Elapsed(begin) * 1e9 / lookups;
+
+            if (found != lookups) {
+                std::cerr << "Unexpected miss in " << type << std::endl;
+                return 1;
+            }
+            std::cout << std::left << std::setw(14) << type << std::setw(12) << keys << std::fixed
+                      << std::setprecision(1) << ns << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <malloc.h>
+#include <new>
+#include <vector>
+
+#include "Common.h"
+
+using namespace Afina::Bench;
+
+// Every allocation made through operator new is counted, that covers std::string, std::map nodes and items
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t size) {
+    allocations++;
+    void *p = std::malloc(size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+// Bytes currently allocated by malloc, includes allocator own per chunk overhead
+static size_t heap_used() {
+#if defined(__GLIBC__) && __GLIBC_PREREQ(2, 33)
+    return mallinfo2().uordblks;
+#else
+    return size_t(mallinfo().uordblks);
+#endif
+}
+
+// Reports heap bytes and allocations per item on top of raw key and value bytes, for 16B keys and 100B values
+int main(int argc, char **argv) {
+    const size_t items = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    const size_t key_size = 16;
+    const size_t value_size = 100;
+
+    std::cout << "storage       items       bytes/item  overhead/item  allocs/put" << std::endl;
+    for (auto type : {"map_global", "flat_hash"}) {
+        // Keys are built up front, so that only storage own allocations are measured
+        std::vector<std::string> keys;
+        keys.reserve(items);
+        for (size_t i = 0; i < items; i++) {
+            keys.push_back(MakeKey(i, key_size));
+        }
+        std::string value(value_size, 'v');
+
+        size_t heap_before = heap_used();
+        size_t allocs_before = allocations.load();
+        {
+            auto storage = MakeStorage(type, size_t(-1));
+            for (auto &key : keys) {
+                storage->Put(key, value);
+            }
+
+            double bytes = double(heap_used() - heap_before) / items;
+            double allocs = double(allocations.load() - allocs_before) / items;
+            std::cout << std::left << std::setw(14) << type << std::setw(12) << items << std::fixed
+                      << std::setprecision(1) << std::setw(12) << bytes << std::setw(15)
+                      << bytes - key_size - value_size << std::setprecision(2) << allocs << std::endl;
+        }
+    }
+    return 0;
+}
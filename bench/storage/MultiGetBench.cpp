@@ -0,0 +1,59 @@
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+#include "Common.h"
+
+using namespace Afina::Bench;
+
+// Measures cost per key of a multi key get depending on number of keys in it: keys looked up one by one with
+// GetRef against the whole batch resolved by single GetMany call. Storage holds enough keys to not fit into
+// CPU caches, so most lookups miss and overlapping them pays off
+int main(int argc, char **argv) {
+    const size_t keys = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    const size_t lookups = 1000000;
+
+    std::cout << "storage       batch       ns/key(GetRef)  ns/key(GetMany)" << std::endl;
+    for (auto type : {"map_global", "map_striped", "flat_hash", "clock_rw"}) {
+        auto storage = MakeStorage(type, size_t(-1));
+        std::string value(16, 'v');
+        for (size_t i = 0; i < keys; i++) {
+            storage->Put(MakeKey(i), value);
+        }
+
+        for (size_t batch = 1; batch <= 256; batch *= 4) {
+            std::vector<std::vector<std::string>> batches(lookups / batch);
+            Random rnd(batch);
+            for (auto &b : batches) {
+                for (size_t i = 0; i < batch; i++) {
+                    b.push_back(MakeKey(rnd.Next() % keys));
+                }
+            }
+
+            size_t found = 0;
+            auto begin = std::chrono::steady_clock::now();
+            for (auto &b : batches) {
+                for (auto &key : b) {
+                    Afina::ValueRef ref;
+                    found += storage->GetRef(key, ref);
+                }
+            }
+            double single = Elapsed(begin) * 1e9 / (batches.size() * batch);
+
+            std::vector<Afina::ValueRef> values;
+            begin = std::chrono::steady_clock::now();
+            for (auto &b : batches) {
+                found += storage->GetMany(b, values);
+            }
+            double many = Elapsed(begin) * 1e9 / (batches.size() * batch);
+
+            if (found != 2 * batches.size() * batch) {
+                std::cerr << "Unexpected miss in " << type << std::endl;
+                return 1;
+            }
+            std::cout << std::left << std::setw(14) << type << std::setw(12) << batch << std::fixed
+                      << std::setprecision(1) << std::setw(16) << single << many << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "Common.h"
+
+using namespace Afina::Bench;
+
+// Runs uniform Get/Set mix over fixed key set and reports total operations per second
+// for the given number of threads
+static double run(Afina::Storage &storage, size_t threads, size_t keys, size_t ops, unsigned read_percent) {
+    std::atomic<bool> start(false);
+    std::vector<std::thread> workers;
+
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            Random rnd(t + 1);
+            std::string value(100, 'v'), out;
+            while (!start.load()) {
+            }
+
+            for (size_t i = 0; i < ops; i++) {
+                uint64_t r = rnd.Next();
+                std::string key = MakeKey(r % keys);
+                if ((r >> 32) % 100 < read_percent) {
+                    storage.Get(key, out);
+                } else {
+                    storage.Put(key, value);
+                }
+            }
+        });
+    }
+
+    auto begin = std::chrono::steady_clock::now();
+    start.store(true);
+    for (auto &w : workers) {
+        w.join();
+    }
+    return threads * ops / Elapsed(begin);
+}
+
+int main(int argc, char **argv) {
+    const size_t keys = 100000;
+    const size_t ops = 500000;
+    const size_t max_threads = argc > 1 ? std::stoul(argv[1]) : std::thread::hardware_concurrency();
+
+    std::cout << "storage       threads  read%    ops/s" << std::endl;
+    for (auto type : {"map_global", "map_striped", "clock_rw", "skiplist"}) {
+        for (unsigned read_percent : {90u, 50u}) {
+            for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+                auto storage = MakeStorage(type, 1024 * 1024 * 1024);
+
+                // Warm up key set so that reads hit
+                std::string value(100, 'v');
+                for (size_t i = 0; i < keys; i++) {
+                    storage->Put(MakeKey(i), value);
+                }
+
+                double rate = run(*storage, threads, keys, ops, read_percent);
+                std::cout << std::left << std::setw(14) << type << std::setw(9) << threads << std::setw(9)
+                          << read_percent << std::fixed << std::setprecision(0) << rate << std::endl;
+            }
+        }
+    }
+    return 0;
+}
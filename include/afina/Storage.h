@@ -1,7 +1,14 @@
 #ifndef AFINA_STORAGE_H
 #define AFINA_STORAGE_H
 
+#include <cstdint>
+#include <ctime>
+#include <functional>
 #include <string>
+#include <utility>
+#include <vector>
+
+#include <afina/ValueRef.h>
 
 namespace Afina {
 
@@ -10,6 +17,23 @@ namespace Afina {
  */
 class Storage {
 public:
+    /**
+     * Outcome of Cas
+     */
+    enum class CasResult {
+        // Value is stored
+        Stored,
+
+        // Version matches, but value couldn't be stored
+        NotStored,
+
+        // Key has been modified since the version was read
+        Exists,
+
+        // There is no such key
+        NotFound
+    };
+
     Storage() {}
     virtual ~Storage() {}
 
@@ -56,6 +80,71 @@ public:
      */
     virtual bool Set(const std::string &key, const std::string &value) = 0;
 
+    /**
+     * Same as Put, but association disappears once given moment comes. Expired association must be invisible
+     * for any subsequent access, exactly as if it has been deleted.
+     *
+     * By default expiration time is ignored, implementations that support expiration override this, two
+     * methods below and SupportsExpiration
+     *
+     * @param key to be associated with value
+     * @param value to be assigned for the key
+     * @param expire_at unix time association expires at, 0 means never
+     */
+    virtual bool Put(const std::string &key, const std::string &value, time_t expire_at) { return Put(key, value); }
+
+    /**
+     * Same as PutIfAbsent, but association expires at the given moment, see Put
+     */
+    virtual bool PutIfAbsent(const std::string &key, const std::string &value, time_t expire_at) {
+        return PutIfAbsent(key, value);
+    }
+
+    /**
+     * Same as Set, but association expires at the given moment, see Put
+     */
+    virtual bool Set(const std::string &key, const std::string &value, time_t expire_at) { return Set(key, value); }
+
+    /**
+     * Whether expiration time given to the methods above is honored. Commands that ask for expiration fail on
+     * storage that would ignore it, so clients never rely on keys going away while they don't
+     */
+    virtual bool SupportsExpiration() const { return false; }
+
+    /**
+     * Adds data to the end of the value for the given key, if there is such. Whole operation is atomic, it
+     * never loses concurrent updates of the same key, and leaves expiration time of the key as is
+     *
+     * @param key to update value for
+     * @param data bytes to add
+     */
+    virtual bool Append(const std::string &key, const std::string &data) = 0;
+
+    /**
+     * Same as Append, but data is added to the beginning of the value
+     *
+     * @param key to update value for
+     * @param data bytes to add
+     */
+    virtual bool Prepend(const std::string &key, const std::string &data) = 0;
+
+    /**
+     * Adds delta to the value of the given key, if there is such. Value must be decimal unsigned 64-bit number,
+     * result wraps around on overflow. Operation is atomic and leaves expiration time of the key as is
+     *
+     * Throws std::invalid_argument if value is not a number
+     *
+     * @param key to update value for
+     * @param delta number to add
+     * @param result output parameter for the new value
+     */
+    virtual bool Increment(const std::string &key, uint64_t delta, uint64_t &result) = 0;
+
+    /**
+     * Same as Increment, but delta is subtracted and value never goes below 0
+     */
+    virtual bool Decrement(const std::string &key, uint64_t delta, uint64_t &result) = 0;
+
     /**
      * Removes association for the given key
      * If requested key doesn't present in storage method returns false and
@@ -84,6 +173,155 @@ public:
      * @param value output parameter to copy value to
      */
     virtual bool Get(const std::string &key, std::string &value) const = 0;
+
+    /**
+     * Same as Get, but instead of copying value out returns read only view on it. View stays valid and
+     * unchanged after key gets overwritten or removed, so caller could hold it while value is being sent.
+     *
+     * By default value is copied once by Get into the buffer view owns, implementations that keep values
+     * in reference counted memory should override it and share that memory instead
+     *
+     * @param key to retrive value for
+     * @param value output parameter to put view into
+     */
+    virtual bool GetRef(const std::string &key, ValueRef &value) const {
+        std::string copy;
+        if (!Get(key, copy)) {
+            return false;
+        }
+        value = ValueRef(std::move(copy));
+        return true;
+    }
+
+    /**
+     * Batch version of GetRef: looks up all given keys at once. Implementations resolve the whole batch under
+     * single lock acquisition and overlap memory accesses of independent lookups, so multi key get is much
+     * cheaper than the same number of GetRef calls.
+     *
+     * By default keys are looked up one by one with GetRef
+     *
+     * @param keys to retrive values for
+     * @param values output parameter, resized to the number of keys. View is valid if the key is found and
+     * empty otherwise
+     * @return number of keys found
+     */
+    virtual size_t GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const {
+        values.clear();
+        values.resize(keys.size());
+
+        size_t found = 0;
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (GetRef(keys[i], values[i])) {
+                found++;
+            }
+        }
+        return found;
+    }
+
+    /**
+     * Bulk insert of associations read from a dump. Keys present already are left as they are, so values written
+     * by clients while dump is streaming in win over older ones from the dump. Implementations take the lock once
+     * for the whole batch and don't count loaded associations as accessed.
+     *
+     * By default associations are added one by one with PutIfAbsent
+     *
+     * @param keys to be associated with values
+     * @param values for the keys, same size as keys
+     * @param expire_at unix time each association expires at, 0 means never, same size as keys
+     * @return number of associations stored
+     */
+    virtual size_t Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                        const std::vector<time_t> &expire_at) {
+        size_t stored = 0;
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (PutIfAbsent(keys[i], values[i], expire_at[i])) {
+                stored++;
+            }
+        }
+        return stored;
+    }
+
+    /**
+     * Same as GetMany, but also returns version of each value found. Version is a number storage assigns to the
+     * key on every modification, it is what Cas compares against
+     *
+     * @param keys to retrive values for
+     * @param values output parameter, see GetMany
+     * @param versions output parameter, resized to the number of keys, 0 for keys not found
+     * @return number of keys found
+     */
+    virtual size_t Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                        std::vector<uint64_t> &versions) const = 0;
+
+    /**
+     * Compare and swap: same as Set, but value is stored only if the key hasn't been modified since the given
+     * version has been read by Gets. Check and update are atomic, so from concurrent writers that have read the
+     * same version only one succeeds
+     *
+     * @param key to be associated with value
+     * @param value to be assigned for the key
+     * @param version of the value writer has seen
+     * @param expire_at unix time association expires at, 0 means never. Storage without expiration ignores it
+     */
+    virtual CasResult Cas(const std::string &key, const std::string &value, uint64_t version, time_t expire_at) = 0;
+
+    /**
+     * Takes next batch of keys starting with the given prefix in key order: keys greater than after, at most
+     * limit of them. Caller gets the whole range by passing the last key of the previous batch as after until
+     * batch comes out short. Each batch is taken under the lock on its own, so writers are stalled for one batch
+     * only, and keys modified between batches may or may not show up. Items are not counted as accessed.
+     *
+     * By default storage doesn't keep keys ordered and returns false
+     *
+     * @param prefix keys must start with, empty for all keys
+     * @param after key to continue after, empty to start from the beginning
+     * @param limit max number of keys to return
+     * @param keys output parameter to append keys to
+     * @param values output parameter to append values to, if given
+     */
+    virtual bool Range(const std::string &prefix, const std::string &after, size_t limit,
+                       std::vector<std::string> &keys, std::vector<ValueRef> *values) const {
+        return false;
+    }
+
+    /**
+     * Takes next batch of keys of the whole storage scan. Scan starts with cursor "0", each call appends some keys
+     * and replaces cursor with the one to continue from, until cursor comes back as "0". Cursor is opaque text
+     * that stays valid while storage is modified: keys present for the whole scan are returned at least once,
+     * keys added or removed meanwhile may or may not be, and some keys could come twice.
+     *
+     * Each call takes the lock once and does work proportional to count, so scan never stalls other clients for
+     * more than one short batch. Batch could have more or less keys than count, even none, before scan is over.
+     * Items are not counted as accessed.
+     *
+     * By default storage doesn't support scan and returns false
+     *
+     * @param cursor to continue from, replaced by the next one. Throws std::invalid_argument if it is malformed
+     * @param count approximate number of keys to take, at least 1
+     * @param keys output parameter to append keys to
+     */
+    virtual bool Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const { return false; }
+
+    /**
+     * Calls f() while storage is frozen: no modification could happen until f returns. Meant for short critical
+     * sections only, e.g. fork() of the snapshot process, all workers are stalled meanwhile
+     */
+    virtual void Freeze(const std::function<void()> &f) = 0;
+
+    /**
+     * Calls f(key, value, expire_at) for every live association, expire_at is 0 for associations that never
+     * expire. Storage is not locked, so caller must either freeze it or be the only thread around, as child
+     * process of fork() is
+     */
+    virtual void ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const = 0;
+
+    /**
+     * Appends storage metrics to the given list as name/value pairs, those are reported back to client
+     * by "stats" command. By default storage has nothing to report
+     *
+     * @param stats output parameter to append metrics to
+     */
+    virtual void GetStats(std::vector<std::pair<std::string, std::string>> &stats) const {}
 };
 
 } // namespace Afina
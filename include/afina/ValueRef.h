@@ -0,0 +1,92 @@
+#ifndef AFINA_VALUE_REF_H
+#define AFINA_VALUE_REF_H
+
+#include <cstddef>
+#include <string>
+#include <utility>
+
+namespace Afina {
+
+/**
+ * # Read only view of the stored value
+ * Points to value bytes and keeps them alive until the view is destroyed, no matter whether key gets
+ * overwritten, deleted or evicted meanwhile. Storage that keeps values in reference counted blocks hands out
+ * views on them directly, so value could travel from storage to socket without being copied.
+ *
+ * View is move only, release callback is called exactly once with the owner pointer given on construction.
+ */
+class ValueRef {
+public:
+    typedef void (*ReleaseFn)(void *owner);
+
+    ValueRef() : _data(nullptr), _size(0), _owner(nullptr), _release(nullptr) {}
+
+    /**
+     * Takes over one reference on the owner, which is given back to release once view is destroyed
+     */
+    ValueRef(const char *data, size_t size, void *owner, ReleaseFn release)
+        : _data(data), _size(size), _owner(owner), _release(release) {}
+
+    /**
+     * View over its own copy of the value, for storages that couldn't share their memory
+     */
+    explicit ValueRef(std::string &&value) : _size(value.size()), _release(&ValueRef::delete_string) {
+        std::string *owner = new std::string(std::move(value));
+        _data = owner->data();
+        _owner = owner;
+    }
+
+    ValueRef(ValueRef &&other)
+        : _data(other._data), _size(other._size), _owner(other._owner), _release(other._release) {
+        other._owner = nullptr;
+        other._release = nullptr;
+    }
+
+    ValueRef &operator=(ValueRef &&other) {
+        if (this != &other) {
+            reset();
+            std::swap(_data, other._data);
+            std::swap(_size, other._size);
+            std::swap(_owner, other._owner);
+            std::swap(_release, other._release);
+        }
+        return *this;
+    }
+
+    ValueRef(const ValueRef &) = delete;
+    ValueRef &operator=(const ValueRef &) = delete;
+
+    ~ValueRef() { reset(); }
+
+    const char *data() const { return _data; }
+    size_t size() const { return _size; }
+    std::string str() const { return std::string(_data, _size); }
+
+    // True if view refers to some value, default constructed or reset view doesn't
+    bool valid() const { return _release != nullptr; }
+
+    /**
+     * Gives reference back to the owner, view becomes empty
+     */
+    void reset() {
+        if (_release != nullptr) {
+            _release(_owner);
+        }
+        _data = nullptr;
+        _size = 0;
+        _owner = nullptr;
+        _release = nullptr;
+    }
+
+private:
+    const char *_data;
+    size_t _size;
+    void *_owner;
+    ReleaseFn _release;
+
+    static void delete_string(void *owner) { delete static_cast<std::string *>(owner); }
+};
+
+} // namespace Afina
+
+#endif // AFINA_VALUE_REF_H
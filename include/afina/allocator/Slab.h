@@ -0,0 +1,168 @@
+#ifndef AFINA_ALLOCATOR_SLAB_H
+#define AFINA_ALLOCATOR_SLAB_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Afina {
+namespace Allocator {
+
+/**
+ * # Slab allocator with geometric size classes
+ * Wraps given memory area, splits it into pages of the same size and hands pages out to size classes on
+ * demand. Each class cuts its pages into chunks of the same size, chunk sizes grow geometrically by the given
+ * factor from the minimal one up to the page size. Freed chunks are kept in per class free list and are never
+ * given back to other classes one by one, but once all chunks of a page are free the whole page could be released
+ * and then goes to whichever class needs a new page first.
+ *
+ * Since memory is never requested from the system, process memory used by the allocator never exceeds the
+ * size of the area, no matter how allocations and frees interleave.
+ *
+ * Same as Simple, allocator doesn't take ownership of the wrapped memory. Not thread safe.
+ */
+class Slab {
+public:
+    /**
+     * Per class usage counters
+     */
+    struct ClassStats {
+        // Size of each chunk in the class
+        size_t chunk_size;
+
+        // Number of pages assigned to the class
+        size_t pages;
+
+        // Number of chunks handed out and not freed yet
+        size_t used_chunks;
+
+        // Number of chunks in the class free list or not cut from the last page yet
+        size_t free_chunks;
+    };
+
+    /**
+     * @param base start of the memory area to allocate from
+     * @param size size of the memory area, must fit at least one page
+     * @param min_chunk size of chunks in the smallest class
+     * @param factor ratio between chunk sizes of neighbour classes, must be greater than 1
+     * @param page_size size of the page, defines the largest possible allocation
+     */
+    Slab(void *base, size_t size, size_t min_chunk = 64, double factor = 1.25, size_t page_size = 1024 * 1024);
+
+    /**
+     * Returns class whose chunks are the smallest to fit the given size. Throws AllocError of type
+     * NoMemory if size is larger than the page
+     */
+    unsigned class_for(size_t size) const;
+
+    /**
+     * Allocates chunk of the given class. Returns nullptr if class has no free chunks and there are no
+     * free pages left, in a such case caller should free some chunk of the same class and retry
+     */
+    void *alloc(unsigned cls);
+
+    /**
+     * Returns chunk to the free list of the class it was allocated from
+     */
+    void free(unsigned cls, void *p);
+
+    /**
+     * Page the chunk belongs to
+     */
+    size_t page_of(const void *p) const { return size_t(static_cast<const char *>(p) - _base) / _page_size; }
+
+    /**
+     * Number of chunks of the page handed out and not freed yet
+     */
+    size_t page_used(size_t page) const { return _pages[page].used; }
+
+    /**
+     * First chunk of the page
+     */
+    void *page_begin(size_t page) const { return _base + page * _page_size; }
+
+    /**
+     * Number of chunks cut from the page so far, whether in use or free. Chunks of the page follow each other
+     * from page_begin with the step of the chunk size of the page class
+     */
+    size_t page_chunks(size_t page) const;
+
+    /**
+     * Takes page away from its class and makes it free, in time linear to the number of chunks of the page.
+     * Throws std::invalid_argument if some chunk of the page is still in use
+     */
+    void release(size_t page);
+
+    /**
+     * Number of size classes
+     */
+    unsigned classes() const { return unsigned(_classes.size()); }
+
+    /**
+     * Size of chunks of the given class
+     */
+    size_t chunk_size(unsigned cls) const { return _classes[cls].chunk_size; }
+
+    /**
+     * Usage counters for the given class
+     */
+    ClassStats stats(unsigned cls) const;
+
+    /**
+     * Number of pages not assigned to any class, either never used or released
+     */
+    size_t free_pages() const { return _pages_total - _pages_used; }
+
+    /**
+     * Human readable usage report, one line per class that has pages
+     */
+    std::string dump() const;
+
+private:
+    // Free list is doubly linked, so chunks of a released page are unlinked one by one without a list walk
+    struct FreeChunk {
+        FreeChunk *next;
+        FreeChunk *prev;
+    };
+
+    struct Class {
+        size_t chunk_size;
+        size_t pages;
+        size_t used;
+
+        // List of freed chunks
+        FreeChunk *free_list;
+        size_t free_count;
+
+        // Bump pointer over the last page assigned to the class
+        char *page_pos;
+        char *page_end;
+    };
+
+    struct Page {
+        // Class page is assigned to
+        unsigned cls;
+
+        // Chunks handed out
+        size_t used;
+    };
+
+    char *_base;
+    size_t _page_size;
+    size_t _pages_total;
+
+    // Pages assigned to classes. Pages from the beginning of the area up to this plus the number of released ones
+    // have been handed out at least once
+    size_t _pages_used;
+    std::vector<Page> _pages;
+
+    // Pages released by their classes
+    std::vector<size_t> _released;
+    std::vector<Class> _classes;
+};
+
+} // namespace Allocator
+} // namespace Afina
+
+#endif // AFINA_ALLOCATOR_SLAB_H
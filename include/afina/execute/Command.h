@@ -3,6 +3,8 @@
 
 #include <string>
 
+#include <afina/execute/Response.h>
+
 namespace Afina {
 
 class Storage;
@@ -19,6 +21,12 @@ public:
     virtual ~Command() {}
 
     virtual void Execute(Storage &storage, const std::string &args, std::string &out) = 0;
+
+    /**
+     * Same as Execute, but output is appended to the response, so that command could pass values read from
+     * storage over to the network without copying them. By default output of Execute is appended as a text
+     */
+    virtual void Respond(Storage &storage, const std::string &args, Response &out);
 };
 
 } // namespace Execute
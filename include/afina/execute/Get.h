@@ -41,6 +41,9 @@ public:
 
     void Execute(Storage &storage, const std::string &args, std::string &out) override;
 
+    // Values of all keys are taken from storage by single GetMany call and go to the response as is
+    void Respond(Storage &storage, const std::string &args, Response &out) override;
+
 private:
     std::vector<std::string> _keys;
 };
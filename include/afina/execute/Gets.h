@@ -0,0 +1,32 @@
+#ifndef AFINA_EXECUTE_GETS_H
+#define AFINA_EXECUTE_GETS_H
+
+#include <string>
+#include <vector>
+
+#include "Get.h"
+
+namespace Afina {
+namespace Execute {
+
+/**
+ * # Retrive values for the keys along with their versions
+ * Same as get, but each item line also carries version of the value, client passes it to cas later:
+ * VALUE <key> <flags> <bytes> <cas unique>\r\n
+ * <data>\r\n
+ * ...
+ * END
+ */
+class Gets : public Get {
+public:
+    Gets(const std::vector<std::string> &keys) : Get(keys) {}
+    ~Gets() {}
+
+    // Values and versions of all keys are taken from storage by single Gets call
+    void Respond(Storage &storage, const std::string &args, Response &out) override;
+};
+
+} // namespace Execute
+} // namespace Afina
+
+#endif // AFINA_EXECUTE_GETS_H
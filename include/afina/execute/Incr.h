@@ -0,0 +1,40 @@
+#ifndef AFINA_EXECUTE_INCR_H
+#define AFINA_EXECUTE_INCR_H
+
+#include <cstdint>
+#include <string>
+
+#include "Command.h"
+
+namespace Afina {
+namespace Execute {
+
+/**
+ * # Increment numeric value of the key
+ * Adds given number to the value of the key. Value must be decimal representation of unsigned 64-bit
+ * integer, result wraps around on overflow
+ *
+ * Command must write result to the output, which could be:
+ * - new value of the key, to indicate success
+ * - "NOT_FOUND" to indicate that the item with this key was not found
+ * - "CLIENT_ERROR cannot increment or decrement non-numeric value" if value is not a number
+ */
+class Incr : public Command {
+public:
+    Incr(const std::string &key, uint64_t value) : _key(key), _value(value) {}
+    ~Incr() {}
+
+    inline const std::string &key() const { return _key; }
+    inline uint64_t value() const { return _value; }
+
+    void Execute(Storage &storage, const std::string &args, std::string &out) override;
+
+private:
+    const std::string _key;
+    const uint64_t _value;
+};
+
+} // namespace Execute
+} // namespace Afina
+
+#endif // AFINA_EXECUTE_INCR_H
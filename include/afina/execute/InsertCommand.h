@@ -2,6 +2,7 @@
 #define AFINA_EXECUTE_INSERT_COMMAND_H
 
 #include <cstdint>
+#include <ctime>
 #include <string>
 
 #include "Command.h"
@@ -22,7 +23,29 @@ public:
     inline const uint32_t flags() const { return _flags; }
     inline const int32_t expire() const { return _expire; }
 
+    /**
+     * Absolute unix time the item expires at, or 0 if it never does. Same as in memcached, exptime up to 30 days
+     * is relative to now, larger one is unix time itself, negative one means item is expired right away
+     */
+    time_t expire_at() const {
+        if (_expire == 0) {
+            return 0;
+        } else if (_expire < 0) {
+            return 1;
+        } else if (_expire <= MaxRelativeExpire) {
+            return time(nullptr) + _expire;
+        }
+        return _expire;
+    }
+
 protected:
+    static const int32_t MaxRelativeExpire = 60 * 60 * 24 * 30;
+
+    /**
+     * Checks that storage honors expiration the command asks for, otherwise puts error into out and returns false
+     */
+    bool check_expiration(const Storage &storage, std::string &out) const;
+
     const std::string _key;
     const uint32_t _flags;
     const int32_t _expire;
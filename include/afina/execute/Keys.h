@@ -0,0 +1,54 @@
+#ifndef AFINA_EXECUTE_KEYS_H
+#define AFINA_EXECUTE_KEYS_H
+
+#include <cstddef>
+#include <string>
+
+#include "Command.h"
+
+namespace Afina {
+namespace Execute {
+
+/**
+ * # List keys under the prefix
+ * keys <prefix> [values]
+ *
+ * Returns all keys starting with the prefix in key order, empty prefix stands for all keys:
+ * KEY <key>\r\n
+ * ...
+ * END
+ *
+ * With "values" argument each key comes with its value, in the same format get uses:
+ * VALUE <key> <flags> <bytes>\r\n
+ * <data>\r\n
+ * ...
+ * END
+ *
+ * Keys are taken from storage in batches of BatchSize, each under its own lock acquisition, so writers are
+ * never stalled for the whole listing. Keys written or deleted meanwhile may or may not be listed. Storage
+ * that doesn't keep keys ordered responds with SERVER_ERROR
+ */
+class Keys : public Command {
+public:
+    static const size_t BatchSize = 1024;
+
+    Keys(const std::string &prefix, bool values) : _prefix(prefix), _values(values) {}
+    ~Keys() {}
+
+    inline const std::string &prefix() const { return _prefix; }
+    inline bool values() const { return _values; }
+
+    void Execute(Storage &storage, const std::string &args, std::string &out) override;
+
+    // Values go to the response as views, so they are not copied
+    void Respond(Storage &storage, const std::string &args, Response &out) override;
+
+private:
+    const std::string _prefix;
+    const bool _values;
+};
+
+} // namespace Execute
+} // namespace Afina
+
+#endif // AFINA_EXECUTE_KEYS_H
@@ -0,0 +1,70 @@
+#ifndef AFINA_EXECUTE_RESPONSE_H
+#define AFINA_EXECUTE_RESPONSE_H
+
+#include <string>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include <afina/ValueRef.h>
+
+namespace Afina {
+namespace Execute {
+
+/**
+ * # Command output ready for scatter/gather write
+ * Sequence of protocol text owned by response itself and values referenced right in the storage memory.
+ * Network layer sends it as a list of buffers, so values are never copied on the way to the socket. Response
+ * must be kept alive until the write completes.
+ */
+class Response {
+public:
+    Response() {}
+
+    Response(const Response &) = delete;
+    Response &operator=(const Response &) = delete;
+
+    /**
+     * Appends copy of the text
+     */
+    void Append(const std::string &text);
+
+    /**
+     * Appends value, response takes over the view
+     */
+    void Append(ValueRef &&value);
+
+    /**
+     * Drops everything appended so far, releasing all values
+     */
+    void Clear() { _segments.clear(); }
+
+    /**
+     * Total number of bytes in response
+     */
+    size_t Size() const;
+
+    /**
+     * Fills out buffers to send response with, those point into response and stay valid until next Append
+     */
+    void Buffers(std::vector<struct iovec> &out) const;
+
+    /**
+     * Whole response copied into a single string
+     */
+    std::string str() const;
+
+private:
+    // Text followed by a value, either of them could be empty
+    struct Segment {
+        std::string text;
+        ValueRef value;
+    };
+
+    std::vector<Segment> _segments;
+};
+
+} // namespace Execute
+} // namespace Afina
+
+#endif // AFINA_EXECUTE_RESPONSE_H
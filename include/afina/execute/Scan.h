@@ -0,0 +1,49 @@
+#ifndef AFINA_EXECUTE_SCAN_H
+#define AFINA_EXECUTE_SCAN_H
+
+#include <cstddef>
+#include <string>
+
+#include "Command.h"
+
+namespace Afina {
+namespace Execute {
+
+/**
+ * # Incremental iteration over all keys
+ * scan <cursor> [count]
+ *
+ * Returns next batch of keys along with the cursor to pass to the next call. Iteration starts with cursor 0
+ * and is over once 0 comes back:
+ * CURSOR <next cursor>\r\n
+ * KEY <key>\r\n
+ * ...
+ * END
+ *
+ * Keys present for the whole iteration are returned at least once, see Storage::Scan. Batch holds about count
+ * keys, 100 by default and at most MaxCount, so each call stalls other clients for a short while only. Batch
+ * may be empty while iteration is not over yet. Malformed cursor gets "CLIENT_ERROR bad cursor", storage
+ * that doesn't support iteration responds with SERVER_ERROR
+ */
+class Scan : public Command {
+public:
+    static const size_t DefaultCount = 100;
+    static const size_t MaxCount = 1000;
+
+    Scan(const std::string &cursor, size_t count) : _cursor(cursor), _count(count) {}
+    ~Scan() {}
+
+    inline const std::string &cursor() const { return _cursor; }
+    inline size_t count() const { return _count; }
+
+    void Execute(Storage &storage, const std::string &args, std::string &out) override;
+
+private:
+    const std::string _cursor;
+    const size_t _count;
+};
+
+} // namespace Execute
+} // namespace Afina
+
+#endif // AFINA_EXECUTE_SCAN_H
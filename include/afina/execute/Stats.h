@@ -8,6 +8,10 @@
 namespace Afina {
 namespace Execute {
 
+/**
+ * # Report server statistics
+ * Writes out all metrics storage reports as "STAT <name> <value>" lines followed by "END"
+ */
 class Stats : public Command {
 public:
     Stats() {}
@@ -0,0 +1,172 @@
+#include <afina/allocator/Slab.h>
+
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include <afina/allocator/Error.h>
+
+namespace Afina {
+namespace Allocator {
+
+// Chunks are aligned the same way malloc does
+static const size_t ChunkAlign = 16;
+
+static size_t align(size_t size) { return (size + ChunkAlign - 1) & ~(ChunkAlign - 1); }
+
+// See Slab.h
+Slab::Slab(void *base, size_t size, size_t min_chunk, double factor, size_t page_size)
+    : _base(static_cast<char *>(base)), _page_size(page_size), _pages_total(size / page_size), _pages_used(0),
+      _pages(_pages_total, Page{0, 0}) {
+    if (_pages_total == 0) {
+        throw std::invalid_argument("Memory area doesn't fit a single page");
+    }
+    if (factor <= 1.0) {
+        throw std::invalid_argument("Slab growth factor must be greater than 1");
+    }
+
+    size_t chunk = align(std::max(min_chunk, sizeof(FreeChunk)));
+    while (chunk < page_size / 2) {
+        _classes.push_back(Class{chunk, 0, 0, nullptr, 0, nullptr, nullptr});
+        chunk = align(std::max(size_t(chunk * factor), chunk + 1));
+    }
+    _classes.push_back(Class{page_size, 0, 0, nullptr, 0, nullptr, nullptr});
+}
+
+// Classes are sorted by chunk size, so binary search finds the first that fits
+unsigned Slab::class_for(size_t size) const {
+    if (size > _page_size) {
+        throw AllocError(AllocErrorType::NoMemory, "Allocation is larger than slab page");
+    }
+
+    unsigned lo = 0, hi = unsigned(_classes.size()) - 1;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (_classes[mid].chunk_size < size) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// Free list first, then the rest of the current page, then a released page, then a page never used before
+void *Slab::alloc(unsigned cls) {
+    Class &c = _classes[cls];
+    if (c.free_list != nullptr) {
+        FreeChunk *chunk = c.free_list;
+        c.free_list = chunk->next;
+        if (c.free_list != nullptr) {
+            c.free_list->prev = nullptr;
+        }
+        c.free_count--;
+        c.used++;
+        _pages[page_of(chunk)].used++;
+        return chunk;
+    }
+
+    if (c.page_pos == nullptr || c.page_pos + c.chunk_size > c.page_end) {
+        if (_pages_used == _pages_total) {
+            return nullptr;
+        }
+
+        size_t page = _pages_used + _released.size();
+        if (!_released.empty()) {
+            page = _released.back();
+            _released.pop_back();
+        }
+        _pages[page] = Page{cls, 0};
+        c.page_pos = _base + page * _page_size;
+        c.page_end = c.page_pos + _page_size;
+        c.pages++;
+        _pages_used++;
+    }
+
+    void *result = c.page_pos;
+    c.page_pos += c.chunk_size;
+    c.used++;
+    _pages[page_of(result)].used++;
+    return result;
+}
+
+// See Slab.h
+void Slab::free(unsigned cls, void *p) {
+    Class &c = _classes[cls];
+    FreeChunk *chunk = static_cast<FreeChunk *>(p);
+    chunk->next = c.free_list;
+    chunk->prev = nullptr;
+    if (c.free_list != nullptr) {
+        c.free_list->prev = chunk;
+    }
+    c.free_list = chunk;
+    c.free_count++;
+    c.used--;
+    _pages[page_of(p)].used--;
+}
+
+// See Slab.h
+size_t Slab::page_chunks(size_t page) const {
+    const Class &c = _classes[_pages[page].cls];
+    char *begin = _base + page * _page_size;
+    if (c.page_end == begin + _page_size) {
+        return size_t(c.page_pos - begin) / c.chunk_size;
+    }
+    return _page_size / c.chunk_size;
+}
+
+// All chunks cut from the page are free, so each of them is unlinked from the class free list in place, and if
+// page is the one class cuts chunks from, the rest of it is dropped too
+void Slab::release(size_t page) {
+    if (_pages[page].used != 0) {
+        throw std::invalid_argument("Released page has chunks in use");
+    }
+
+    Class &c = _classes[_pages[page].cls];
+    char *begin = _base + page * _page_size;
+    size_t chunks = page_chunks(page);
+    for (size_t i = 0; i < chunks; i++) {
+        FreeChunk *chunk = reinterpret_cast<FreeChunk *>(begin + i * c.chunk_size);
+        if (chunk->prev != nullptr) {
+            chunk->prev->next = chunk->next;
+        } else {
+            c.free_list = chunk->next;
+        }
+        if (chunk->next != nullptr) {
+            chunk->next->prev = chunk->prev;
+        }
+        c.free_count--;
+    }
+    if (c.page_end == begin + _page_size) {
+        c.page_pos = nullptr;
+        c.page_end = nullptr;
+    }
+
+    c.pages--;
+    _pages_used--;
+    _released.push_back(page);
+}
+
+// See Slab.h
+Slab::ClassStats Slab::stats(unsigned cls) const {
+    const Class &c = _classes[cls];
+    size_t tail = c.page_pos == nullptr ? 0 : (c.page_end - c.page_pos) / c.chunk_size;
+    return ClassStats{c.chunk_size, c.pages, c.used, c.free_count + tail};
+}
+
+// See Slab.h
+std::string Slab::dump() const {
+    std::stringstream ss;
+    ss << "pages: " << _pages_used << "/" << _pages_total << " of " << _page_size << " bytes" << std::endl;
+    for (unsigned i = 0; i < _classes.size(); i++) {
+        ClassStats s = stats(i);
+        if (s.pages > 0) {
+            ss << "class " << i << ": chunk " << s.chunk_size << ", pages " << s.pages << ", used " << s.used_chunks
+               << ", free " << s.free_chunks << std::endl;
+        }
+    }
+    return ss.str();
+}
+
+} // namespace Allocator
+} // namespace Afina
@@ -10,7 +10,10 @@ namespace Execute {
 // hold data for this key".
 void Add::Execute(Storage &storage, const std::string &args, std::string &out) {
     std::cout << "Add(" << _key << ")" << args << std::endl;
-    out = storage.PutIfAbsent(_key, args) ? "STORED" : "NOT_STORED";
+    if (!check_expiration(storage, out)) {
+        return;
+    }
+    out = storage.PutIfAbsent(_key, args, expire_at()) ? "STORED" : "NOT_STORED";
 }
 
 } // namespace Execute
@@ -0,0 +1,22 @@
+#include <afina/Storage.h>
+#include <afina/execute/Decr.h>
+
+#include <iostream>
+#include <stdexcept>
+
+namespace Afina {
+namespace Execute {
+
+// memcached protocol: "decr" means "subtract delta from the number stored for the key", underflow gives 0.
+void Decr::Execute(Storage &storage, const std::string &args, std::string &out) {
+    std::cout << "Decr(" << _key << "): " << _value << std::endl;
+    try {
+        uint64_t result;
+        out = storage.Decrement(_key, _value, result) ? std::to_string(result) : "NOT_FOUND";
+    } catch (std::invalid_argument &e) {
+        out = std::string("CLIENT_ERROR ") + e.what();
+    }
+}
+
+} // namespace Execute
+} // namespace Afina
@@ -22,22 +22,27 @@ to indicate the end of response.
 */
 
 void Get::Execute(Storage &storage, const std::string &args, std::string &out) {
+    Response response;
+    Respond(storage, args, response);
+    out = response.str();
+}
+
+// See Get.h
+void Get::Respond(Storage &storage, const std::string &args, Response &out) {
     std::stringstream keyStream;
     copy(_keys.begin(), _keys.end(), std::ostream_iterator<std::string>(keyStream, " "));
     std::cout << "Get(" << keyStream.str() << ")" << std::endl;
 
-    std::stringstream outStream;
-
-    std::string value;
-    for (auto &key : _keys) {
-        if (!storage.Get(key, value))
+    std::vector<ValueRef> values;
+    storage.GetMany(_keys, values);
+    for (size_t i = 0; i < _keys.size(); i++) {
+        if (!values[i].valid())
             continue;
-        outStream << "VALUE " << key << " 0 " << value.size() << "\r\n";
-        outStream << value << "\r\n";
+        out.Append("VALUE " + _keys[i] + " 0 " + std::to_string(values[i].size()) + "\r\n");
+        out.Append(std::move(values[i]));
+        out.Append("\r\n");
     }
-    outStream << "END"; // networking layer should add the last \r\n
-
-    out = outStream.str();
+    out.Append("END"); // networking layer should add the last \r\n
 }
 
 } // namespace Execute
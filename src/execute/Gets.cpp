@@ -0,0 +1,32 @@
+#include <afina/Storage.h>
+#include <afina/execute/Gets.h>
+
+#include <iostream>
+#include <iterator>
+#include <sstream>
+
+namespace Afina {
+namespace Execute {
+
+// See Gets.h
+void Gets::Respond(Storage &storage, const std::string &args, Response &out) {
+    std::stringstream keyStream;
+    copy(keys().begin(), keys().end(), std::ostream_iterator<std::string>(keyStream, " "));
+    std::cout << "Gets(" << keyStream.str() << ")" << std::endl;
+
+    std::vector<ValueRef> values;
+    std::vector<uint64_t> versions;
+    storage.Gets(keys(), values, versions);
+    for (size_t i = 0; i < keys().size(); i++) {
+        if (!values[i].valid())
+            continue;
+        out.Append("VALUE " + keys()[i] + " 0 " + std::to_string(values[i].size()) + " " +
+                   std::to_string(versions[i]) + "\r\n");
+        out.Append(std::move(values[i]));
+        out.Append("\r\n");
+    }
+    out.Append("END"); // networking layer should add the last \r\n
+}
+
+} // namespace Execute
+} // namespace Afina
@@ -0,0 +1,22 @@
+#include <afina/Storage.h>
+#include <afina/execute/Incr.h>
+
+#include <iostream>
+#include <stdexcept>
+
+namespace Afina {
+namespace Execute {
+
+// memcached protocol: "incr" means "add delta to the number stored for the key".
+void Incr::Execute(Storage &storage, const std::string &args, std::string &out) {
+    std::cout << "Incr(" << _key << "): " << _value << std::endl;
+    try {
+        uint64_t result;
+        out = storage.Increment(_key, _value, result) ? std::to_string(result) : "NOT_FOUND";
+    } catch (std::invalid_argument &e) {
+        out = std::string("CLIENT_ERROR ") + e.what();
+    }
+}
+
+} // namespace Execute
+} // namespace Afina
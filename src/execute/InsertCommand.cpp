@@ -0,0 +1,17 @@
+#include <afina/Storage.h>
+#include <afina/execute/InsertCommand.h>
+
+namespace Afina {
+namespace Execute {
+
+// Storage without expiration would keep the key forever, so client is told instead
+bool InsertCommand::check_expiration(const Storage &storage, std::string &out) const {
+    if (_expire != 0 && !storage.SupportsExpiration()) {
+        out = "SERVER_ERROR storage doesn't support expiration";
+        return false;
+    }
+    return true;
+}
+
+} // namespace Execute
+} // namespace Afina
@@ -0,0 +1,49 @@
+#include <afina/Storage.h>
+#include <afina/execute/Keys.h>
+
+#include <iostream>
+#include <vector>
+
+namespace Afina {
+namespace Execute {
+
+// See Keys.h
+void Keys::Execute(Storage &storage, const std::string &args, std::string &out) {
+    Response response;
+    Respond(storage, args, response);
+    out = response.str();
+}
+
+// Next batch continues after the last key of the previous one, until batch comes out short
+void Keys::Respond(Storage &storage, const std::string &args, Response &out) {
+    std::cout << "Keys(" << _prefix << ")" << std::endl;
+
+    std::string after;
+    std::vector<std::string> keys;
+    std::vector<ValueRef> values;
+    do {
+        keys.clear();
+        values.clear();
+        if (!storage.Range(_prefix, after, BatchSize, keys, _values ? &values : nullptr)) {
+            out.Append("SERVER_ERROR storage doesn't support key ranges");
+            return;
+        }
+
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (_values) {
+                out.Append("VALUE " + keys[i] + " 0 " + std::to_string(values[i].size()) + "\r\n");
+                out.Append(std::move(values[i]));
+                out.Append("\r\n");
+            } else {
+                out.Append("KEY " + keys[i] + "\r\n");
+            }
+        }
+        if (!keys.empty()) {
+            after = keys.back();
+        }
+    } while (keys.size() == BatchSize);
+    out.Append("END"); // networking layer should add the last \r\n
+}
+
+} // namespace Execute
+} // namespace Afina
@@ -11,9 +11,12 @@ namespace Execute {
 
 void Replace::Execute(Storage &storage, const std::string &args, std::string &out) {
     std::cout << "Replace(" << _key << "): " << args << std::endl;
+    if (!check_expiration(storage, out)) {
+        return;
+    }
     std::string value;
     if (storage.Get(_key, value)) {
-        storage.Set(_key, args);
+        storage.Set(_key, args, expire_at());
         out = "STORED";
     } else {
         out = "NOT_STORED";
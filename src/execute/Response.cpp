@@ -0,0 +1,55 @@
+#include <afina/execute/Response.h>
+
+namespace Afina {
+namespace Execute {
+
+// Text goes into the last segment until some value is appended after it
+void Response::Append(const std::string &text) {
+    if (_segments.empty() || _segments.back().value.data() != nullptr) {
+        _segments.emplace_back();
+    }
+    _segments.back().text.append(text);
+}
+
+// See Response.h
+void Response::Append(ValueRef &&value) {
+    if (_segments.empty() || _segments.back().value.data() != nullptr) {
+        _segments.emplace_back();
+    }
+    _segments.back().value = std::move(value);
+}
+
+// See Response.h
+size_t Response::Size() const {
+    size_t size = 0;
+    for (auto &segment : _segments) {
+        size += segment.text.size() + segment.value.size();
+    }
+    return size;
+}
+
+// See Response.h
+void Response::Buffers(std::vector<struct iovec> &out) const {
+    for (auto &segment : _segments) {
+        if (!segment.text.empty()) {
+            out.push_back({const_cast<char *>(segment.text.data()), segment.text.size()});
+        }
+        if (segment.value.size() > 0) {
+            out.push_back({const_cast<char *>(segment.value.data()), segment.value.size()});
+        }
+    }
+}
+
+// See Response.h
+std::string Response::str() const {
+    std::string result;
+    result.reserve(Size());
+    for (auto &segment : _segments) {
+        result.append(segment.text);
+        result.append(segment.value.data(), segment.value.size());
+    }
+    return result;
+}
+
+} // namespace Execute
+} // namespace Afina
@@ -0,0 +1,39 @@
+#include <afina/Storage.h>
+#include <afina/execute/Scan.h>
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace Afina {
+namespace Execute {
+
+const size_t Scan::DefaultCount;
+const size_t Scan::MaxCount;
+
+// Count is clamped here, so that client can't make storage hold the lock for long
+void Scan::Execute(Storage &storage, const std::string &args, std::string &out) {
+    std::cout << "Scan(" << _cursor << "): " << _count << std::endl;
+
+    std::string cursor = _cursor;
+    std::vector<std::string> keys;
+    try {
+        if (!storage.Scan(cursor, std::min(std::max(_count, size_t(1)), MaxCount), keys)) {
+            out = "SERVER_ERROR storage doesn't support scan";
+            return;
+        }
+    } catch (std::invalid_argument &e) {
+        out = std::string("CLIENT_ERROR ") + e.what();
+        return;
+    }
+
+    out = "CURSOR " + cursor + "\r\n";
+    for (auto &key : keys) {
+        out += "KEY " + key + "\r\n";
+    }
+    out += "END"; // networking layer should add the last \r\n
+}
+
+} // namespace Execute
+} // namespace Afina
@@ -9,7 +9,10 @@ namespace Execute {
 // memcached protocol: "set" means "store this data".
 void Set::Execute(Storage &storage, const std::string &args, std::string &out) {
     std::cout << "Set(" << _key << "): " << args << std::endl;
-    storage.Put(_key, args);
+    if (!check_expiration(storage, out)) {
+        return;
+    }
+    storage.Put(_key, args, expire_at());
     out = "STORED";
 }
 
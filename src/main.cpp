@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <thread>
 #include <uv.h>
 
 #include <cxxopts.hpp>
@@ -12,13 +15,43 @@
 #include "network/blocking/ServerImpl.h"
 #include "network/nonblocking/ServerImpl.h"
 #include "network/uv/ServerImpl.h"
+#include "storage/ArtImpl.h"
+#include "storage/ClockRWLockImpl.h"
+#include "storage/CuckooImpl.h"
+#include "storage/FlatHashImpl.h"
+#include "storage/LogStructuredImpl.h"
+#include "storage/LoggedStorage.h"
 #include "storage/MapBasedGlobalLockImpl.h"
+#include "storage/MappedImpl.h"
+#include "storage/SkipListImpl.h"
+#include "storage/SlabImpl.h"
+#include "storage/Snapshot.h"
+#include "storage/SnapshotLoader.h"
+#include "storage/StripedLockImpl.h"
 
 typedef struct {
     std::shared_ptr<Afina::Storage> storage;
     std::shared_ptr<Afina::Network::Server> server;
+    std::shared_ptr<Afina::Backend::Snapshot> snapshot;
+    std::shared_ptr<Afina::Backend::SnapshotLoader> loader;
 } Application;
 
+// Waits for the snapshot load and reports how fast it went
+void finish_load(Application &app) {
+    try {
+        app.loader->Wait();
+        std::cout << "Snapshot loaded";
+    } catch (std::exception &e) {
+        std::cerr << "Snapshot load failed: " << e.what() << std::endl;
+        std::cout << "Snapshot loaded partially";
+    }
+
+    auto ms = app.loader->Elapsed().count();
+    std::cout << ": " << app.loader->Items() << " items, " << app.loader->Stored() << " stored, "
+              << app.loader->Bytes() / (1024 * 1024) << "MB in " << ms << "ms, "
+              << uint64_t(app.loader->Items() * 1000 / (ms > 0 ? ms : 1)) << " items/s" << std::endl;
+}
+
 // Handle all signals catched
 void signal_handler(uv_signal_t *handle, int signum) {
     Application *pApp = static_cast<Application *>(handle->data);
@@ -27,6 +60,41 @@ void signal_handler(uv_signal_t *handle, int signum) {
     uv_stop(handle->loop);
 }
 
+// Starts background snapshot of the storage
+void snapshot_handler(uv_signal_t *handle, int signum) {
+    Application *pApp = static_cast<Application *>(handle->data);
+
+    try {
+        if (pApp->snapshot->Start()) {
+            std::cout << "Snapshot started, writers stalled for " << pApp->snapshot->Stall().count() << "us"
+                      << std::endl;
+        } else {
+            std::cout << "Snapshot is in progress already" << std::endl;
+        }
+    } catch (std::exception &e) {
+        std::cerr << "Snapshot failed: " << e.what() << std::endl;
+    }
+}
+
+// Reports snapshot once its process exits
+void child_handler(uv_signal_t *handle, int signum) {
+    Application *pApp = static_cast<Application *>(handle->data);
+
+    if (pApp->snapshot->Poll()) {
+        std::cout << "Snapshot " << (pApp->snapshot->Succeeded() ? "completed" : "failed") << " in "
+                  << pApp->snapshot->Duration().count() << "ms" << std::endl;
+    }
+}
+
+// Reports load streaming in while server is serving, once it is complete
+void load_handler(uv_timer_t *handle) {
+    Application *pApp = static_cast<Application *>(handle->data);
+    if (pApp->loader->Done()) {
+        finish_load(*pApp);
+        uv_timer_stop(handle);
+    }
+}
+
 // Called when it is time to collect passive metrics from services
 void timer_handler(uv_timer_t *handle) {
     Application *pApp = static_cast<Application *>(handle->data);
@@ -48,7 +116,29 @@ int main(int argc, char **argv) {
         // TODO: use custom cxxopts::value to print options possible values in help message
         // and simplify validation below
         options.add_options()("s,storage", "Type of storage service to use", cxxopts::value<std::string>());
+        options.add_options()("shards", "Number of lock stripes for map_striped storage", cxxopts::value<size_t>());
+        options.add_options()("bump-interval", "Milliseconds map_global doesn't promote entry again after a hit",
+                              cxxopts::value<uint32_t>());
+        options.add_options()("headroom", "Percent of memory map_global and map_striped keep free by evicting in "
+                                          "background", cxxopts::value<size_t>());
+        options.add_options()("hot", "Percent of memory map_global keeps uncompressed for the most recently used "
+                                     "entries, values of older ones are compressed", cxxopts::value<size_t>());
+        options.add_options()("m,memory", "Memory limit of the storage in megabytes, 64 by default",
+                              cxxopts::value<size_t>());
+        options.add_options()("arena", "File mapped storage keeps items in", cxxopts::value<std::string>());
+        options.add_options()("e,eviction", "Eviction policy of flat_hash storage: lru, slru, arc or tinylfu",
+                              cxxopts::value<std::string>());
         options.add_options()("n,network", "Type of network service to use", cxxopts::value<std::string>());
+        options.add_options()("snapshot", "File SIGUSR1 writes storage snapshot to", cxxopts::value<std::string>());
+        options.add_options()("load", "Snapshot file to load into storage on start", cxxopts::value<std::string>());
+        options.add_options()("load-threads", "Number of threads loading snapshot", cxxopts::value<size_t>());
+        options.add_options()("serve-while-loading", "Start serving clients before snapshot is loaded");
+        options.add_options()("wal", "Directory of the operation log, makes every write durable",
+                              cxxopts::value<std::string>());
+        options.add_options()("wal-sync", "Milliseconds writes are batched for before sync, 0 syncs every write",
+                              cxxopts::value<size_t>());
+        options.add_options()("wal-compact", "Megabytes operation log grows to before compaction",
+                              cxxopts::value<size_t>());
         options.add_options()("h,help", "Print usage info");
         options.parse(argc, argv);
 
@@ -71,12 +161,82 @@ int main(int argc, char **argv) {
         storage_type = options["storage"].as<std::string>();
     }
 
+    size_t memory = 64 * 1024 * 1024;
+    if (options.count("memory") > 0) {
+        memory = options["memory"].as<size_t>() * 1024 * 1024;
+    }
+
+    size_t headroom = 10;
+    if (options.count("headroom") > 0) {
+        headroom = std::min(options["headroom"].as<size_t>(), size_t(100));
+    }
+
     if (storage_type == "map_global") {
-        app.storage = std::make_shared<Afina::Backend::MapBasedGlobalLockImpl>();
+        uint32_t bump_interval = 100;
+        if (options.count("bump-interval") > 0) {
+            bump_interval = options["bump-interval"].as<uint32_t>();
+        }
+        size_t hot_size = SIZE_MAX;
+        if (options.count("hot") > 0 && options["hot"].as<size_t>() < 100) {
+            hot_size = memory * options["hot"].as<size_t>() / 100;
+        }
+        app.storage = std::make_shared<Afina::Backend::MapBasedGlobalLockImpl>(memory, bump_interval,
+                                                                               memory * headroom / 100, hot_size);
+    } else if (storage_type == "map_striped") {
+        size_t shards = 16;
+        if (options.count("shards") > 0) {
+            shards = options["shards"].as<size_t>();
+        }
+        app.storage = std::make_shared<Afina::Backend::StripedLockImpl>(memory, shards, memory * headroom / 100);
+    } else if (storage_type == "flat_hash") {
+        std::string eviction = "lru";
+        if (options.count("eviction") > 0) {
+            eviction = options["eviction"].as<std::string>();
+        }
+        app.storage = std::make_shared<Afina::Backend::FlatHashImpl>(memory, eviction);
+    } else if (storage_type == "art") {
+        app.storage = std::make_shared<Afina::Backend::ArtImpl>(memory);
+    } else if (storage_type == "clock_rw") {
+        app.storage = std::make_shared<Afina::Backend::ClockRWLockImpl>(memory);
+    } else if (storage_type == "cuckoo") {
+        app.storage = std::make_shared<Afina::Backend::CuckooImpl>(memory);
+    } else if (storage_type == "skiplist") {
+        app.storage = std::make_shared<Afina::Backend::SkipListImpl>(memory);
+    } else if (storage_type == "slab") {
+        app.storage = std::make_shared<Afina::Backend::SlabImpl>(memory);
+    } else if (storage_type == "log_structured") {
+        app.storage = std::make_shared<Afina::Backend::LogStructuredImpl>(memory);
+    } else if (storage_type == "mapped") {
+        std::string arena = "afina.arena";
+        if (options.count("arena") > 0) {
+            arena = options["arena"].as<std::string>();
+        }
+        auto mapped = std::make_shared<Afina::Backend::MappedImpl>(arena, memory);
+        std::cout << "Arena " << arena << " attached: " << mapped->Attach() << std::endl;
+        app.storage = mapped;
     } else {
         throw std::runtime_error("Unknown storage type");
     }
 
+    // Writes go to the log before they are acknowledged
+    if (options.count("wal") > 0) {
+        size_t window = 1, compact = 64;
+        if (options.count("wal-sync") > 0) {
+            window = options["wal-sync"].as<size_t>();
+        }
+        if (options.count("wal-compact") > 0) {
+            compact = options["wal-compact"].as<size_t>();
+        }
+        app.storage = std::make_shared<Afina::Backend::LoggedStorage>(
+            app.storage, options["wal"].as<std::string>(), std::chrono::milliseconds(window), compact * 1024 * 1024);
+    }
+
+    std::string snapshot_path = "afina.snapshot";
+    if (options.count("snapshot") > 0) {
+        snapshot_path = options["snapshot"].as<std::string>();
+    }
+    app.snapshot = std::make_shared<Afina::Backend::Snapshot>(*app.storage, snapshot_path);
+
     // Build  & start network layer
     std::string network_type = "uv";
     if (options.count("network") > 0) {
@@ -112,14 +272,48 @@ int main(int argc, char **argv) {
     sig_term.data = &app;
     sig_int.data = &app;
 
+    uv_signal_t sig_usr1, sig_chld;
+    uv_signal_init(&loop, &sig_usr1);
+    uv_signal_init(&loop, &sig_chld);
+    uv_signal_start(&sig_usr1, snapshot_handler, SIGUSR1);
+    uv_signal_start(&sig_chld, child_handler, SIGCHLD);
+    sig_usr1.data = &app;
+    sig_chld.data = &app;
+
     uv_timer_t timer;
     uv_timer_init(&loop, &timer);
     timer.data = &app;
     uv_timer_start(&timer, timer_handler, 0, 5000);
 
+    uv_timer_t load_timer;
+    uv_timer_init(&loop, &load_timer);
+    load_timer.data = &app;
+
     // Start services
     try {
         app.storage->Start();
+
+        // Listener is opened once storage is warm, unless clients are allowed to see load streaming in
+        if (options.count("load") > 0) {
+            size_t threads = std::thread::hardware_concurrency();
+            if (options.count("load-threads") > 0) {
+                threads = options["load-threads"].as<size_t>();
+            }
+            app.loader = std::make_shared<Afina::Backend::SnapshotLoader>(
+                *app.storage, options["load"].as<std::string>(), threads);
+            try {
+                app.loader->Start();
+            } catch (std::exception &e) {
+                // Cache starts cold then
+                std::cerr << "Snapshot load failed: " << e.what() << std::endl;
+                app.loader.reset();
+            }
+        }
+        if (app.loader && options.count("serve-while-loading") > 0) {
+            uv_timer_start(&load_timer, load_handler, 100, 100);
+        } else if (app.loader) {
+            finish_load(app);
+        }
         app.server->Start(8080);
 
         // Freeze current thread and process events
@@ -129,6 +323,7 @@ int main(int argc, char **argv) {
         // Stop services
         app.server->Stop();
         app.server->Join();
+        app.snapshot->Wait();
         app.storage->Stop();
 
         std::cout << "Application stopped" << std::endl;
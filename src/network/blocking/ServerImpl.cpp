@@ -273,7 +273,9 @@ void ServerImpl::RunConnection(int socket) {
                 continue;
             }
         } catch (std::runtime_error &e) {
-            std::string result = std::string("SERVER_ERROR ") + e.what() + std::string("\r\n");
+            // Malformed arguments are the client fault, anything else is reported as server one
+            std::string kind = dynamic_cast<Protocol::ClientError *>(&e) != nullptr ? "CLIENT_ERROR " : "SERVER_ERROR ";
+            std::string result = kind + e.what() + std::string("\r\n");
             command.clear();
             
             if (send(socket, result.data(), result.size(), 0) <= 0) {
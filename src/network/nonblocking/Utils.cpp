@@ -1,5 +1,8 @@
 #include "Utils.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
 #include <stdexcept>
 
 #include <fcntl.h>
@@ -27,6 +30,34 @@ void make_socket_non_blocking(int sfd) {
     }
 }
 
+// Short writes advance through the buffer list, so no buffer is ever copied to be resent
+bool write_buffers(int sfd, std::vector<struct iovec> &buffers, size_t &first) {
+    while (first < buffers.size()) {
+        int count = int(std::min(buffers.size() - first, size_t(IOV_MAX)));
+        ssize_t written = writev(sfd, &buffers[first], count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EWOULDBLOCK || errno == EAGAIN) {
+                return false;
+            }
+            throw std::runtime_error("Socket writev() failed");
+        }
+
+        while (written > 0) {
+            struct iovec &buffer = buffers[first];
+            size_t done = std::min(size_t(written), buffer.iov_len);
+            buffer.iov_base = static_cast<char *>(buffer.iov_base) + done;
+            buffer.iov_len -= done;
+            written -= done;
+            if (buffer.iov_len == 0) {
+                first++;
+            }
+        }
+    }
+    return true;
+}
+
 } // namespace NonBlocking
 } // namespace Network
 } // namespace Afina
@@ -1,12 +1,24 @@
 #ifndef AFINA_NETWORK_NONBLOCKING_UTILS_H
 #define AFINA_NETWORK_NONBLOCKING_UTILS_H
 
+#include <vector>
+
+#include <sys/uio.h>
+
 namespace Afina {
 namespace Network {
 namespace NonBlocking {
 
 void make_socket_non_blocking(int sfd);
 
+/**
+ * Writes buffers starting from first out to the non blocking socket with writev, until all of them are written
+ * or socket send buffer is full. Written bytes are consumed and first is moved past buffers written completely,
+ * so the call could be repeated once socket is writable again. Returns true if everything is written, throws
+ * std::runtime_error if write fails
+ */
+bool write_buffers(int sfd, std::vector<struct iovec> &buffers, size_t &first);
+
 } // namespace NonBlocking
 } // namespace Network
 } // namespace Afina
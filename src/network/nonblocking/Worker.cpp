@@ -1,7 +1,6 @@
 #include "Worker.h"
 
-#include <cstring>
-#include <fstream>
+#include <cerrno>
 #include <iostream>
 
 #include <sys/epoll.h>
@@ -10,8 +9,6 @@
 #include <unistd.h>
 
 #include "Utils.h"
-#include <../src/protocol/Parser.h>
-#include <afina/execute/Command.h>
 
 namespace Afina {
 namespace Network {
@@ -59,82 +56,93 @@ void *Worker::OnRunProxy(void *args_) {
     return NULL;
 }
 
-bool Worker::read_(int socket, std::unordered_map<int, std::string>::iterator iter) {
-
-    std::ofstream myfile;
-    myfile.open("example.txt", std::ofstream::app);
-
-    Protocol::Parser parser;
-    size_t buf_size = 1024;
-    uint32_t body_size;
-    size_t parsed, all_parsed;
-    ssize_t input_size;
-    std::string command = iter->second;
-    std::string args = "";
-    char buf[buf_size];
-    bool is_parsed = false;
-    std::memset(buf, 0, buf_size);
-
-    while (running.load()) {
-        if ((input_size = read(socket, buf, buf_size)) <= 0 && command.size() == 0) {
-            if (!((errno == EWOULDBLOCK || errno == EAGAIN) && running.load())) {
-                return true;
+// Level triggered epoll reports socket again while it has data, so reading stops once responses pile up and
+// resumes after they are sent
+bool Worker::OnReadable(int socket, Connection &conn) {
+    char buf[4096];
+    while (running.load() && !conn.closing && conn.buffers.empty()) {
+        ssize_t input_size = read(socket, buf, sizeof(buf));
+        if (input_size == 0) {
+            return false;
+        } else if (input_size < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EWOULDBLOCK || errno == EAGAIN) {
+                break;
             }
-            break;
+            return false;
         }
 
-        command += buf;
-
+        conn.input.append(buf, input_size);
+        std::string error;
         try {
-            if ((is_parsed = parser.Parse(command, parsed))) {
-
-                std::memset(buf, 0, buf_size);
-                command.erase(0, parsed);
-
-                auto command_ptr = parser.Build(body_size);
-                parser.Reset();
-
-                if (body_size > 0) {
-                    while (body_size + 2 > command.size()) {
-                        input_size = read(socket, buf, buf_size);
-                        command += buf;
-                        std::memset(buf, 0, buf_size);
-                    }
-                    args = command.substr(0, body_size);
-                    command.erase(0, body_size + 2);
-                }
-
-                std::string result;
-                try {
-                    command_ptr->Execute(*pStorage, args, result);
-                } catch (...) {
-                    result = "SERVER_ERROR";
-                }
-                result += "\r\n";
-
-                if (result.size() && send(socket, result.data(), result.size(), 0) <= 0) {
-                    throw std::runtime_error("Socket send() failed");
-                }
-                parser.Reset();
+            Process(conn);
+        } catch (Protocol::ClientError &e) {
+            error = std::string("CLIENT_ERROR ") + e.what();
+        } catch (std::runtime_error &e) {
+            error = std::string("SERVER_ERROR ") + e.what();
+        }
+        if (!error.empty()) {
+            conn.output.emplace_back();
+            conn.output.back().Append(error + std::string("\r\n"));
+            conn.output.back().Buffers(conn.buffers);
+            conn.closing = true;
+        }
+        Flush(socket, conn);
+    }
+    return true;
+}
 
-            } else {
-                std::memset(buf, 0, buf_size);
-                iter->second += command;
-                command.erase(0, parsed);
-                continue;
+// See Worker.h
+void Worker::Process(Connection &conn) {
+    size_t pos = 0;
+    while (true) {
+        if (!conn.command) {
+            size_t parsed = 0;
+            bool is_parsed = conn.parser.Parse(conn.input.data() + pos, conn.input.size() - pos, parsed);
+            pos += parsed;
+            if (!is_parsed) {
+                break;
             }
-        } catch (std::runtime_error &e) {
-            std::string result = std::string("SERVER_ERROR ") + e.what() + std::string("\r\n");
-            command.clear();
-            is_parsed = true;
-            
-            if (send(socket, result.data(), result.size(), 0) <= 0) {
-                throw std::runtime_error("Socket send() failed");
+            conn.command = conn.parser.Build(conn.body_size);
+            conn.parser.Reset();
+        }
+
+        // Body is followed by \r\n
+        std::string args;
+        if (conn.body_size > 0) {
+            if (conn.input.size() - pos < conn.body_size + 2) {
+                break;
             }
-            break;
+            args = conn.input.substr(pos, conn.body_size);
+            pos += conn.body_size + 2;
+        }
+
+        // Values in response are shared with storage and go to the socket without being copied
+        conn.output.emplace_back();
+        Execute::Response &result = conn.output.back();
+        try {
+            conn.command->Respond(*pStorage, args, result);
+        } catch (...) {
+            result.Clear();
+            result.Append("SERVER_ERROR");
         }
+        result.Append("\r\n");
+        result.Buffers(conn.buffers);
+        conn.command.reset();
     }
-    return is_parsed;
+    conn.input.erase(0, pos);
+}
+
+// See Worker.h
+bool Worker::Flush(int socket, Connection &conn) {
+    if (!write_buffers(socket, conn.buffers, conn.written)) {
+        return false;
+    }
+    conn.buffers.clear();
+    conn.output.clear();
+    conn.written = 0;
+    return true;
 }
 
 // See Worker.h
@@ -142,18 +150,16 @@ void Worker::OnRun(int server_socket_) {
     std::cout << "network debug: " << __PRETTY_FUNCTION__ << std::endl;
 
     server_socket = server_socket_;
-    // TODO: implementation here
     // 1. Create epoll_context here
     int max_epoll = 10;
-    int epoll_fd = epoll_create(max_epoll);
+    epoll_fd = epoll_create(max_epoll);
     if (epoll_fd == -1) {
         throw std::runtime_error("Failed to epoll_context");
     }
     // 2. Add server_socket to context
     struct epoll_event server_event;
     server_event.events = EPOLLIN | EPOLLERR | EPOLLHUP | EPOLLEXCLUSIVE;
-    server_event.data.ptr = (void *)&server_socket;
-    ;
+    server_event.data.fd = server_socket;
     if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_socket, &server_event) == -1) {
         throw std::runtime_error("Failed to epoll_ctl");
     }
@@ -162,11 +168,14 @@ void Worker::OnRun(int server_socket_) {
     while (running.load()) {
         int n = epoll_wait(epoll_fd, events, max_epoll, -1);
         if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
             throw std::runtime_error("Failed to epoll_wait");
         }
 
         for (int i = 0; i < n; ++i) {
-            if (events[i].data.ptr == &server_socket) {
+            if (events[i].data.fd == server_socket) {
                 // 3. Accept new connections, don't forget to call
                 // make_socket_nonblocking on
                 // the client socket descriptor
@@ -183,36 +192,55 @@ void Worker::OnRun(int server_socket_) {
 
                     // 4. Add connections to the local context
                     struct epoll_event client_event;
-                    client_event.events = EPOLLIN | EPOLLHUP | EPOLLERR;
-                    client_event.data.ptr = (void *)&client_socket;
-                    connections.emplace(client_socket, "");
+                    client_event.events = EPOLLIN;
+                    client_event.data.fd = client_socket;
+                    connections[client_socket].events = EPOLLIN;
                     if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client_socket, &client_event) == -1) {
                         throw std::runtime_error("Failed to client socket epoll_ctl");
                     }
                 }
-            } else {
-                int client_socket = *(int *)events[i].data.ptr;
-                // 5. Process connection events
-                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
-                    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_socket, NULL);
-                    connections.erase(client_socket);
-                } else if (events[i].events & EPOLLIN) {
-                    if (read_(client_socket, connections.find(client_socket))) {
-                        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_socket, NULL);
-                        close(client_socket);
-                        connections.erase(client_socket);
-                    }
-                } else {
-                    connections.erase(client_socket);
-                    throw std::runtime_error("Unknown event");
+                continue;
+            }
+
+            // 5. Process connection events
+            int client_socket = events[i].data.fd;
+            Connection &conn = connections[client_socket];
+            bool alive = (events[i].events & (EPOLLERR | EPOLLHUP)) == 0;
+            try {
+                if (alive && (events[i].events & EPOLLOUT)) {
+                    Flush(client_socket, conn);
+                }
+                if (alive && (events[i].events & EPOLLIN)) {
+                    alive = OnReadable(client_socket, conn);
+                }
+            } catch (std::runtime_error &e) {
+                alive = false;
+            }
+
+            // Socket is watched for writes only while there is output pending, so that the loop never waits
+            // for a slow client and doesn't read commands it has no room to answer
+            uint32_t wanted = conn.buffers.empty() ? EPOLLIN : EPOLLOUT;
+            if (!alive || (conn.closing && conn.buffers.empty())) {
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client_socket, NULL);
+                close(client_socket);
+                connections.erase(client_socket);
+            } else if (wanted != conn.events) {
+                struct epoll_event client_event;
+                client_event.events = wanted;
+                client_event.data.fd = client_socket;
+                if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client_socket, &client_event) == -1) {
+                    throw std::runtime_error("Failed to client socket epoll_ctl");
                 }
+                conn.events = wanted;
             }
         }
     }
     for (const auto &p : connections) {
         epoll_ctl(epoll_fd, EPOLL_CTL_DEL, p.first, NULL);
+        close(p.first);
     }
     connections.clear();
+    close(epoll_fd);
 }
 
 } // namespace NonBlocking
@@ -4,7 +4,16 @@
 #include <memory>
 #include <pthread.h>
 #include <atomic>
+#include <list>
+#include <string>
 #include <unordered_map>
+#include <vector>
+
+#include <sys/uio.h>
+
+#include <afina/execute/Command.h>
+#include <afina/execute/Response.h>
+#include <protocol/Parser.h>
 
 namespace Afina {
 
@@ -52,13 +61,59 @@ protected:
      */
     void OnRun(int socket);
     static void* OnRunProxy(void *args);
-    bool read_(int, std::unordered_map<int, std::string>::iterator);
 
 private:
+    /**
+     * State of the client connection kept between events
+     */
+    struct Connection {
+        Connection() : body_size(0), written(0), events(0), closing(false) {}
+
+        // Input received, but not parsed yet
+        std::string input;
+
+        // State of the header parser
+        Protocol::Parser parser;
+
+        // Command parsed out from the input, waiting for its body
+        std::unique_ptr<Execute::Command> command;
+        uint32_t body_size;
+
+        // Responses not sent yet, they keep values buffers point into alive
+        std::list<Execute::Response> output;
+        std::vector<struct iovec> buffers;
+
+        // Number of buffers sent completely
+        size_t written;
+
+        // Events connection is registered in epoll for
+        uint32_t events;
+
+        // Connection is closed once output is sent
+        bool closing;
+    };
+
+    /**
+     * Reads whatever socket has and executes complete commands. Reading stops as soon as responses can't be sent
+     * right away. Returns false if client has closed the connection
+     */
+    bool OnReadable(int socket, Connection &conn);
+
+    /**
+     * Executes commands complete in the connection input and queues their responses
+     */
+    void Process(Connection &conn);
+
+    /**
+     * Sends queued responses until socket send buffer is full. Returns true if nothing is left to send
+     */
+    bool Flush(int socket, Connection &conn);
+
     pthread_t thread;
-    std::unordered_map<int, std::string> connections;
+    std::unordered_map<int, Connection> connections;
     std::shared_ptr<Afina::Storage> pStorage;
     int server_socket;
+    int epoll_fd;
     std::atomic<bool> running;
 };
 
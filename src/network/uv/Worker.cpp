@@ -352,20 +352,13 @@ void Worker::OnRead(uv_stream_t *conn, ssize_t nread, const uv_buf_t *buf) {
         std::stringstream ss;
         ss << "CLIENT_ERROR " << ex.what();
 
-        std::string output = ss.str();
-
         ExecuteTask *ptask = new ExecuteTask();
         ptask->connection = pconn;
         uv_async_init(&uvLoop, &ptask->done, delegate<Worker>::callback<&Worker::OnExecutionDone>);
         ptask->done.data = this;
 
-        size_t size = output.size() + 2;
-        ptask->result.base = new char[size];
-        ptask->result.len = size;
-
-        std::memcpy(ptask->result.base, &output[0], size - 2);
-        ptask->result.base[size - 2] = '\r';
-        ptask->result.base[size - 1] = '\n';
+        ptask->response.Append(ss.str());
+        PrepareOutput(ptask);
 
         pconn->runningTasks++;
         pconn->state = ConnectionState::sClosed;
@@ -393,31 +386,39 @@ void Worker::Execute(Connection &pconn) {
 
     // TODO: That should be in another thread
     {
-        std::string output;
         try {
-            ptask->cmd->Execute(*pStorage, ptask->argument, output);
+            ptask->cmd->Respond(*pStorage, ptask->argument, ptask->response);
         } catch (std::runtime_error &ex) {
             std::cerr << "Failed to execute command: " << ex.what() << std::endl;
 
             std::stringstream ss;
             ss << "SERVER_ERROR " << ex.what();
-            output = ss.str();
+            ptask->response.Clear();
+            ptask->response.Append(ss.str());
         }
 
         // Prepare output
-        size_t size = output.size() + 2;
-        ptask->result.base = new char[size];
-        ptask->result.len = size;
-
-        std::memcpy(ptask->result.base, &output[0], size - 2);
-        ptask->result.base[size - 2] = '\r';
-        ptask->result.base[size - 1] = '\n';
+        PrepareOutput(ptask);
 
         // Notify event loop about task completition
         uv_async_send(&ptask->done);
     }
 }
 
+// Response buffers are passed to libuv as is, values in them point right into the storage memory
+// See Worker.h
+void Worker::PrepareOutput(ExecuteTask *ptask) {
+    ptask->response.Append("\r\n");
+
+    std::vector<struct iovec> buffers;
+    ptask->response.Buffers(buffers);
+
+    ptask->buffers.reserve(buffers.size());
+    for (auto &buffer : buffers) {
+        ptask->buffers.push_back(uv_buf_init(static_cast<char *>(buffer.iov_base), buffer.iov_len));
+    }
+}
+
 // See Worker.h
 void Worker::OnExecutionDone(uv_async_t *handle) {
     std::cout << "network debug:" << __PRETTY_FUNCTION__ << std::endl;
@@ -431,7 +432,7 @@ void Worker::OnExecutionDone(uv_async_t *handle) {
 
     // Send buffer to socket. Even if connection is already closed we are still try to write data out,
     // that would lead to possible write error which is ok and will be handled in the OnWriteDone
-    int rc = uv_write(&task->handler, &task->connection->handler, &task->result, 1,
+    int rc = uv_write(&task->handler, &task->connection->handler, task->buffers.data(), task->buffers.size(),
                       delegate<Worker, int>::callback<&Worker::OnWriteDone>);
     if (rc != 0) {
         throw std::runtime_error("Failed to write request");
@@ -450,7 +451,7 @@ void Worker::OnWriteDone(uv_write_t *req, int status) {
         uv_close((uv_handle_t *)(task->connection), delegate<Worker>::callback<&Worker::OnConnectionClosed>);
     }
 
-    delete[] task->result.base;
+    // Releases values shared with storage as well
     delete task;
 }
 
@@ -140,8 +140,11 @@ protected:
         // Argument for the command
         std::string argument;
 
-        // Execution result
-        uv_buf_t result;
+        // Execution result, values in it are shared with storage
+        Execute::Response response;
+
+        // Buffers of the response passed to uv_write
+        std::vector<uv_buf_t> buffers;
     } ExecuteTask;
 
     /**
@@ -193,6 +196,12 @@ protected:
      */
     void Execute(Connection &pconn);
 
+    /**
+     * Terminates response with \r\n and lays it out into task buffers, so it could be written out by a single
+     * scatter/gather write
+     */
+    void PrepareOutput(ExecuteTask *ptask);
+
     /**
      * Called once command execution is complete
      */
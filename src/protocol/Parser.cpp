@@ -6,9 +6,16 @@
 
 #include <afina/execute/Add.h>
 #include <afina/execute/Append.h>
+#include <afina/execute/Cas.h>
 #include <afina/execute/Command.h>
+#include <afina/execute/Decr.h>
 #include <afina/execute/Delete.h>
 #include <afina/execute/Get.h>
+#include <afina/execute/Gets.h>
+#include <afina/execute/Incr.h>
+#include <afina/execute/Keys.h>
+#include <afina/execute/Prepend.h>
+#include <afina/execute/Scan.h>
 #include <afina/execute/Set.h>
 #include <afina/execute/Stats.h>
 
@@ -27,10 +34,21 @@ bool Parser::Parse(const char *input, const size_t size, size_t &parsed) {
         case State::sName: {
             if (c == ' ' || c == '\r') {
                 // std::cout << "parser debug: name='" << name << "'" << std::endl;
-                if (name == "set" || name == "add" || name == "append" || name == "prepend") {
+                if (name == "set" || name == "add" || name == "append" || name == "prepend" || name == "cas") {
                     state = State::spKey;
                 } else if (name == "get" || name == "gets") {
                     state = State::sgKey;
+                } else if ((name == "keys" || name == "scan") && c == ' ') {
+                    state = State::sgKey;
+                } else if (name == "keys") {
+                    // No prefix, all keys
+                    keys.push_back("");
+                    state = State::sLF;
+                    continue;
+                } else if (name == "scan") {
+                    throw std::runtime_error("Client provides no cursor");
+                } else if (name == "incr" || name == "decr") {
+                    state = State::siKey;
                 } else if (name == "stats") {
                     state = State::sLF;
                     continue;
@@ -76,6 +94,36 @@ bool Parser::Parse(const char *input, const size_t size, size_t &parsed) {
             break;
         }
 
+        case State::siKey: {
+            if (c == ' ') {
+                state = State::siValueStart;
+                keys.push_back(curKey);
+            } else if (c == '\r') {
+                // No value at all
+                throw ClientError("bad command line format");
+            } else {
+                curKey.push_back(c);
+            }
+            break;
+        }
+
+        case State::siValueStart:
+        case State::siValue: {
+            if (c == '\r' && state == State::siValue) {
+                state = State::sLF;
+            } else if (c >= '0' && c <= '9') {
+                uint64_t d = delta * 10 + (c - '0');
+                if (delta > UINT64_MAX / 10 || d < delta * 10) {
+                    throw std::runtime_error("Value field overflow");
+                }
+                delta = d;
+                state = State::siValue;
+            } else {
+                throw ClientError("bad command line format");
+            }
+            break;
+        }
+
         case State::spFlags: {
             if (c == ' ') {
                 negative = false;
@@ -108,27 +156,24 @@ bool Parser::Parse(const char *input, const size_t size, size_t &parsed) {
                 state = State::spBytes;
                 // std::cout << "parser debug: ExprTime='" << exprtime << "'" << std::endl;
             } else if (c >= '0' && c <= '9') {
-                int32_t et = exprtime;
-                if (negative) {
-                    et -= (c - '0');
-                    if (et > exprtime) {
-                        throw std::runtime_error("Expire time field overflow");
-                    }
-                } else {
-                    et += (c - '0');
-                    if (et < exprtime) {
-                        throw std::runtime_error("Expire time field overflow");
-                    }
+                int64_t et = int64_t(exprtime) * 10 + (negative ? -(c - '0') : (c - '0'));
+                if (et > INT32_MAX || et < INT32_MIN) {
+                    throw std::runtime_error("Expire time field overflow");
                 }
-                exprtime = et;
+                exprtime = int32_t(et);
             }
             break;
         }
 
         case State::spBytes: {
-            if (c == '\r') {
+            if (c == '\r' && name == "cas") {
+                // No <cas unique>
+                throw ClientError("bad command line format");
+            } else if (c == '\r') {
                 state = State::sLF;
                 // std::cout << "parser debug: bytes='" << bytes << "'" << std::endl;
+            } else if (c == ' ' && name == "cas") {
+                state = State::spCasStart;
             } else if (c >= '0' && c <= '9') {
                 uint32_t b = (bytes * 10) + (c - '0');
                 if (b < bytes) {
@@ -140,6 +185,23 @@ bool Parser::Parse(const char *input, const size_t size, size_t &parsed) {
             break;
         }
 
+        case State::spCasStart:
+        case State::spCas: {
+            if (c == '\r' && state == State::spCas) {
+                state = State::sLF;
+            } else if (c >= '0' && c <= '9') {
+                uint64_t v = cas * 10 + (c - '0');
+                if (cas > UINT64_MAX / 10 || v < cas * 10) {
+                    throw std::runtime_error("Cas field overflow");
+                }
+                cas = v;
+                state = State::spCas;
+            } else {
+                throw ClientError("bad command line format");
+            }
+            break;
+        }
+
         case State::sLF: {
             if (c == '\n') {
                 parse_complete = true;
@@ -173,8 +235,34 @@ std::unique_ptr<Execute::Command> Parser::Build(uint32_t &body_size) const {
         return std::unique_ptr<Execute::Command>(new Execute::Add(keys[0], flags, exprtime));
     } else if (name == "append") {
         return std::unique_ptr<Execute::Command>(new Execute::Append(keys[0], flags, exprtime));
+    } else if (name == "prepend") {
+        return std::unique_ptr<Execute::Command>(new Execute::Prepend(keys[0], flags, exprtime));
+    } else if (name == "incr") {
+        return std::unique_ptr<Execute::Command>(new Execute::Incr(keys[0], delta));
+    } else if (name == "decr") {
+        return std::unique_ptr<Execute::Command>(new Execute::Decr(keys[0], delta));
+    } else if (name == "cas") {
+        return std::unique_ptr<Execute::Command>(new Execute::Cas(keys[0], flags, exprtime, cas));
     } else if (name == "get") {
         return std::unique_ptr<Execute::Command>(new Execute::Get(keys));
+    } else if (name == "gets") {
+        return std::unique_ptr<Execute::Command>(new Execute::Gets(keys));
+    } else if (name == "keys") {
+        if (keys.size() > 2 || (keys.size() == 2 && keys[1] != "values")) {
+            throw std::runtime_error("Expected keys <prefix> [values]");
+        }
+        return std::unique_ptr<Execute::Command>(new Execute::Keys(keys[0], keys.size() == 2));
+    } else if (name == "scan") {
+        size_t count = Execute::Scan::DefaultCount;
+        if (keys.size() > 2) {
+            throw std::runtime_error("Expected scan <cursor> [count]");
+        } else if (keys.size() == 2) {
+            if (keys[1].empty() || keys[1].size() > 9 || keys[1].find_first_not_of("0123456789") != keys[1].npos) {
+                throw std::runtime_error("Count must be a number");
+            }
+            count = std::stoul(keys[1]);
+        }
+        return std::unique_ptr<Execute::Command>(new Execute::Scan(keys[0], count));
     } else if (name == "stats") {
         return std::unique_ptr<Execute::Command>(new Execute::Stats());
     } else {
@@ -192,6 +280,8 @@ void Parser::Reset() {
     flags = 0;
     bytes = 0;
     exprtime = 0;
+    delta = 0;
+    cas = 0;
 }
 
 } // namespace Protocol
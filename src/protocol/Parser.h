@@ -2,6 +2,7 @@
 #define AFINA_PROTOCOL_PARSER_H
 
 #include <memory>
+#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -14,6 +15,15 @@ class Command;
 } // namespace Execute
 namespace Protocol {
 
+/**
+ * # Malformed arguments of a known command
+ * Thrown by parser, network layer answers it with "CLIENT_ERROR <message>" rather than SERVER_ERROR
+ */
+class ClientError : public std::runtime_error {
+public:
+    explicit ClientError(const std::string &message) : std::runtime_error(message) {}
+};
+
 /**
  * # Memcached protocol parser
  * Parser supports subset of memcached protocol
@@ -61,8 +71,24 @@ private:
      * - s: state for PUT and GET commands
      * - sp: for PUT commands only
      * - sg: for GET commands only
+     * - si: for INCR/DECR commands only
      */
-    enum State : uint16_t { sCR, sLF, sName, spKey, spFlags, spExprTimeStart, spExprTime, spBytes, sgKey };
+    enum State : uint16_t {
+        sCR,
+        sLF,
+        sName,
+        spKey,
+        spFlags,
+        spExprTimeStart,
+        spExprTime,
+        spBytes,
+        spCasStart,
+        spCas,
+        sgKey,
+        siKey,
+        siValueStart,
+        siValue
+    };
 
     // Current parser state
     State state;
@@ -88,6 +114,12 @@ private:
     // it's followed by an empty data block).
     uint32_t bytes;
 
+    // <value> of incr/decr is the amount by which client wants to change the item, 64-bit unsigned integer
+    uint64_t delta;
+
+    // <cas unique> of cas command is the version of the item client has got from gets
+    uint64_t cas;
+
     bool negative;
     std::string curKey;
     bool parse_complete;
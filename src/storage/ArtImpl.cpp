@@ -0,0 +1,370 @@
+#include "ArtImpl.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Counter.h"
+#include "Cursor.h"
+
+namespace Afina {
+namespace Backend {
+
+// See ArtImpl.h
+ArtImpl::~ArtImpl() {
+    while (Item *item = _lru.front()) {
+        _lru.erase(item);
+        Item::Release(item);
+    }
+}
+
+// See ArtImpl.h
+bool ArtImpl::Put(const std::string &key, const std::string &value) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(key);
+    if (item != nullptr) {
+        return update(item, value);
+    }
+    return insert(key, value);
+}
+
+// See ArtImpl.h
+bool ArtImpl::PutIfAbsent(const std::string &key, const std::string &value) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    if (find(key) != nullptr) {
+        return false;
+    }
+    return insert(key, value);
+}
+
+// See ArtImpl.h
+bool ArtImpl::Set(const std::string &key, const std::string &value) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(key);
+    if (item == nullptr) {
+        return false;
+    }
+    return update(item, value);
+}
+
+// See ArtImpl.h
+bool ArtImpl::Append(const std::string &key, const std::string &data) { return extend(key, data, false); }
+
+// See ArtImpl.h
+bool ArtImpl::Prepend(const std::string &key, const std::string &data) { return extend(key, data, true); }
+
+// See ArtImpl.h
+bool ArtImpl::Increment(const std::string &key, uint64_t delta, uint64_t &result) {
+    return change(key, delta, false, result);
+}
+
+// See ArtImpl.h
+bool ArtImpl::Decrement(const std::string &key, uint64_t delta, uint64_t &result) {
+    return change(key, delta, true, result);
+}
+
+// See ArtImpl.h
+bool ArtImpl::Delete(const std::string &key) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = _index.Find(key.data(), key.size());
+    if (item == nullptr) {
+        return false;
+    }
+    drop(item);
+    return true;
+}
+
+// See ArtImpl.h
+bool ArtImpl::Get(const std::string &key, std::string &value) const {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(key);
+    if (item == nullptr) {
+        return false;
+    }
+    if (item->flags & Item::Counter) {
+        value = item->Text();
+    } else {
+        value.assign(item->value(), item->value_size);
+    }
+    return true;
+}
+
+// See ArtImpl.h
+bool ArtImpl::GetRef(const std::string &key, ValueRef &value) const {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(key);
+    if (item == nullptr) {
+        return false;
+    }
+    value = item->Share();
+    return true;
+}
+
+// See ArtImpl.h
+size_t ArtImpl::GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const {
+    return get_many(keys, values, nullptr);
+}
+
+// See ArtImpl.h
+size_t ArtImpl::Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                     std::vector<uint64_t> &versions) const {
+    versions.assign(keys.size(), 0);
+    return get_many(keys, values, versions.data());
+}
+
+// Expiration is not supported by this storage, so it is ignored as in other TTL overloads
+Storage::CasResult ArtImpl::Cas(const std::string &key, const std::string &value, uint64_t version,
+                                time_t expire_at) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(key);
+    if (item == nullptr) {
+        return CasResult::NotFound;
+    } else if (item->version != version) {
+        return CasResult::Exists;
+    }
+    return update(item, value) ? CasResult::Stored : CasResult::NotStored;
+}
+
+// Keys are looked up in the tree directly, so that existing ones are not moved in the list
+size_t ArtImpl::Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                     const std::vector<time_t> &expire_at) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t stored = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (_index.Find(keys[i].data(), keys[i].size()) == nullptr && insert(keys[i], values[i])) {
+            stored++;
+        }
+    }
+    return stored;
+}
+
+// Walk starts at whichever of prefix and after is greater and stops at the first key out of the prefix
+bool ArtImpl::Range(const std::string &prefix, const std::string &after, size_t limit,
+                    std::vector<std::string> &keys, std::vector<ValueRef> *values) const {
+    const std::string &from = std::max(prefix, after);
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t taken = 0;
+    _index.Walk(from, [&](Item *item) {
+        if (taken == limit || item->key_size < prefix.size() ||
+            std::memcmp(item->key(), prefix.data(), prefix.size()) != 0) {
+            return false;
+        }
+        if (!after.empty() && item->Equals(after.data(), after.size())) {
+            return true;
+        }
+
+        keys.emplace_back(item->key(), item->key_size);
+        if (values != nullptr) {
+            values->push_back(item->Share());
+        }
+        taken++;
+        return true;
+    });
+    return true;
+}
+
+// See ArtImpl.h
+bool ArtImpl::Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const {
+    return RangeScan(*this, cursor, count, keys);
+}
+
+// See ArtImpl.h
+void ArtImpl::Freeze(const std::function<void()> &f) {
+    std::unique_lock<std::mutex> guard(_lock);
+    f();
+}
+
+// Least recently used go first, so that storage filled in this order gets the same LRU order back
+void ArtImpl::ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const {
+    for (Item *item = _lru.back(); item != nullptr; item = item->prev) {
+        f(std::string(item->key(), item->key_size), item->Text(), 0);
+    }
+}
+
+// See ArtImpl.h
+void ArtImpl::GetStats(std::vector<std::pair<std::string, std::string>> &stats) const {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    stats.emplace_back("curr_items", std::to_string(_index.Size()));
+    stats.emplace_back("bytes", std::to_string(_size));
+    stats.emplace_back("limit_maxbytes", std::to_string(_max_size));
+    stats.emplace_back("evictions", std::to_string(_evictions));
+    _index.GetStats(stats);
+}
+
+// See ArtImpl.h
+Item *ArtImpl::find(const std::string &key) const {
+    Item *item = _index.Find(key.data(), key.size());
+    if (item != nullptr) {
+        _lru.move_to_front(item);
+    }
+    return item;
+}
+
+// See ArtImpl.h
+size_t ArtImpl::get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                         uint64_t *versions) const {
+    values.clear();
+    values.resize(keys.size());
+
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t found = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        Item *item = find(keys[i]);
+        if (item != nullptr) {
+            values[i] = item->Share();
+            if (versions != nullptr) {
+                versions[i] = item->version;
+            }
+            found++;
+        }
+    }
+    return found;
+}
+
+// Value is overwritten in place if it fits into item and nobody holds a view on it, otherwise item gets
+// reallocated. Old item stays alive until the last view is released
+bool ArtImpl::update(Item *item, const std::string &value) {
+    size_t old_size = item->Size();
+    _size -= old_size;
+    if (!free_space(item->key_size + value.size(), item)) {
+        _size += old_size;
+        return false;
+    }
+
+    if (value.size() <= item->capacity && !item->Shared()) {
+        item->Assign(value.data(), value.size());
+        item->version = ++_version;
+        return true;
+    }
+    relink(item, Item::Create(0, item->key(), item->key_size, value.data(), value.size()));
+    return true;
+}
+
+// Same as FlatHashImpl::extend: appended bytes go past the end of the value views look at, so only prepend to
+// the shared item copies it, and item that runs out of capacity is reallocated with twice as much as needed
+bool ArtImpl::extend(const std::string &key, const std::string &data, bool front) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(key);
+    if (item == nullptr) {
+        return false;
+    }
+    if (item->flags & Item::Counter) {
+        return update(item, front ? data + item->Text() : item->Text() + data);
+    }
+
+    size_t old_size = item->Size();
+    size_t value_size = item->value_size + data.size();
+    _size -= old_size;
+    if (!free_space(item->key_size + value_size, item)) {
+        _size += old_size;
+        return false;
+    }
+
+    if (value_size <= item->capacity && (!front || !item->Shared())) {
+        item->Extend(data.data(), data.size(), front);
+        item->version = ++_version;
+        return true;
+    }
+
+    size_t capacity = std::max(value_size, std::min(2 * value_size, _max_size));
+    Item *fresh = Item::Create(0, item->key(), item->key_size, item->value(), item->value_size, capacity);
+    fresh->Extend(data.data(), data.size(), front);
+    relink(item, fresh);
+    return true;
+}
+
+// Text is parsed only once, after that counter is kept in the item as native number and updated in place
+bool ArtImpl::change(const std::string &key, uint64_t delta, bool decrement, uint64_t &result) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(key);
+    if (item == nullptr) {
+        return false;
+    }
+    if (item->flags & Item::Counter) {
+        result = ApplyDelta(item->Number(), delta, decrement);
+        item->SetNumber(result);
+        item->version = ++_version;
+        return true;
+    }
+
+    result = ApplyDelta(ParseCounter(item->value(), item->value_size), delta, decrement);
+    size_t old_size = item->Size();
+    _size -= old_size;
+    if (!free_space(item->key_size + sizeof(uint64_t), item)) {
+        _size += old_size;
+        return false;
+    }
+
+    if (item->capacity >= sizeof(uint64_t) && !item->Shared()) {
+        item->SetNumber(result);
+        item->version = ++_version;
+        return true;
+    }
+
+    Item *fresh = Item::Create(0, item->key(), item->key_size, item->value(), 0, sizeof(uint64_t));
+    fresh->SetNumber(result);
+    relink(item, fresh);
+    return true;
+}
+
+// See ArtImpl.h
+void ArtImpl::relink(Item *item, Item *fresh) {
+    fresh->version = ++_version;
+    _index.Replace(fresh);
+    _lru.replace(item, fresh);
+    Item::Release(item);
+}
+
+// See ArtImpl.h
+bool ArtImpl::insert(const std::string &key, const std::string &value) {
+    if (!free_space(key.size() + value.size())) {
+        return false;
+    }
+
+    Item *item = Item::Create(0, key, value);
+    item->version = ++_version;
+    _index.Insert(item);
+    _lru.push_front(item);
+    return true;
+}
+
+// Item being updated is at the front of the list, so it is the last one to become victim, and only if it is
+// the only item left, when there is enough space anyway since its own size is not counted
+bool ArtImpl::free_space(size_t size, const Item *keep) {
+    if (size > _max_size) {
+        return false;
+    }
+    while (size + _size > _max_size) {
+        Item *victim = _lru.back();
+        if (victim == keep) {
+            victim = victim->prev;
+        }
+        drop(victim);
+        _evictions++;
+    }
+    _size += size;
+    return true;
+}
+
+// See ArtImpl.h
+void ArtImpl::drop(Item *item) {
+    _size -= item->Size();
+    _index.Erase(item->key(), item->key_size);
+    _lru.erase(item);
+    Item::Release(item);
+}
+
+} // namespace Backend
+} // namespace Afina
@@ -0,0 +1,136 @@
+#ifndef AFINA_STORAGE_ART_IMPL_H
+#define AFINA_STORAGE_ART_IMPL_H
+
+#include <mutex>
+#include <string>
+
+#include <afina/Storage.h>
+
+#include "ArtIndex.h"
+#include "Item.h"
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Adaptive radix tree based implementation with global lock
+ * Same LRU semantics as MapBasedGlobalLockImpl, but keys are indexed by ArtIndex instead of std::map. Hierarchical
+ * keys such as "user:1234:session:..." share long prefixes, which map stores in full in every node, while the
+ * tree keeps each shared part once and compares only the bytes that tell keys apart. Keys stay ordered, so
+ * storage supports Range over a prefix.
+ *
+ * Each entry is a single Item holding LRU links, key and value, tree leaf points to it directly and GetRef shares
+ * the item itself. Counters are kept as native numbers, same as in FlatHashImpl. Expiration is not supported.
+ */
+class ArtImpl : public Afina::Storage {
+public:
+    ArtImpl(size_t max_size = 1024) : _max_size(max_size), _size(0), _version(0), _evictions(0) {}
+    ~ArtImpl();
+
+    // Implements Afina::Storage interface
+    bool Put(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool PutIfAbsent(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Set(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Append(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Prepend(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Increment(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Decrement(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Delete(const std::string &key) override;
+
+    // Implements Afina::Storage interface
+    bool Get(const std::string &key, std::string &value) const override;
+
+    // Implements Afina::Storage interface
+    bool GetRef(const std::string &key, ValueRef &value) const override;
+
+    // Implements Afina::Storage interface
+    size_t GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const override;
+
+    // Implements Afina::Storage interface
+    size_t Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                std::vector<uint64_t> &versions) const override;
+
+    // Implements Afina::Storage interface
+    CasResult Cas(const std::string &key, const std::string &value, uint64_t version, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    size_t Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                const std::vector<time_t> &expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool Range(const std::string &prefix, const std::string &after, size_t limit, std::vector<std::string> &keys,
+               std::vector<ValueRef> *values) const override;
+
+    // Implements Afina::Storage interface
+    bool Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const override;
+
+    // Implements Afina::Storage interface
+    void Freeze(const std::function<void()> &f) override;
+
+    // Implements Afina::Storage interface
+    void ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const override;
+
+    // Implements Afina::Storage interface
+    void GetStats(std::vector<std::pair<std::string, std::string>> &stats) const override;
+
+private:
+    size_t _max_size;
+    mutable std::mutex _lock;
+
+    size_t _size;
+    ArtIndex _index;
+
+    // Lookups move items to the front, so even const methods change the list
+    mutable ItemList _lru;
+
+    // Last version assigned to an item
+    uint64_t _version;
+
+    size_t _evictions;
+
+    // Returns item for the given key and moves it to the front of the LRU list
+    Item *find(const std::string &key) const;
+
+    // Looks up batch of keys, versions are filled in if given
+    size_t get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values, uint64_t *versions) const;
+
+    // Replaces value of the existing item
+    bool update(Item *item, const std::string &value);
+
+    // Adds data to the value of existing key, to the beginning if front is set
+    bool extend(const std::string &key, const std::string &data, bool front);
+
+    // Applies incr/decr to the value of existing key
+    bool change(const std::string &key, uint64_t delta, bool decrement, uint64_t &result);
+
+    // Puts fresh copy of the item in its place in both tree and list
+    void relink(Item *item, Item *fresh);
+
+    // Adds new item for the given key, key must be absent
+    bool insert(const std::string &key, const std::string &value);
+
+    // Evicts least recently used items until there is enough space for the new one, never evicts keep item
+    bool free_space(size_t size, const Item *keep = nullptr);
+
+    // Unlinks item from everywhere and drops storage reference on it
+    void drop(Item *item);
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_ART_IMPL_H
@@ -0,0 +1,652 @@
+#include "ArtIndex.h"
+
+#include <algorithm>
+#include <cstring>
+#include <initializer_list>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace Afina {
+namespace Backend {
+
+const size_t ArtIndex::MaxPrefix;
+
+struct ArtIndex::Node4 : ArtIndex::Node {
+    uint8_t keys[4];
+    Node *children[4];
+};
+
+struct ArtIndex::Node16 : ArtIndex::Node {
+    uint8_t keys[16];
+    Node *children[16];
+};
+
+struct ArtIndex::Node48 : ArtIndex::Node {
+    // Slot of the child plus one, 0 if there is no child for the byte
+    uint8_t index[256];
+    Node *children[48];
+};
+
+struct ArtIndex::Node256 : ArtIndex::Node {
+    Node *children[256];
+};
+
+// Bitmask of the first count keys equal to the byte
+static uint32_t match16(const uint8_t *keys, uint8_t byte, unsigned count) {
+#ifdef __SSE2__
+    __m128i cmp = _mm_cmpeq_epi8(_mm_set1_epi8(char(byte)), _mm_loadu_si128(reinterpret_cast<const __m128i *>(keys)));
+    return uint32_t(_mm_movemask_epi8(cmp)) & ((1u << count) - 1);
+#else
+    uint32_t result = 0;
+    for (unsigned i = 0; i < count; i++) {
+        result |= uint32_t(keys[i] == byte) << i;
+    }
+    return result;
+#endif
+}
+
+// Position of the first of count sorted keys greater than the byte. SSE2 compares signed bytes only, so both
+// sides are shifted by 0x80 to get unsigned order
+static unsigned upper16(const uint8_t *keys, uint8_t byte, unsigned count) {
+#ifdef __SSE2__
+    __m128i bias = _mm_set1_epi8(char(0x80));
+    __m128i k = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(keys)), bias);
+    __m128i b = _mm_xor_si128(_mm_set1_epi8(char(byte)), bias);
+    uint32_t mask = uint32_t(_mm_movemask_epi8(_mm_cmplt_epi8(b, k))) & ((1u << count) - 1);
+    return mask != 0 ? unsigned(__builtin_ctz(mask)) : count;
+#else
+    unsigned i = 0;
+    while (i < count && keys[i] <= byte) {
+        i++;
+    }
+    return i;
+#endif
+}
+
+// Same order as std::string::compare gives for unsigned chars
+static int compare(const Item *item, const std::string &key) {
+    int result = std::memcmp(item->key(), key.data(), std::min(size_t(item->key_size), key.size()));
+    if (result != 0) {
+        return result;
+    }
+    return item->key_size < key.size() ? -1 : (item->key_size > key.size() ? 1 : 0);
+}
+
+// See ArtIndex.h
+ArtIndex::~ArtIndex() { destroy(_root); }
+
+// Prefix bytes beyond MaxPrefix are skipped here, the final comparison with the item key checks them
+Item *ArtIndex::Find(const char *key, size_t size) const {
+    const Node *n = _root;
+    size_t depth = 0;
+    while (n != nullptr) {
+        if (is_leaf(n)) {
+            Item *item = as_leaf(n);
+            return matches(item, key, size) ? item : nullptr;
+        }
+
+        if (n->prefix_len > 0) {
+            if (depth + n->prefix_len > size) {
+                return nullptr;
+            }
+            size_t kept = std::min(size_t(n->prefix_len), MaxPrefix);
+            if (std::memcmp(n->prefix, key + depth, kept) != 0) {
+                return nullptr;
+            }
+            depth += n->prefix_len;
+        }
+
+        if (depth == size) {
+            return n->value != nullptr && matches(n->value, key, size) ? n->value : nullptr;
+        }
+        Node **c = child(const_cast<Node *>(n), uint8_t(key[depth]));
+        if (c == nullptr) {
+            return nullptr;
+        }
+        n = *c;
+        depth++;
+    }
+    return nullptr;
+}
+
+// See ArtIndex.h
+void ArtIndex::Insert(Item *item) {
+    insert(_root, item, 0, false);
+    _size++;
+}
+
+// See ArtIndex.h
+void ArtIndex::Replace(Item *item) { insert(_root, item, 0, true); }
+
+// See ArtIndex.h
+Item *ArtIndex::Erase(const char *key, size_t size) {
+    Item *item = erase(_root, key, size, 0);
+    if (item != nullptr) {
+        _size--;
+    }
+    return item;
+}
+
+// See ArtIndex.h
+void ArtIndex::Walk(const std::string &from, const std::function<bool(Item *)> &f) const {
+    if (_root != nullptr) {
+        walk(_root, 0, from, true, f);
+    }
+}
+
+// See ArtIndex.h
+void ArtIndex::ForEach(const std::function<void(Item *)> &f) const {
+    Walk("", [&f](Item *item) {
+        f(item);
+        return true;
+    });
+}
+
+// See ArtIndex.h
+void ArtIndex::GetStats(std::vector<std::pair<std::string, std::string>> &stats) const {
+    stats.emplace_back("art_node4", std::to_string(_nodes[Node4Type]));
+    stats.emplace_back("art_node16", std::to_string(_nodes[Node16Type]));
+    stats.emplace_back("art_node48", std::to_string(_nodes[Node48Type]));
+    stats.emplace_back("art_node256", std::to_string(_nodes[Node256Type]));
+    stats.emplace_back("art_node_bytes",
+                       std::to_string(_nodes[Node4Type] * sizeof(Node4) + _nodes[Node16Type] * sizeof(Node16) +
+                                      _nodes[Node48Type] * sizeof(Node48) + _nodes[Node256Type] * sizeof(Node256)));
+}
+
+// Nodes are value initialized, so all children and the prefix start zeroed
+ArtIndex::Node *ArtIndex::alloc(Type type) {
+    Node *n;
+    switch (type) {
+    case Node4Type:
+        n = new Node4();
+        break;
+    case Node16Type:
+        n = new Node16();
+        break;
+    case Node48Type:
+        n = new Node48();
+        break;
+    default:
+        n = new Node256();
+        break;
+    }
+    n->type = type;
+    _nodes[type]++;
+    return n;
+}
+
+// See ArtIndex.h
+void ArtIndex::free(Node *n) {
+    _nodes[n->type]--;
+    switch (n->type) {
+    case Node4Type:
+        delete static_cast<Node4 *>(n);
+        break;
+    case Node16Type:
+        delete static_cast<Node16 *>(n);
+        break;
+    case Node48Type:
+        delete static_cast<Node48 *>(n);
+        break;
+    default:
+        delete static_cast<Node256 *>(n);
+        break;
+    }
+}
+
+// See ArtIndex.h
+void ArtIndex::destroy(Node *n) {
+    if (n == nullptr || is_leaf(n)) {
+        return;
+    }
+    children(n, 0, [this](uint8_t, Node *c) {
+        destroy(c);
+        return true;
+    });
+    free(n);
+}
+
+// See ArtIndex.h
+ArtIndex::Node **ArtIndex::child(Node *n, uint8_t byte) {
+    switch (n->type) {
+    case Node4Type: {
+        Node4 *n4 = static_cast<Node4 *>(n);
+        for (unsigned i = 0; i < n4->count; i++) {
+            if (n4->keys[i] == byte) {
+                return &n4->children[i];
+            }
+        }
+        return nullptr;
+    }
+    case Node16Type: {
+        Node16 *n16 = static_cast<Node16 *>(n);
+        uint32_t mask = match16(n16->keys, byte, n16->count);
+        return mask != 0 ? &n16->children[__builtin_ctz(mask)] : nullptr;
+    }
+    case Node48Type: {
+        Node48 *n48 = static_cast<Node48 *>(n);
+        return n48->index[byte] != 0 ? &n48->children[n48->index[byte] - 1] : nullptr;
+    }
+    default: {
+        Node256 *n256 = static_cast<Node256 *>(n);
+        return n256->children[byte] != nullptr ? &n256->children[byte] : nullptr;
+    }
+    }
+}
+
+// Keys of Node4 and Node16 are kept sorted, so children come out in order without sorting
+void ArtIndex::add_child(Node *&ref, uint8_t byte, Node *c) {
+    Node *n = ref;
+    switch (n->type) {
+    case Node4Type: {
+        Node4 *n4 = static_cast<Node4 *>(n);
+        if (n4->count == 4) {
+            ref = resize(n, Node16Type);
+            add_child(ref, byte, c);
+            return;
+        }
+        unsigned pos = 0;
+        while (pos < n4->count && n4->keys[pos] < byte) {
+            pos++;
+        }
+        std::memmove(&n4->keys[pos + 1], &n4->keys[pos], n4->count - pos);
+        std::memmove(&n4->children[pos + 1], &n4->children[pos], (n4->count - pos) * sizeof(Node *));
+        n4->keys[pos] = byte;
+        n4->children[pos] = c;
+        break;
+    }
+    case Node16Type: {
+        Node16 *n16 = static_cast<Node16 *>(n);
+        if (n16->count == 16) {
+            ref = resize(n, Node48Type);
+            add_child(ref, byte, c);
+            return;
+        }
+        unsigned pos = upper16(n16->keys, byte, n16->count);
+        std::memmove(&n16->keys[pos + 1], &n16->keys[pos], n16->count - pos);
+        std::memmove(&n16->children[pos + 1], &n16->children[pos], (n16->count - pos) * sizeof(Node *));
+        n16->keys[pos] = byte;
+        n16->children[pos] = c;
+        break;
+    }
+    case Node48Type: {
+        Node48 *n48 = static_cast<Node48 *>(n);
+        if (n48->count == 48) {
+            ref = resize(n, Node256Type);
+            add_child(ref, byte, c);
+            return;
+        }
+        unsigned slot = 0;
+        while (n48->children[slot] != nullptr) {
+            slot++;
+        }
+        n48->children[slot] = c;
+        n48->index[byte] = uint8_t(slot + 1);
+        break;
+    }
+    default:
+        static_cast<Node256 *>(n)->children[byte] = c;
+        break;
+    }
+    n->count++;
+}
+
+// Nodes shrink a few children below the size of the smaller one, so that key added and removed right at the
+// boundary doesn't resize node back and forth
+void ArtIndex::remove_child(Node *&ref, uint8_t byte) {
+    Node *n = ref;
+    switch (n->type) {
+    case Node4Type: {
+        Node4 *n4 = static_cast<Node4 *>(n);
+        unsigned pos = unsigned(child(n, byte) - n4->children);
+        std::memmove(&n4->keys[pos], &n4->keys[pos + 1], n4->count - pos - 1);
+        std::memmove(&n4->children[pos], &n4->children[pos + 1], (n4->count - pos - 1) * sizeof(Node *));
+        n4->count--;
+        collapse(ref);
+        break;
+    }
+    case Node16Type: {
+        Node16 *n16 = static_cast<Node16 *>(n);
+        unsigned pos = unsigned(child(n, byte) - n16->children);
+        std::memmove(&n16->keys[pos], &n16->keys[pos + 1], n16->count - pos - 1);
+        std::memmove(&n16->children[pos], &n16->children[pos + 1], (n16->count - pos - 1) * sizeof(Node *));
+        if (--n16->count == 3) {
+            ref = resize(n, Node4Type);
+        }
+        break;
+    }
+    case Node48Type: {
+        Node48 *n48 = static_cast<Node48 *>(n);
+        n48->children[n48->index[byte] - 1] = nullptr;
+        n48->index[byte] = 0;
+        if (--n48->count == 12) {
+            ref = resize(n, Node16Type);
+        }
+        break;
+    }
+    default: {
+        Node256 *n256 = static_cast<Node256 *>(n);
+        n256->children[byte] = nullptr;
+        if (--n256->count == 37) {
+            ref = resize(n, Node48Type);
+        }
+        break;
+    }
+    }
+}
+
+// Only Node4 could get down to a single entry. Child node takes over prefix of the parent and the byte
+// leading to it, item doesn't need anything since it has the whole key
+void ArtIndex::collapse(Node *&ref) {
+    Node *n = ref;
+    if (n->type != Node4Type || n->count + (n->value != nullptr ? 1 : 0) > 1) {
+        return;
+    }
+
+    Node4 *n4 = static_cast<Node4 *>(n);
+    if (n4->count == 0) {
+        ref = n4->value != nullptr ? leaf(n4->value) : nullptr;
+    } else if (is_leaf(n4->children[0])) {
+        ref = n4->children[0];
+    } else {
+        Node *c = n4->children[0];
+        uint8_t prefix[MaxPrefix];
+        size_t len = std::min(size_t(n4->prefix_len), MaxPrefix);
+        std::memcpy(prefix, n4->prefix, len);
+        if (len < MaxPrefix) {
+            prefix[len++] = n4->keys[0];
+        }
+        size_t rest = std::min(size_t(c->prefix_len), MaxPrefix - len);
+        std::memcpy(prefix + len, c->prefix, rest);
+        std::memcpy(c->prefix, prefix, len + rest);
+        c->prefix_len += n4->prefix_len + 1;
+        ref = c;
+    }
+    free(n);
+}
+
+// See ArtIndex.h
+ArtIndex::Node *ArtIndex::resize(Node *n, Type type) {
+    Node *m = alloc(type);
+    m->prefix_len = n->prefix_len;
+    std::memcpy(m->prefix, n->prefix, sizeof(m->prefix));
+    m->value = n->value;
+
+    children(n, 0, [m, type](uint8_t byte, Node *c) {
+        switch (type) {
+        case Node4Type: {
+            Node4 *m4 = static_cast<Node4 *>(m);
+            m4->keys[m->count] = byte;
+            m4->children[m->count] = c;
+            break;
+        }
+        case Node16Type: {
+            Node16 *m16 = static_cast<Node16 *>(m);
+            m16->keys[m->count] = byte;
+            m16->children[m->count] = c;
+            break;
+        }
+        case Node48Type: {
+            Node48 *m48 = static_cast<Node48 *>(m);
+            m48->children[m->count] = c;
+            m48->index[byte] = uint8_t(m->count + 1);
+            break;
+        }
+        default:
+            static_cast<Node256 *>(m)->children[byte] = c;
+            break;
+        }
+        m->count++;
+        return true;
+    });
+    free(n);
+    return m;
+}
+
+// Leftmost path is the cheapest one to follow
+Item *ArtIndex::any_leaf(const Node *n) {
+    while (!is_leaf(n)) {
+        if (n->value != nullptr) {
+            return n->value;
+        }
+        children(n, 0, [&n](uint8_t, Node *c) {
+            n = c;
+            return false;
+        });
+    }
+    return as_leaf(n);
+}
+
+// See ArtIndex.h
+uint8_t ArtIndex::prefix_byte(const Node *n, size_t depth, size_t i) {
+    return i < MaxPrefix ? n->prefix[i] : uint8_t(any_leaf(n)->key()[depth + i]);
+}
+
+// See ArtIndex.h
+size_t ArtIndex::prefix_mismatch(const Node *n, const char *key, size_t size, size_t depth) {
+    size_t max = std::min(size_t(n->prefix_len), size - depth);
+    size_t i = 0;
+    while (i < std::min(max, MaxPrefix) && n->prefix[i] == uint8_t(key[depth + i])) {
+        i++;
+    }
+    if (i == MaxPrefix && max > MaxPrefix) {
+        const char *full = any_leaf(n)->key() + depth;
+        while (i < max && full[i] == key[depth + i]) {
+            i++;
+        }
+    }
+    return i;
+}
+
+// Returns item that has been replaced, inner node is split whenever new key diverges within its prefix
+Item *ArtIndex::insert(Node *&ref, Item *item, size_t depth, bool replace) {
+    const char *key = item->key();
+    size_t size = item->key_size;
+    if (ref == nullptr) {
+        ref = leaf(item);
+        return nullptr;
+    }
+
+    if (is_leaf(ref)) {
+        Item *old = as_leaf(ref);
+        if (matches(old, key, size)) {
+            ref = leaf(item);
+            return old;
+        }
+
+        // Both keys go under the new node with their common part as its prefix
+        Node *n = alloc(Node4Type);
+        size_t common = 0;
+        while (depth + common < size && depth + common < old->key_size &&
+               key[depth + common] == old->key()[depth + common]) {
+            common++;
+        }
+        n->prefix_len = uint32_t(common);
+        std::memcpy(n->prefix, key + depth, std::min(common, MaxPrefix));
+
+        size_t end = depth + common;
+        for (Item *i : {old, item}) {
+            if (i->key_size == end) {
+                n->value = i;
+            } else {
+                add_child(n, uint8_t(i->key()[end]), leaf(i));
+            }
+        }
+        ref = n;
+        return nullptr;
+    }
+
+    Node *n = ref;
+    if (n->prefix_len > 0) {
+        size_t p = prefix_mismatch(n, key, size, depth);
+        if (p < n->prefix_len) {
+            Node *parent = alloc(Node4Type);
+            parent->prefix_len = uint32_t(p);
+            std::memcpy(parent->prefix, n->prefix, std::min(p, MaxPrefix));
+
+            // Node keeps the part of its prefix after the byte it is reached by
+            uint8_t byte = prefix_byte(n, depth, p);
+            size_t rest = n->prefix_len - p - 1;
+            if (n->prefix_len > MaxPrefix) {
+                std::memcpy(n->prefix, any_leaf(n)->key() + depth + p + 1, std::min(rest, MaxPrefix));
+            } else {
+                std::memmove(n->prefix, n->prefix + p + 1, rest);
+            }
+            n->prefix_len = uint32_t(rest);
+
+            add_child(parent, byte, n);
+            if (size == depth + p) {
+                parent->value = item;
+            } else {
+                add_child(parent, uint8_t(key[depth + p]), leaf(item));
+            }
+            ref = parent;
+            return nullptr;
+        }
+        depth += n->prefix_len;
+    }
+
+    if (depth == size) {
+        Item *old = n->value;
+        n->value = item;
+        return old;
+    }
+    Node **c = child(n, uint8_t(key[depth]));
+    if (c != nullptr) {
+        return insert(*c, item, depth + 1, replace);
+    }
+    add_child(ref, uint8_t(key[depth]), leaf(item));
+    return nullptr;
+}
+
+// Item found is compared with the whole key, so prefixes are only skipped on the way down
+Item *ArtIndex::erase(Node *&ref, const char *key, size_t size, size_t depth) {
+    if (ref == nullptr) {
+        return nullptr;
+    } else if (is_leaf(ref)) {
+        Item *item = as_leaf(ref);
+        if (!matches(item, key, size)) {
+            return nullptr;
+        }
+        ref = nullptr;
+        return item;
+    }
+
+    Node *n = ref;
+    if (depth + n->prefix_len > size) {
+        return nullptr;
+    }
+    depth += n->prefix_len;
+
+    if (depth == size) {
+        Item *item = n->value;
+        if (item == nullptr || !matches(item, key, size)) {
+            return nullptr;
+        }
+        n->value = nullptr;
+        collapse(ref);
+        return item;
+    }
+
+    Node **c = child(n, uint8_t(key[depth]));
+    if (c == nullptr) {
+        return nullptr;
+    } else if (!is_leaf(*c)) {
+        return erase(*c, key, size, depth + 1);
+    }
+
+    Item *item = as_leaf(*c);
+    if (!matches(item, key, size)) {
+        return nullptr;
+    }
+    remove_child(ref, uint8_t(key[depth]));
+    return item;
+}
+
+// Subtree is skipped as a whole once its path gets below from, and walked without comparisons once it gets above
+bool ArtIndex::walk(const Node *n, size_t depth, const std::string &from, bool bounded,
+                    const std::function<bool(Item *)> &f) const {
+    if (is_leaf(n)) {
+        Item *item = as_leaf(n);
+        return bounded && compare(item, from) < 0 ? true : f(item);
+    }
+
+    if (bounded) {
+        const char *full = n->prefix_len > MaxPrefix ? any_leaf(n)->key() + depth : nullptr;
+        for (size_t i = 0; i < n->prefix_len; i++) {
+            if (depth + i == from.size()) {
+                bounded = false;
+                break;
+            }
+            uint8_t byte = i < MaxPrefix ? n->prefix[i] : uint8_t(full[i]);
+            uint8_t bound = uint8_t(from[depth + i]);
+            if (byte < bound) {
+                return true;
+            } else if (byte > bound) {
+                bounded = false;
+                break;
+            }
+        }
+    }
+    depth += n->prefix_len;
+
+    // Key of the node item is the path itself, it is below from if from goes on further
+    if (n->value != nullptr && (!bounded || from.size() == depth) && !f(n->value)) {
+        return false;
+    }
+    if (bounded && from.size() == depth) {
+        bounded = false;
+    }
+
+    unsigned start = bounded ? uint8_t(from[depth]) : 0;
+    return children(n, start, [&](uint8_t byte, Node *c) {
+        return walk(c, depth + 1, from, bounded && byte == start, f);
+    });
+}
+
+// See ArtIndex.h
+bool ArtIndex::children(const Node *n, unsigned from, const std::function<bool(uint8_t, Node *)> &f) {
+    switch (n->type) {
+    case Node4Type: {
+        const Node4 *n4 = static_cast<const Node4 *>(n);
+        for (unsigned i = 0; i < n4->count; i++) {
+            if (n4->keys[i] >= from && !f(n4->keys[i], n4->children[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case Node16Type: {
+        const Node16 *n16 = static_cast<const Node16 *>(n);
+        for (unsigned i = 0; i < n16->count; i++) {
+            if (n16->keys[i] >= from && !f(n16->keys[i], n16->children[i])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    case Node48Type: {
+        const Node48 *n48 = static_cast<const Node48 *>(n);
+        for (unsigned b = from; b < 256; b++) {
+            if (n48->index[b] != 0 && !f(uint8_t(b), n48->children[n48->index[b] - 1])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    default: {
+        const Node256 *n256 = static_cast<const Node256 *>(n);
+        for (unsigned b = from; b < 256; b++) {
+            if (n256->children[b] != nullptr && !f(uint8_t(b), n256->children[b])) {
+                return false;
+            }
+        }
+        return true;
+    }
+    }
+}
+
+} // namespace Backend
+} // namespace Afina
@@ -0,0 +1,158 @@
+#ifndef AFINA_STORAGE_ART_INDEX_H
+#define AFINA_STORAGE_ART_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Item.h"
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Adaptive radix tree index
+ * Ordered index of items by key, see "The Adaptive Radix Tree: ARTful Indexing for Main-Memory Databases" by
+ * Leis et al. Each inner node consumes one byte of the key and comes in one of four sizes, picked by the number
+ * of children it has:
+ * - Node4 and Node16 keep sorted key bytes next to children, Node16 is searched with single SSE2 comparison
+ * - Node48 maps every byte to a slot in 48 children
+ * - Node256 is indexed by byte directly
+ * Nodes grow and shrink between sizes as children come and go.
+ *
+ * Bytes shared by all keys under a node are compressed into its prefix, so long common key prefixes such as
+ * "user:1234:session:" are stored once per subtree and not once per key. Up to MaxPrefix bytes of the prefix
+ * are kept in the node, lookup checks only those and relies on the final comparison of the whole key with the
+ * item found. Whenever longer prefix has to be known exactly, it is taken from the key of any item below.
+ *
+ * Key that is a prefix of another key ends right at the inner node, such item is kept in the node itself. Items
+ * are leaves of the tree, pointers to them are tagged with the low bit to tell them from inner nodes.
+ *
+ * Index doesn't own items. Class is not thread safe.
+ */
+class ArtIndex {
+public:
+    ArtIndex() : _root(nullptr), _size(0), _nodes{0, 0, 0, 0} {}
+
+    // Frees nodes, but not items
+    ~ArtIndex();
+
+    ArtIndex(const ArtIndex &) = delete;
+    ArtIndex &operator=(const ArtIndex &) = delete;
+
+    /**
+     * Returns item with the given key or nullptr
+     */
+    Item *Find(const char *key, size_t size) const;
+
+    /**
+     * Adds item, its key must be absent from the index
+     */
+    void Insert(Item *item);
+
+    /**
+     * Puts item in place of the one with the same key, which must be in the index
+     */
+    void Replace(Item *item);
+
+    /**
+     * Removes item with the given key, returns it or nullptr if there was no such
+     */
+    Item *Erase(const char *key, size_t size);
+
+    /**
+     * Calls f for items with keys not less than from in key order, until f returns false. Keys are compared
+     * bytewise as unsigned chars, shorter key goes before longer one it is a prefix of
+     */
+    void Walk(const std::string &from, const std::function<bool(Item *)> &f) const;
+
+    /**
+     * Calls f for every item in no particular order
+     */
+    void ForEach(const std::function<void(Item *)> &f) const;
+
+    size_t Size() const { return _size; }
+
+    /**
+     * Appends number of nodes of each size and memory they take
+     */
+    void GetStats(std::vector<std::pair<std::string, std::string>> &stats) const;
+
+private:
+    static const size_t MaxPrefix = 16;
+
+    enum Type : uint8_t { Node4Type, Node16Type, Node48Type, Node256Type };
+
+    // Common header of inner nodes
+    struct Node {
+        // Full length of the compressed prefix, only first MaxPrefix bytes of it are kept
+        uint32_t prefix_len;
+        uint16_t count;
+        Type type;
+        uint8_t prefix[MaxPrefix];
+
+        // Item which key ends right after the prefix
+        Item *value;
+    };
+
+    struct Node4;
+    struct Node16;
+    struct Node48;
+    struct Node256;
+
+    Node *_root;
+    size_t _size;
+    size_t _nodes[4];
+
+    static bool is_leaf(const Node *n) { return (reinterpret_cast<uintptr_t>(n) & 1) != 0; }
+    static Item *as_leaf(const Node *n) { return reinterpret_cast<Item *>(reinterpret_cast<uintptr_t>(n) & ~1); }
+    static Node *leaf(Item *item) { return reinterpret_cast<Node *>(reinterpret_cast<uintptr_t>(item) | 1); }
+
+    static bool matches(const Item *item, const char *key, size_t size) { return item->Equals(key, size); }
+
+    Node *alloc(Type type);
+    void free(Node *n);
+    void destroy(Node *n);
+
+    // Pointer to the child slot for the given byte or nullptr
+    static Node **child(Node *n, uint8_t byte);
+
+    // Adds child, growing node into larger one if it is full
+    void add_child(Node *&ref, uint8_t byte, Node *child);
+
+    // Removes child, shrinking node if it is not full enough anymore
+    void remove_child(Node *&ref, uint8_t byte);
+
+    // Replaces node having the only child or the only item with that child or item
+    void collapse(Node *&ref);
+
+    // Moves header and children into the new node of given type, old one is freed
+    Node *resize(Node *n, Type type);
+
+    // Any item below the node, used to get bytes of the prefix that are not kept in the node
+    static Item *any_leaf(const Node *n);
+
+    // Byte of the full prefix, node is at the given depth of the key
+    static uint8_t prefix_byte(const Node *n, size_t depth, size_t i);
+
+    // Number of prefix bytes matching the key from the given depth
+    static size_t prefix_mismatch(const Node *n, const char *key, size_t size, size_t depth);
+
+    Item *insert(Node *&ref, Item *item, size_t depth, bool replace);
+    Item *erase(Node *&ref, const char *key, size_t size, size_t depth);
+
+    // Walks subtree in order, bounded is set while path so far equals to the beginning of from
+    bool walk(const Node *n, size_t depth, const std::string &from, bool bounded,
+              const std::function<bool(Item *)> &f) const;
+
+    // Calls f for each child in byte order starting from the given byte, until f returns false
+    static bool children(const Node *n, unsigned from, const std::function<bool(uint8_t, Node *)> &f);
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_ART_INDEX_H
@@ -0,0 +1,104 @@
+#ifndef AFINA_STORAGE_BUMP_BUFFER_H
+#define AFINA_STORAGE_BUMP_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Striped buffer of LRU promotions
+ * Hits are recorded here instead of moving entries to the front of the LRU list right away, so readers never
+ * write to the list and could run under shared lock. Whoever gets the list exclusively drains the buffer and
+ * applies recorded promotions in one batch.
+ *
+ * Buffer is split in stripes and each thread records into its own one, picked round robin on first use the same
+ * way SharedMutex picks reader slots, so readers on different cores don't bounce cache lines. Stripe mutex only
+ * matters when there are more threads than stripes. Full stripe drops further hits until it is drained:
+ * promotion is a hint, losing some of them makes order slightly less exact, but cost of a hit stays bounded.
+ *
+ * Add must not run concurrently with Drain: callers add under shared lock and drain under exclusive one.
+ */
+template <typename T> class BumpBuffer {
+public:
+    static const size_t Stripes = 64;
+    static const size_t StripeSize = 32;
+
+    BumpBuffer() : _dirty(false), _dropped(0) {}
+
+    BumpBuffer(const BumpBuffer &) = delete;
+    BumpBuffer &operator=(const BumpBuffer &) = delete;
+
+    /**
+     * Records hit, returns true if stripe of the calling thread is full and buffer should be drained
+     */
+    bool Add(T *item) {
+        Stripe &s = _stripes[slot()];
+        std::unique_lock<std::mutex> guard(s.lock);
+        if (s.size == StripeSize) {
+            s.dropped++;
+            return true;
+        }
+        if (s.size == 0) {
+            _dirty.store(true, std::memory_order_relaxed);
+        }
+        s.items[s.size++] = item;
+        return s.size == StripeSize;
+    }
+
+    /**
+     * Calls f for every recorded item, stripe by stripe in order of recording, and empties the buffer. Returns
+     * number of items drained
+     */
+    template <typename F> size_t Drain(F f) {
+        if (!_dirty.load(std::memory_order_relaxed)) {
+            return 0;
+        }
+        _dirty.store(false, std::memory_order_relaxed);
+
+        size_t drained = 0;
+        for (auto &s : _stripes) {
+            for (size_t i = 0; i < s.size; i++) {
+                f(s.items[i]);
+            }
+            drained += s.size;
+            _dropped += s.dropped;
+            s.size = 0;
+            s.dropped = 0;
+        }
+        return drained;
+    }
+
+    /**
+     * Number of hits dropped by full stripes so far, counted as stripes get drained
+     */
+    size_t Dropped() const { return _dropped; }
+
+private:
+    struct alignas(64) Stripe {
+        Stripe() : size(0), dropped(0) {}
+
+        std::mutex lock;
+        size_t size;
+        size_t dropped;
+        T *items[StripeSize];
+    };
+
+    // Returns stripe of the calling thread
+    static size_t slot() {
+        static std::atomic<size_t> next(0);
+        thread_local size_t self = next.fetch_add(1) % Stripes;
+        return self;
+    }
+
+    Stripe _stripes[Stripes];
+    alignas(64) std::atomic<bool> _dirty;
+    size_t _dropped;
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_BUMP_BUFFER_H
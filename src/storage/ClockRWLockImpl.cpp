@@ -0,0 +1,365 @@
+#include "ClockRWLockImpl.h"
+
+#include <mutex>
+
+#include "Counter.h"
+#include "Cursor.h"
+
+namespace Afina {
+namespace Backend {
+
+// See ClockRWLockImpl.h
+ClockRWLockImpl::~ClockRWLockImpl() {
+    _index.ForEach([](Entry *entry) { delete entry; });
+}
+
+// See ClockRWLockImpl.h
+bool ClockRWLockImpl::Put(const std::string &key, const std::string &value) {
+    std::unique_lock<SharedMutex> guard(_lock);
+
+    uint64_t hash = Hash(key.data(), key.size());
+    Entry *entry = _index.Find(hash, key.data(), key.size());
+    if (entry != nullptr) {
+        return update(entry, value);
+    }
+    return insert(hash, key, value);
+}
+
+// See ClockRWLockImpl.h
+bool ClockRWLockImpl::PutIfAbsent(const std::string &key, const std::string &value) {
+    std::unique_lock<SharedMutex> guard(_lock);
+
+    uint64_t hash = Hash(key.data(), key.size());
+    if (_index.Find(hash, key.data(), key.size()) != nullptr) {
+        return false;
+    }
+    return insert(hash, key, value);
+}
+
+// See ClockRWLockImpl.h
+bool ClockRWLockImpl::Set(const std::string &key, const std::string &value) {
+    std::unique_lock<SharedMutex> guard(_lock);
+
+    Entry *entry = _index.Find(Hash(key.data(), key.size()), key.data(), key.size());
+    if (entry == nullptr) {
+        return false;
+    }
+    return update(entry, value);
+}
+
+// See ClockRWLockImpl.h
+bool ClockRWLockImpl::Append(const std::string &key, const std::string &data) { return extend(key, data, false); }
+
+// See ClockRWLockImpl.h
+bool ClockRWLockImpl::Prepend(const std::string &key, const std::string &data) { return extend(key, data, true); }
+
+// See ClockRWLockImpl.h
+bool ClockRWLockImpl::Increment(const std::string &key, uint64_t delta, uint64_t &result) {
+    return change(key, delta, false, result);
+}
+
+// See ClockRWLockImpl.h
+bool ClockRWLockImpl::Decrement(const std::string &key, uint64_t delta, uint64_t &result) {
+    return change(key, delta, true, result);
+}
+
+// See ClockRWLockImpl.h
+bool ClockRWLockImpl::Delete(const std::string &key) {
+    std::unique_lock<SharedMutex> guard(_lock);
+
+    Entry *entry = _index.Erase(Hash(key.data(), key.size()), key.data(), key.size());
+    if (entry == nullptr) {
+        return false;
+    }
+    _size -= entry->key.size() + entry->value.size();
+    delete entry;
+    return true;
+}
+
+// Hit only sets reference bit. Bit is checked first to not write shared cache line if it is already set,
+// which is the common case for hot keys
+bool ClockRWLockImpl::Get(const std::string &key, std::string &value) const {
+    SharedLock guard(_lock);
+
+    Entry *entry = _index.Find(Hash(key.data(), key.size()), key.data(), key.size());
+    if (entry == nullptr) {
+        return false;
+    }
+    if (!entry->referenced.load(std::memory_order_relaxed)) {
+        entry->referenced.store(true, std::memory_order_relaxed);
+    }
+    value = entry->text();
+    return true;
+}
+
+// See ClockRWLockImpl.h
+size_t ClockRWLockImpl::GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const {
+    return get_many(keys, values, nullptr);
+}
+
+// See ClockRWLockImpl.h
+size_t ClockRWLockImpl::Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                             std::vector<uint64_t> &versions) const {
+    versions.assign(keys.size(), 0);
+    return get_many(keys, values, versions.data());
+}
+
+// Exclusive lock keeps counters still while version is compared and value is replaced
+Storage::CasResult ClockRWLockImpl::Cas(const std::string &key, const std::string &value, uint64_t version,
+                                        time_t expire_at) {
+    std::unique_lock<SharedMutex> guard(_lock);
+
+    Entry *entry = _index.Find(Hash(key.data(), key.size()), key.data(), key.size());
+    if (entry == nullptr) {
+        return CasResult::NotFound;
+    } else if (entry->version.load(std::memory_order_relaxed) != version) {
+        return CasResult::Exists;
+    }
+    return update(entry, value) ? CasResult::Stored : CasResult::NotStored;
+}
+
+// Entries are built before the lock is taken, so only index updates and eviction are left under it
+size_t ClockRWLockImpl::Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                             const std::vector<time_t> &expire_at) {
+    std::vector<uint64_t> hashes(keys.size());
+    std::vector<Entry *> entries(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        hashes[i] = Hash(keys[i].data(), keys[i].size());
+        entries[i] = new Entry(keys[i], values[i]);
+    }
+
+    size_t stored = 0;
+    std::unique_lock<SharedMutex> guard(_lock);
+    for (size_t i = 0; i < entries.size(); i++) {
+        Entry *entry = entries[i];
+        if (_index.Find(hashes[i], entry->key.data(), entry->key.size()) != nullptr ||
+            !free_space(entry->key.size() + entry->value.size(), nullptr)) {
+            continue;
+        }
+        bump(entry);
+        _index.Insert(hashes[i], entry);
+        entries[i] = nullptr;
+        stored++;
+    }
+    guard.unlock();
+
+    // Entries that were not stored
+    for (Entry *entry : entries) {
+        delete entry;
+    }
+    return stored;
+}
+
+// Index doesn't change under shared lock, so scan doesn't stall readers at all
+bool ClockRWLockImpl::Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const {
+    uint64_t position = ParsePosition(cursor);
+    SharedLock guard(_lock);
+
+    size_t first = keys.size(), groups = 0;
+    do {
+        position = _index.Scan(position, [&keys](Entry *entry) { keys.push_back(entry->key); });
+    } while (position != 0 && keys.size() - first < count && ++groups < count);
+
+    cursor = std::to_string(position);
+    return true;
+}
+
+// Exclusive lock stops counters updated under shared one as well
+void ClockRWLockImpl::Freeze(const std::function<void()> &f) {
+    std::unique_lock<SharedMutex> guard(_lock);
+    f();
+}
+
+// See ClockRWLockImpl.h
+void ClockRWLockImpl::ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const {
+    _index.ForEach([&f](Entry *entry) { f(entry->key, entry->text(), 0); });
+}
+
+// Size and evictions change under exclusive lock only, so shared one is enough to read them
+void ClockRWLockImpl::GetStats(std::vector<std::pair<std::string, std::string>> &stats) const {
+    SharedLock guard(_lock);
+
+    stats.emplace_back("curr_items", std::to_string(_index.Size()));
+    stats.emplace_back("bytes", std::to_string(_size));
+    stats.emplace_back("limit_maxbytes", std::to_string(_max_size));
+    stats.emplace_back("evictions", std::to_string(_evictions));
+}
+
+// Whole batch goes under single shared lock, values are copied since entries could change once it is released.
+// Counter could be changed concurrently, so version is read before the value: stale version with fresh value
+// only makes cas fail, while the opposite would let it overwrite a change client has never seen
+size_t ClockRWLockImpl::get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                                 uint64_t *versions) const {
+    std::vector<uint64_t> hashes(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        hashes[i] = Hash(keys[i].data(), keys[i].size());
+    }
+    values.clear();
+    values.resize(keys.size());
+
+    SharedLock guard(_lock);
+
+    size_t found = 0;
+    _index.FindMany(hashes.data(), keys.data(), keys.size(), [&values, versions, &found](size_t i, Entry *entry) {
+        if (entry == nullptr) {
+            return;
+        }
+        if (!entry->referenced.load(std::memory_order_relaxed)) {
+            entry->referenced.store(true, std::memory_order_relaxed);
+        }
+        if (versions != nullptr) {
+            versions[i] = entry->version.load(std::memory_order_acquire);
+        }
+        values[i] = ValueRef(entry->text());
+        found++;
+    });
+    return found;
+}
+
+// See ClockRWLockImpl.h
+bool ClockRWLockImpl::update(Entry *entry, const std::string &value) {
+    size_t old_size = entry->key.size() + entry->value.size();
+    _size -= old_size;
+    if (!free_space(entry->key.size() + value.size(), entry)) {
+        _size += old_size;
+        return false;
+    }
+    entry->value = value;
+    entry->counter = false;
+    entry->referenced.store(true, std::memory_order_relaxed);
+    bump(entry);
+    return true;
+}
+
+// Value string grows with its own amortized reserve, so appends don't copy the whole value each time
+bool ClockRWLockImpl::extend(const std::string &key, const std::string &data, bool front) {
+    std::unique_lock<SharedMutex> guard(_lock);
+
+    Entry *entry = _index.Find(Hash(key.data(), key.size()), key.data(), key.size());
+    if (entry == nullptr) {
+        return false;
+    }
+    if (entry->counter) {
+        _size -= entry->value.size();
+        entry->value = entry->text();
+        entry->counter = false;
+        _size += entry->value.size();
+    }
+
+    size_t old_size = entry->key.size() + entry->value.size();
+    _size -= old_size;
+    if (!free_space(old_size + data.size(), entry)) {
+        _size += old_size;
+        return false;
+    }
+    if (front) {
+        entry->value.insert(0, data);
+    } else {
+        entry->value.append(data);
+    }
+    entry->referenced.store(true, std::memory_order_relaxed);
+    bump(entry);
+    return true;
+}
+
+// Applies incr/decr to the counter atomically, decr needs CAS loop to stop at 0
+static uint64_t apply(std::atomic<uint64_t> &number, uint64_t delta, bool decrement) {
+    if (!decrement) {
+        return number.fetch_add(delta, std::memory_order_relaxed) + delta;
+    }
+
+    uint64_t current = number.load(std::memory_order_relaxed);
+    while (!number.compare_exchange_weak(current, ApplyDelta(current, delta, true), std::memory_order_relaxed)) {
+    }
+    return ApplyDelta(current, delta, true);
+}
+
+// Counter is updated under shared lock. Text value is parsed only once under exclusive lock, entry could change
+// while lock is upgraded, so it is looked up again
+bool ClockRWLockImpl::change(const std::string &key, uint64_t delta, bool decrement, uint64_t &result) {
+    uint64_t hash = Hash(key.data(), key.size());
+    {
+        SharedLock guard(_lock);
+
+        Entry *entry = _index.Find(hash, key.data(), key.size());
+        if (entry == nullptr) {
+            return false;
+        }
+        if (entry->counter) {
+            if (!entry->referenced.load(std::memory_order_relaxed)) {
+                entry->referenced.store(true, std::memory_order_relaxed);
+            }
+            result = apply(entry->number, delta, decrement);
+            bump(entry);
+            return true;
+        }
+    }
+
+    std::unique_lock<SharedMutex> guard(_lock);
+
+    Entry *entry = _index.Find(hash, key.data(), key.size());
+    if (entry == nullptr) {
+        return false;
+    }
+    if (!entry->counter) {
+        entry->number.store(ParseCounter(entry->value.data(), entry->value.size()), std::memory_order_relaxed);
+        entry->counter = true;
+    }
+    entry->referenced.store(true, std::memory_order_relaxed);
+    result = apply(entry->number, delta, decrement);
+    bump(entry);
+    return true;
+}
+
+// Versions are taken after the value is changed. Concurrent counter changes could store their versions out of
+// order, so entry version only grows: whoever sees it sees every change that took smaller version as well
+void ClockRWLockImpl::bump(Entry *entry) {
+    uint64_t version = _version.fetch_add(1, std::memory_order_acq_rel) + 1;
+    uint64_t current = entry->version.load(std::memory_order_relaxed);
+    while (current < version &&
+           !entry->version.compare_exchange_weak(current, version, std::memory_order_release,
+                                                 std::memory_order_relaxed)) {
+    }
+}
+
+// New entries start with clear reference bit, so entries that were never read are evicted first
+bool ClockRWLockImpl::insert(uint64_t hash, const std::string &key, const std::string &value) {
+    if (!free_space(key.size() + value.size(), nullptr)) {
+        return false;
+    }
+    Entry *entry = new Entry(key, value);
+    bump(entry);
+    _index.Insert(hash, entry);
+    return true;
+}
+
+// Every entry could be passed by hand at most twice: first time bit gets cleared, second time entry gets evicted
+bool ClockRWLockImpl::free_space(size_t size, const Entry *keep) {
+    if (size > _max_size) {
+        return false;
+    }
+    while (size + _size > _max_size) {
+        if (_hand >= _index.Capacity()) {
+            _hand = 0;
+        }
+
+        Entry *entry = _index.At(_hand++);
+        if (entry == nullptr || entry == keep) {
+            continue;
+        }
+        if (entry->referenced.load(std::memory_order_relaxed)) {
+            entry->referenced.store(false, std::memory_order_relaxed);
+            continue;
+        }
+
+        _size -= entry->key.size() + entry->value.size();
+        _index.Erase(EntryTraits::Hash(entry), entry->key.data(), entry->key.size());
+        delete entry;
+        _evictions++;
+    }
+    _size += size;
+    return true;
+}
+
+} // namespace Backend
+} // namespace Afina
@@ -0,0 +1,159 @@
+#ifndef AFINA_STORAGE_CLOCK_RW_LOCK_IMPL_H
+#define AFINA_STORAGE_CLOCK_RW_LOCK_IMPL_H
+
+#include <atomic>
+#include <cstring>
+#include <string>
+
+#include <afina/Storage.h>
+
+#include "FlatIndex.h"
+#include "Hash.h"
+#include "SharedMutex.h"
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Read scalable implementation with CLOCK eviction
+ * Strict LRU requires every hit to relink the list, so even Get needs an exclusive lock. Here LRU is
+ * approximated by CLOCK: hit only sets reference bit of the entry, and the clock hand walking over index slots
+ * evicts first entry whose bit is clear, clearing bits it passes by. Get never changes the structure, so it
+ * runs under shared lock and readers never block each other. Modifications take exclusive lock.
+ *
+ * First incr/decr turns value into native counter under exclusive lock, after that counter is updated by atomic
+ * operations under shared lock, so hot counter doesn't serialize its writers on the lock.
+ */
+class ClockRWLockImpl : public Afina::Storage {
+public:
+    ClockRWLockImpl(size_t max_size = 1024) : _max_size(max_size), _size(0), _hand(0), _version(0), _evictions(0) {}
+    ~ClockRWLockImpl();
+
+    // Implements Afina::Storage interface
+    bool Put(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool PutIfAbsent(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Set(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Append(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Prepend(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Increment(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Decrement(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Delete(const std::string &key) override;
+
+    // Implements Afina::Storage interface
+    bool Get(const std::string &key, std::string &value) const override;
+
+    // Implements Afina::Storage interface
+    size_t GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const override;
+
+    // Implements Afina::Storage interface
+    size_t Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                std::vector<uint64_t> &versions) const override;
+
+    // Implements Afina::Storage interface
+    CasResult Cas(const std::string &key, const std::string &value, uint64_t version, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    size_t Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                const std::vector<time_t> &expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const override;
+
+    // Implements Afina::Storage interface
+    void Freeze(const std::function<void()> &f) override;
+
+    // Implements Afina::Storage interface
+    void ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const override;
+
+    // Implements Afina::Storage interface
+    void GetStats(std::vector<std::pair<std::string, std::string>> &stats) const override;
+
+private:
+    struct Entry {
+        Entry(const std::string &k, const std::string &v)
+            : key(k), value(v), referenced(false), number(0), counter(false), version(0) {}
+
+        // Value as client sees it
+        std::string text() const {
+            return counter ? std::to_string(number.load(std::memory_order_relaxed)) : value;
+        }
+
+        std::string key;
+
+        // Text of the value. Once entry becomes counter it keeps the text it had, entry is accounted by its size
+        std::string value;
+
+        // Set on access, cleared by the clock hand. Written by readers, so must be atomic
+        std::atomic<bool> referenced;
+
+        // Value of the counter, updated by incr/decr under shared lock
+        std::atomic<uint64_t> number;
+
+        // Set if number is the actual value, changed under exclusive lock only
+        bool counter;
+
+        // CAS version, bumped after the value is changed, so it is never newer than the value next to it
+        std::atomic<uint64_t> version;
+    };
+
+    struct EntryTraits {
+        static uint64_t Hash(const Entry *entry) { return Backend::Hash(entry->key.data(), entry->key.size()); }
+        static bool Equals(const Entry *entry, const char *key, size_t size) {
+            return entry->key.size() == size && std::memcmp(entry->key.data(), key, size) == 0;
+        }
+    };
+
+    size_t _max_size;
+    size_t _size;
+
+    // Index slot clock hand points to
+    size_t _hand;
+
+    // Last version assigned to an entry, counters take versions under shared lock
+    std::atomic<uint64_t> _version;
+
+    size_t _evictions;
+
+    mutable SharedMutex _lock;
+    FlatIndex<Entry, EntryTraits> _index;
+
+    // Assigns new version to the entry once its value has been changed
+    void bump(Entry *entry);
+
+    // Looks up batch of keys, versions are filled in if given
+    size_t get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values, uint64_t *versions) const;
+
+    // Replaces value of the existing entry
+    bool update(Entry *entry, const std::string &value);
+
+    // Adds data to the value of existing entry, to the beginning if front is set
+    bool extend(const std::string &key, const std::string &data, bool front);
+
+    // Applies incr/decr to the value of existing key
+    bool change(const std::string &key, uint64_t delta, bool decrement, uint64_t &result);
+
+    // Adds new entry for the given key, key must be absent
+    bool insert(uint64_t hash, const std::string &key, const std::string &value);
+
+    // Evicts entries until there is enough space for the new one, given entry is never evicted
+    bool free_space(size_t size, const Entry *keep);
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_CLOCK_RW_LOCK_IMPL_H
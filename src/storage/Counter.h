@@ -0,0 +1,47 @@
+#ifndef AFINA_STORAGE_COUNTER_H
+#define AFINA_STORAGE_COUNTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * Parses value incr/decr is applied to, same as memcached it must be decimal unsigned 64-bit number. Throws
+ * std::invalid_argument otherwise
+ */
+inline uint64_t ParseCounter(const char *data, size_t size) {
+    if (size == 0) {
+        throw std::invalid_argument("cannot increment or decrement non-numeric value");
+    }
+
+    uint64_t result = 0;
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] < '0' || data[i] > '9') {
+            throw std::invalid_argument("cannot increment or decrement non-numeric value");
+        }
+        uint64_t next = result * 10 + uint64_t(data[i] - '0');
+        if (result > UINT64_MAX / 10 || next < result * 10) {
+            throw std::invalid_argument("cannot increment or decrement non-numeric value");
+        }
+        result = next;
+    }
+    return result;
+}
+
+/**
+ * Result of incr/decr: incr wraps around at 2^64, decr stops at 0
+ */
+inline uint64_t ApplyDelta(uint64_t value, uint64_t delta, bool decrement) {
+    if (decrement) {
+        return value > delta ? value - delta : 0;
+    }
+    return value + delta;
+}
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_COUNTER_H
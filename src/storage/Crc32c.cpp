@@ -0,0 +1,54 @@
+#include "Crc32c.h"
+
+#include <cstring>
+
+namespace Afina {
+namespace Backend {
+
+// Reflected Castagnoli polynomial
+static const uint32_t Polynomial = 0x82f63b78;
+
+// Table k gives checksum of a byte followed by k zero bytes, so 8 bytes are folded by 8 independent lookups
+struct Tables {
+    uint32_t t[8][256];
+
+    Tables() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t crc = i;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (crc & 1 ? Polynomial : 0);
+            }
+            t[0][i] = crc;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) {
+                t[k][i] = (t[k - 1][i] >> 8) ^ t[0][t[k - 1][i] & 0xff];
+            }
+        }
+    }
+};
+
+static const Tables tables;
+
+// Words are read as little endian, the same way they are laid out on x86 and ARM
+uint32_t Crc32c(const void *data, size_t size, uint32_t crc) {
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    const uint32_t(*t)[256] = tables.t;
+    crc = ~crc;
+
+    for (; size >= 8; size -= 8, p += 8) {
+        uint64_t word;
+        std::memcpy(&word, p, sizeof(word));
+        word ^= crc;
+        crc = t[7][word & 0xff] ^ t[6][(word >> 8) & 0xff] ^ t[5][(word >> 16) & 0xff] ^
+              t[4][(word >> 24) & 0xff] ^ t[3][(word >> 32) & 0xff] ^ t[2][(word >> 40) & 0xff] ^
+              t[1][(word >> 48) & 0xff] ^ t[0][word >> 56];
+    }
+    for (; size > 0; size--, p++) {
+        crc = (crc >> 8) ^ t[0][(crc ^ *p) & 0xff];
+    }
+    return ~crc;
+}
+
+} // namespace Backend
+} // namespace Afina
@@ -0,0 +1,20 @@
+#ifndef AFINA_STORAGE_CRC32C_H
+#define AFINA_STORAGE_CRC32C_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * CRC-32C (Castagnoli) of raw bytes, the one used by iSCSI, ext4 and most storage formats. Computed by
+ * slicing-by-8 tables, so checksums of on-disk data cost about a byte per cycle. Pass checksum of previous
+ * part as crc to continue it
+ */
+uint32_t Crc32c(const void *data, size_t size, uint32_t crc = 0);
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_CRC32C_H
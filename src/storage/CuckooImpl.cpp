@@ -0,0 +1,637 @@
+#include "CuckooImpl.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/mman.h>
+
+#include "Counter.h"
+#include "Hash.h"
+
+namespace Afina {
+namespace Backend {
+
+const size_t CuckooImpl::Slots;
+const size_t CuckooImpl::MaxSearch;
+
+// Times insert looks for a cuckoo path before it evicts from candidate buckets
+static const size_t RoomAttempts = 4;
+
+// Same as for SlabImpl, address space is reserved without committing memory
+static void *map_arena(size_t size) {
+    void *arena = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena == MAP_FAILED) {
+        throw std::runtime_error("Failed to mmap cuckoo arena");
+    }
+    return arena;
+}
+
+// Table has a slot per 128 bytes of the budget, which is more than enough unless items are tiny, and those
+// that don't fit are evicted from the table instead
+CuckooImpl::CuckooImpl(size_t max_size, size_t page_size)
+    : _arena_size(max_size), _arena(static_cast<char *>(map_arena(max_size))),
+      _slab(_arena, max_size, 64, 1.25, page_size), _evictions(0), _reassigned(0), _buckets(nullptr), _mask(0), _version(0),
+      _items(0), _size(0), _displacements(0), _table_evictions(0) {
+    _classes.resize(_slab.classes());
+
+    size_t buckets = 2;
+    while (buckets * Slots * 128 < max_size) {
+        buckets *= 2;
+    }
+
+    void *mem = nullptr;
+    if (posix_memalign(&mem, alignof(Bucket), buckets * sizeof(Bucket)) != 0) {
+        munmap(_arena, _arena_size);
+        throw std::bad_alloc();
+    }
+    _buckets = static_cast<Bucket *>(mem);
+    for (size_t b = 0; b < buckets; b++) {
+        Bucket *bucket = new (&_buckets[b]) Bucket();
+        bucket->version.store(0);
+        for (size_t s = 0; s < Slots; s++) {
+            bucket->tags[s].store(0);
+            bucket->items[s].store(nullptr);
+        }
+    }
+    _mask = buckets - 1;
+}
+
+// Items live in the arena, so there is nothing to free one by one
+CuckooImpl::~CuckooImpl() {
+    std::free(_buckets);
+    munmap(_arena, _arena_size);
+}
+
+// Existing item is updated in place if new value fits, otherwise new one is linked instead
+bool CuckooImpl::Put(const std::string &key, const std::string &value) {
+    CasResult result = modify(key, [&value](const Item *, std::string &out) {
+        out = value;
+        return true;
+    });
+    if (result != CasResult::NotFound) {
+        return result == CasResult::Stored;
+    }
+
+    Item *fresh = allocate(Hash(key.data(), key.size()), key, value);
+    return fresh != nullptr && link(fresh, true);
+}
+
+// Key is checked optimistically first, so that existing one doesn't cost an allocation
+bool CuckooImpl::PutIfAbsent(const std::string &key, const std::string &value) {
+    uint64_t hash = Hash(key.data(), key.size());
+    if (read(hash, key, nullptr, nullptr)) {
+        return false;
+    }
+
+    Item *fresh = allocate(hash, key, value);
+    return fresh != nullptr && link(fresh, false);
+}
+
+// See CuckooImpl.h
+bool CuckooImpl::Set(const std::string &key, const std::string &value) {
+    return modify(key, [&value](const Item *, std::string &out) {
+        out = value;
+        return true;
+    }) == CasResult::Stored;
+}
+
+// See CuckooImpl.h
+bool CuckooImpl::Append(const std::string &key, const std::string &data) {
+    return modify(key, [&data](const Item *item, std::string &out) {
+        out.assign(item->value(), item->value_size);
+        out.append(data);
+        return true;
+    }) == CasResult::Stored;
+}
+
+// See CuckooImpl.h
+bool CuckooImpl::Prepend(const std::string &key, const std::string &data) {
+    return modify(key, [&data](const Item *item, std::string &out) {
+        out = data;
+        out.append(item->value(), item->value_size);
+        return true;
+    }) == CasResult::Stored;
+}
+
+// Counters are kept as text, readers copy value bytes as they are
+bool CuckooImpl::Increment(const std::string &key, uint64_t delta, uint64_t &result) {
+    return modify(key, [delta, &result](const Item *item, std::string &out) {
+        result = ApplyDelta(ParseCounter(item->value(), item->value_size), delta, false);
+        out = std::to_string(result);
+        return true;
+    }) == CasResult::Stored;
+}
+
+// See CuckooImpl.h
+bool CuckooImpl::Decrement(const std::string &key, uint64_t delta, uint64_t &result) {
+    return modify(key, [delta, &result](const Item *item, std::string &out) {
+        result = ApplyDelta(ParseCounter(item->value(), item->value_size), delta, true);
+        out = std::to_string(result);
+        return true;
+    }) == CasResult::Stored;
+}
+
+// See CuckooImpl.h
+bool CuckooImpl::Delete(const std::string &key) {
+    uint64_t hash = Hash(key.data(), key.size());
+    Item *item;
+    {
+        Locked guard(*this, first_bucket(hash), second_bucket(hash));
+        Slot found = locate(hash, key);
+        if (found.item == nullptr) {
+            return false;
+        }
+        item = found.item;
+        _buckets[found.bucket].items[found.slot].store(nullptr, std::memory_order_relaxed);
+        _items--;
+        _size -= item->Size();
+    }
+    release(item);
+    return true;
+}
+
+// See CuckooImpl.h
+bool CuckooImpl::Get(const std::string &key, std::string &value) const {
+    return read(Hash(key.data(), key.size()), key, &value, nullptr);
+}
+
+// See CuckooImpl.h
+size_t CuckooImpl::GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const {
+    return get_many(keys, values, nullptr);
+}
+
+// See CuckooImpl.h
+size_t CuckooImpl::Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                        std::vector<uint64_t> &versions) const {
+    versions.assign(keys.size(), 0);
+    return get_many(keys, values, versions.data());
+}
+
+// Expiration is not supported by this storage, so it is ignored as in other TTL overloads
+Storage::CasResult CuckooImpl::Cas(const std::string &key, const std::string &value, uint64_t version,
+                                   time_t expire_at) {
+    return modify(key, [&value, version](const Item *item, std::string &out) {
+        if (item->version != version) {
+            return false;
+        }
+        out = value;
+        return true;
+    });
+}
+
+// See CuckooImpl.h
+size_t CuckooImpl::Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                        const std::vector<time_t> &expire_at) {
+    size_t stored = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (PutIfAbsent(keys[i], values[i])) {
+            stored++;
+        }
+    }
+    return stored;
+}
+
+// Allocation lock goes first, then buckets in index order, same as every writer takes them
+void CuckooImpl::Freeze(const std::function<void()> &f) {
+    std::unique_lock<std::mutex> guard(_alloc_lock);
+    for (size_t b = 0; b <= _mask; b++) {
+        lock(b);
+    }
+
+    try {
+        f();
+    } catch (...) {
+        for (size_t b = 0; b <= _mask; b++) {
+            unlock(b);
+        }
+        throw;
+    }
+    for (size_t b = 0; b <= _mask; b++) {
+        unlock(b);
+    }
+}
+
+// Items go in table order, there is no access order to keep
+void CuckooImpl::ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const {
+    for (size_t b = 0; b <= _mask; b++) {
+        for (size_t s = 0; s < Slots; s++) {
+            const Item *item = _buckets[b].items[s].load(std::memory_order_relaxed);
+            if (item != nullptr) {
+                f(std::string(item->key(), item->key_size), std::string(item->value(), item->value_size), 0);
+            }
+        }
+    }
+}
+
+// See CuckooImpl.h
+void CuckooImpl::GetStats(std::vector<std::pair<std::string, std::string>> &stats) const {
+    stats.emplace_back("curr_items", std::to_string(_items.load()));
+    stats.emplace_back("bytes", std::to_string(_size.load()));
+    stats.emplace_back("limit_maxbytes", std::to_string(_arena_size));
+    {
+        std::unique_lock<std::mutex> guard(_alloc_lock);
+        stats.emplace_back("evictions", std::to_string(_evictions));
+        stats.emplace_back("slabs_moved", std::to_string(_reassigned));
+    }
+    stats.emplace_back("table_evictions", std::to_string(_table_evictions.load()));
+    stats.emplace_back("displacements", std::to_string(_displacements.load()));
+    stats.emplace_back("table_slots", std::to_string((_mask + 1) * Slots));
+}
+
+// See CuckooImpl.h
+CuckooImpl::Locked::Locked(const CuckooImpl &storage, size_t a, size_t b)
+    : _storage(storage), _first(std::min(a, b)), _second(std::max(a, b)) {
+    _storage.lock(_first);
+    if (_second != _first) {
+        _storage.lock(_second);
+    }
+}
+
+// See CuckooImpl.h
+CuckooImpl::Locked::~Locked() {
+    if (_second != _first) {
+        _storage.unlock(_second);
+    }
+    _storage.unlock(_first);
+}
+
+// Fence keeps stores made under the lock from becoming visible before the odd version does
+void CuckooImpl::lock(size_t b) const {
+    std::atomic<uint32_t> &version = _buckets[b].version;
+    uint32_t seen = version.load(std::memory_order_relaxed);
+    while ((seen & 1) != 0 || !version.compare_exchange_weak(seen, seen + 1, std::memory_order_acquire)) {
+        std::this_thread::yield();
+        seen = version.load(std::memory_order_relaxed);
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+// See CuckooImpl.h
+void CuckooImpl::unlock(size_t b) const { _buckets[b].version.fetch_add(1, std::memory_order_release); }
+
+// Item could be freed and reused while it is being copied, so its header is trusted only as far as it keeps
+// reads inside the arena. Whatever was read is thrown away unless both versions stay the same, and every unlink
+// or move changes version of the bucket item was taken from
+bool CuckooImpl::read(uint64_t hash, const std::string &key, std::string *value, uint64_t *version) const {
+    const Bucket *buckets[] = {&_buckets[first_bucket(hash)], &_buckets[second_bucket(hash)]};
+    const char *arena_end = _arena + _arena_size;
+    uint8_t t = tag(hash);
+
+    for (;;) {
+        uint32_t seen[2];
+        for (int i = 0; i < 2; i++) {
+            while (((seen[i] = buckets[i]->version.load(std::memory_order_acquire)) & 1) != 0) {
+                std::this_thread::yield();
+            }
+        }
+
+        bool found = false, torn = false;
+        for (int i = 0; i < 2 && !found && !torn; i++) {
+            for (size_t s = 0; s < Slots; s++) {
+                if (buckets[i]->tags[s].load(std::memory_order_relaxed) != t) {
+                    continue;
+                }
+                const Item *item = buckets[i]->items[s].load(std::memory_order_relaxed);
+                if (item == nullptr || item->key_size != key.size() ||
+                    size_t(arena_end - item->key()) < key.size() ||
+                    std::memcmp(item->key(), key.data(), key.size()) != 0) {
+                    continue;
+                }
+
+                const char *data = item->key() + key.size();
+                size_t size = item->value_size;
+                if (size_t(arena_end - data) < size) {
+                    torn = true;
+                    break;
+                }
+                if (value != nullptr) {
+                    value->assign(data, size);
+                }
+                if (version != nullptr) {
+                    *version = item->version;
+                }
+                found = true;
+                break;
+            }
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (!torn && buckets[0]->version.load(std::memory_order_relaxed) == seen[0] &&
+            buckets[1]->version.load(std::memory_order_relaxed) == seen[1]) {
+            return found;
+        }
+    }
+}
+
+// See CuckooImpl.h
+size_t CuckooImpl::get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                            uint64_t *versions) const {
+    values.clear();
+    values.resize(keys.size());
+
+    size_t found = 0;
+    std::string value;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (read(Hash(keys[i].data(), keys[i].size()), keys[i], &value, versions != nullptr ? &versions[i] : nullptr)) {
+            values[i] = ValueRef(std::move(value));
+            found++;
+        }
+    }
+    return found;
+}
+
+// See CuckooImpl.h
+CuckooImpl::Slot CuckooImpl::locate(uint64_t hash, const std::string &key) const {
+    for (size_t b : {first_bucket(hash), second_bucket(hash)}) {
+        for (size_t s = 0; s < Slots; s++) {
+            Item *item = _buckets[b].items[s].load(std::memory_order_relaxed);
+            if (item != nullptr && item->Equals(key.data(), key.size())) {
+                return Slot{b, s, item};
+            }
+        }
+    }
+    return Slot{0, 0, nullptr};
+}
+
+// See CuckooImpl.h
+void CuckooImpl::place(size_t b, size_t s, Item *item) {
+    _buckets[b].tags[s].store(tag(item->hash), std::memory_order_relaxed);
+    _buckets[b].items[s].store(item, std::memory_order_relaxed);
+}
+
+// Allocation can't happen under bucket lock, so value that outgrows the item is built first, then item is
+// reallocated and swapped in unless it was changed meanwhile, otherwise the whole thing is retried. Versions are
+// never reused, so item changed or freed and reused meanwhile is told apart by version
+Storage::CasResult CuckooImpl::modify(const std::string &key,
+                                      const std::function<bool(const Item *, std::string &)> &f) {
+    uint64_t hash = Hash(key.data(), key.size());
+    std::string value;
+    for (;;) {
+        Item *seen;
+        uint64_t seen_version;
+        {
+            Locked guard(*this, first_bucket(hash), second_bucket(hash));
+            Slot found = locate(hash, key);
+            if (found.item == nullptr) {
+                return CasResult::NotFound;
+            } else if (!f(found.item, value)) {
+                return CasResult::Exists;
+            }
+
+            seen = found.item;
+            if (value.size() <= seen->capacity) {
+                _size += value.size() - seen->value_size;
+                seen->Assign(value.data(), value.size());
+                seen->version = ++_version;
+                return CasResult::Stored;
+            }
+            seen_version = seen->version;
+        }
+
+        Item *fresh = allocate(hash, key, value);
+        if (fresh == nullptr) {
+            return CasResult::NotStored;
+        }
+
+        bool swapped = false;
+        {
+            Locked guard(*this, first_bucket(hash), second_bucket(hash));
+            Slot found = locate(hash, key);
+            if (found.item == seen && seen->version == seen_version) {
+                fresh->version = ++_version;
+                place(found.bucket, found.slot, fresh);
+                _size += fresh->Size() - seen->Size();
+                swapped = true;
+            }
+        }
+
+        release(swapped ? seen : fresh);
+        if (swapped) {
+            return CasResult::Stored;
+        }
+    }
+}
+
+// Once paths keep failing, the oldest of the items in both candidate buckets gives its slot away
+bool CuckooImpl::link(Item *fresh, bool replace) {
+    uint64_t hash = fresh->hash;
+    size_t buckets[] = {first_bucket(hash), second_bucket(hash)};
+    std::string key(fresh->key(), fresh->key_size);
+
+    for (size_t attempt = 0;; attempt++) {
+        Item *old = nullptr;
+        bool linked = false;
+        {
+            Locked guard(*this, buckets[0], buckets[1]);
+            Slot found = locate(hash, key);
+            if (found.item != nullptr) {
+                if (!replace) {
+                    old = fresh;
+                } else {
+                    old = found.item;
+                    fresh->version = ++_version;
+                    place(found.bucket, found.slot, fresh);
+                    _size += fresh->Size() - old->Size();
+                    linked = true;
+                }
+            } else {
+                Slot victim{0, 0, nullptr};
+                for (size_t b : buckets) {
+                    for (size_t s = 0; s < Slots && !linked; s++) {
+                        Item *item = _buckets[b].items[s].load(std::memory_order_relaxed);
+                        if (item == nullptr) {
+                            fresh->version = ++_version;
+                            place(b, s, fresh);
+                            _items++;
+                            _size += fresh->Size();
+                            linked = true;
+                        } else if (victim.item == nullptr || item->version < victim.item->version) {
+                            victim = Slot{b, s, item};
+                        }
+                    }
+                }
+
+                if (!linked && attempt == RoomAttempts) {
+                    old = victim.item;
+                    fresh->version = ++_version;
+                    place(victim.bucket, victim.slot, fresh);
+                    _size += fresh->Size() - old->Size();
+                    _table_evictions++;
+                    linked = true;
+                }
+            }
+        }
+
+        if (old != nullptr) {
+            release(old);
+        }
+        if (linked || old == fresh) {
+            return linked;
+        }
+        if (!make_room(hash)) {
+            attempt = RoomAttempts - 1;
+        }
+    }
+}
+
+// Search reads buckets without locks, as readers do, but nothing found is trusted: each move along the path
+// is checked again under locks of both buckets it touches. Moves are done from the free end of the path, so
+// item is never out of the table: it is written into the new slot before the old one is cleared
+bool CuckooImpl::make_room(uint64_t hash) {
+    struct Node {
+        size_t bucket;
+
+        // Node whose bucket holds the item that moves to this bucket, and the slot of the item there
+        size_t parent;
+        size_t slot;
+    };
+    const size_t root = size_t(-1);
+
+    std::vector<Node> queue;
+    queue.reserve(MaxSearch);
+    queue.push_back(Node{first_bucket(hash), root, 0});
+    queue.push_back(Node{second_bucket(hash), root, 0});
+
+    for (size_t i = 0; i < queue.size(); i++) {
+        const Bucket &bucket = _buckets[queue[i].bucket];
+        size_t free = Slots;
+        for (size_t s = 0; s < Slots && free == Slots; s++) {
+            if (bucket.items[s].load(std::memory_order_relaxed) == nullptr) {
+                free = s;
+            }
+        }
+
+        if (free == Slots) {
+            for (size_t s = 0; s < Slots && queue.size() < MaxSearch; s++) {
+                const Item *item = bucket.items[s].load(std::memory_order_relaxed);
+                if (item != nullptr) {
+                    queue.push_back(Node{other_bucket(item->hash, queue[i].bucket), i, s});
+                }
+            }
+            continue;
+        }
+
+        for (size_t n = i; queue[n].parent != root; n = queue[n].parent) {
+            size_t from = queue[queue[n].parent].bucket, to = queue[n].bucket;
+            Locked guard(*this, from, to);
+
+            Item *item = _buckets[from].items[queue[n].slot].load(std::memory_order_relaxed);
+            if (item == nullptr || _buckets[to].items[free].load(std::memory_order_relaxed) != nullptr ||
+                other_bucket(item->hash, from) != to) {
+                return false;
+            }
+            place(to, free, item);
+            _buckets[from].items[queue[n].slot].store(nullptr, std::memory_order_relaxed);
+            _displacements++;
+            free = queue[n].slot;
+        }
+        return true;
+    }
+    return false;
+}
+
+// Items being linked or released by other writers are in the list but not in the table, they are skipped
+Item *CuckooImpl::allocate(uint64_t hash, const std::string &key, const std::string &value) {
+    size_t need = Item::AllocSize(key.size(), value.size());
+    if (need > _slab.chunk_size(_slab.classes() - 1)) {
+        return nullptr;
+    }
+
+    std::unique_lock<std::mutex> guard(_alloc_lock);
+    unsigned cls = _slab.class_for(need);
+    ItemList &list = _classes[cls];
+
+    void *mem;
+    while ((mem = _slab.alloc(cls)) == nullptr) {
+        Item *victim = list.back();
+        while (victim != nullptr && !unlink(victim)) {
+            victim = victim->prev;
+        }
+        if (victim == nullptr) {
+            if (list.back() != nullptr || !reassign(cls)) {
+                return nullptr;
+            }
+            continue;
+        }
+        list.erase(victim);
+        victim->flags &= ~Item::Allocated;
+        _slab.free(cls, victim);
+        _evictions++;
+    }
+
+    // Whole chunk is given to the item, slack after value could be used by later updates
+    size_t capacity = _slab.chunk_size(cls) - sizeof(Item) - key.size();
+    Item *item = Item::Init(mem, hash, key.data(), key.size(), value.data(), value.size(), capacity);
+    item->flags |= Item::Allocated;
+    list.push_front(item);
+    return item;
+}
+
+// Item versions are written under bucket locks, so donor is picked by page count rather than by age of its items.
+// Page is walked chunk by chunk, every chunk in use holds an item of the donor list. Items of the page that are
+// unlinked before a busy one is met stay evicted, the page is then taken next time
+bool CuckooImpl::reassign(unsigned cls) {
+    unsigned donor = cls;
+    for (unsigned i = 0; i < _classes.size(); i++) {
+        if (i != cls && _classes[i].back() != nullptr &&
+            (donor == cls || _slab.stats(i).pages > _slab.stats(donor).pages)) {
+            donor = i;
+        }
+    }
+    if (donor == cls) {
+        return false;
+    }
+
+    ItemList &list = _classes[donor];
+    size_t page = _slab.page_of(list.back());
+    char *begin = static_cast<char *>(_slab.page_begin(page));
+    size_t chunk_size = _slab.chunk_size(donor);
+    size_t chunks = _slab.page_chunks(page);
+    for (size_t i = 0; i < chunks; i++) {
+        Item *item = reinterpret_cast<Item *>(begin + i * chunk_size);
+        if (item->flags & Item::Allocated) {
+            if (!unlink(item)) {
+                return false;
+            }
+            list.erase(item);
+            item->flags &= ~Item::Allocated;
+            _slab.free(donor, item);
+            _evictions++;
+        }
+    }
+    _slab.release(page);
+    _reassigned++;
+    return true;
+}
+
+// See CuckooImpl.h
+bool CuckooImpl::unlink(Item *item) {
+    size_t buckets[] = {first_bucket(item->hash), second_bucket(item->hash)};
+    Locked guard(*this, buckets[0], buckets[1]);
+    for (size_t b : buckets) {
+        for (size_t s = 0; s < Slots; s++) {
+            if (_buckets[b].items[s].load(std::memory_order_relaxed) == item) {
+                _buckets[b].items[s].store(nullptr, std::memory_order_relaxed);
+                _items--;
+                _size -= item->Size();
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// See CuckooImpl.h
+void CuckooImpl::release(Item *item) {
+    std::unique_lock<std::mutex> guard(_alloc_lock);
+    unsigned cls = class_of(item);
+    _classes[cls].erase(item);
+    item->flags &= ~Item::Allocated;
+    _slab.free(cls, item);
+}
+
+} // namespace Backend
+} // namespace Afina
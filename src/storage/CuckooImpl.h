@@ -0,0 +1,219 @@
+#ifndef AFINA_STORAGE_CUCKOO_IMPL_H
+#define AFINA_STORAGE_CUCKOO_IMPL_H
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <afina/Storage.h>
+#include <afina/allocator/Slab.h>
+
+#include "Item.h"
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Bucketized cuckoo hash with optimistic reads
+ * Each key has two candidate buckets of four slots. Insert that finds both of them full moves entries along a
+ * path of alternative buckets, found by breadth first search, until there is a free slot, same as MemC3 and
+ * libcuckoo do. So lookup never touches more than two buckets, whatever the load is.
+ *
+ * Reads never write shared memory. Every bucket has version counter that is odd while writer holds the bucket:
+ * reader takes versions of both buckets, looks the key up and copies value out, then checks versions once more
+ * and starts over if any of them changed. Writers lock only buckets they change, by the same counters, two at
+ * a time and always in index order, so writes to different buckets go in parallel.
+ *
+ * Reader could copy an item that is being freed at the same moment, that is why items live in chunks of
+ * Allocator::Slab over memory area that is never unmapped while storage is alive: reused chunk is garbage at
+ * worst, copying is bounded by the area, and the garbage is thrown away since unlink bumps the bucket version.
+ * Slab and eviction lists are guarded by a separate mutex, taken by writers before any bucket lock.
+ *
+ * Readers can't track accesses, so once slab class runs out of chunks the oldest item of the class is evicted,
+ * in order of writes. Class that has nothing to evict takes a page from the class holding the most pages, all
+ * items of the page with its oldest item are evicted. Table is sized up front for the memory budget and never grows: if no path to a free slot
+ * is found, the oldest item of two candidate buckets is evicted instead. Entries move between buckets behind
+ * any cursor, so scan is not supported. Expiration is not supported.
+ */
+class CuckooImpl : public Afina::Storage {
+public:
+    static const size_t Slots = 4;
+
+    // Buckets breadth first search of the cuckoo path visits before giving up
+    static const size_t MaxSearch = 256;
+
+    CuckooImpl(size_t max_size = 64 * 1024 * 1024, size_t page_size = 1024 * 1024);
+    ~CuckooImpl();
+
+    // Implements Afina::Storage interface
+    bool Put(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool PutIfAbsent(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Set(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Append(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Prepend(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Increment(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Decrement(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Delete(const std::string &key) override;
+
+    // Implements Afina::Storage interface
+    bool Get(const std::string &key, std::string &value) const override;
+
+    // Implements Afina::Storage interface
+    size_t GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const override;
+
+    // Implements Afina::Storage interface
+    size_t Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                std::vector<uint64_t> &versions) const override;
+
+    // Implements Afina::Storage interface
+    CasResult Cas(const std::string &key, const std::string &value, uint64_t version, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    size_t Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                const std::vector<time_t> &expire_at) override;
+
+    // Implements Afina::Storage interface
+    void Freeze(const std::function<void()> &f) override;
+
+    // Implements Afina::Storage interface
+    void ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const override;
+
+    // Implements Afina::Storage interface
+    void GetStats(std::vector<std::pair<std::string, std::string>> &stats) const override;
+
+private:
+    struct alignas(64) Bucket {
+        // Even while bucket is free, odd while writer holds it
+        std::atomic<uint32_t> version;
+
+        // Top byte of the key hash for each slot, so that most of mismatching items are not even touched
+        std::atomic<uint8_t> tags[Slots];
+
+        // Items, nullptr for free slot
+        std::atomic<Item *> items[Slots];
+    };
+
+    // Position of the item in the table
+    struct Slot {
+        size_t bucket;
+        size_t slot;
+        Item *item;
+    };
+
+    // Holds both candidate buckets of the hash locked
+    class Locked {
+    public:
+        Locked(const CuckooImpl &storage, size_t a, size_t b);
+        ~Locked();
+
+        Locked(const Locked &) = delete;
+        Locked &operator=(const Locked &) = delete;
+
+    private:
+        const CuckooImpl &_storage;
+        size_t _first, _second;
+    };
+
+    // Memory area all items are allocated from
+    size_t _arena_size;
+    char *_arena;
+
+    // Guards slab and eviction lists, never taken while bucket is held
+    mutable std::mutex _alloc_lock;
+    Allocator::Slab _slab;
+    std::vector<ItemList> _classes;
+    size_t _evictions;
+    size_t _reassigned;
+
+    Bucket *_buckets;
+    size_t _mask;
+
+    // Updated by writers holding different buckets
+    std::atomic<uint64_t> _version;
+    std::atomic<size_t> _items;
+    std::atomic<size_t> _size;
+    std::atomic<size_t> _displacements;
+    std::atomic<size_t> _table_evictions;
+
+    // Candidate buckets of the hash
+    size_t first_bucket(uint64_t hash) const { return hash & _mask; }
+    size_t second_bucket(uint64_t hash) const {
+        size_t b = (hash >> 32) & _mask;
+        return b != first_bucket(hash) ? b : (b + 1) & _mask;
+    }
+
+    // Candidate bucket of the hash that is not the given one
+    size_t other_bucket(uint64_t hash, size_t b) const {
+        return b == first_bucket(hash) ? second_bucket(hash) : first_bucket(hash);
+    }
+
+    static uint8_t tag(uint64_t hash) { return uint8_t(hash >> 56); }
+
+    // Writer side of bucket versions
+    void lock(size_t b) const;
+    void unlock(size_t b) const;
+
+    // Looks key up optimistically, copies value and version out if they are given. Returns false if key is absent
+    bool read(uint64_t hash, const std::string &key, std::string *value, uint64_t *version) const;
+
+    // Looks up batch of keys, versions are filled in if given
+    size_t get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values, uint64_t *versions) const;
+
+    // Finds item of the key in its buckets, which must be locked. Slot item is nullptr if there is no such
+    Slot locate(uint64_t hash, const std::string &key) const;
+
+    // Puts item into the slot, bucket must be locked
+    void place(size_t b, size_t s, Item *item);
+
+    // Replaces value of the existing key by the one f makes out of the current item, in place if it fits. Returns
+    // Exists if f refuses to change the item
+    CasResult modify(const std::string &key, const std::function<bool(const Item *, std::string &)> &f);
+
+    // Links new item into the table, replacing item of the same key if replace is set. Item is released if it is
+    // not linked
+    bool link(Item *fresh, bool replace);
+
+    // Moves items along a path of alternative buckets, so that one of candidate buckets of the hash has a free
+    // slot. Returns false if no path is found or table changed under the path
+    bool make_room(uint64_t hash);
+
+    // Allocates and initializes new item, evicting oldest items of the same class if needed. Returns nullptr if
+    // item is larger than a page or no memory could be freed for it
+    Item *allocate(uint64_t hash, const std::string &key, const std::string &value);
+
+    // Evicts all items of a page of some class other than cls and releases the page, alloc lock must be held.
+    // Returns false if there is no such page or some of its items are being linked or released by other writers
+    bool reassign(unsigned cls);
+
+    // Takes item out of the table if it is still there, alloc lock must be held
+    bool unlink(Item *item);
+
+    // Returns chunk of the item that is not in the table to the allocator
+    void release(Item *item);
+
+    // Slab class item was allocated from
+    unsigned class_of(const Item *item) const {
+        return _slab.class_for(Item::AllocSize(item->key_size, item->capacity));
+    }
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_CUCKOO_IMPL_H
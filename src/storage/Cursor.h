@@ -0,0 +1,98 @@
+#ifndef AFINA_STORAGE_CURSOR_H
+#define AFINA_STORAGE_CURSOR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <afina/Storage.h>
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * Cursor of hash based storages is a position in the table written as decimal number.
+ * Throws std::invalid_argument if cursor is not a number
+ */
+inline uint64_t ParsePosition(const std::string &cursor) {
+    if (cursor.empty() || cursor.size() > 20) {
+        throw std::invalid_argument("bad cursor");
+    }
+    uint64_t result = 0;
+    for (char c : cursor) {
+        if (c < '0' || c > '9' || result > (UINT64_MAX - (c - '0')) / 10) {
+            throw std::invalid_argument("bad cursor");
+        }
+        result = result * 10 + (c - '0');
+    }
+    return result;
+}
+
+/**
+ * Cursor of ordered storages is the last key taken. It is hex encoded, so that it is a single token of the text
+ * protocol whatever bytes the key has, and it is prefixed, so that it never equals to "0"
+ */
+inline std::string KeyCursor(const std::string &key) {
+    static const char digits[] = "0123456789abcdef";
+    std::string result = "k";
+    result.reserve(1 + 2 * key.size());
+    for (unsigned char c : key) {
+        result.push_back(digits[c >> 4]);
+        result.push_back(digits[c & 0xf]);
+    }
+    return result;
+}
+
+/**
+ * Key the cursor made by KeyCursor stands for. Throws std::invalid_argument if cursor is malformed
+ */
+inline std::string CursorKey(const std::string &cursor) {
+    if (cursor.empty() || cursor[0] != 'k' || cursor.size() % 2 != 1) {
+        throw std::invalid_argument("bad cursor");
+    }
+
+    auto digit = [](char c) {
+        if (c >= '0' && c <= '9') {
+            return c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            return c - 'a' + 10;
+        }
+        throw std::invalid_argument("bad cursor");
+    };
+
+    std::string result;
+    result.reserve(cursor.size() / 2);
+    for (size_t i = 1; i < cursor.size(); i += 2) {
+        result.push_back(char(digit(cursor[i]) << 4 | digit(cursor[i + 1])));
+    }
+    return result;
+}
+
+/**
+ * Storage::Scan for storages that implement Range: each call takes next count keys in key order. Keys are never
+ * returned twice, and key present for the whole scan can't be missed since it stays in its place of the order
+ */
+inline bool RangeScan(const Storage &storage, std::string &cursor, size_t count, std::vector<std::string> &keys) {
+    std::string after = cursor == "0" ? std::string() : CursorKey(cursor);
+    count = std::max(count, size_t(1));
+
+    // Empty after means the beginning for Range, so continuing after the empty key takes it once more
+    bool skip = cursor != "0" && after.empty();
+    size_t first = keys.size();
+    if (!storage.Range("", after, count + skip, keys, nullptr)) {
+        return false;
+    }
+    if (skip && keys.size() > first && keys[first].empty()) {
+        keys.erase(keys.begin() + first);
+    }
+
+    cursor = keys.size() - first < count ? "0" : KeyCursor(keys.back());
+    return true;
+}
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_CURSOR_H
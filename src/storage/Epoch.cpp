@@ -0,0 +1,107 @@
+#include "Epoch.h"
+
+namespace Afina {
+namespace Backend {
+
+const size_t Epoch::Slots;
+const size_t Epoch::AdvanceInterval;
+
+// See Epoch.h
+Epoch::Epoch() : _epoch(0) {
+    for (auto &s : _slots) {
+        s.state.store(0);
+        s.retired = 0;
+        for (auto &e : s.limbo_epoch) {
+            e = 0;
+        }
+    }
+}
+
+// Nobody could be inside a guard any more, so everything retired is freed right away
+Epoch::~Epoch() {
+    for (auto &s : _slots) {
+        for (auto &list : s.limbo) {
+            for (auto &r : list) {
+                r.deleter(r.p);
+            }
+        }
+    }
+}
+
+// Threads get slots round robin in order of their first guard
+size_t Epoch::slot() {
+    static std::atomic<size_t> next(0);
+    thread_local size_t self = next.fetch_add(1) % Slots;
+    return self;
+}
+
+// Announcement must be visible before any pointer is read, otherwise epoch could advance twice past the reader,
+// so all operations on state and epoch are sequentially consistent
+Epoch::Guard::Guard(const Epoch &epoch) : _epoch(epoch), _slot(slot()) {
+    std::atomic<uint64_t> &state = _epoch._slots[_slot].state;
+    uint64_t current = state.load();
+    for (;;) {
+        uint64_t next = current + 1;
+        if ((current & 0xffffffff) == 0) {
+            next = uint64_t(_epoch._epoch.load()) << 32 | 1;
+        }
+        if (state.compare_exchange_weak(current, next)) {
+            return;
+        }
+    }
+}
+
+// See Epoch.h
+Epoch::Guard::~Guard() { _epoch._slots[_slot].state.fetch_sub(1); }
+
+// Stale list of the slot is freed by whoever retires into it next, so deleters must not retire anything themselves
+void Epoch::Retire(void *p, void (*deleter)(void *)) {
+    Slot &s = _slots[slot()];
+    bool advance;
+    {
+        std::unique_lock<std::mutex> guard(s.lock);
+        uint32_t e = _epoch.load();
+        unsigned i = e % 3;
+        if (s.limbo_epoch[i] != e) {
+            // List was filled three or more epochs ago
+            for (auto &r : s.limbo[i]) {
+                r.deleter(r.p);
+            }
+            s.limbo[i].clear();
+            s.limbo_epoch[i] = e;
+        }
+        s.limbo[i].push_back(Retired{p, deleter});
+        advance = ++s.retired % AdvanceInterval == 0;
+    }
+
+    if (advance) {
+        try_advance();
+    }
+}
+
+// See Epoch.h
+size_t Epoch::Pending() const {
+    size_t result = 0;
+    for (auto &s : _slots) {
+        std::unique_lock<std::mutex> guard(s.lock);
+        for (auto &list : s.limbo) {
+            result += list.size();
+        }
+    }
+    return result;
+}
+
+// See Epoch.h
+bool Epoch::try_advance() {
+    uint32_t e = _epoch.load();
+    for (auto &s : _slots) {
+        uint64_t state = s.state.load();
+        if ((state & 0xffffffff) != 0 && uint32_t(state >> 32) != e) {
+            return false;
+        }
+    }
+    return _epoch.compare_exchange_strong(e, e + 1);
+}
+
+} // namespace Backend
+} // namespace Afina
@@ -0,0 +1,106 @@
+#ifndef AFINA_STORAGE_EPOCH_H
+#define AFINA_STORAGE_EPOCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Epoch based memory reclamation
+ * Lock-free structures can't free a node right after unlinking it, since readers that don't take any lock could
+ * still be looking at it. Instead every access happens inside a Guard, and unlinked node is retired: it is freed
+ * only once every thread that could have seen it left its guard.
+ *
+ * There is a global epoch counter. Guard announces the epoch it started in, and the epoch advances only when all
+ * threads inside guards have announced the current one. Node retired in epoch e was unlinked before anybody
+ * could announce e + 1, so once epoch reaches e + 2 nobody inside a guard could have seen it linked.
+ *
+ * Announcements live in slots picked round robin on first use, the same way SharedMutex picks reader slots, so
+ * guards on different cores don't bounce cache lines. Slot counts threads inside guards and keeps the epoch of
+ * the first of them: thread that joins an occupied slot is taken for being in that older epoch, which only holds
+ * reclamation back. Guards could be nested.
+ *
+ * Retired nodes are kept per slot in three lists, one per epoch modulo 3. List is freed when its slot retires
+ * something again three epochs later, or when the manager is destroyed.
+ */
+class Epoch {
+public:
+    static const size_t Slots = 64;
+
+    // Retires a slot makes between attempts to advance the epoch
+    static const size_t AdvanceInterval = 64;
+
+    Epoch();
+    ~Epoch();
+
+    Epoch(const Epoch &) = delete;
+    Epoch &operator=(const Epoch &) = delete;
+
+    /**
+     * RAII critical section, pointers taken from the structure stay valid while it is alive
+     */
+    class Guard {
+    public:
+        explicit Guard(const Epoch &epoch);
+        ~Guard();
+
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+
+    private:
+        const Epoch &_epoch;
+        size_t _slot;
+    };
+
+    /**
+     * Hands over pointer that is no longer reachable from the structure, deleter is called on it once no guard
+     * could see it. Caller must be inside a guard
+     */
+    void Retire(void *p, void (*deleter)(void *));
+
+    /**
+     * Current epoch
+     */
+    uint32_t Current() const { return _epoch.load(); }
+
+    /**
+     * Number of retired pointers waiting to be freed
+     */
+    size_t Pending() const;
+
+private:
+    struct Retired {
+        void *p;
+        void (*deleter)(void *);
+    };
+
+    struct alignas(64) Slot {
+        // Epoch of the first thread inside guard in the high half, number of threads inside in the low one
+        std::atomic<uint64_t> state;
+
+        // Guards lists of retired pointers
+        std::mutex lock;
+        std::vector<Retired> limbo[3];
+        uint32_t limbo_epoch[3];
+        size_t retired;
+    };
+
+    // Returns slot of the calling thread
+    static size_t slot();
+
+    // Moves epoch forward if every thread inside guard has seen the current one
+    bool try_advance();
+
+    mutable Slot _slots[Slots];
+    alignas(64) std::atomic<uint32_t> _epoch;
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_EPOCH_H
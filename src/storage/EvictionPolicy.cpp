@@ -0,0 +1,333 @@
+#include "EvictionPolicy.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace Afina {
+namespace Backend {
+
+// Least recently used item of the list other than keep one
+static Item *last_but(const ItemList &list, const Item *keep) {
+    Item *item = list.back();
+    if (item != nullptr && item == keep) {
+        item = item->prev;
+    }
+    return item;
+}
+
+// See EvictionPolicy.h
+std::unique_ptr<EvictionPolicy> EvictionPolicy::Create(const std::string &name, size_t max_size) {
+    if (name == "lru") {
+        return std::unique_ptr<EvictionPolicy>(new LRUPolicy());
+    } else if (name == "slru") {
+        return std::unique_ptr<EvictionPolicy>(new SLRUPolicy(max_size));
+    } else if (name == "arc") {
+        return std::unique_ptr<EvictionPolicy>(new ARCPolicy(max_size));
+    } else if (name == "tinylfu") {
+        return std::unique_ptr<EvictionPolicy>(new TinyLFUPolicy(max_size));
+    }
+    throw std::invalid_argument("Unknown eviction policy: " + name);
+}
+
+// See EvictionPolicy.h
+void LRUPolicy::Update(Item *old_item, size_t old_size, Item *item) {
+    if (item != old_item) {
+        _list.replace(old_item, item);
+    }
+    _list.move_to_front(item);
+}
+
+// See EvictionPolicy.h
+Item *LRUPolicy::Victim(const Item *keep) {
+    Item *victim = last_but(_list, keep);
+    if (victim != nullptr) {
+        _list.erase(victim);
+    }
+    return victim;
+}
+
+// See EvictionPolicy.h
+void SLRUPolicy::Insert(Item *item) {
+    item->segment = Probation;
+    _probation.push_front(item);
+}
+
+// Second access promotes item into protected segment
+void SLRUPolicy::Access(Item *item) {
+    if (item->segment == Protected) {
+        _protected.move_to_front(item);
+        return;
+    }
+
+    _probation.erase(item);
+    item->segment = Protected;
+    _protected.push_front(item);
+    _protected_size += item->Size();
+    demote();
+}
+
+// See EvictionPolicy.h
+void SLRUPolicy::Update(Item *old_item, size_t old_size, Item *item) {
+    item->segment = old_item->segment;
+    ItemList &list = item->segment == Protected ? _protected : _probation;
+    if (item != old_item) {
+        list.replace(old_item, item);
+    }
+
+    if (item->segment == Protected) {
+        _protected_size = _protected_size - old_size + item->Size();
+        demote();
+    }
+}
+
+// See EvictionPolicy.h
+void SLRUPolicy::Remove(Item *item) {
+    if (item->segment == Protected) {
+        _protected.erase(item);
+        _protected_size -= item->Size();
+    } else {
+        _probation.erase(item);
+    }
+}
+
+// Probation goes first, protected items are evicted only once there is nothing else
+Item *SLRUPolicy::Victim(const Item *keep) {
+    Item *victim = last_but(_probation, keep);
+    if (victim == nullptr) {
+        victim = last_but(_protected, keep);
+    }
+    if (victim != nullptr) {
+        Remove(victim);
+    }
+    return victim;
+}
+
+// See EvictionPolicy.h
+void SLRUPolicy::demote() {
+    while (_protected_size > _protected_max && _protected.back() != nullptr) {
+        Item *item = _protected.back();
+        _protected.erase(item);
+        _protected_size -= item->Size();
+        item->segment = Probation;
+        _probation.push_front(item);
+    }
+}
+
+// See EvictionPolicy.h
+void ARCPolicy::GhostList::push_front(uint64_t hash, size_t size) {
+    erase(hash);
+    _list.emplace_front(hash, size);
+    _index[hash] = _list.begin();
+    _size += size;
+}
+
+// See EvictionPolicy.h
+size_t ARCPolicy::GhostList::erase(uint64_t hash) {
+    auto it = _index.find(hash);
+    if (it == _index.end()) {
+        return 0;
+    }
+
+    size_t size = it->second->second;
+    _list.erase(it->second);
+    _index.erase(it);
+    _size -= size;
+    return size;
+}
+
+// See EvictionPolicy.h
+void ARCPolicy::GhostList::pop_back() {
+    auto &last = _list.back();
+    _index.erase(last.first);
+    _size -= last.second;
+    _list.pop_back();
+}
+
+// Ghost hit means item was evicted too early from the list ghost belongs to, so that list must grow. Step is
+// proportional to the ratio of ghost lists, same as in the original ARC, but in bytes instead of entries
+void ARCPolicy::Insert(Item *item) {
+    size_t size = item->Size();
+    size_t b1 = _b1.size(), b2 = _b2.size();
+
+    if (_b1.erase(item->hash) > 0) {
+        size_t delta = std::max(size, b1 > 0 ? size * b2 / b1 : size);
+        _target = std::min(_max_size, _target + delta);
+    } else if (_b2.erase(item->hash) > 0) {
+        size_t delta = std::max(size, b2 > 0 ? size * b1 / b2 : size);
+        _target = _target > delta ? _target - delta : 0;
+    } else {
+        item->segment = T1;
+        _t1.push_front(item);
+        _t1_size += size;
+        trim_ghosts();
+        return;
+    }
+
+    item->segment = T2;
+    _t2.push_front(item);
+    _t2_size += size;
+    trim_ghosts();
+}
+
+// See EvictionPolicy.h
+void ARCPolicy::Access(Item *item) {
+    if (item->segment == T2) {
+        _t2.move_to_front(item);
+        return;
+    }
+
+    _t1.erase(item);
+    _t1_size -= item->Size();
+    item->segment = T2;
+    _t2.push_front(item);
+    _t2_size += item->Size();
+}
+
+// See EvictionPolicy.h
+void ARCPolicy::Update(Item *old_item, size_t old_size, Item *item) {
+    item->segment = old_item->segment;
+    if (item->segment == T1) {
+        if (item != old_item) {
+            _t1.replace(old_item, item);
+        }
+        _t1_size = _t1_size - old_size + item->Size();
+    } else {
+        if (item != old_item) {
+            _t2.replace(old_item, item);
+        }
+        _t2_size = _t2_size - old_size + item->Size();
+    }
+}
+
+// See EvictionPolicy.h
+void ARCPolicy::Remove(Item *item) {
+    if (item->segment == T1) {
+        _t1.erase(item);
+        _t1_size -= item->Size();
+    } else {
+        _t2.erase(item);
+        _t2_size -= item->Size();
+    }
+}
+
+// T1 gives up items while it is over its target, otherwise T2 does. Victim key is remembered in the ghost
+// list of the segment it came from
+Item *ARCPolicy::Victim(const Item *keep) {
+    Item *t1 = last_but(_t1, keep);
+    Item *t2 = last_but(_t2, keep);
+
+    Item *victim;
+    if (t1 != nullptr && (_t1_size > _target || t2 == nullptr)) {
+        victim = t1;
+    } else {
+        victim = t2;
+    }
+    if (victim == nullptr) {
+        return nullptr;
+    }
+
+    Remove(victim);
+    (victim->segment == T1 ? _b1 : _b2).push_front(victim->hash, victim->Size());
+    trim_ghosts();
+    return victim;
+}
+
+// See EvictionPolicy.h
+void ARCPolicy::trim_ghosts() {
+    while (_b1.size() > 0 && _b1.size() > _max_size - std::min(_max_size, _t1_size)) {
+        _b1.pop_back();
+    }
+    while (_b2.size() > 0 && _b2.size() > _max_size - std::min(_max_size, _t2_size)) {
+        _b2.pop_back();
+    }
+}
+
+// Sketch is sized for the number of average 64 byte items that fit into budget, but never gets too large
+TinyLFUPolicy::TinyLFUPolicy(size_t max_size)
+    : _window_max(max_size / 100), _window_size(0), _main(max_size - max_size / 100),
+      _sketch(std::min(max_size / 64, size_t(1) << 24)) {}
+
+// New items always enter the window, those pushed out of it move to main probation without any filtering,
+// admission decision is made only once storage actually needs space
+void TinyLFUPolicy::Insert(Item *item) {
+    _sketch.Increment(item->hash);
+
+    item->segment = Window;
+    _window.push_front(item);
+    _window_size += item->Size();
+
+    while (_window_size > _window_max && _window.back() != item) {
+        Item *last = _window.back();
+        _window.erase(last);
+        _window_size -= last->Size();
+        _main.Insert(last);
+    }
+}
+
+// See EvictionPolicy.h
+void TinyLFUPolicy::Access(Item *item) {
+    _sketch.Increment(item->hash);
+    if (item->segment == Window) {
+        _window.move_to_front(item);
+    } else {
+        _main.Access(item);
+    }
+}
+
+// See EvictionPolicy.h
+void TinyLFUPolicy::Update(Item *old_item, size_t old_size, Item *item) {
+    if (old_item->segment != Window) {
+        _main.Update(old_item, old_size, item);
+        return;
+    }
+
+    item->segment = Window;
+    if (item != old_item) {
+        _window.replace(old_item, item);
+    }
+    _window_size = _window_size - old_size + item->Size();
+}
+
+// See EvictionPolicy.h
+void TinyLFUPolicy::Remove(Item *item) {
+    if (item->segment == Window) {
+        _window.erase(item);
+        _window_size -= item->Size();
+    } else {
+        _main.Remove(item);
+    }
+}
+
+// Newest probationary item is the candidate for admission, it stays only if it is accessed more often than
+// the least recently used probationary one
+Item *TinyLFUPolicy::Victim(const Item *keep) {
+    ItemList &probation = _main.probation();
+    Item *victim = last_but(probation, keep);
+    Item *candidate = probation.front();
+    if (candidate != nullptr && candidate == keep) {
+        candidate = candidate->next;
+    }
+
+    if (victim != nullptr && candidate != nullptr && candidate != victim &&
+        _sketch.Frequency(candidate->hash) <= _sketch.Frequency(victim->hash)) {
+        victim = candidate;
+    }
+
+    if (victim != nullptr) {
+        _main.Remove(victim);
+        return victim;
+    }
+
+    // Probation is empty, take from protected, then from window
+    victim = _main.Victim(keep);
+    if (victim == nullptr) {
+        victim = last_but(_window, keep);
+        if (victim != nullptr) {
+            Remove(victim);
+        }
+    }
+    return victim;
+}
+
+} // namespace Backend
+} // namespace Afina
@@ -0,0 +1,242 @@
+#ifndef AFINA_STORAGE_EVICTION_POLICY_H
+#define AFINA_STORAGE_EVICTION_POLICY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "FrequencySketch.h"
+#include "Item.h"
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Decides which item to evict
+ * Storage notifies policy about every item it links, touches, updates or removes, policy keeps items in its
+ * own intrusive lists and picks victims once storage runs out of memory. Policy never frees items, victim is
+ * unlinked from the policy and then storage drops it from the index.
+ *
+ * Sizes are in the same units storage counts its budget in, i.e key plus value bytes. Not thread safe, storage
+ * must call it under its own lock.
+ */
+class EvictionPolicy {
+public:
+    virtual ~EvictionPolicy() {}
+
+    /**
+     * New item has been stored
+     */
+    virtual void Insert(Item *item) = 0;
+
+    /**
+     * Existing item has been read or written
+     */
+    virtual void Access(Item *item) = 0;
+
+    /**
+     * Item got a new value of old_size bytes before. Item could have been reallocated, in a such case fresh one
+     * takes the place of old_item in the policy
+     */
+    virtual void Update(Item *old_item, size_t old_size, Item *item) = 0;
+
+    /**
+     * Item has been deleted by client
+     */
+    virtual void Remove(Item *item) = 0;
+
+    /**
+     * Unlinks and returns item to evict, never picks the keep one. Returns nullptr if there is nothing else
+     */
+    virtual Item *Victim(const Item *keep) = 0;
+
+    /**
+     * Builds policy by name: lru, slru, arc or tinylfu. Throws std::invalid_argument for unknown one
+     *
+     * @param max_size budget of the storage, used to size policy segments
+     */
+    static std::unique_ptr<EvictionPolicy> Create(const std::string &name, size_t max_size);
+};
+
+/**
+ * # Least recently used
+ * Single list, accessed item goes to the head, victim is taken from the tail
+ */
+class LRUPolicy : public EvictionPolicy {
+public:
+    // Implements EvictionPolicy interface
+    void Insert(Item *item) override { _list.push_front(item); }
+
+    // Implements EvictionPolicy interface
+    void Access(Item *item) override { _list.move_to_front(item); }
+
+    // Implements EvictionPolicy interface
+    void Update(Item *old_item, size_t old_size, Item *item) override;
+
+    // Implements EvictionPolicy interface
+    void Remove(Item *item) override { _list.erase(item); }
+
+    // Implements EvictionPolicy interface
+    Item *Victim(const Item *keep) override;
+
+private:
+    ItemList _list;
+};
+
+/**
+ * # Segmented LRU
+ * New items get into probationary segment and are promoted into protected one on the second access. Protected
+ * segment is limited to 80% of the budget, its least recently used items are demoted back to probation. Victims
+ * are taken from probation first, so a one-time scan never flushes items accessed more than once.
+ */
+class SLRUPolicy : public EvictionPolicy {
+public:
+    SLRUPolicy(size_t max_size) : _protected_max(max_size * 4 / 5), _protected_size(0) {}
+
+    // Implements EvictionPolicy interface
+    void Insert(Item *item) override;
+
+    // Implements EvictionPolicy interface
+    void Access(Item *item) override;
+
+    // Implements EvictionPolicy interface
+    void Update(Item *old_item, size_t old_size, Item *item) override;
+
+    // Implements EvictionPolicy interface
+    void Remove(Item *item) override;
+
+    // Implements EvictionPolicy interface
+    Item *Victim(const Item *keep) override;
+
+    enum Segment : uint8_t { Probation, Protected };
+
+    ItemList &probation() { return _probation; }
+
+private:
+    size_t _protected_max;
+    size_t _protected_size;
+
+    ItemList _probation;
+    ItemList _protected;
+
+    // Moves protected items over the limit back to probation
+    void demote();
+};
+
+/**
+ * # Adaptive replacement cache
+ * Items seen once live in T1, items seen at least twice in T2. Keys recently evicted from each of them are
+ * remembered in ghost lists B1 and B2: a miss that hits B1 means T1 is too small, a hit in B2 means T2 is, and
+ * target size of T1 adapts accordingly. So policy balances between recency and frequency with no tuning.
+ *
+ * Ghosts keep only key hash and item size, each ghost list is limited by the storage budget.
+ */
+class ARCPolicy : public EvictionPolicy {
+public:
+    ARCPolicy(size_t max_size) : _max_size(max_size), _target(0), _t1_size(0), _t2_size(0) {}
+
+    // Implements EvictionPolicy interface
+    void Insert(Item *item) override;
+
+    // Implements EvictionPolicy interface
+    void Access(Item *item) override;
+
+    // Implements EvictionPolicy interface
+    void Update(Item *old_item, size_t old_size, Item *item) override;
+
+    // Implements EvictionPolicy interface
+    void Remove(Item *item) override;
+
+    // Implements EvictionPolicy interface
+    Item *Victim(const Item *keep) override;
+
+    enum Segment : uint8_t { T1, T2 };
+
+private:
+    /**
+     * Keys of evicted items in order of eviction, most recent first
+     */
+    class GhostList {
+    public:
+        GhostList() : _size(0) {}
+
+        size_t size() const { return _size; }
+
+        void push_front(uint64_t hash, size_t size);
+
+        // Removes entry for the key if present and returns its size, otherwise returns 0
+        size_t erase(uint64_t hash);
+
+        void pop_back();
+
+    private:
+        size_t _size;
+        std::list<std::pair<uint64_t, size_t>> _list;
+        std::unordered_map<uint64_t, std::list<std::pair<uint64_t, size_t>>::iterator> _index;
+    };
+
+    size_t _max_size;
+
+    // Target size of T1
+    size_t _target;
+
+    size_t _t1_size;
+    size_t _t2_size;
+
+    ItemList _t1;
+    ItemList _t2;
+    GhostList _b1;
+    GhostList _b2;
+
+    // Drops oldest ghosts, so that each ghost list together with its live list fits into budget
+    void trim_ghosts();
+};
+
+/**
+ * # Window TinyLFU
+ * New items get into a small LRU window of 1% of the budget, the rest is a segmented LRU main area. When storage
+ * needs space, the newest probationary item, which is usually the one just pushed out of the window, competes
+ * with the least recently used probationary one: the item with lower estimated access frequency is evicted.
+ *
+ * Frequencies come from a count-min sketch with doorkeeper fed by every access, so scans and one-hit wonders
+ * could never push out popular items, while the window still gives new bursty keys a chance to collect hits.
+ */
+class TinyLFUPolicy : public EvictionPolicy {
+public:
+    TinyLFUPolicy(size_t max_size);
+
+    // Implements EvictionPolicy interface
+    void Insert(Item *item) override;
+
+    // Implements EvictionPolicy interface
+    void Access(Item *item) override;
+
+    // Implements EvictionPolicy interface
+    void Update(Item *old_item, size_t old_size, Item *item) override;
+
+    // Implements EvictionPolicy interface
+    void Remove(Item *item) override;
+
+    // Implements EvictionPolicy interface
+    Item *Victim(const Item *keep) override;
+
+    enum Segment : uint8_t { Window = 2 };
+
+private:
+    size_t _window_max;
+    size_t _window_size;
+    ItemList _window;
+
+    // Main area, items moved out of the window enter its probation segment
+    SLRUPolicy _main;
+
+    FrequencySketch _sketch;
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_EVICTION_POLICY_H
@@ -0,0 +1,509 @@
+#include "FlatHashImpl.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "Counter.h"
+#include "Cursor.h"
+
+namespace Afina {
+namespace Backend {
+
+// See FlatHashImpl.h
+FlatHashImpl::FlatHashImpl(size_t max_size, const std::string &policy)
+    : _max_size(max_size), _size(0), _slack(0), _wheel(now()), _policy(EvictionPolicy::Create(policy, max_size)),
+      _version(0), _evictions(0), _reclaimed(0), _running(false) {}
+
+// See FlatHashImpl.h
+FlatHashImpl::~FlatHashImpl() {
+    Stop();
+    _index.ForEach([](Item *item) { Item::Release(item); });
+}
+
+// See FlatHashImpl.h
+void FlatHashImpl::Start() {
+    std::unique_lock<std::mutex> guard(_reaper_lock);
+    if (!_running) {
+        _running = true;
+        _reaper = std::thread(&FlatHashImpl::reap, this);
+    }
+}
+
+// See FlatHashImpl.h
+void FlatHashImpl::Stop() {
+    {
+        std::unique_lock<std::mutex> guard(_reaper_lock);
+        _running = false;
+    }
+    _reaper_wakeup.notify_all();
+    if (_reaper.joinable()) {
+        _reaper.join();
+    }
+}
+
+// See FlatHashImpl.h
+bool FlatHashImpl::Put(const std::string &key, const std::string &value, time_t expire_at) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    uint64_t hash = Hash(key.data(), key.size());
+    Item *item = find(hash, key);
+    if (item != nullptr) {
+        return update(item, value, expire_at);
+    }
+    return insert(hash, key, value, expire_at);
+}
+
+// See FlatHashImpl.h
+bool FlatHashImpl::PutIfAbsent(const std::string &key, const std::string &value, time_t expire_at) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    uint64_t hash = Hash(key.data(), key.size());
+    if (find(hash, key) != nullptr) {
+        return false;
+    }
+    return insert(hash, key, value, expire_at);
+}
+
+// See FlatHashImpl.h
+bool FlatHashImpl::Set(const std::string &key, const std::string &value, time_t expire_at) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(Hash(key.data(), key.size()), key);
+    if (item == nullptr) {
+        return false;
+    }
+    return update(item, value, expire_at);
+}
+
+// See FlatHashImpl.h
+bool FlatHashImpl::Append(const std::string &key, const std::string &data) { return extend(key, data, false); }
+
+// See FlatHashImpl.h
+bool FlatHashImpl::Prepend(const std::string &key, const std::string &data) { return extend(key, data, true); }
+
+// See FlatHashImpl.h
+bool FlatHashImpl::Increment(const std::string &key, uint64_t delta, uint64_t &result) {
+    return change(key, delta, false, result);
+}
+
+// See FlatHashImpl.h
+bool FlatHashImpl::Decrement(const std::string &key, uint64_t delta, uint64_t &result) {
+    return change(key, delta, true, result);
+}
+
+// Expired item is deleted already as far as client could tell
+bool FlatHashImpl::Delete(const std::string &key) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = _index.Find(Hash(key.data(), key.size()), key.data(), key.size());
+    if (item == nullptr) {
+        return false;
+    }
+
+    bool expired = item->Expired(now());
+    _policy->Remove(item);
+    drop(item);
+    return !expired;
+}
+
+// See FlatHashImpl.h
+bool FlatHashImpl::Get(const std::string &key, std::string &value) const {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(Hash(key.data(), key.size()), key);
+    if (item == nullptr) {
+        return false;
+    }
+    if (item->flags & Item::Counter) {
+        value = item->Text();
+    } else {
+        value.assign(item->value(), item->value_size);
+    }
+    return true;
+}
+
+// See FlatHashImpl.h
+bool FlatHashImpl::GetRef(const std::string &key, ValueRef &value) const {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(Hash(key.data(), key.size()), key);
+    if (item == nullptr) {
+        return false;
+    }
+    value = item->Share();
+    return true;
+}
+
+// See FlatHashImpl.h
+size_t FlatHashImpl::GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const {
+    return get_many(keys, values, nullptr);
+}
+
+// See FlatHashImpl.h
+size_t FlatHashImpl::Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                          std::vector<uint64_t> &versions) const {
+    versions.assign(keys.size(), 0);
+    return get_many(keys, values, versions.data());
+}
+
+// Version check and update go under the same lock
+Storage::CasResult FlatHashImpl::Cas(const std::string &key, const std::string &value, uint64_t version,
+                                     time_t expire_at) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(Hash(key.data(), key.size()), key);
+    if (item == nullptr) {
+        return CasResult::NotFound;
+    } else if (item->version != version) {
+        return CasResult::Exists;
+    }
+    return update(item, value, expire_at) ? CasResult::Stored : CasResult::NotStored;
+}
+
+// Items are allocated and filled before the lock is taken, so only index and policy updates are left under it.
+// Expired item found in the index is gone for the client, so it is replaced as well
+size_t FlatHashImpl::Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                          const std::vector<time_t> &expire_at) {
+    uint32_t time = now();
+    std::vector<Item *> items;
+    items.reserve(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (expire_at[i] != 0 && expire_at[i] <= time) {
+            continue;
+        }
+        Item *item = Item::Create(Hash(keys[i].data(), keys[i].size()), keys[i], values[i], 0, expire_at[i] != 0);
+        item->expire_at = uint32_t(expire_at[i]);
+        items.push_back(item);
+    }
+
+    size_t stored = 0;
+    std::unique_lock<std::mutex> guard(_lock);
+    for (size_t i = 0; i < items.size(); i++) {
+        Item *item = items[i];
+        Item *existing = _index.Find(item->hash, item->key(), item->key_size);
+        if (existing != nullptr && existing->Expired(time)) {
+            _policy->Remove(existing);
+            drop(existing);
+            existing = nullptr;
+        }
+        if (existing != nullptr || !free_space(item->Size())) {
+            continue;
+        }
+        link(item);
+        items[i] = nullptr;
+        stored++;
+    }
+    guard.unlock();
+
+    // Items that were not stored
+    for (Item *item : items) {
+        if (item != nullptr) {
+            Item::Release(item);
+        }
+    }
+    return stored;
+}
+
+// Groups are visited until count keys are taken, so that sparse table doesn't make call take longer
+bool FlatHashImpl::Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const {
+    uint64_t position = ParsePosition(cursor);
+    std::unique_lock<std::mutex> guard(_lock);
+
+    uint32_t time = now();
+    size_t first = keys.size(), groups = 0;
+    do {
+        position = _index.Scan(position, [&keys, time](Item *item) {
+            if (!item->Expired(time)) {
+                keys.emplace_back(item->key(), item->key_size);
+            }
+        });
+    } while (position != 0 && keys.size() - first < count && ++groups < count);
+
+    cursor = std::to_string(position);
+    return true;
+}
+
+// See FlatHashImpl.h
+void FlatHashImpl::Freeze(const std::function<void()> &f) {
+    std::unique_lock<std::mutex> guard(_lock);
+    f();
+}
+
+// Items expired but not reaped yet are skipped, as they are invisible to Get already
+void FlatHashImpl::ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const {
+    uint32_t time = now();
+    _index.ForEach([&f, time](Item *item) {
+        if (!item->Expired(time)) {
+            f(std::string(item->key(), item->key_size), item->Text(), item->expire_at);
+        }
+    });
+}
+
+// Hashes don't depend on the table, so they are computed before the lock is taken
+size_t FlatHashImpl::get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                              uint64_t *versions) const {
+    std::vector<uint64_t> hashes(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        hashes[i] = Hash(keys[i].data(), keys[i].size());
+    }
+    values.clear();
+    values.resize(keys.size());
+
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t found = 0;
+    _index.FindMany(hashes.data(), keys.data(), keys.size(), [this, &values, versions, &found](size_t i, Item *item) {
+        item = accessed(item);
+        if (item != nullptr) {
+            values[i] = item->Share();
+            if (versions != nullptr) {
+                versions[i] = item->version;
+            }
+            found++;
+        }
+    });
+    return found;
+}
+
+// See FlatHashImpl.h
+void FlatHashImpl::GetStats(std::vector<std::pair<std::string, std::string>> &stats) const {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    stats.emplace_back("curr_items", std::to_string(_index.Size()));
+    stats.emplace_back("bytes", std::to_string(_size));
+    stats.emplace_back("slack_bytes", std::to_string(_slack));
+    stats.emplace_back("limit_maxbytes", std::to_string(_max_size));
+    stats.emplace_back("evictions", std::to_string(_evictions));
+    stats.emplace_back("reclaimed", std::to_string(_reclaimed));
+    stats.emplace_back("expiring_items", std::to_string(_wheel.Size()));
+}
+
+// See FlatHashImpl.h
+Item *FlatHashImpl::accessed(Item *item) const {
+    if (item == nullptr) {
+        return nullptr;
+    }
+
+    if (item->Expired(now())) {
+        _policy->Remove(item);
+        drop(item);
+        _reclaimed++;
+        return nullptr;
+    }
+
+    _policy->Access(item);
+    return item;
+}
+
+// Value is overwritten in place if it fits into item and nobody holds a view on it, otherwise item gets
+// reallocated and replaced in both index and policy. Old item stays alive until the last view is released.
+// Item that doesn't have timer links gets reallocated as well once it has to expire. Item grown by appends is
+// reallocated to the exact size once value shrinks to less than a half of it, so its slack is given back
+bool FlatHashImpl::update(Item *item, const std::string &value, time_t expire_at) {
+    bool timer = expire_at != 0;
+    bool in_place = value.size() <= item->capacity && item->capacity - value.size() <= value.size() &&
+                    !item->Shared() && (!timer || (item->flags & Item::HasTimer));
+
+    size_t old_size = item->Size(), old_slack = slack(item);
+    _size -= old_size;
+    _slack -= old_slack;
+    if (!free_space(item->key_size + value.size(), item, in_place ? item->capacity - value.size() : 0)) {
+        _size += old_size;
+        _slack += old_slack;
+        return false;
+    }
+
+    if (item->expire_at != 0) {
+        _wheel.Cancel(item);
+    }
+
+    if (in_place) {
+        item->Assign(value.data(), value.size());
+        item->expire_at = uint32_t(expire_at);
+        item->version = ++_version;
+        if (timer) {
+            _wheel.Schedule(item);
+        }
+        _policy->Update(item, old_size, item);
+        return true;
+    }
+
+    Item *fresh = Item::Create(item->hash, item->key(), item->key_size, value.data(), value.size(), 0, timer);
+    fresh->expire_at = uint32_t(expire_at);
+    relink(item, fresh, old_size);
+    return true;
+}
+
+// Appended bytes go past the end of the value, which views never look at, so append is done in place even if
+// item is shared. Prepend has to move the value, so shared item is copied. Once item runs out of capacity,
+// it is reallocated with twice as much as needed, that way series of appends costs amortized O(appended bytes)
+// instead of copying the whole value every time. Reserved slack counts against max_size, so it is never more than
+// what is left of it after the key and value
+bool FlatHashImpl::extend(const std::string &key, const std::string &data, bool front) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(Hash(key.data(), key.size()), key);
+    if (item == nullptr) {
+        return false;
+    }
+    if (item->flags & Item::Counter) {
+        return update(item, front ? data + item->Text() : item->Text() + data, item->expire_at);
+    }
+
+    size_t old_size = item->Size(), old_slack = slack(item);
+    size_t value_size = item->value_size + data.size();
+    size_t size = item->key_size + value_size;
+    if (size > _max_size) {
+        return false;
+    }
+
+    bool in_place = value_size <= item->capacity && (!front || !item->Shared());
+    size_t capacity = in_place ? item->capacity : value_size + std::min(value_size, _max_size - size);
+    _size -= old_size;
+    _slack -= old_slack;
+    if (!free_space(size, item, capacity - value_size)) {
+        _size += old_size;
+        _slack += old_slack;
+        return false;
+    }
+
+    if (in_place) {
+        item->Extend(data.data(), data.size(), front);
+        item->version = ++_version;
+        _policy->Update(item, old_size, item);
+        return true;
+    }
+
+    Item *fresh = Item::Create(item->hash, item->key(), item->key_size, item->value(), item->value_size, capacity,
+                               item->flags & Item::HasTimer);
+    fresh->Extend(data.data(), data.size(), front);
+    fresh->expire_at = item->expire_at;
+    if (item->expire_at != 0) {
+        _wheel.Cancel(item);
+    }
+    relink(item, fresh, old_size);
+    return true;
+}
+
+// Text is parsed only once, after that counter is kept in the item as native number and updated in place. Item
+// is reallocated if it is shared or too small for the number
+bool FlatHashImpl::change(const std::string &key, uint64_t delta, bool decrement, uint64_t &result) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(Hash(key.data(), key.size()), key);
+    if (item == nullptr) {
+        return false;
+    }
+    if (item->flags & Item::Counter) {
+        result = ApplyDelta(item->Number(), delta, decrement);
+        item->SetNumber(result);
+        item->version = ++_version;
+        return true;
+    }
+
+    result = ApplyDelta(ParseCounter(item->value(), item->value_size), delta, decrement);
+    bool in_place = item->capacity >= sizeof(uint64_t) && !item->Shared();
+    size_t old_size = item->Size(), old_slack = slack(item);
+    _size -= old_size;
+    _slack -= old_slack;
+    if (!free_space(item->key_size + sizeof(uint64_t), item, in_place ? item->capacity - sizeof(uint64_t) : 0)) {
+        _size += old_size;
+        _slack += old_slack;
+        return false;
+    }
+
+    if (in_place) {
+        item->SetNumber(result);
+        item->version = ++_version;
+        _policy->Update(item, old_size, item);
+        return true;
+    }
+
+    Item *fresh = Item::Create(item->hash, item->key(), item->key_size, item->value(), 0, sizeof(uint64_t),
+                               item->flags & Item::HasTimer);
+    fresh->SetNumber(result);
+    fresh->expire_at = item->expire_at;
+    if (item->expire_at != 0) {
+        _wheel.Cancel(item);
+    }
+    relink(item, fresh, old_size);
+    return true;
+}
+
+// See FlatHashImpl.h
+void FlatHashImpl::relink(Item *item, Item *fresh, size_t old_size) {
+    fresh->version = ++_version;
+    if (fresh->expire_at != 0) {
+        _wheel.Schedule(fresh);
+    }
+    _index.Replace(item->hash, item->key(), item->key_size, fresh);
+    _policy->Update(item, old_size, fresh);
+    Item::Release(item);
+}
+
+// See FlatHashImpl.h
+bool FlatHashImpl::insert(uint64_t hash, const std::string &key, const std::string &value, time_t expire_at) {
+    if (!free_space(key.size() + value.size())) {
+        return false;
+    }
+
+    Item *item = Item::Create(hash, key, value, 0, expire_at != 0);
+    item->expire_at = uint32_t(expire_at);
+    link(item);
+    return true;
+}
+
+// See FlatHashImpl.h
+void FlatHashImpl::link(Item *item) {
+    item->version = ++_version;
+    if (item->expire_at != 0) {
+        _wheel.Schedule(item);
+    }
+    _index.Insert(item->hash, item);
+    _policy->Insert(item);
+}
+
+// Item being updated is never evicted to make room for itself, if it is the only one left there is enough space
+// anyway since its own size is not counted
+bool FlatHashImpl::free_space(size_t size, const Item *keep, size_t reserve) {
+    if (size + reserve > _max_size) {
+        return false;
+    }
+    while (size + reserve + _size + _slack > _max_size) {
+        drop(_policy->Victim(keep));
+        _evictions++;
+    }
+    _size += size;
+    _slack += reserve;
+    return true;
+}
+
+// See FlatHashImpl.h
+void FlatHashImpl::drop(Item *item) const {
+    _size -= item->Size();
+    _slack -= slack(item);
+    _index.Erase(item->hash, item->key(), item->key_size);
+    if (item->expire_at != 0) {
+        _wheel.Cancel(item);
+    }
+    Item::Release(item);
+}
+
+// Wheel is advanced once a second under the storage lock, each step touches only items that are due
+void FlatHashImpl::reap() {
+    std::unique_lock<std::mutex> guard(_reaper_lock);
+    while (_running) {
+        _reaper_wakeup.wait_for(guard, std::chrono::seconds(1));
+
+        std::unique_lock<std::mutex> storage_guard(_lock);
+        _wheel.Advance(now(), [this](Item *item) {
+            _policy->Remove(item);
+            item->expire_at = 0;
+            drop(item);
+            _reclaimed++;
+        });
+    }
+}
+
+} // namespace Backend
+} // namespace Afina
@@ -0,0 +1,192 @@
+#ifndef AFINA_STORAGE_FLAT_HASH_IMPL_H
+#define AFINA_STORAGE_FLAT_HASH_IMPL_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <afina/Storage.h>
+
+#include "EvictionPolicy.h"
+#include "FlatIndex.h"
+#include "Hash.h"
+#include "Item.h"
+#include "TimingWheel.h"
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Flat hash based implementation with global lock
+ * Same LRU semantics as MapBasedGlobalLockImpl, but keys are indexed by open addressing hash table with SIMD
+ * probing instead of std::map. Lookup costs O(1) with one or two cache misses instead of O(log n) string
+ * comparisons over pointer chasing.
+ *
+ * Each entry is a single Item allocation holding LRU links, key and value, index slot points to it directly.
+ * GetRef shares the item itself, so values are never copied on read.
+ *
+ * Items to evict are chosen by the EvictionPolicy given by name on construction, LRU by default.
+ *
+ * Values touched by incr/decr are kept in the item as native numbers, so updating counter doesn't parse and
+ * print text, it is turned back into text on read.
+ *
+ * Expiring items are tracked by TimingWheel. Lookups treat expired items as absent and drop them right away,
+ * and once storage is started, background thread advances the wheel every second to reclaim memory of expired
+ * items nobody asks for.
+ */
+class FlatHashImpl : public Afina::Storage {
+public:
+    FlatHashImpl(size_t max_size = 1024, const std::string &policy = "lru");
+    ~FlatHashImpl();
+
+    // Implements Afina::Storage interface
+    void Start() override;
+
+    // Implements Afina::Storage interface
+    void Stop() override;
+
+    // Implements Afina::Storage interface
+    bool Put(const std::string &key, const std::string &value) override { return Put(key, value, 0); }
+
+    // Implements Afina::Storage interface
+    bool Put(const std::string &key, const std::string &value, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool PutIfAbsent(const std::string &key, const std::string &value) override {
+        return PutIfAbsent(key, value, 0);
+    }
+
+    // Implements Afina::Storage interface
+    bool PutIfAbsent(const std::string &key, const std::string &value, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool Set(const std::string &key, const std::string &value) override { return Set(key, value, 0); }
+
+    // Implements Afina::Storage interface
+    bool Set(const std::string &key, const std::string &value, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool SupportsExpiration() const override { return true; }
+
+    // Implements Afina::Storage interface
+    bool Append(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Prepend(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Increment(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Decrement(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Delete(const std::string &key) override;
+
+    // Implements Afina::Storage interface
+    bool Get(const std::string &key, std::string &value) const override;
+
+    // Implements Afina::Storage interface
+    bool GetRef(const std::string &key, ValueRef &value) const override;
+
+    // Implements Afina::Storage interface
+    size_t GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const override;
+
+    // Implements Afina::Storage interface
+    size_t Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                std::vector<uint64_t> &versions) const override;
+
+    // Implements Afina::Storage interface
+    CasResult Cas(const std::string &key, const std::string &value, uint64_t version, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    size_t Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                const std::vector<time_t> &expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const override;
+
+    // Implements Afina::Storage interface
+    void Freeze(const std::function<void()> &f) override;
+
+    // Implements Afina::Storage interface
+    void ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const override;
+
+    // Implements Afina::Storage interface
+    void GetStats(std::vector<std::pair<std::string, std::string>> &stats) const override;
+
+private:
+    size_t _max_size;
+    mutable std::mutex _lock;
+
+    // Lookups drop expired items they come across, so even const methods change those
+    mutable size_t _size;
+
+    // Bytes reserved past the values of the items, counted against max_size along with _size
+    mutable size_t _slack;
+    mutable FlatIndex<Item, ItemTraits> _index;
+    mutable TimingWheel _wheel;
+    std::unique_ptr<EvictionPolicy> _policy;
+
+    // Last version assigned to an item
+    uint64_t _version;
+
+    size_t _evictions;
+    mutable size_t _reclaimed;
+
+    // Background thread advancing the wheel
+    std::thread _reaper;
+    std::mutex _reaper_lock;
+    std::condition_variable _reaper_wakeup;
+    bool _running;
+
+    // Returns item for the given key and reports access to the policy, expired item is removed instead
+    Item *find(uint64_t hash, const std::string &key) const {
+        return accessed(_index.Find(hash, key.data(), key.size()));
+    }
+
+    // Looks up batch of keys, versions are filled in if given
+    size_t get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values, uint64_t *versions) const;
+
+    // Reports access to the item found by index to the policy, expired item is removed instead
+    Item *accessed(Item *item) const;
+
+    // Replaces value of the existing item
+    bool update(Item *item, const std::string &value, time_t expire_at);
+
+    // Adds data to the value of existing key, to the beginning if front is set
+    bool extend(const std::string &key, const std::string &data, bool front);
+
+    // Applies incr/decr to the value of existing key
+    bool change(const std::string &key, uint64_t delta, bool decrement, uint64_t &result);
+
+    // Puts fresh copy of the item in its place everywhere, old item must be unscheduled already
+    void relink(Item *item, Item *fresh, size_t old_size);
+
+    // Adds new item for the given key, key must be absent
+    bool insert(uint64_t hash, const std::string &key, const std::string &value, time_t expire_at);
+
+    // Links new item into the index, the wheel and the policy, its space must be accounted already
+    void link(Item *item);
+
+    // Evicts entries chosen by policy until there is enough space for the new one and the slack it reserves,
+    // never evicts keep item
+    bool free_space(size_t size, const Item *keep = nullptr, size_t reserve = 0);
+
+    // Drops item that is already unlinked from the policy
+    void drop(Item *item) const;
+
+    // Body of the reaper thread
+    void reap();
+
+    static uint32_t now() { return uint32_t(time(nullptr)); }
+
+    static size_t slack(const Item *item) { return item->capacity - item->value_size; }
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_FLAT_HASH_IMPL_H
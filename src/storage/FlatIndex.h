@@ -0,0 +1,398 @@
+#ifndef AFINA_STORAGE_FLAT_INDEX_H
+#define AFINA_STORAGE_FLAT_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * Default way FlatIndex keeps elements: slot holds pointer to the element
+ */
+template <typename T> class PointerRef {
+public:
+    typedef T *Type;
+
+    T *Decode(T *ref) const { return ref; }
+    T *Encode(T *value) const { return value; }
+};
+
+/**
+ * Slot holds 32-bit offset of the element from the start of the arena all elements live in, counted in Align
+ * bytes. Slot takes half of the pointer, so index of small items costs 5 bytes per slot instead of 9, while arena
+ * could still be as large as MaxArena
+ */
+template <typename T, size_t Align = 8> class OffsetRef {
+public:
+    typedef uint32_t Type;
+
+    static const size_t MaxArena = (size_t(1) << 32) * Align;
+
+    explicit OffsetRef(char *base = nullptr) : _base(base) {}
+
+    T *Decode(uint32_t ref) const { return reinterpret_cast<T *>(_base + size_t(ref) * Align); }
+    uint32_t Encode(T *value) const { return uint32_t(size_t(reinterpret_cast<char *>(value) - _base) / Align); }
+
+private:
+    char *_base;
+};
+
+template <typename T, size_t Align> const size_t OffsetRef<T, Align>::MaxArena;
+
+/**
+ * # Open addressing hash index
+ * Flat hash table that maps keys to pointers of type T. Table doesn't own pointed objects and doesn't store
+ * keys, instead Traits are used to get back to the key of an element:
+ * - static uint64_t Traits::Hash(const T *): hash of the element key, used on rehash and scan only
+ * - static bool Traits::Equals(const T *, const char *key, size_t size): compares element key with the given one
+ *
+ * Ref turns pointers into what slots actually keep and back, PointerRef by default. Elements that all live in
+ * one arena could be kept as OffsetRef instead, which makes slot twice smaller.
+ *
+ * Slots are split in groups of 16. Each slot has a control byte, which is either empty/deleted marker or 7 bits
+ * tag taken from the key hash. Lookup compares all 16 control bytes of the group with the tag at once using
+ * SSE2, so most of the time the only memory touched besides control bytes is the element being searched.
+ *
+ * Groups are probed in triangular sequence, probe stops at first group that has an empty slot. Deleted slots
+ * are turned back into empty when that is safe, i.e if group has an empty slot nobody could probe through it.
+ *
+ * Class is not thread safe.
+ */
+template <typename T, typename Traits, typename Ref = PointerRef<T>> class FlatIndex {
+public:
+    static const size_t GroupSize = 16;
+
+    // How many lookups ahead FindMany prefetches
+    static const size_t PrefetchDistance = 8;
+
+    FlatIndex(size_t capacity = GroupSize, Ref ref = Ref()) : _ref(ref), _ctrl(nullptr), _slots(nullptr), _size(0) {
+        init(round(capacity));
+    }
+    ~FlatIndex() { release(); }
+
+    FlatIndex(const FlatIndex &) = delete;
+    FlatIndex &operator=(const FlatIndex &) = delete;
+
+    /**
+     * Returns element with the given key or nullptr if there is no such
+     */
+    T *Find(uint64_t hash, const char *key, size_t size) const {
+        size_t pos = slot(hash, key, size);
+        return pos == npos ? nullptr : _ref.Decode(_slots[pos]);
+    }
+
+    /**
+     * Inserts new element into the index. Element with the same key must not be present in index
+     */
+    void Insert(uint64_t hash, T *value) {
+        if (_growth_left == 0) {
+            // Too many tombstones: rehash in place, otherwise grow
+            rehash(_size * 2 <= max_load(_capacity) ? _capacity : _capacity * 2);
+        }
+
+        size_t pos = free_slot(hash);
+        if (_ctrl[pos] == kEmpty) {
+            _growth_left--;
+        }
+        _ctrl[pos] = tag(hash);
+        _slots[pos] = _ref.Encode(value);
+        _size++;
+    }
+
+    /**
+     * Replaces element that has the same key as the given one and returns the replaced element, or returns
+     * nullptr and does nothing if there were no such element
+     */
+    T *Replace(uint64_t hash, const char *key, size_t size, T *value) {
+        size_t pos = slot(hash, key, size);
+        if (pos == npos) {
+            return nullptr;
+        }
+
+        T *result = _ref.Decode(_slots[pos]);
+        _slots[pos] = _ref.Encode(value);
+        return result;
+    }
+
+    /**
+     * Removes element with the given key from the index and returns it, or returns nullptr if
+     * there were no such element
+     */
+    T *Erase(uint64_t hash, const char *key, size_t size) {
+        size_t pos = slot(hash, key, size);
+        if (pos == npos) {
+            return nullptr;
+        }
+
+        T *result = _ref.Decode(_slots[pos]);
+        size_t group = pos & ~(GroupSize - 1);
+        if (match_empty(group) != 0) {
+            _ctrl[pos] = kEmpty;
+            _growth_left++;
+        } else {
+            _ctrl[pos] = kDeleted;
+        }
+        _slots[pos] = Slot();
+        _size--;
+        return result;
+    }
+
+    /**
+     * Hints CPU to load control bytes and element pointers of the group probe for given hash starts from
+     */
+    void Prefetch(uint64_t hash) const {
+        size_t pos = start(hash);
+        __builtin_prefetch(&_ctrl[pos]);
+        __builtin_prefetch(&_slots[pos]);
+    }
+
+    /**
+     * Looks up n keys in order, calling f(i, T *) for each of them with nullptr if key is absent. Keys must have
+     * data() and size(). Groups of the next keys are prefetched while current one is probed, so cache misses
+     * of independent lookups overlap instead of going one after another. Function could erase elements, but
+     * must not insert them
+     */
+    template <typename K, typename F> void FindMany(const uint64_t *hashes, const K *keys, size_t n, F f) const {
+        for (size_t i = 0; i < n && i < PrefetchDistance; i++) {
+            Prefetch(hashes[i]);
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (i + PrefetchDistance < n) {
+                Prefetch(hashes[i + PrefetchDistance]);
+            }
+            f(i, Find(hashes[i], keys[i].data(), keys[i].size()));
+        }
+    }
+
+    /**
+     * Returns element stored in the given slot or nullptr if slot is free. Allows to walk over the
+     * index in slot order, position must be less than Capacity()
+     */
+    T *At(size_t pos) const { return _ctrl[pos] >= 0 ? _ref.Decode(_slots[pos]) : nullptr; }
+
+    /**
+     * Calls f(T *) for each element in the index. Function must not modify the index
+     */
+    template <typename F> void ForEach(F f) const {
+        for (size_t i = 0; i < _capacity; i++) {
+            if (_ctrl[i] >= 0) {
+                f(_ref.Decode(_slots[i]));
+            }
+        }
+    }
+
+    /**
+     * Calls f(T *) for each element whose probe sequence starts at the group cursor points to and returns cursor
+     * of the next group, or 0 once all groups are visited. Scan starts with cursor 0.
+     *
+     * Cursor is the group number with bits reversed and incremented from the top, as Redis does for its
+     * dictionaries. Group of an element is taken from the low bits of its hash, so when capacity doubles, groups
+     * already visited split into groups that are still ordered before the cursor, and no element present for the
+     * whole scan is missed, though some could be visited twice. Elements never leave the probe sequence of their
+     * group, so tombstones and rehash in place don't matter either. Function must not modify the index
+     */
+    template <typename F> uint64_t Scan(uint64_t cursor, F f) const {
+        uint64_t mask = _capacity / GroupSize - 1;
+        size_t home = size_t(cursor & mask) * GroupSize;
+
+        // Same walk as lookup does, it stops at the first group with an empty slot
+        size_t group = home;
+        for (size_t step = GroupSize;; step += GroupSize) {
+            for (uint32_t m = ~match_free(group) & 0xffff; m != 0; m &= m - 1) {
+                size_t pos = group + __builtin_ctz(m);
+                T *value = _ref.Decode(_slots[pos]);
+                if (start(Traits::Hash(value)) == home) {
+                    f(value);
+                }
+            }
+            if (match_empty(group) != 0) {
+                break;
+            }
+            group = (group + step) & (_capacity - 1);
+        }
+
+        return reverse(reverse(cursor | ~mask) + 1);
+    }
+
+    // Number of elements in the index
+    size_t Size() const { return _size; }
+
+    // Number of slots in the index
+    size_t Capacity() const { return _capacity; }
+
+    // Bytes used by index itself, not including elements
+    size_t MemoryUsage() const { return _capacity * (sizeof(int8_t) + sizeof(Slot)); }
+
+private:
+    typedef typename Ref::Type Slot;
+
+    static const int8_t kEmpty = -128;
+    static const int8_t kDeleted = -2;
+    static const size_t npos = size_t(-1);
+
+    // Keeps load factor under 7/8
+    static size_t max_load(size_t capacity) { return capacity - capacity / 8; }
+
+    static size_t round(size_t capacity) {
+        size_t result = GroupSize;
+        while (max_load(result) < capacity) {
+            result *= 2;
+        }
+        return result;
+    }
+
+    static int8_t tag(uint64_t hash) { return int8_t(hash & 0x7f); }
+
+    size_t start(uint64_t hash) const { return ((hash >> 7) * GroupSize) & (_capacity - 1); }
+
+    static uint64_t reverse(uint64_t v) {
+        v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+        v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+        v = ((v >> 4) & 0x0f0f0f0f0f0f0f0fULL) | ((v & 0x0f0f0f0f0f0f0f0fULL) << 4);
+        return __builtin_bswap64(v);
+    }
+
+    // Bitmask of slots in the group whose control byte equals to b
+    uint32_t match(size_t group, int8_t b) const {
+#ifdef __SSE2__
+        __m128i ctrl = _mm_load_si128(reinterpret_cast<const __m128i *>(&_ctrl[group]));
+        return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(b))));
+#else
+        uint32_t result = 0;
+        for (size_t i = 0; i < GroupSize; i++) {
+            result |= uint32_t(_ctrl[group + i] == b) << i;
+        }
+        return result;
+#endif
+    }
+
+    uint32_t match_empty(size_t group) const { return match(group, kEmpty); }
+
+    // Bitmask of slots in the group that are either empty or deleted, both have sign bit set
+    uint32_t match_free(size_t group) const {
+#ifdef __SSE2__
+        __m128i ctrl = _mm_load_si128(reinterpret_cast<const __m128i *>(&_ctrl[group]));
+        return uint32_t(_mm_movemask_epi8(ctrl));
+#else
+        uint32_t result = 0;
+        for (size_t i = 0; i < GroupSize; i++) {
+            result |= uint32_t(_ctrl[group + i] < 0) << i;
+        }
+        return result;
+#endif
+    }
+
+    // Position of the slot holding given key or npos
+    size_t slot(uint64_t hash, const char *key, size_t size) const {
+        int8_t t = tag(hash);
+        size_t group = start(hash);
+        for (size_t step = GroupSize;; step += GroupSize) {
+            for (uint32_t m = match(group, t); m != 0; m &= m - 1) {
+                size_t pos = group + __builtin_ctz(m);
+                if (Traits::Equals(_ref.Decode(_slots[pos]), key, size)) {
+                    return pos;
+                }
+            }
+            if (match_empty(group) != 0) {
+                return npos;
+            }
+            group = (group + step) & (_capacity - 1);
+        }
+    }
+
+    // Position of the first empty or deleted slot in probe sequence
+    size_t free_slot(uint64_t hash) const {
+        size_t group = start(hash);
+        for (size_t step = GroupSize;; step += GroupSize) {
+            uint32_t m = match_free(group);
+            if (m != 0) {
+                return group + __builtin_ctz(m);
+            }
+            group = (group + step) & (_capacity - 1);
+        }
+    }
+
+    void init(size_t capacity) {
+        _capacity = capacity;
+        _growth_left = max_load(capacity);
+        void *ctrl = nullptr;
+        if (posix_memalign(&ctrl, GroupSize, capacity) == 0) {
+            _ctrl = static_cast<int8_t *>(ctrl);
+        }
+        _slots = static_cast<Slot *>(std::calloc(capacity, sizeof(Slot)));
+        if (_ctrl == nullptr || _slots == nullptr) {
+            release();
+            throw std::bad_alloc();
+        }
+        std::memset(_ctrl, kEmpty, capacity);
+    }
+
+    void release() {
+        std::free(_ctrl);
+        std::free(_slots);
+        _ctrl = nullptr;
+        _slots = nullptr;
+    }
+
+    void rehash(size_t capacity) {
+        int8_t *old_ctrl = _ctrl;
+        Slot *old_slots = _slots;
+        size_t old_capacity = _capacity;
+        size_t old_growth_left = _growth_left;
+
+        _ctrl = nullptr;
+        _slots = nullptr;
+        try {
+            init(capacity);
+        } catch (std::bad_alloc &) {
+            _ctrl = old_ctrl;
+            _slots = old_slots;
+            _capacity = old_capacity;
+            _growth_left = old_growth_left;
+            throw;
+        }
+
+        for (size_t i = 0; i < old_capacity; i++) {
+            if (old_ctrl[i] >= 0) {
+                uint64_t hash = Traits::Hash(_ref.Decode(old_slots[i]));
+                size_t pos = free_slot(hash);
+                _ctrl[pos] = tag(hash);
+                _slots[pos] = old_slots[i];
+                _growth_left--;
+            }
+        }
+
+        std::free(old_ctrl);
+        std::free(old_slots);
+    }
+
+    Ref _ref;
+
+    // Control bytes, one per slot
+    int8_t *_ctrl;
+
+    // Elements as kept by Ref, one per slot
+    Slot *_slots;
+
+    // Number of slots, power of 2 and multiple of group size
+    size_t _capacity;
+
+    // Number of elements in the table
+    size_t _size;
+
+    // Number of empty slots could be consumed before rehash
+    size_t _growth_left;
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_FLAT_INDEX_H
@@ -0,0 +1,105 @@
+#include "FrequencySketch.h"
+
+#include <algorithm>
+
+namespace Afina {
+namespace Backend {
+
+static const uint64_t Seeds[] = {0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL,
+                                 0xcbf29ce484222325ULL};
+
+// Mixes the key hash with row seed, so that rows are independent enough
+static uint64_t rehash(uint64_t hash, unsigned row) {
+    uint64_t h = (hash + Seeds[row]) * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 32);
+}
+
+// See FrequencySketch.h
+FrequencySketch::FrequencySketch(size_t items) : _samples(0) {
+    size_t width = 1024;
+    while (width < items) {
+        width <<= 1;
+    }
+    _mask = width - 1;
+
+    // 4 rows of width counters, 16 counters per word
+    _table.resize(width / 4, 0);
+    _doorkeeper.resize(width / 16, 0);
+    _sample_size = 10 * width;
+}
+
+// Conservative update: only the smallest counters are incremented, that keeps overestimation low
+void FrequencySketch::Increment(uint64_t hash) {
+    if (!set_doorkeeper(hash)) {
+        return;
+    }
+
+    size_t counters[4];
+    unsigned min = 15;
+    for (unsigned row = 0; row < 4; row++) {
+        counters[row] = counter(hash, row);
+        min = std::min(min, unsigned(_table[counters[row] / 16] >> (counters[row] % 16 * 4)) & 0xf);
+    }
+    if (min == 15) {
+        return;
+    }
+
+    for (unsigned row = 0; row < 4; row++) {
+        uint64_t &word = _table[counters[row] / 16];
+        unsigned shift = counters[row] % 16 * 4;
+        if (((word >> shift) & 0xf) == min) {
+            word += uint64_t(1) << shift;
+        }
+    }
+
+    if (++_samples >= _sample_size) {
+        reset();
+    }
+}
+
+// See FrequencySketch.h
+unsigned FrequencySketch::Frequency(uint64_t hash) const {
+    unsigned min = 15;
+    for (unsigned row = 0; row < 4; row++) {
+        size_t c = counter(hash, row);
+        min = std::min(min, unsigned(_table[c / 16] >> (c % 16 * 4)) & 0xf);
+    }
+    return min + (test_doorkeeper(hash) ? 1 : 0);
+}
+
+// See FrequencySketch.h
+size_t FrequencySketch::counter(uint64_t hash, unsigned row) const {
+    return row * (_mask + 1) + (rehash(hash, row) & _mask);
+}
+
+// Doorkeeper uses two bits out of 4 * width
+bool FrequencySketch::test_doorkeeper(uint64_t hash) const {
+    size_t bits = _doorkeeper.size() * 64 - 1;
+    size_t a = hash & bits, b = (hash >> 32) & bits;
+    return (_doorkeeper[a / 64] >> (a % 64) & 1) && (_doorkeeper[b / 64] >> (b % 64) & 1);
+}
+
+// Returns true if key has been there already
+bool FrequencySketch::set_doorkeeper(uint64_t hash) {
+    if (test_doorkeeper(hash)) {
+        return true;
+    }
+
+    size_t bits = _doorkeeper.size() * 64 - 1;
+    size_t a = hash & bits, b = (hash >> 32) & bits;
+    _doorkeeper[a / 64] |= uint64_t(1) << (a % 64);
+    _doorkeeper[b / 64] |= uint64_t(1) << (b % 64);
+    return false;
+}
+
+// See FrequencySketch.h
+void FrequencySketch::reset() {
+    for (auto &word : _table) {
+        word = (word >> 1) & 0x7777777777777777ULL;
+    }
+    std::fill(_doorkeeper.begin(), _doorkeeper.end(), 0);
+    _samples /= 2;
+}
+
+} // namespace Backend
+} // namespace Afina
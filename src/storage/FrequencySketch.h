@@ -0,0 +1,58 @@
+#ifndef AFINA_STORAGE_FREQUENCY_SKETCH_H
+#define AFINA_STORAGE_FREQUENCY_SKETCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Approximate access frequency of keys
+ * Count-min sketch of 4 rows with 4 bit saturating counters, in front of which sits a doorkeeper bloom filter:
+ * the first access of a key only sets its doorkeeper bits, so one-hit wonders never reach the counters.
+ *
+ * Once number of recorded accesses reaches sample size all counters are halved and doorkeeper is cleared,
+ * so frequencies reflect recent history rather than all the time since start.
+ */
+class FrequencySketch {
+public:
+    /**
+     * @param items expected number of distinct keys in the cache, defines the sketch width
+     */
+    FrequencySketch(size_t items);
+
+    /**
+     * Records one more access of the key with the given hash
+     */
+    void Increment(uint64_t hash);
+
+    /**
+     * Estimated number of recent accesses of the key, never less than the real one until it is aged
+     */
+    unsigned Frequency(uint64_t hash) const;
+
+private:
+    // Each 64 bit word holds 16 counters
+    std::vector<uint64_t> _table;
+    std::vector<uint64_t> _doorkeeper;
+    size_t _mask;
+
+    size_t _samples;
+    size_t _sample_size;
+
+    // Index of the counter in the row, rows use different parts of the rehashed key hash
+    size_t counter(uint64_t hash, unsigned row) const;
+
+    bool test_doorkeeper(uint64_t hash) const;
+    bool set_doorkeeper(uint64_t hash);
+
+    // Halves all counters and clears doorkeeper
+    void reset();
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_FREQUENCY_SKETCH_H
@@ -0,0 +1,62 @@
+#ifndef AFINA_STORAGE_HASH_H
+#define AFINA_STORAGE_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * 64-bit MurmurHash2 (MurmurHash64A) over raw bytes. Storage engines need a hash of key bytes that are not
+ * necessary kept in std::string, and also need good entropy in both low and high bits as they used for
+ * different purposes (shard/bucket selection and tags)
+ */
+inline uint64_t Hash(const char *data, size_t len, uint64_t seed = 0xc70f6907UL) {
+    const uint64_t m = 0xc6a4a7935bd1e995ULL;
+    const int r = 47;
+
+    uint64_t h = seed ^ (len * m);
+
+    const char *end = data + (len & ~size_t(7));
+    for (const char *p = data; p != end; p += 8) {
+        uint64_t k;
+        std::memcpy(&k, p, sizeof(k));
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    switch (len & 7) {
+    case 7:
+        h ^= uint64_t(uint8_t(end[6])) << 48;
+    case 6:
+        h ^= uint64_t(uint8_t(end[5])) << 40;
+    case 5:
+        h ^= uint64_t(uint8_t(end[4])) << 32;
+    case 4:
+        h ^= uint64_t(uint8_t(end[3])) << 24;
+    case 3:
+        h ^= uint64_t(uint8_t(end[2])) << 16;
+    case 2:
+        h ^= uint64_t(uint8_t(end[1])) << 8;
+    case 1:
+        h ^= uint64_t(uint8_t(end[0]));
+        h *= m;
+    };
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_HASH_H
@@ -0,0 +1,303 @@
+#ifndef AFINA_STORAGE_ITEM_H
+#define AFINA_STORAGE_ITEM_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include <afina/ValueRef.h>
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Storage item
+ * Header, LRU links, key and value live in a single allocation:
+ *
+ * | prev | next | hash | key_size | value_size | capacity | refs | segment | flags | expire_at | version |
+ * | key | value |
+ *
+ * So each entry costs exactly one allocation and there is no extra pointer chasing from the header to the
+ * data. Value could be updated in place as long as new one fits into the capacity reserved.
+ *
+ * Items that expire are allocated with TimerLinks right in front of the header, so that TimingWheel could link
+ * them without any extra memory, while items that never expire don't pay for it.
+ *
+ * Storage holds one reference on the item while it is linked, each ValueRef handed out holds one more. Item
+ * is freed by whoever drops the last reference, and must not be updated in place while it is shared.
+ */
+struct Item {
+    // LRU list links
+    Item *prev;
+    Item *next;
+
+    // Hash of the key, saved to not rehash key on index grow and eviction
+    uint64_t hash;
+
+    uint32_t key_size;
+    uint32_t value_size;
+
+    // Number of bytes reserved for the value
+    uint32_t capacity;
+
+    // Number of owners, fits into padding after capacity
+    std::atomic<uint32_t> refs;
+
+    // List of the eviction policy item is linked into
+    uint8_t segment;
+
+    // Combination of Flags
+    uint8_t flags;
+
+    // Unix time item expires at, 0 if never
+    uint32_t expire_at;
+
+    // Assigned by storage on every modification, compared by cas
+    uint64_t version;
+
+    enum Flags : uint8_t {
+        // TimerLinks are allocated in front of the item
+        HasTimer = 1,
+
+        // Value is native uint64_t updated by incr/decr instead of text, it is turned into text on read
+        Counter = 2,
+
+        // Chunk holds an item, set by slab based storages until chunk is freed, so that a page could be walked
+        // chunk by chunk telling items from free chunks
+        Allocated = 4
+    };
+
+    const char *key() const { return reinterpret_cast<const char *>(this + 1); }
+    char *value() { return reinterpret_cast<char *>(this + 1) + key_size; }
+    const char *value() const { return reinterpret_cast<const char *>(this + 1) + key_size; }
+
+    bool Equals(const char *k, size_t size) const { return key_size == size && std::memcmp(key(), k, size) == 0; }
+
+    bool Expired(uint32_t now) const { return expire_at != 0 && expire_at <= now; }
+
+    // Size of key and value as seen by client
+    size_t Size() const { return key_size + value_size; }
+
+    // Assigns new value, it must fit into capacity
+    void Assign(const char *data, size_t size) {
+        std::memcpy(value(), data, size);
+        value_size = uint32_t(size);
+        // Flags are written only if needed, chunk walkers may read them concurrently with in place updates
+        if (flags & Counter) {
+            flags &= ~Counter;
+        }
+    }
+
+    // Value of the counter item
+    uint64_t Number() const {
+        uint64_t result;
+        std::memcpy(&result, value(), sizeof(result));
+        return result;
+    }
+
+    // Turns item into counter with the given value, capacity must be enough for uint64_t
+    void SetNumber(uint64_t number) {
+        std::memcpy(value(), &number, sizeof(number));
+        value_size = sizeof(number);
+        flags |= Counter;
+    }
+
+    // Value as client sees it
+    std::string Text() const {
+        return (flags & Counter) ? std::to_string(Number()) : std::string(value(), value_size);
+    }
+
+    // Adds data to the end of value, or to the beginning if front is set, result must fit into capacity
+    void Extend(const char *data, size_t size, bool front) {
+        if (front) {
+            std::memmove(value() + size, value(), value_size);
+            std::memcpy(value(), data, size);
+        } else {
+            std::memcpy(value() + value_size, data, size);
+        }
+        value_size += uint32_t(size);
+    }
+
+    /**
+     * Number of bytes item with given key size and value capacity occupies
+     */
+    static size_t AllocSize(size_t key_size, size_t capacity) { return sizeof(Item) + key_size + capacity; }
+
+    /**
+     * Constructs item in the given memory, which must be at least AllocSize(key_size, capacity) bytes
+     */
+    static Item *Init(void *mem, uint64_t hash, const char *key, size_t key_size, const char *value,
+                      size_t value_size, size_t capacity) {
+        Item *item = static_cast<Item *>(mem);
+        item->prev = nullptr;
+        item->next = nullptr;
+        item->hash = hash;
+        item->key_size = uint32_t(key_size);
+        item->capacity = uint32_t(capacity);
+        new (&item->refs) std::atomic<uint32_t>(1);
+        item->segment = 0;
+        item->flags = 0;
+        item->expire_at = 0;
+        item->version = 0;
+        std::memcpy(const_cast<char *>(item->key()), key, key_size);
+        item->Assign(value, value_size);
+        return item;
+    }
+
+    /**
+     * Allocates new item for the given key/value, capacity reserved for value is at least value size. Item that
+     * is going to be put into TimingWheel must be created with timer
+     */
+    static Item *Create(uint64_t hash, const char *key, size_t key_size, const char *value, size_t value_size,
+                        size_t capacity = 0, bool timer = false);
+
+    static Item *Create(uint64_t hash, const std::string &key, const std::string &value, size_t capacity = 0,
+                        bool timer = false) {
+        return Create(hash, key.data(), key.size(), value.data(), value.size(), capacity, timer);
+    }
+
+    static void Destroy(Item *item);
+
+    // True if there are views on the value besides the storage itself
+    bool Shared() const { return refs.load(std::memory_order_acquire) > 1; }
+
+    void Acquire() { refs.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * Drops one reference, item created by Create is destroyed once the last one is gone
+     */
+    static void Release(Item *item) {
+        if (item->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            Destroy(item);
+        }
+    }
+
+    /**
+     * Takes one more reference on the item and returns view on its value holding it
+     */
+    ValueRef Share() {
+        if (flags & Counter) {
+            // Counter is updated in place, so view gets its own text
+            return ValueRef(Text());
+        }
+        Acquire();
+        return ValueRef(value(), value_size, this, [](void *owner) { Release(static_cast<Item *>(owner)); });
+    }
+};
+
+/**
+ * Links of the TimingWheel slot list, live right before the item header. Same as in linux hlist, pprev points to
+ * the pointer to this item, so that item could be unlinked without knowing which slot it is in
+ */
+struct TimerLinks {
+    Item *next;
+    Item **pprev;
+
+    static TimerLinks *Of(Item *item) { return reinterpret_cast<TimerLinks *>(item) - 1; }
+};
+
+inline Item *Item::Create(uint64_t hash, const char *key, size_t key_size, const char *value, size_t value_size,
+                          size_t capacity, bool timer) {
+    if (capacity < value_size) {
+        capacity = value_size;
+    }
+
+    size_t prefix = timer ? sizeof(TimerLinks) : 0;
+    char *mem = static_cast<char *>(::operator new(prefix + AllocSize(key_size, capacity)));
+    Item *item = Init(mem + prefix, hash, key, key_size, value, value_size, capacity);
+    if (timer) {
+        item->flags |= HasTimer;
+    }
+    return item;
+}
+
+inline void Item::Destroy(Item *item) {
+    if (item->flags & HasTimer) {
+        ::operator delete(TimerLinks::Of(item));
+    } else {
+        ::operator delete(item);
+    }
+}
+
+/**
+ * Intrusive doubly linked list of items, ordered from most to least recently used. List doesn't own items
+ */
+class ItemList {
+public:
+    ItemList() : _head(nullptr), _tail(nullptr) {}
+
+    Item *front() const { return _head; }
+    Item *back() const { return _tail; }
+
+    // Whether item is linked into this list, given it is either linked here or not linked anywhere
+    bool contains(const Item *item) const { return item->prev != nullptr || item == _head; }
+
+    void push_front(Item *item) {
+        item->prev = nullptr;
+        item->next = _head;
+        if (_head != nullptr) {
+            _head->prev = item;
+        } else {
+            _tail = item;
+        }
+        _head = item;
+    }
+
+    void erase(Item *item) {
+        if (item->prev != nullptr) {
+            item->prev->next = item->next;
+        } else {
+            _head = item->next;
+        }
+        if (item->next != nullptr) {
+            item->next->prev = item->prev;
+        } else {
+            _tail = item->prev;
+        }
+        item->prev = nullptr;
+        item->next = nullptr;
+    }
+
+    void move_to_front(Item *item) {
+        if (item != _head) {
+            erase(item);
+            push_front(item);
+        }
+    }
+
+    // Puts item in place of the one linked already
+    void replace(Item *old_item, Item *item) {
+        item->prev = old_item->prev;
+        item->next = old_item->next;
+        if (item->prev != nullptr) {
+            item->prev->next = item;
+        } else {
+            _head = item;
+        }
+        if (item->next != nullptr) {
+            item->next->prev = item;
+        } else {
+            _tail = item;
+        }
+    }
+
+private:
+    Item *_head;
+    Item *_tail;
+};
+
+/**
+ * Allows to put items into FlatIndex
+ */
+struct ItemTraits {
+    static uint64_t Hash(const Item *item) { return item->hash; }
+    static bool Equals(const Item *item, const char *key, size_t size) { return item->Equals(key, size); }
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_ITEM_H
@@ -0,0 +1,590 @@
+#include "LogStructuredImpl.h"
+
+#include <chrono>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Counter.h"
+#include "Cursor.h"
+
+namespace Afina {
+namespace Backend {
+
+const size_t LogStructuredImpl::DefaultSegmentSize;
+const size_t LogStructuredImpl::MaxKeySize;
+const size_t LogStructuredImpl::MinSegments;
+constexpr double LogStructuredImpl::TargetUtilization;
+constexpr double LogStructuredImpl::MinUtilization;
+constexpr double LogStructuredImpl::MaxCleanUtilization;
+const size_t LogStructuredImpl::FreeAhead;
+const size_t LogStructuredImpl::EntriesPerSegment;
+const size_t LogStructuredImpl::None;
+
+// Reserves address space without committing memory, pages become resident only once segments are written
+static char *map_arena(size_t size) {
+    void *arena = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena == MAP_FAILED) {
+        throw std::runtime_error("Failed to mmap segment arena");
+    }
+    return static_cast<char *>(arena);
+}
+
+// CPU time of the calling thread in nanoseconds, so that cleaner cost doesn't include time spent waiting for lock
+static uint64_t thread_cpu() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+}
+
+// Number of segments of the given size memory is split into, throws if there are too few or too many of them
+static size_t segment_count(size_t max_size, size_t segment_size) {
+    if (segment_size == 0 || max_size / segment_size < LogStructuredImpl::MinSegments) {
+        throw std::invalid_argument("Memory must fit at least " + std::to_string(LogStructuredImpl::MinSegments) +
+                                    " segments");
+    }
+    size_t count = max_size / segment_size;
+    if (count > OffsetRef<char>::MaxArena / segment_size) {
+        throw std::invalid_argument("Memory must not exceed " + std::to_string(OffsetRef<char>::MaxArena) + " bytes");
+    }
+    return count;
+}
+
+// Segments are handed out from the lowest address, free list keeps them in reverse order for that
+LogStructuredImpl::LogStructuredImpl(size_t max_size, size_t segment_size)
+    : _max_size(max_size), _segment_size(segment_size & ~size_t(7)),
+      _arena(map_arena(segment_count(max_size, _segment_size) * _segment_size)),
+      _release_pages(_segment_size % size_t(sysconf(_SC_PAGESIZE)) == 0), _head(None), _cleaner_head(None),
+      _index(FlatIndex<Entry, EntryTraits, OffsetRef<Entry>>::GroupSize, OffsetRef<Entry>(_arena)), _size(0),
+      _dead_sealed(0), _version(0), _sealed(0), _evictions(0), _cleaned(0), _foreground_cleaned(0), _relocated(0),
+      _cleaner_nsec(0), _running(false) {
+    _segments.assign(max_size / _segment_size, Segment{0, 0, 0, SegmentState::Free});
+    for (size_t i = _segments.size(); i > 0; i--) {
+        _free.push_back(i - 1);
+    }
+}
+
+// Entries live in the arena, so there is nothing to free one by one
+LogStructuredImpl::~LogStructuredImpl() {
+    Stop();
+    munmap(_arena, _segments.size() * _segment_size);
+}
+
+// See LogStructuredImpl.h
+void LogStructuredImpl::Start() {
+    std::unique_lock<std::mutex> guard(_cleaner_lock);
+    if (!_running) {
+        _running = true;
+        _cleaner = std::thread(&LogStructuredImpl::run_cleaner, this);
+    }
+}
+
+// See LogStructuredImpl.h
+void LogStructuredImpl::Stop() {
+    {
+        std::unique_lock<std::mutex> guard(_cleaner_lock);
+        _running = false;
+    }
+    _cleaner_wakeup.notify_all();
+    if (_cleaner.joinable()) {
+        _cleaner.join();
+    }
+}
+
+// See LogStructuredImpl.h
+bool LogStructuredImpl::Put(const std::string &key, const std::string &value) {
+    std::unique_lock<std::mutex> guard(_lock);
+    return write(Hash(key.data(), key.size()), key, value, false);
+}
+
+// See LogStructuredImpl.h
+bool LogStructuredImpl::PutIfAbsent(const std::string &key, const std::string &value) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    uint64_t hash = Hash(key.data(), key.size());
+    if (_index.Find(hash, key.data(), key.size()) != nullptr) {
+        return false;
+    }
+    return write(hash, key, value, false);
+}
+
+// See LogStructuredImpl.h
+bool LogStructuredImpl::Set(const std::string &key, const std::string &value) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    uint64_t hash = Hash(key.data(), key.size());
+    if (_index.Find(hash, key.data(), key.size()) == nullptr) {
+        return false;
+    }
+    return write(hash, key, value, true);
+}
+
+// Entry stays in its segment until cleaner gets there, only its bytes stop counting as live
+bool LogStructuredImpl::Delete(const std::string &key) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Entry *entry = _index.Erase(Hash(key.data(), key.size()), key.data(), key.size());
+    if (entry == nullptr) {
+        return false;
+    }
+    kill(entry);
+    return true;
+}
+
+// See LogStructuredImpl.h
+bool LogStructuredImpl::Append(const std::string &key, const std::string &data) { return extend(key, data, false); }
+
+// See LogStructuredImpl.h
+bool LogStructuredImpl::Prepend(const std::string &key, const std::string &data) { return extend(key, data, true); }
+
+// See LogStructuredImpl.h
+bool LogStructuredImpl::Increment(const std::string &key, uint64_t delta, uint64_t &result) {
+    return change(key, delta, false, result);
+}
+
+// See LogStructuredImpl.h
+bool LogStructuredImpl::Decrement(const std::string &key, uint64_t delta, uint64_t &result) {
+    return change(key, delta, true, result);
+}
+
+// See LogStructuredImpl.h
+bool LogStructuredImpl::Get(const std::string &key, std::string &value) const {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Entry *entry = find(Hash(key.data(), key.size()), key);
+    if (entry == nullptr) {
+        return false;
+    }
+    value.assign(entry->value(), entry->value_size);
+    return true;
+}
+
+// See LogStructuredImpl.h
+size_t LogStructuredImpl::GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const {
+    return get_many(keys, values, nullptr);
+}
+
+// See LogStructuredImpl.h
+size_t LogStructuredImpl::Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                               std::vector<uint64_t> &versions) const {
+    versions.assign(keys.size(), 0);
+    return get_many(keys, values, versions.data());
+}
+
+// Expiration is not supported by this storage, so it is ignored as in other TTL overloads
+Storage::CasResult LogStructuredImpl::Cas(const std::string &key, const std::string &value, uint64_t version,
+                                          time_t expire_at) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    uint64_t hash = Hash(key.data(), key.size());
+    Entry *entry = _index.Find(hash, key.data(), key.size());
+    if (entry == nullptr) {
+        return CasResult::NotFound;
+    } else if (entry->version != version) {
+        return CasResult::Exists;
+    }
+    return write(hash, key, value, true) ? CasResult::Stored : CasResult::NotStored;
+}
+
+// Same as SlabImpl::Load, space in segments could only be taken under the lock
+size_t LogStructuredImpl::Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                               const std::vector<time_t> &expire_at) {
+    std::vector<uint64_t> hashes(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        hashes[i] = Hash(keys[i].data(), keys[i].size());
+    }
+
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t stored = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (_index.Find(hashes[i], keys[i].data(), keys[i].size()) == nullptr &&
+            write(hashes[i], keys[i], values[i], false)) {
+            stored++;
+        }
+    }
+    return stored;
+}
+
+// Same as FlatHashImpl::Scan, relocation replaces index slot in place, so cursor stays valid
+bool LogStructuredImpl::Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const {
+    uint64_t position = ParsePosition(cursor);
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t first = keys.size(), groups = 0;
+    do {
+        position = _index.Scan(position, [&keys](Entry *entry) { keys.emplace_back(entry->key(), entry->key_size); });
+    } while (position != 0 && keys.size() - first < count && ++groups < count);
+
+    cursor = std::to_string(position);
+    return true;
+}
+
+// Cleaner takes the same lock, so it doesn't move entries while f runs
+void LogStructuredImpl::Freeze(const std::function<void()> &f) {
+    std::unique_lock<std::mutex> guard(_lock);
+    f();
+}
+
+// See LogStructuredImpl.h
+void LogStructuredImpl::ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const {
+    _index.ForEach([&f](Entry *entry) {
+        f(std::string(entry->key(), entry->key_size), std::string(entry->value(), entry->value_size), 0);
+    });
+}
+
+// Utilization is client data relative to memory taken by segments in use, headers and dead entries included
+void LogStructuredImpl::GetStats(std::vector<std::pair<std::string, std::string>> &stats) const {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t in_use = (_segments.size() - _free.size()) * _segment_size;
+    stats.emplace_back("curr_items", std::to_string(_index.Size()));
+    stats.emplace_back("bytes", std::to_string(_size));
+    stats.emplace_back("limit_maxbytes", std::to_string(_max_size));
+    stats.emplace_back("evictions", std::to_string(_evictions));
+    stats.emplace_back("segments", std::to_string(_segments.size()));
+    stats.emplace_back("free_segments", std::to_string(_free.size()));
+    stats.emplace_back("segment_bytes", std::to_string(in_use));
+    stats.emplace_back("utilization", std::to_string(in_use == 0 ? 0 : 100 * _size / in_use));
+    stats.emplace_back("cleaned_segments", std::to_string(_cleaned));
+    stats.emplace_back("foreground_cleaned_segments", std::to_string(_foreground_cleaned));
+    stats.emplace_back("relocated_bytes", std::to_string(_relocated));
+    stats.emplace_back("cleaner_cpu_usec", std::to_string(_cleaner_nsec / 1000));
+    stats.emplace_back("index_bytes", std::to_string(_index.MemoryUsage()));
+}
+
+// See LogStructuredImpl.h
+LogStructuredImpl::Entry *LogStructuredImpl::find(uint64_t hash, const std::string &key) const {
+    Entry *entry = _index.Find(hash, key.data(), key.size());
+    if (entry != nullptr) {
+        entry->flags |= Entry::Accessed;
+    }
+    return entry;
+}
+
+// Entries move while space is made, so they are copied out under the lock
+size_t LogStructuredImpl::get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                                   uint64_t *versions) const {
+    std::vector<uint64_t> hashes(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        hashes[i] = Hash(keys[i].data(), keys[i].size());
+    }
+    values.clear();
+    values.resize(keys.size());
+
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t found = 0;
+    _index.FindMany(hashes.data(), keys.data(), keys.size(), [&values, versions, &found](size_t i, Entry *entry) {
+        if (entry == nullptr) {
+            return;
+        }
+        entry->flags |= Entry::Accessed;
+        values[i] = ValueRef(std::string(entry->value(), entry->value_size));
+        if (versions != nullptr) {
+            versions[i] = entry->version;
+        }
+        found++;
+    });
+    return found;
+}
+
+// Making room could relocate or evict the current entry of the key, so it is looked up only once space is taken
+bool LogStructuredImpl::write(uint64_t hash, const std::string &key, const std::string &value, bool existing) {
+    if (key.size() > MaxKeySize) {
+        return false;
+    }
+
+    Entry *entry = allocate(Entry::AllocSize(key.size(), value.size()));
+    if (entry == nullptr) {
+        return false;
+    }
+
+    entry->version = ++_version;
+    entry->key_size = uint16_t(key.size());
+    entry->value_size = uint32_t(value.size());
+    entry->flags = 0;
+    std::memcpy(entry + 1, key.data(), key.size());
+    std::memcpy(reinterpret_cast<char *>(entry + 1) + key.size(), value.data(), value.size());
+    _size += entry->Size();
+
+    Entry *old = _index.Replace(hash, key.data(), key.size(), entry);
+    if (old != nullptr) {
+        kill(old);
+    } else if (existing) {
+        // Space is taken already, new entry just stays dead in the segment
+        kill(entry);
+        return false;
+    } else {
+        _index.Insert(hash, entry);
+    }
+    return true;
+}
+
+// Entries are never changed in place, so new value is built aside and written as new entry
+bool LogStructuredImpl::extend(const std::string &key, const std::string &data, bool front) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    uint64_t hash = Hash(key.data(), key.size());
+    Entry *entry = _index.Find(hash, key.data(), key.size());
+    if (entry == nullptr) {
+        return false;
+    }
+
+    std::string value;
+    value.reserve(entry->value_size + data.size());
+    if (front) {
+        value.append(data).append(entry->value(), entry->value_size);
+    } else {
+        value.append(entry->value(), entry->value_size).append(data);
+    }
+    return write(hash, key, value, true);
+}
+
+// See LogStructuredImpl.h
+bool LogStructuredImpl::change(const std::string &key, uint64_t delta, bool decrement, uint64_t &result) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    uint64_t hash = Hash(key.data(), key.size());
+    Entry *entry = _index.Find(hash, key.data(), key.size());
+    if (entry == nullptr) {
+        return false;
+    }
+
+    result = ApplyDelta(ParseCounter(entry->value(), entry->value_size), delta, decrement);
+    return write(hash, key, std::to_string(result), true);
+}
+
+// See LogStructuredImpl.h
+void LogStructuredImpl::kill(Entry *entry) {
+    Segment &s = _segments[segment_of(entry)];
+    size_t footprint = entry->Footprint();
+    entry->flags |= Entry::Dead;
+    s.live -= footprint;
+    _size -= entry->Size();
+    if (s.state == SegmentState::Sealed) {
+        _dead_sealed += footprint;
+    }
+}
+
+// Cleaner is woken up once per segment written, when it has something to do
+LogStructuredImpl::Entry *LogStructuredImpl::allocate(size_t size) {
+    if (size > _segment_size / EntriesPerSegment) {
+        return nullptr;
+    }
+
+    if (_head == None || _segments[_head].used + size > _segment_size) {
+        if (_head != None) {
+            seal(_head);
+        }
+        make_room();
+        _head = open_segment();
+        catch_up();
+
+        size_t victim;
+        if (clean_needed(victim)) {
+            _cleaner_wakeup.notify_one();
+        }
+    }
+
+    Segment &s = _segments[_head];
+    Entry *entry = reinterpret_cast<Entry *>(segment_data(_head) + s.used);
+    s.used += size;
+    s.live += size;
+    return entry;
+}
+
+// Reserve segment guarantees there is a free segment for the next head, see make_room()
+LogStructuredImpl::Entry *LogStructuredImpl::relocation_space(size_t size) {
+    if (_cleaner_head == None || _segments[_cleaner_head].used + size > _segment_size) {
+        if (_cleaner_head != None) {
+            seal(_cleaner_head);
+        }
+        _cleaner_head = open_segment();
+    }
+
+    Segment &s = _segments[_cleaner_head];
+    Entry *entry = reinterpret_cast<Entry *>(segment_data(_cleaner_head) + s.used);
+    s.used += size;
+    s.live += size;
+    return entry;
+}
+
+// Index slot is replaced in place, so scans in progress don't notice the move
+void LogStructuredImpl::relocate(Entry *entry) {
+    size_t footprint = entry->Footprint();
+    Entry *copy = relocation_space(footprint);
+    std::memcpy(copy, entry, footprint);
+    _index.Replace(EntryTraits::Hash(entry), entry->key(), entry->key_size, copy);
+
+    kill(entry);
+    _size += copy->Size();
+    _relocated += footprint;
+}
+
+// See LogStructuredImpl.h
+size_t LogStructuredImpl::open_segment() {
+    if (_free.empty()) {
+        throw std::logic_error("No free segments left");
+    }
+    size_t id = _free.back();
+    _free.pop_back();
+    _segments[id].state = SegmentState::Head;
+    return id;
+}
+
+// Space left at the end of the segment is counted as dead, only cleaning could give it back
+void LogStructuredImpl::seal(size_t id) {
+    Segment &s = _segments[id];
+    s.state = SegmentState::Sealed;
+    s.sealed_at = ++_sealed;
+    _dead_sealed += _segment_size - s.live;
+}
+
+// Free segments are reused last in first out. The few on top of the list are left resident, as writers and
+// cleaner take them soon anyway, pages of the segment that sinks below them are dropped
+void LogStructuredImpl::release(size_t id) {
+    Segment &s = _segments[id];
+    _dead_sealed -= _segment_size - s.live;
+    s.used = 0;
+    s.live = 0;
+    s.state = SegmentState::Free;
+    _free.push_back(id);
+
+    if (_release_pages && _free.size() > 1 + FreeAhead) {
+        madvise(segment_data(_free[_free.size() - 2 - FreeAhead]), _segment_size, MADV_DONTNEED);
+    }
+}
+
+// Writers never take the last free segment, so that survivors of cleaning and eviction always have space: each
+// of them relocates less than a segment, cleaner head could take at most one free segment for that and the
+// segment being cleaned is freed afterwards. Cleaning frees at least 1 - MaxCleanUtilization of a segment,
+// which is more than the space left unused at the end of sealed cleaner head, and eviction clears accessed
+// flags, so the loop always ends
+void LogStructuredImpl::make_room() {
+    while (_free.size() <= 1) {
+        size_t victim = cleaning_victim();
+        if (victim != None) {
+            clean(victim);
+        } else {
+            evict(oldest());
+        }
+    }
+}
+
+// Memory in use grows only when a segment is opened, so that is when writer checks utilization. Cleaning takes
+// at most the free segment left in reserve and gives it back
+void LogStructuredImpl::catch_up() {
+    size_t victim;
+    while (below(MinUtilization) && (victim = cleaning_victim()) != None) {
+        clean(victim);
+        _foreground_cleaned++;
+    }
+}
+
+// Linear pass over segment table, it is tiny compared to the segment that is going to be copied
+size_t LogStructuredImpl::least_utilized() const {
+    size_t result = None;
+    for (size_t i = 0; i < _segments.size(); i++) {
+        if (_segments[i].state == SegmentState::Sealed &&
+            (result == None || _segments[i].live < _segments[result].live)) {
+            result = i;
+        }
+    }
+    return result;
+}
+
+// See LogStructuredImpl.h
+size_t LogStructuredImpl::oldest() const {
+    size_t result = None;
+    for (size_t i = 0; i < _segments.size(); i++) {
+        if (_segments[i].state == SegmentState::Sealed &&
+            (result == None || _segments[i].sealed_at < _segments[result].sealed_at)) {
+            result = i;
+        }
+    }
+    return result;
+}
+
+// See LogStructuredImpl.h
+size_t LogStructuredImpl::cleaning_victim() const {
+    size_t victim = least_utilized();
+    if (victim == None || _segments[victim].live > MaxCleanUtilization * _segment_size) {
+        return None;
+    }
+    return victim;
+}
+
+// See LogStructuredImpl.h
+bool LogStructuredImpl::below(double utilization) const {
+    size_t in_use = (_segments.size() - _free.size()) * _segment_size;
+    return _dead_sealed >= _segment_size && _size < utilization * in_use;
+}
+
+// Segments that are too full are left to eviction
+bool LogStructuredImpl::clean_needed(size_t &victim) const {
+    victim = cleaning_victim();
+    return victim != None && (_free.size() < 1 + FreeAhead || below(TargetUtilization));
+}
+
+// Entries are walked in the order they were appended, dead ones are just skipped
+void LogStructuredImpl::clean(size_t id) {
+    uint64_t start = thread_cpu();
+
+    char *data = segment_data(id);
+    for (size_t offset = 0; offset < _segments[id].used;) {
+        Entry *entry = reinterpret_cast<Entry *>(data + offset);
+        offset += entry->Footprint();
+        if ((entry->flags & Entry::Dead) == 0) {
+            relocate(entry);
+        }
+    }
+    release(id);
+    _cleaned++;
+
+    _cleaner_nsec += thread_cpu() - start;
+}
+
+// See LogStructuredImpl.h
+void LogStructuredImpl::evict(size_t id) {
+    char *data = segment_data(id);
+    for (size_t offset = 0; offset < _segments[id].used;) {
+        Entry *entry = reinterpret_cast<Entry *>(data + offset);
+        offset += entry->Footprint();
+        if ((entry->flags & Entry::Dead) != 0) {
+            continue;
+        } else if ((entry->flags & Entry::Accessed) != 0) {
+            entry->flags &= ~Entry::Accessed;
+            relocate(entry);
+        } else {
+            _index.Erase(EntryTraits::Hash(entry), entry->key(), entry->key_size);
+            kill(entry);
+            _evictions++;
+        }
+    }
+    release(id);
+}
+
+// Storage lock is taken for one segment at a time, so writers and readers interleave with cleaning
+void LogStructuredImpl::run_cleaner() {
+    std::unique_lock<std::mutex> guard(_cleaner_lock);
+    while (_running) {
+        _cleaner_wakeup.wait_for(guard, std::chrono::milliseconds(100));
+
+        guard.unlock();
+        for (;;) {
+            std::unique_lock<std::mutex> storage_guard(_lock);
+            size_t victim;
+            if (!clean_needed(victim)) {
+                break;
+            }
+            clean(victim);
+        }
+        guard.lock();
+    }
+}
+
+} // namespace Backend
+} // namespace Afina
@@ -0,0 +1,320 @@
+#ifndef AFINA_STORAGE_LOG_STRUCTURED_IMPL_H
+#define AFINA_STORAGE_LOG_STRUCTURED_IMPL_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <afina/Storage.h>
+
+#include "FlatIndex.h"
+#include "Hash.h"
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Log-structured storage
+ * Values of varying size replaced over and over fragment malloc heap, so that resident memory ends up far
+ * larger than the data. Here memory is split into fixed size segments and items are only ever appended to the
+ * head segment, as in log-structured file systems and RAMCloud. Update appends new copy of the item and leaves
+ * the old one dead in place, FlatIndex points right into the segments.
+ *
+ * Segment counts bytes of its live items. Background cleaner picks the sealed segments with the least live
+ * bytes, copies their live items into its own head segment and frees the whole segment, which is given back
+ * to the system with madvise. Cleaner keeps keys and values above TargetUtilization of memory taken by
+ * segments in use, and a few segments free ahead of writers. Survivors of cleaning are written apart from fresh
+ * items, so long living items end up together in dense segments that rarely need cleaning again. If cleaner
+ * falls behind and utilization drops under MinUtilization, writer that takes a new segment cleans others by
+ * itself, which holds writers back until cleaning catches up.
+ *
+ * Once memory is full writer evicts the segment sealed earliest, FIFO the way Segcache does. Items read since
+ * they got written get a second chance and are moved to cleaner head, so eviction is close to CLOCK.
+ *
+ * Segments fuller than MaxCleanUtilization are never cleaned: relocation would cost more than eviction saves.
+ * Writer that finds no free segments cleans or evicts by itself, so storage works without cleaner thread,
+ * which is started by Start(). One segment is always kept in reserve, so that cleaning could never run out of
+ * space for survivors.
+ *
+ * Index and entry headers are kept small for storages of hundreds of millions of small items: index slot keeps
+ * 32-bit offset of the entry in the arena next to 7-bit hash tag, keys are compared only on tag match, and entry
+ * header takes 16 bytes. So arena can't be larger than OffsetRef::MaxArena.
+ *
+ * All operations take global lock, the cleaner takes it once per segment.
+ */
+class LogStructuredImpl : public Afina::Storage {
+public:
+    static const size_t DefaultSegmentSize = 1 << 20;
+
+    // Longer keys are refused, so that key size fits into entry header
+    static const size_t MaxKeySize = UINT16_MAX;
+
+    // Memory must hold at least that many segments: two heads, reserve and one to clean
+    static const size_t MinSegments = 4;
+
+    // Cleaner compacts segments while keys and values make less than that share of memory in use
+    static constexpr double TargetUtilization = 0.85;
+
+    // Writers compact segments while keys and values make less than that share of memory in use
+    static constexpr double MinUtilization = 0.8;
+
+    // Segments fuller than that are evicted rather than cleaned
+    static constexpr double MaxCleanUtilization = 0.85;
+
+    // Free segments cleaner keeps for writers on top of the reserve one
+    static const size_t FreeAhead = 2;
+
+    // Segment fits at least that many entries of the largest size allowed, so that space left unused at the end
+    // of sealed segment is always less than cleaning of a segment frees
+    static const size_t EntriesPerSegment = 8;
+
+    LogStructuredImpl(size_t max_size = 64 * 1024 * 1024, size_t segment_size = DefaultSegmentSize);
+    ~LogStructuredImpl();
+
+    // Implements Afina::Storage interface
+    void Start() override;
+
+    // Implements Afina::Storage interface
+    void Stop() override;
+
+    // Implements Afina::Storage interface
+    bool Put(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool PutIfAbsent(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Set(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Append(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Prepend(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Increment(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Decrement(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Delete(const std::string &key) override;
+
+    // Implements Afina::Storage interface
+    bool Get(const std::string &key, std::string &value) const override;
+
+    // Implements Afina::Storage interface
+    size_t GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const override;
+
+    // Implements Afina::Storage interface
+    size_t Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                std::vector<uint64_t> &versions) const override;
+
+    // Implements Afina::Storage interface
+    CasResult Cas(const std::string &key, const std::string &value, uint64_t version, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    size_t Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                const std::vector<time_t> &expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const override;
+
+    // Implements Afina::Storage interface
+    void Freeze(const std::function<void()> &f) override;
+
+    // Implements Afina::Storage interface
+    void ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const override;
+
+    // Implements Afina::Storage interface
+    void GetStats(std::vector<std::pair<std::string, std::string>> &stats) const override;
+
+private:
+    /**
+     * Item as it is laid out in the segment, key and value follow the header. Entries are aligned by 8 bytes.
+     * Hash of the key is not kept: it is needed only when index grows and when entry moves, and recomputing it
+     * is cheap next to the cache miss of reading the entry
+     */
+    struct Entry {
+        // Assigned by storage on every modification, compared by cas
+        uint64_t version;
+
+        uint32_t value_size;
+        uint16_t key_size;
+
+        // Combination of Flags
+        uint16_t flags;
+
+        enum Flags : uint16_t {
+            // Entry was replaced or removed, its space is reclaimed by cleaning
+            Dead = 1,
+
+            // Entry was read since it got written, so it survives eviction once
+            Accessed = 2
+        };
+
+        const char *key() const { return reinterpret_cast<const char *>(this + 1); }
+        const char *value() const { return key() + key_size; }
+
+        bool Equals(const char *k, size_t size) const { return key_size == size && std::memcmp(key(), k, size) == 0; }
+
+        // Size of key and value as seen by client
+        size_t Size() const { return key_size + value_size; }
+
+        // Bytes entry takes in the segment
+        size_t Footprint() const { return AllocSize(key_size, value_size); }
+
+        static size_t AllocSize(size_t key_size, size_t value_size) {
+            return (sizeof(Entry) + key_size + value_size + 7) & ~size_t(7);
+        }
+    };
+
+    struct EntryTraits {
+        static uint64_t Hash(const Entry *entry) { return Backend::Hash(entry->key(), entry->key_size); }
+        static bool Equals(const Entry *entry, const char *key, size_t size) { return entry->Equals(key, size); }
+    };
+
+    enum class SegmentState : uint8_t { Free, Head, Sealed };
+
+    struct Segment {
+        // Bytes appended so far
+        size_t used;
+
+        // Bytes of entries that are not dead
+        size_t live;
+
+        // Order segment got sealed in, eviction takes the lowest
+        uint64_t sealed_at;
+
+        SegmentState state;
+    };
+
+    // Segment id meaning there is none
+    static const size_t None = ~size_t(0);
+
+    size_t _max_size;
+    size_t _segment_size;
+    char *_arena;
+
+    // Free segments are given back to the system, if they are made of whole pages
+    bool _release_pages;
+
+    mutable std::mutex _lock;
+
+    std::vector<Segment> _segments;
+    std::vector<size_t> _free;
+
+    // Segments writers and cleaner append to, None until the first append
+    size_t _head;
+    size_t _cleaner_head;
+
+    // Entries are kept as offsets into the arena
+    mutable FlatIndex<Entry, EntryTraits, OffsetRef<Entry>> _index;
+
+    // Key and value bytes of live entries
+    size_t _size;
+
+    // Footprint of dead entries in sealed segments, the most cleaning could free
+    size_t _dead_sealed;
+
+    uint64_t _version;
+    uint64_t _sealed;
+
+    size_t _evictions;
+    size_t _cleaned;
+    size_t _foreground_cleaned;
+    size_t _relocated;
+
+    // Thread CPU time spent on cleaning and eviction, wherever it ran
+    uint64_t _cleaner_nsec;
+
+    // Background cleaner
+    std::thread _cleaner;
+    std::mutex _cleaner_lock;
+    std::condition_variable _cleaner_wakeup;
+    bool _running;
+
+    size_t segment_of(const Entry *entry) const {
+        return size_t(reinterpret_cast<const char *>(entry) - _arena) / _segment_size;
+    }
+    char *segment_data(size_t id) const { return _arena + id * _segment_size; }
+
+    // Returns live entry of the key, marking it accessed
+    Entry *find(uint64_t hash, const std::string &key) const;
+
+    // Looks up batch of keys, versions are filled in if given
+    size_t get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values, uint64_t *versions) const;
+
+    // Appends new entry of the key and links it in place of the current one, if there is one. If existing is set,
+    // key is only replaced: entry is dropped when making room for it has evicted the key. Returns false if key or
+    // entry is too large or key is gone
+    bool write(uint64_t hash, const std::string &key, const std::string &value, bool existing);
+
+    // Adds data to the value of existing key, to the beginning if front is set
+    bool extend(const std::string &key, const std::string &data, bool front);
+
+    // Applies incr/decr to the value of existing key
+    bool change(const std::string &key, uint64_t delta, bool decrement, uint64_t &result);
+
+    // Marks entry dead and accounts for the space it leaves behind, doesn't touch the index
+    void kill(Entry *entry);
+
+    // Reserves space for the entry in the writer head segment, returns nullptr if it could never fit
+    Entry *allocate(size_t size);
+
+    // Reserves space in cleaner head segment, there must be a free segment in case head is full
+    Entry *relocation_space(size_t size);
+
+    // Moves live entry to cleaner head and repoints the index to the copy
+    void relocate(Entry *entry);
+
+    // Takes a free segment and makes it head
+    size_t open_segment();
+
+    // Makes head segment a candidate for cleaning and eviction
+    void seal(size_t id);
+
+    // Returns segment to the free list
+    void release(size_t id);
+
+    // Cleans or evicts segments until writers could take a free one
+    void make_room();
+
+    // Cleans segments while utilization is below MinUtilization
+    void catch_up();
+
+    // Sealed segment with the least live bytes, or None
+    size_t least_utilized() const;
+
+    // Sealed segment that was sealed earliest, or None
+    size_t oldest() const;
+
+    // Least utilized segment if it is worth cleaning, None otherwise
+    size_t cleaning_victim() const;
+
+    // Whether there is at least a segment worth of dead bytes to gain and key and value bytes make less than the
+    // given share of memory in use
+    bool below(double utilization) const;
+
+    // Whether cleaner thread has work to do, sets victim to the segment to clean
+    bool clean_needed(size_t &victim) const;
+
+    // Relocates live entries of the sealed segment and frees it
+    void clean(size_t id);
+
+    // Drops entries of the sealed segment, except those accessed since they were written, and frees it
+    void evict(size_t id);
+
+    // Body of the cleaner thread
+    void run_cleaner();
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_LOG_STRUCTURED_IMPL_H
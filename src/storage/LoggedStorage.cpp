@@ -0,0 +1,311 @@
+#include "LoggedStorage.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Snapshot.h"
+#include "SnapshotLoader.h"
+
+namespace Afina {
+namespace Backend {
+
+// See LoggedStorage.h
+LoggedStorage::LoggedStorage(std::shared_ptr<Afina::Storage> storage, const std::string &dir,
+                             std::chrono::milliseconds window, size_t compact_size)
+    : _storage(storage), _dir(dir), _compact_size(compact_size), _log(dir, window), _stripes(Stripes),
+      _running(false), _replayed(0), _compactions(0), _compaction_failures(0), _compaction_ms(0) {}
+
+// See LoggedStorage.h
+LoggedStorage::~LoggedStorage() { stop_compactor(); }
+
+// Segments and snapshots older than the newest snapshot are left by compaction interrupted before cleanup
+void LoggedStorage::Start() {
+    _storage->Start();
+    if (mkdir(_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        throw std::runtime_error("Failed to create directory " + _dir + ": " + strerror(errno));
+    }
+
+    std::vector<uint64_t> snapshots = OperationLog::List(_dir, "snapshot.");
+    uint64_t base = snapshots.empty() ? 0 : snapshots.back();
+    if (base > 0) {
+        SnapshotLoader loader(*_storage, snapshot_path(base), std::thread::hardware_concurrency());
+        loader.Start();
+        loader.Wait();
+    }
+    _replayed = _log.Replay(base, [this](OperationLog::Op op, const std::string &key, const std::string &value,
+                                         uint64_t number) { replay(op, key, value, number); });
+    _log.Start();
+
+    _log.Drop(base);
+    for (uint64_t snapshot : snapshots) {
+        if (snapshot < base) {
+            unlink(snapshot_path(snapshot).c_str());
+        }
+    }
+
+    _running = true;
+    _compactor = std::thread(&LoggedStorage::compactor, this);
+}
+
+// See LoggedStorage.h
+void LoggedStorage::Stop() {
+    stop_compactor();
+    _log.Stop();
+    _storage->Stop();
+}
+
+// See LoggedStorage.h
+bool LoggedStorage::Put(const std::string &key, const std::string &value) {
+    return apply(OperationLog::Op::Put, key, value, 0, [&]() { return _storage->Put(key, value); });
+}
+
+// Succeeds only if there was no such key, so Put gets to the same state on replay
+bool LoggedStorage::PutIfAbsent(const std::string &key, const std::string &value) {
+    return apply(OperationLog::Op::Put, key, value, 0, [&]() { return _storage->PutIfAbsent(key, value); });
+}
+
+// Succeeds only if there is such key, so Put gets to the same state on replay
+bool LoggedStorage::Set(const std::string &key, const std::string &value) {
+    return apply(OperationLog::Op::Put, key, value, 0, [&]() { return _storage->Set(key, value); });
+}
+
+// See LoggedStorage.h
+bool LoggedStorage::Put(const std::string &key, const std::string &value, time_t expire_at) {
+    return apply(OperationLog::Op::Put, key, value, uint64_t(expire_at),
+                 [&]() { return _storage->Put(key, value, expire_at); });
+}
+
+// See LoggedStorage.h
+bool LoggedStorage::PutIfAbsent(const std::string &key, const std::string &value, time_t expire_at) {
+    return apply(OperationLog::Op::Put, key, value, uint64_t(expire_at),
+                 [&]() { return _storage->PutIfAbsent(key, value, expire_at); });
+}
+
+// See LoggedStorage.h
+bool LoggedStorage::Set(const std::string &key, const std::string &value, time_t expire_at) {
+    return apply(OperationLog::Op::Put, key, value, uint64_t(expire_at),
+                 [&]() { return _storage->Set(key, value, expire_at); });
+}
+
+// See LoggedStorage.h
+bool LoggedStorage::Append(const std::string &key, const std::string &data) {
+    return apply(OperationLog::Op::Append, key, data, 0, [&]() { return _storage->Append(key, data); });
+}
+
+// See LoggedStorage.h
+bool LoggedStorage::Prepend(const std::string &key, const std::string &data) {
+    return apply(OperationLog::Op::Prepend, key, data, 0, [&]() { return _storage->Prepend(key, data); });
+}
+
+// See LoggedStorage.h
+bool LoggedStorage::Increment(const std::string &key, uint64_t delta, uint64_t &result) {
+    return apply(OperationLog::Op::Increment, key, "", delta,
+                 [&]() { return _storage->Increment(key, delta, result); });
+}
+
+// See LoggedStorage.h
+bool LoggedStorage::Decrement(const std::string &key, uint64_t delta, uint64_t &result) {
+    return apply(OperationLog::Op::Decrement, key, "", delta,
+                 [&]() { return _storage->Decrement(key, delta, result); });
+}
+
+// See LoggedStorage.h
+bool LoggedStorage::Delete(const std::string &key) {
+    return apply(OperationLog::Op::Delete, key, "", 0, [&]() { return _storage->Delete(key); });
+}
+
+// See LoggedStorage.h
+bool LoggedStorage::Get(const std::string &key, std::string &value) const { return _storage->Get(key, value); }
+
+// See LoggedStorage.h
+bool LoggedStorage::GetRef(const std::string &key, ValueRef &value) const { return _storage->GetRef(key, value); }
+
+// See LoggedStorage.h
+size_t LoggedStorage::GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const {
+    return _storage->GetMany(keys, values);
+}
+
+// See LoggedStorage.h
+size_t LoggedStorage::Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                           std::vector<uint64_t> &versions) const {
+    return _storage->Gets(keys, values, versions);
+}
+
+// Versions are not logged, replayed items get new ones
+Afina::Storage::CasResult LoggedStorage::Cas(const std::string &key, const std::string &value, uint64_t version,
+                                             time_t expire_at) {
+    CasResult result = CasResult::NotStored;
+    apply(OperationLog::Op::Put, key, value, uint64_t(expire_at), [&]() {
+        result = _storage->Cas(key, value, version, expire_at);
+        return result == CasResult::Stored;
+    });
+    return result;
+}
+
+// See LoggedStorage.h
+size_t LoggedStorage::Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                           const std::vector<time_t> &expire_at) {
+    size_t stored = 0;
+    uint64_t sequence = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        std::unique_lock<std::mutex> guard(_stripes[_hash(keys[i]) % Stripes]);
+        if (_storage->PutIfAbsent(keys[i], values[i], expire_at[i])) {
+            sequence = _log.Add(OperationLog::Op::Put, keys[i], values[i], uint64_t(expire_at[i]));
+            stored++;
+        }
+    }
+    if (sequence > 0) {
+        _log.Sync(sequence);
+    }
+    return stored;
+}
+
+// See LoggedStorage.h
+bool LoggedStorage::Range(const std::string &prefix, const std::string &after, size_t limit,
+                          std::vector<std::string> &keys, std::vector<ValueRef> *values) const {
+    return _storage->Range(prefix, after, limit, keys, values);
+}
+
+// See LoggedStorage.h
+bool LoggedStorage::Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const {
+    return _storage->Scan(cursor, count, keys);
+}
+
+// See LoggedStorage.h
+void LoggedStorage::Freeze(const std::function<void()> &f) { _storage->Freeze(f); }
+
+// See LoggedStorage.h
+void LoggedStorage::ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const {
+    _storage->ForEach(f);
+}
+
+// See LoggedStorage.h
+void LoggedStorage::GetStats(std::vector<std::pair<std::string, std::string>> &stats) const {
+    _storage->GetStats(stats);
+    _log.GetStats(stats);
+    stats.emplace_back("wal_replayed", std::to_string(_replayed));
+    stats.emplace_back("wal_compactions", std::to_string(_compactions.load()));
+    stats.emplace_back("wal_compaction_failures", std::to_string(_compaction_failures.load()));
+    stats.emplace_back("wal_last_compaction_ms", std::to_string(_compaction_ms.load()));
+}
+
+// All stripes are held while segment is switched and snapshot process is forked, so no modification could be
+// in the storage but not in the old segment, or the other way around
+bool LoggedStorage::Compact() {
+    std::unique_lock<std::mutex> guard(_compaction);
+    auto started = std::chrono::steady_clock::now();
+
+    uint64_t segment;
+    std::unique_ptr<Snapshot> snapshot;
+    try {
+        std::vector<std::unique_lock<std::mutex>> stripes;
+        for (auto &stripe : _stripes) {
+            stripes.emplace_back(stripe);
+        }
+        segment = _log.Rotate();
+        snapshot.reset(new Snapshot(*_storage, snapshot_path(segment)));
+        snapshot->Start();
+    } catch (std::exception &) {
+        _compaction_failures++;
+        return false;
+    }
+
+    snapshot->Wait();
+    if (!snapshot->Succeeded()) {
+        _compaction_failures++;
+        return false;
+    }
+
+    OperationLog::SyncDir(_dir);
+    _log.Drop(segment);
+    for (uint64_t older : OperationLog::List(_dir, "snapshot.")) {
+        if (older < segment) {
+            unlink(snapshot_path(older).c_str());
+        }
+    }
+
+    _compactions++;
+    _compaction_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started)
+                         .count();
+    return true;
+}
+
+// Record is added before stripe is released, but synced after, so writers of other keys in the stripe don't
+// wait for this one to get to disk
+bool LoggedStorage::apply(OperationLog::Op op, const std::string &key, const std::string &value, uint64_t number,
+                          const std::function<bool()> &modify) {
+    uint64_t sequence;
+    {
+        std::unique_lock<std::mutex> guard(_stripes[_hash(key) % Stripes]);
+        if (!modify()) {
+            return false;
+        }
+        sequence = _log.Add(op, key, value, number);
+    }
+    _log.Sync(sequence);
+    return true;
+}
+
+// Record is there only if modification has succeeded, so replaying it on the same state succeeds too
+void LoggedStorage::replay(OperationLog::Op op, const std::string &key, const std::string &value, uint64_t number) {
+    uint64_t result;
+    switch (op) {
+    case OperationLog::Op::Put:
+        _storage->Put(key, value, time_t(number));
+        break;
+    case OperationLog::Op::Append:
+        _storage->Append(key, value);
+        break;
+    case OperationLog::Op::Prepend:
+        _storage->Prepend(key, value);
+        break;
+    case OperationLog::Op::Increment:
+        _storage->Increment(key, number, result);
+        break;
+    case OperationLog::Op::Decrement:
+        _storage->Decrement(key, number, result);
+        break;
+    case OperationLog::Op::Delete:
+        _storage->Delete(key);
+        break;
+    default:
+        throw std::runtime_error("Unknown operation in log: " + std::to_string(int(op)));
+    }
+}
+
+// Checks segment size a few times a second
+void LoggedStorage::compactor() {
+    std::unique_lock<std::mutex> guard(_compactor_lock);
+    while (_running) {
+        _compactor_cv.wait_for(guard, std::chrono::milliseconds(100));
+        if (_running && _log.SegmentBytes() >= _compact_size) {
+            guard.unlock();
+            Compact();
+            guard.lock();
+        }
+    }
+}
+
+// See LoggedStorage.h
+void LoggedStorage::stop_compactor() {
+    {
+        std::unique_lock<std::mutex> guard(_compactor_lock);
+        _running = false;
+        _compactor_cv.notify_all();
+    }
+    if (_compactor.joinable()) {
+        _compactor.join();
+    }
+}
+
+// See LoggedStorage.h
+std::string LoggedStorage::snapshot_path(uint64_t segment) const {
+    return _dir + "/snapshot." + std::to_string(segment);
+}
+
+} // namespace Backend
+} // namespace Afina
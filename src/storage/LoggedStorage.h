@@ -0,0 +1,184 @@
+#ifndef AFINA_STORAGE_LOGGED_STORAGE_H
+#define AFINA_STORAGE_LOGGED_STORAGE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <afina/Storage.h>
+
+#include "OperationLog.h"
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Durable storage
+ * Wraps any storage and writes its every modification to OperationLog: modification is applied first, then its
+ * record is added to the log and method returns only once record is on disk, so whatever client has got reply
+ * for survives crash. Readers are not affected and could see modification before it is synced.
+ *
+ * Modification and its record are done with the lock stripe of the key held, so records of the same key are in
+ * the log in the same order as modifications have been applied and replay gets to the same state. Records are
+ * logical: append is logged as the data appended, increment as delta, set as the whole value.
+ *
+ * Compaction: once current segment grows over the given size, background thread takes snapshot of the storage
+ * into <dir>/snapshot.<N>, where N is the segment started right at the moment of the snapshot, and removes
+ * segments before N along with older snapshots. Snapshot is the same fork based one SIGUSR1 takes, so it has
+ * nothing but live items and writers are stalled only for the segment switch and fork(). On start the newest
+ * complete snapshot is loaded and segments starting from its number are replayed on top of it.
+ *
+ * Evictions and expirations are not logged: replay brings back evicted items and storage evicts them again if
+ * they don't fit.
+ */
+class LoggedStorage : public Afina::Storage {
+public:
+    /**
+     * @param storage to make durable, must be empty
+     * @param dir to keep log and snapshots in, created if missing
+     * @param window how long writes are batched before sync, 0 to sync every write on its own
+     * @param compact_size segment size in bytes compaction starts at
+     */
+    LoggedStorage(std::shared_ptr<Afina::Storage> storage, const std::string &dir, std::chrono::milliseconds window,
+                  size_t compact_size = 64 * 1024 * 1024);
+
+    // Stops compaction and syncs the log
+    ~LoggedStorage();
+
+    /**
+     * Restores storage from the snapshot and log, opens new segment and starts compaction thread. Throws
+     * std::runtime_error if state could not be restored
+     */
+    void Start() override;
+
+    // Implements Afina::Storage interface
+    void Stop() override;
+
+    // Implements Afina::Storage interface
+    bool Put(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool PutIfAbsent(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Set(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Put(const std::string &key, const std::string &value, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool PutIfAbsent(const std::string &key, const std::string &value, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool Set(const std::string &key, const std::string &value, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool SupportsExpiration() const override { return _storage->SupportsExpiration(); }
+
+    // Implements Afina::Storage interface
+    bool Append(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Prepend(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Increment(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Decrement(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Delete(const std::string &key) override;
+
+    // Implements Afina::Storage interface
+    bool Get(const std::string &key, std::string &value) const override;
+
+    // Implements Afina::Storage interface
+    bool GetRef(const std::string &key, ValueRef &value) const override;
+
+    // Implements Afina::Storage interface
+    size_t GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const override;
+
+    // Implements Afina::Storage interface
+    size_t Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                std::vector<uint64_t> &versions) const override;
+
+    // Implements Afina::Storage interface
+    CasResult Cas(const std::string &key, const std::string &value, uint64_t version, time_t expire_at) override;
+
+    /**
+     * Implements Afina::Storage interface. Whole batch is synced at once
+     */
+    size_t Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                const std::vector<time_t> &expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool Range(const std::string &prefix, const std::string &after, size_t limit, std::vector<std::string> &keys,
+               std::vector<ValueRef> *values) const override;
+
+    // Implements Afina::Storage interface
+    bool Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const override;
+
+    // Implements Afina::Storage interface
+    void Freeze(const std::function<void()> &f) override;
+
+    // Implements Afina::Storage interface
+    void ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const override;
+
+    // Implements Afina::Storage interface
+    void GetStats(std::vector<std::pair<std::string, std::string>> &stats) const override;
+
+    /**
+     * Takes snapshot and drops log segments it covers, blocks until snapshot is written. Returns false if it has
+     * failed, log is kept as is then
+     */
+    bool Compact();
+
+private:
+    static const size_t Stripes = 64;
+
+    std::shared_ptr<Afina::Storage> _storage;
+    std::string _dir;
+    size_t _compact_size;
+    OperationLog _log;
+
+    std::hash<std::string> _hash;
+    std::vector<std::mutex> _stripes;
+
+    // Only one compaction runs at a time
+    std::mutex _compaction;
+
+    std::thread _compactor;
+    std::mutex _compactor_lock;
+    std::condition_variable _compactor_cv;
+    bool _running;
+
+    size_t _replayed;
+    std::atomic<size_t> _compactions;
+    std::atomic<size_t> _compaction_failures;
+    std::atomic<int64_t> _compaction_ms;
+
+    // Applies modification and logs it with the key stripe held, then waits for the record to be synced.
+    // Returns whatever modification returns, nothing is logged if it is false
+    bool apply(OperationLog::Op op, const std::string &key, const std::string &value, uint64_t number,
+               const std::function<bool()> &modify);
+
+    // Applies record of the log to the wrapped storage
+    void replay(OperationLog::Op op, const std::string &key, const std::string &value, uint64_t number);
+
+    void compactor();
+    void stop_compactor();
+
+    std::string snapshot_path(uint64_t segment) const;
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_LOGGED_STORAGE_H
@@ -0,0 +1,199 @@
+#include "Lz.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace Afina {
+namespace Backend {
+
+// Shortest match worth encoding, it takes three bytes at least
+static const size_t MinMatch = 4;
+
+// Farthest match 16-bit distance could point to
+static const size_t MaxDistance = 65535;
+
+// Lengths up to that fit into the token nibble, longer ones continue in extra bytes
+static const size_t RunMask = 15;
+
+// Positions of 4-byte prefixes are kept in up to 4096 slots, small enough to stay in L1. Short inputs get
+// smaller table, so that clearing it doesn't cost more than compression itself
+static const unsigned MinHashBits = 8;
+static const unsigned MaxHashBits = 12;
+
+static uint32_t load32(const uint8_t *p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+// Knuth multiplicative hash of the prefix, top bits are the best mixed
+static uint32_t hash(uint32_t v, unsigned bits) { return (v * 2654435761u) >> (32 - bits); }
+
+// Writes length remaining after the nibble as run of 255 bytes and the final one
+static void put_length(std::string &out, size_t length) {
+    for (; length >= 255; length -= 255) {
+        out.push_back(char(255));
+    }
+    out.push_back(char(length));
+}
+
+// Reads length continued after the nibble, returns false if block ends first
+static bool get_length(const uint8_t *&p, const uint8_t *end, size_t &length) {
+    uint8_t b;
+    do {
+        if (p == end) {
+            return false;
+        }
+        b = *p++;
+        length += b;
+    } while (b == 255);
+    return true;
+}
+
+// Reads varint size of the original data in front of the block
+static bool get_original(const uint8_t *&p, const uint8_t *end, size_t &original) {
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (p == end) {
+            return false;
+        }
+        uint8_t b = *p++;
+        original |= size_t(b & 0x7f) << shift;
+        if ((b & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Appends literals followed by the match, the last sequence of the block has literals only and match of 0
+static void put_sequence(std::string &out, const uint8_t *literals, size_t count, size_t distance, size_t match) {
+    size_t match_code = match == 0 ? 0 : match - MinMatch;
+    out.push_back(char((std::min(count, RunMask) << 4) | std::min(match_code, RunMask)));
+    if (count >= RunMask) {
+        put_length(out, count - RunMask);
+    }
+    out.append(reinterpret_cast<const char *>(literals), count);
+    if (match != 0) {
+        out.push_back(char(distance & 0xff));
+        out.push_back(char(distance >> 8));
+        if (match_code >= RunMask) {
+            put_length(out, match_code - RunMask);
+        }
+    }
+}
+
+// Step grows with the length of the current literal run, so data that doesn't compress is skipped through fast
+// the way LZ4 does
+void LzCompress(const char *data, size_t size, std::string &out) {
+    out.clear();
+    for (size_t v = size;; v >>= 7) {
+        out.push_back(char((v & 0x7f) | (v >= 0x80 ? 0x80 : 0)));
+        if (v < 0x80) {
+            break;
+        }
+    }
+
+    const uint8_t *src = reinterpret_cast<const uint8_t *>(data);
+    unsigned bits = MinHashBits;
+    while (bits < MaxHashBits && (size_t(1) << bits) < size) {
+        bits++;
+    }
+    uint32_t table[1 << MaxHashBits];
+    std::memset(table, 0, sizeof(uint32_t) << bits);
+
+    size_t anchor = 0;
+    size_t pos = 0;
+    while (pos + MinMatch <= size) {
+        uint32_t prefix = load32(src + pos);
+        uint32_t &slot = table[hash(prefix, bits)];
+        size_t candidate = slot;
+        slot = uint32_t(pos);
+
+        if (candidate < pos && pos - candidate <= MaxDistance && load32(src + candidate) == prefix) {
+            size_t match = MinMatch;
+            while (pos + match < size && src[candidate + match] == src[pos + match]) {
+                match++;
+            }
+            put_sequence(out, src + anchor, pos - anchor, pos - candidate, match);
+            pos += match;
+            anchor = pos;
+        } else {
+            pos += 1 + ((pos - anchor) >> 6);
+        }
+    }
+    put_sequence(out, src + anchor, size - anchor, 0, 0);
+}
+
+// See Lz.h
+size_t LzOriginalSize(const char *data, size_t size) {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+    size_t original = 0;
+    return get_original(p, p + size, original) ? original : 0;
+}
+
+// Every length and distance is checked against both ends, so malformed block could never read or write out of
+// bounds
+bool LzDecompress(const char *data, size_t size, std::string &out) {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+    const uint8_t *end = p + size;
+
+    size_t original = 0;
+    if (!get_original(p, end, original)) {
+        return false;
+    }
+
+    // Each byte of the block restores 255 bytes at most, so bogus size can't make us allocate arbitrary memory
+    if (original / 255 > size) {
+        return false;
+    }
+    out.resize(original);
+    char *dst = &out[0];
+    size_t written = 0;
+
+    while (p != end) {
+        uint8_t token = *p++;
+        size_t count = token >> 4;
+        if (count == RunMask && !get_length(p, end, count)) {
+            return false;
+        }
+        if (count > size_t(end - p) || count > original - written) {
+            return false;
+        }
+        std::memcpy(dst + written, p, count);
+        p += count;
+        written += count;
+        if (p == end) {
+            break;
+        }
+
+        if (end - p < 2) {
+            return false;
+        }
+        size_t distance = p[0] | (size_t(p[1]) << 8);
+        p += 2;
+        size_t match = token & RunMask;
+        if (match == RunMask && !get_length(p, end, match)) {
+            return false;
+        }
+        match += MinMatch;
+        if (distance == 0 || distance > written || match > original - written) {
+            return false;
+        }
+
+        // Match may overlap bytes it produces, runs of the same byte are encoded that way
+        const char *from = dst + written - distance;
+        if (distance >= match) {
+            std::memcpy(dst + written, from, match);
+        } else {
+            for (size_t i = 0; i < match; i++) {
+                dst[written + i] = from[i];
+            }
+        }
+        written += match;
+    }
+    return written == original;
+}
+
+} // namespace Backend
+} // namespace Afina
@@ -0,0 +1,33 @@
+#ifndef AFINA_STORAGE_LZ_H
+#define AFINA_STORAGE_LZ_H
+
+#include <cstddef>
+#include <string>
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # LZ77 block codec
+ * Byte oriented LZ77 in the format of LZ4 blocks: sequence of runs, each is a token byte with lengths of literals
+ * and of the match in its nibbles, the literals themselves and 16-bit distance back to the match. Matches are
+ * found through a single hash table of 4-byte prefixes without chains, so compression is one pass that runs at
+ * hundreds of megabytes per second, and decompression is plain copying. Ratio is well below zlib, but text
+ * like JSON with repeated field names still shrinks several times.
+ *
+ * Block starts with the size of the original data as varint, so that decompression allocates output once.
+ */
+
+// Compresses data, replacing contents of out by the block
+void LzCompress(const char *data, size_t size, std::string &out);
+
+// Size of the data block restores, without restoring it. Returns 0 if block is malformed
+size_t LzOriginalSize(const char *data, size_t size);
+
+// Restores data compressed by LzCompress into out, returns false if block is malformed
+bool LzDecompress(const char *data, size_t size, std::string &out);
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_LZ_H
@@ -1,73 +1,130 @@
 #include "MapBasedGlobalLockImpl.h"
 
+#include <algorithm>
+#include <chrono>
 #include <mutex>
 #include <iostream>
+#include <stdexcept>
+
+#include <time.h>
+
+#include "Counter.h"
+#include "Cursor.h"
+#include "Lz.h"
 
 namespace Afina {
 namespace Backend {
 
+// Milliseconds clock of hit timestamps, never returns 0 which stands for no hits. Coarse clock is read from vDSO
+// page without syscall and costs a few nanoseconds, several times less than steady_clock, while its resolution
+// of a few milliseconds is good enough for bump interval
+static uint32_t bump_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return uint32_t(ts.tv_sec * 1000 + ts.tv_nsec / 1000000) | 1;
+}
+
+// CPU time of the calling thread in nanoseconds, so that cost of compression doesn't include time spent waiting
+static uint64_t thread_cpu() {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return uint64_t(ts.tv_sec) * 1000000000 + uint64_t(ts.tv_nsec);
+}
+
+const size_t MapBasedGlobalLockImpl::EvictBatch;
+const size_t MapBasedGlobalLockImpl::MinCompressSize;
+
+// See MapBasedGlobalLockImpl.h
+MapBasedGlobalLockImpl::MapBasedGlobalLockImpl(size_t max_size, uint32_t bump_interval, size_t headroom,
+                                               size_t hot_size)
+    : _max_size(max_size), _size(0), _version(0), _bump_interval(bump_interval), _bumps_applied(0),
+      _list(new Dl_list()), _headroom(std::min(headroom, max_size)), _hot_size(hot_size), _hot(0), _cold(nullptr),
+      _compressed(0), _compressed_raw(0), _compressed_bytes(0), _compress_nsec(0), _evictions(0),
+      _foreground_evictions(0), _reclaimed(0), _running(false) {}
+
+// See MapBasedGlobalLockImpl.h
+MapBasedGlobalLockImpl::~MapBasedGlobalLockImpl() {
+    Stop();
+    delete (_list);
+}
+
+// See MapBasedGlobalLockImpl.h
+void MapBasedGlobalLockImpl::Start() {
+    std::unique_lock<std::mutex> guard(_maintainer_lock);
+    if (!_running) {
+        _running = true;
+        _maintainer = std::thread(&MapBasedGlobalLockImpl::maintain, this);
+    }
+}
+
 // See MapBasedGlobalLockImpl.h
-bool MapBasedGlobalLockImpl::Put(const std::string &key, const std::string &value) {
-    std::unique_lock<std::mutex> guard(_lock);
+void MapBasedGlobalLockImpl::Stop() {
+    {
+        std::unique_lock<std::mutex> guard(_maintainer_lock);
+        _running = false;
+    }
+    _maintainer_wakeup.notify_all();
+    if (_maintainer.joinable()) {
+        _maintainer.join();
+    }
+}
+
+// See MapBasedGlobalLockImpl.h
+bool MapBasedGlobalLockImpl::Put(const std::string &key, const std::string &value, time_t expire_at) {
+    auto guard = exclusive();
 
     if (exists(key)) {
-        _size -= key.size() + _list->front()->value.size();
-        if (!free_space(key.size() + value.size())) {
-            _size += key.size() + _list->front()->value.size();
-            return false;
-        }
-        _list->front()->value = value;
-    } else {
-        if (!free_space(key.size() + value.size())) {
-            return false;
-        }
-        _list->push_front(key, value);
-        _backend.emplace(_list->front()->key, _list->front());
+        return update(key, value, expire_at);
     }
-    return true;
+    return insert(key, value, expire_at);
 }
 
 // See MapBasedGlobalLockImpl.h
-bool MapBasedGlobalLockImpl::PutIfAbsent(const std::string &key, const std::string &value) {
-    std::unique_lock<std::mutex> guard(_lock);
+bool MapBasedGlobalLockImpl::PutIfAbsent(const std::string &key, const std::string &value, time_t expire_at) {
+    auto guard = exclusive();
     
     if (exists(key)) {
         return false;
-    } else {
-        if (!free_space(key.size() + value.size())) {
-            return false;
-        }
-        _list->push_front(key, value);
-        _backend.emplace(_list->front()->key, _list->front());
     }
-    return true;
+    return insert(key, value, expire_at);
 }
 
 // See MapBasedGlobalLockImpl.h
-bool MapBasedGlobalLockImpl::Set(const std::string &key, const std::string &value) {
-    std::unique_lock<std::mutex> guard(_lock);
+bool MapBasedGlobalLockImpl::Set(const std::string &key, const std::string &value, time_t expire_at) {
+    auto guard = exclusive();
     
     if (exists(key)) {
-        _size -= key.size() + _list->front()->value.size();
-        if (!free_space(key.size() + value.size())) {
-            _size += key.size() + _list->front()->value.size();
-            return false;
-        }
-        _list->front()->value = value;
-        return true;
+        return update(key, value, expire_at);
     }
     return false;
 }
 
+// See MapBasedGlobalLockImpl.h
+bool MapBasedGlobalLockImpl::Append(const std::string &key, const std::string &data) {
+    return extend(key, data, false);
+}
+
+// See MapBasedGlobalLockImpl.h
+bool MapBasedGlobalLockImpl::Prepend(const std::string &key, const std::string &data) {
+    return extend(key, data, true);
+}
+
+// See MapBasedGlobalLockImpl.h
+bool MapBasedGlobalLockImpl::Increment(const std::string &key, uint64_t delta, uint64_t &result) {
+    return change(key, delta, false, result);
+}
+
+// See MapBasedGlobalLockImpl.h
+bool MapBasedGlobalLockImpl::Decrement(const std::string &key, uint64_t delta, uint64_t &result) {
+    return change(key, delta, true, result);
+}
+
 // See MapBasedGlobalLockImpl.h
 bool MapBasedGlobalLockImpl::Delete(const std::string &key) {
-    std::unique_lock<std::mutex> guard(_lock);
+    auto guard = exclusive();
 
     if (exists(key)) {
-        auto item = _backend.find(key);
-        _size -= key.size() + item->second->value.size();
-        _list->erase(item->second);
-        _backend.erase(key);
+        remove(_backend.find(key));
         return true;
     }
     return false;
@@ -75,43 +132,459 @@ bool MapBasedGlobalLockImpl::Delete(const std::string &key) {
 
 // See MapBasedGlobalLockImpl.h
 bool MapBasedGlobalLockImpl::Get(const std::string &key, std::string &value) const {
-    std::unique_lock<std::mutex> guard(_lock);
-    
-    if (exists(key)) {
-        value = _list->front()->value;
-        return true;
+    bool drain = false;
+    {
+        SharedLock guard(_lock);
+        Node *node = hit(key, drain);
+        if (node == nullptr) {
+            return false;
+        }
+        value = value_of(node);
     }
-    return false;
+
+    if (drain) {
+        exclusive();
+    }
+    return true;
+}
+
+// See MapBasedGlobalLockImpl.h
+size_t MapBasedGlobalLockImpl::GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const {
+    values.clear();
+    values.resize(keys.size());
+
+    bool drain = false;
+    size_t found = 0;
+    {
+        SharedLock guard(_lock);
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (Node *node = hit(keys[i], drain)) {
+                values[i] = ValueRef(value_of(node));
+                found++;
+            }
+        }
+    }
+
+    if (drain) {
+        exclusive();
+    }
+    return found;
+}
+
+// See MapBasedGlobalLockImpl.h
+size_t MapBasedGlobalLockImpl::Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                                    std::vector<uint64_t> &versions) const {
+    values.clear();
+    values.resize(keys.size());
+    versions.assign(keys.size(), 0);
+
+    bool drain = false;
+    size_t found = 0;
+    {
+        SharedLock guard(_lock);
+        for (size_t i = 0; i < keys.size(); i++) {
+            if (Node *node = hit(keys[i], drain)) {
+                values[i] = ValueRef(value_of(node));
+                versions[i] = node->version;
+                found++;
+            }
+        }
+    }
+
+    if (drain) {
+        exclusive();
+    }
+    return found;
+}
+
+// See MapBasedGlobalLockImpl.h
+Storage::CasResult MapBasedGlobalLockImpl::Cas(const std::string &key, const std::string &value, uint64_t version,
+                                               time_t expire_at) {
+    auto guard = exclusive();
+
+    if (!exists(key)) {
+        return CasResult::NotFound;
+    } else if (_list->front()->version != version) {
+        return CasResult::Exists;
+    }
+    return update(key, value, expire_at) ? CasResult::Stored : CasResult::NotStored;
+}
+
+// Map keeps keys ordered, so range is a walk from whichever of prefix and after is greater
+bool MapBasedGlobalLockImpl::Range(const std::string &prefix, const std::string &after, size_t limit,
+                                   std::vector<std::string> &keys, std::vector<ValueRef> *values) const {
+    const std::string &from = std::max(prefix, after);
+    SharedLock guard(_lock);
+
+    auto it = _backend.lower_bound(from);
+    if (it != _backend.end() && !after.empty() && it->first.get() == after) {
+        ++it;
+    }
+    for (size_t taken = 0; it != _backend.end() && taken < limit; ++it) {
+        const std::string &key = it->first;
+        if (key.compare(0, prefix.size(), prefix) != 0) {
+            break;
+        }
+        if (expired(it->second)) {
+            continue;
+        }
+        taken++;
+        keys.push_back(key);
+        if (values != nullptr) {
+            values->emplace_back(value_of(it->second));
+        }
+    }
+    return true;
+}
+
+// See MapBasedGlobalLockImpl.h
+bool MapBasedGlobalLockImpl::Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const {
+    return RangeScan(*this, cursor, count, keys);
+}
+
+// See MapBasedGlobalLockImpl.h
+void MapBasedGlobalLockImpl::Freeze(const std::function<void()> &f) {
+    auto guard = exclusive();
+    f();
+}
+
+// Least recently used go first, so that storage filled in this order gets the same LRU order back
+void MapBasedGlobalLockImpl::ForEach(
+    const std::function<void(const std::string &, const std::string &, time_t)> &f) const {
+    for (Node *node = _list->back(); node != nullptr; node = node->prev) {
+        if (!expired(node)) {
+            f(node->key, value_of(node), node->expire_at);
+        }
+    }
+}
+
+// Keys are looked up in the map directly, so that existing ones are not moved in the list
+size_t MapBasedGlobalLockImpl::Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                                    const std::vector<time_t> &expire_at) {
+    uint32_t time = now();
+    auto guard = exclusive();
+
+    size_t stored = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (expire_at[i] != 0 && expire_at[i] <= time) {
+            continue;
+        }
+        auto it = _backend.find(keys[i]);
+        if (it != _backend.end() && expired(it->second)) {
+            remove(it);
+            _reclaimed++;
+            it = _backend.end();
+        }
+        if (it == _backend.end() && insert(keys[i], values[i], expire_at[i])) {
+            stored++;
+        }
+    }
+    return stored;
+}
+
+// Value is kept as text, so it is parsed and printed back under the lock
+bool MapBasedGlobalLockImpl::change(const std::string &key, uint64_t delta, bool decrement, uint64_t &result) {
+    auto guard = exclusive();
+
+    if (!exists(key)) {
+        return false;
+    }
+
+    std::string &value = _list->front()->value;
+    result = ApplyDelta(ParseCounter(value.data(), value.size()), delta, decrement);
+    std::string text = std::to_string(result);
+    _size = _size - value.size() + text.size();
+    _hot = _hot - value.size() + text.size();
+    value = text;
+    _list->front()->version = ++_version;
+    cool();
+    return true;
 }
 
 // Check if record for given key exists and move it to the beginnind of LRU _list
-bool MapBasedGlobalLockImpl::exists(const std::string &key) const {
+bool MapBasedGlobalLockImpl::exists(const std::string &key) {
     
     auto it = _backend.find(key);
-    if (it != _backend.end()) {
-        _list->move_to_front(it->second);
-        return true;
+    if (it == _backend.end()) {
+        return false;
     }
-    return false;
+    if (expired(it->second)) {
+        remove(it);
+        _reclaimed++;
+        return false;
+    }
+    promote(it->second);
+    return true;
+}
+
+// Nodes are removed under exclusive lock only, and buffer is drained right after it is taken, so every node in
+// the buffer is still alive
+std::unique_lock<SharedMutex> MapBasedGlobalLockImpl::exclusive() const {
+    std::unique_lock<SharedMutex> guard(_lock);
+    _bumps_applied += _bumps.Drain([this](Node *node) { promote(node); });
+    return guard;
+}
+
+// Concurrent hits of the same node race on the timestamp, so that only one of them gets recorded
+Node *MapBasedGlobalLockImpl::hit(const std::string &key, bool &drain) const {
+    auto it = _backend.find(key);
+    if (it == _backend.end() || expired(it->second)) {
+        return nullptr;
+    }
+
+    Node *node = it->second;
+    _hits.Add();
+    if (node->compressed) {
+        _compressed_hits.Add();
+    }
+    if (_bump_interval == 0) {
+        drain |= _bumps.Add(node);
+        return node;
+    }
+
+    uint32_t now = bump_clock();
+    uint32_t bumped = node->bumped.load(std::memory_order_relaxed);
+    if ((bumped == 0 || now - bumped >= _bump_interval) &&
+        node->bumped.compare_exchange_strong(bumped, now, std::memory_order_relaxed)) {
+        drain |= _bumps.Add(node);
+    }
+    return node;
+}
+
+// See MapBasedGlobalLockImpl.h
+void MapBasedGlobalLockImpl::GetStats(std::vector<std::pair<std::string, std::string>> &stats) const {
+    auto guard = exclusive();
+
+    stats.emplace_back("curr_items", std::to_string(_backend.size()));
+    stats.emplace_back("bytes", std::to_string(_size));
+    stats.emplace_back("limit_maxbytes", std::to_string(_max_size));
+    stats.emplace_back("lru_bumps", std::to_string(_bumps_applied));
+    stats.emplace_back("lru_bumps_dropped", std::to_string(_bumps.Dropped()));
+    stats.emplace_back("evictions", std::to_string(_evictions));
+    stats.emplace_back("foreground_evictions", std::to_string(_foreground_evictions));
+    stats.emplace_back("reclaimed", std::to_string(_reclaimed));
+
+    size_t hits = _hits.Load();
+    size_t compressed_hits = _compressed_hits.Load();
+    stats.emplace_back("get_hits", std::to_string(hits));
+    stats.emplace_back("compressed_hits", std::to_string(compressed_hits));
+    stats.emplace_back("compressed_hit_percent", std::to_string(hits == 0 ? 0 : 100 * compressed_hits / hits));
+    stats.emplace_back("compressed_items", std::to_string(_compressed));
+    stats.emplace_back("compressed_raw_bytes", std::to_string(_compressed_raw));
+    stats.emplace_back("compressed_bytes", std::to_string(_compressed_bytes));
+    stats.emplace_back("compressed_percent",
+                       std::to_string(_compressed_raw == 0 ? 0 : 100 * _compressed_bytes / _compressed_raw));
+    stats.emplace_back("compress_cpu_usec", std::to_string(_compress_nsec / 1000));
+    stats.emplace_back("decompress_cpu_usec", std::to_string(_decompress_nsec.Load() / 1000));
+}
+
+// Cold node is thawed before it moves, so that hot part of the list stays a prefix of it
+void MapBasedGlobalLockImpl::promote(Node *node) const {
+    if (node->cold) {
+        if (node == _cold) {
+            _cold = node->next;
+        }
+        if (node->compressed) {
+            std::string value = value_of(node);
+            _compressed--;
+            _compressed_raw -= value.size();
+            _compressed_bytes -= node->value.size();
+            _size = _size - node->value.size() + value.size();
+            node->value.swap(value);
+            node->compressed = false;
+        }
+        node->cold = false;
+        _hot += node->key.size() + node->value.size();
+    }
+    _list->move_to_front(node);
+    cool();
+}
+
+// Value is replaced by a copy of the block, so that the node doesn't keep capacity of uncompressed value. Values
+// that don't shrink stay as they are, but still go cold, so that they are not tried again
+void MapBasedGlobalLockImpl::cool() const {
+    if (_hot <= _hot_size) {
+        return;
+    }
+
+    uint64_t start = thread_cpu();
+    std::string block;
+    while (_hot > _hot_size) {
+        Node *node = _cold != nullptr ? _cold->prev : _list->back();
+        if (node == _list->front()) {
+            break;
+        }
+
+        node->cold = true;
+        _cold = node;
+        _hot -= node->key.size() + node->value.size();
+        if (node->value.size() < MinCompressSize) {
+            continue;
+        }
+
+        LzCompress(node->value.data(), node->value.size(), block);
+        if (block.size() < node->value.size()) {
+            _compressed++;
+            _compressed_raw += node->value.size();
+            _compressed_bytes += block.size();
+            _size -= node->value.size() - block.size();
+            std::string(block).swap(node->value);
+            node->compressed = true;
+        }
+    }
+    _compress_nsec += thread_cpu() - start;
+}
+
+// See MapBasedGlobalLockImpl.h
+void MapBasedGlobalLockImpl::detach(Node *node) {
+    if (node == _cold) {
+        _cold = node->next;
+    }
+    if (!node->cold) {
+        _hot -= node->key.size() + node->value.size();
+    } else if (node->compressed) {
+        _compressed--;
+        _compressed_raw -= LzOriginalSize(node->value.data(), node->value.size());
+        _compressed_bytes -= node->value.size();
+    }
+}
+
+// Readers decompress under shared lock into their own copy, node itself is changed only once it gets promoted
+std::string MapBasedGlobalLockImpl::value_of(const Node *node) const {
+    if (!node->compressed) {
+        return node->value;
+    }
+
+    uint64_t start = thread_cpu();
+    std::string value;
+    if (!LzDecompress(node->value.data(), node->value.size(), value)) {
+        throw std::runtime_error("Compressed value of " + node->key + " is corrupted");
+    }
+    _decompress_nsec.Add(thread_cpu() - start);
+    return value;
+}
+
+// Node is in front of the list while older ones are evicted, so it never gets evicted itself
+bool MapBasedGlobalLockImpl::update(const std::string &key, const std::string &value, time_t expire_at) {
+    Node *node = _list->front();
+    _size -= key.size() + node->value.size();
+    if (!free_space(key.size() + value.size())) {
+        _size += key.size() + node->value.size();
+        return false;
+    }
+    _hot = _hot - node->value.size() + value.size();
+    node->value = value;
+    node->version = ++_version;
+    node->expire_at = uint32_t(expire_at);
+    cool();
+    return true;
+}
+
+// See MapBasedGlobalLockImpl.h
+bool MapBasedGlobalLockImpl::insert(const std::string &key, const std::string &value, time_t expire_at) {
+    if (!free_space(key.size() + value.size())) {
+        return false;
+    }
+    _list->push_front(key, value);
+    _list->front()->version = ++_version;
+    _list->front()->expire_at = uint32_t(expire_at);
+    _backend.emplace(_list->front()->key, _list->front());
+    _hot += key.size() + value.size();
+    cool();
+    return true;
+}
+
+// Node is in front of the list while older ones are evicted, so it never gets evicted itself
+bool MapBasedGlobalLockImpl::extend(const std::string &key, const std::string &data, bool front) {
+    auto guard = exclusive();
+
+    if (!exists(key)) {
+        return false;
+    }
+
+    std::string &value = _list->front()->value;
+    _size -= key.size() + value.size();
+    if (!free_space(key.size() + value.size() + data.size())) {
+        _size += key.size() + value.size();
+        return false;
+    }
+    if (front) {
+        value.insert(0, data);
+    } else {
+        value.append(data);
+    }
+    _hot += data.size();
+    _list->front()->version = ++_version;
+    cool();
+    return true;
+}
+
+// Map key references node's key, so map entry must be removed before the node itself
+void MapBasedGlobalLockImpl::remove(Index::iterator it) {
+    Node *node = it->second;
+    _size -= node->key.size() + node->value.size();
+    detach(node);
+    _backend.erase(it);
+    _list->erase(node);
 }
 
 // Check if new pair key/value fits into memory
 // Remove least used records from cache until there is enought space for new record
+// Notification doesn't take maintainer lock, wakeup lost that way is picked up by periodic one
 bool MapBasedGlobalLockImpl::free_space(size_t elem_size) {
     if (elem_size > _max_size) {
         return false;
     }
     while (elem_size + _size > _max_size) {
-        auto last = _list->back();
-        _size -= last->key.size() + last->key.size();
-        _backend.erase(_list->back()->key);
-        _list->pop_back();
+        evict();
+        _foreground_evictions++;
     }
     _size += elem_size;
+    if (_size + _headroom > _max_size) {
+        _maintainer_wakeup.notify_one();
+    }
     return true;
 }
 
-Dl_list::Dl_list() { head = NULL; }
+// See MapBasedGlobalLockImpl.h
+void MapBasedGlobalLockImpl::evict() {
+    auto last = _list->back();
+    _size -= last->key.size() + last->value.size();
+    detach(last);
+    _backend.erase(last->key);
+    _list->pop_back();
+    _evictions++;
+}
+
+// Lock is taken with exclusive(), so pending promotions are applied before victims are picked
+bool MapBasedGlobalLockImpl::evict_batch() {
+    auto guard = exclusive();
+    for (size_t i = 0; i < EvictBatch; i++) {
+        if (_size + _headroom <= _max_size || _list->back() == nullptr) {
+            return false;
+        }
+        evict();
+    }
+    return true;
+}
+
+// Storage lock is released between batches, so writers and readers interleave with eviction
+void MapBasedGlobalLockImpl::maintain() {
+    std::unique_lock<std::mutex> guard(_maintainer_lock);
+    while (_running) {
+        _maintainer_wakeup.wait_for(guard, std::chrono::milliseconds(100));
+
+        guard.unlock();
+        while (evict_batch()) {
+        }
+        guard.lock();
+    }
+}
+
+Dl_list::Dl_list() {
+    head = NULL;
+    tail = NULL;
+}
 
 Dl_list::~Dl_list() {
     while (head) {
@@ -121,7 +594,7 @@ Dl_list::~Dl_list() {
     }
 }
 
-void Dl_list::push_front(std::string key, std::string value) {
+void Dl_list::push_front(const std::string &key, const std::string &value) {
 
     Node *node = new Node();
     node->key = key;
@@ -141,21 +614,25 @@ void Dl_list::push_front(std::string key, std::string value) {
 
 void Dl_list::pop_back() {
     Node *tmp = tail;
-    tail->prev->next = NULL;
     tail = tail->prev;
+    if (tail == NULL) {
+        head = NULL;
+    } else {
+        tail->next = NULL;
+    }
     delete (tmp);
 }
 
 void Dl_list::erase(Node *node) {
-    if (node == head) {
-        Node *tmp = head;
+    if (node == tail) {
+        pop_back();
+    } else if (node == head) {
         head = node->next;
         head->prev = NULL;
-        delete (tmp);
-    } else if (node == tail) {
-        pop_back();
+        delete (node);
     } else {
         node->prev->next = node->next;
+        node->next->prev = node->prev;
         delete (node);
     }
 }
@@ -1,14 +1,23 @@
 #ifndef AFINA_STORAGE_MAP_BASED_GLOBAL_LOCK_IMPL_H
 #define AFINA_STORAGE_MAP_BASED_GLOBAL_LOCK_IMPL_H
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
 #include <functional>
 #include <list>
 #include <map>
 #include <mutex>
 #include <string>
+#include <thread>
 
 #include "../../include/afina/Storage.h"
 
+#include "BumpBuffer.h"
+#include "SharedMutex.h"
+#include "StripedCounter.h"
+
 namespace Afina {
 namespace Backend {
 
@@ -21,15 +30,29 @@ class Node {
 public:
     std::string key;
     std::string value;
+    uint64_t version;
+
+    // Unix time node expires at, 0 if never
+    uint32_t expire_at{0};
+
     Node *next;
     Node *prev;
+
+    // Milliseconds clock reading of the last hit recorded for promotion, 0 if there were none
+    std::atomic<uint32_t> bumped{0};
+
+    // Node is behind the hot part of the list
+    bool cold{false};
+
+    // Value is kept as LzCompress block, only cold nodes are compressed
+    bool compressed{false};
 };
 
 class Dl_list {
 public:
     Dl_list();
     ~Dl_list();
-    void push_front(std::string, std::string);
+    void push_front(const std::string &, const std::string &);
     void pop_back();
     void erase(Node *);
     void move_to_front(Node *);
@@ -42,19 +65,77 @@ private:
     Node *tail;
 };
 
+/**
+ * Reads go under shared lock and don't touch the LRU list: hits are recorded in BumpBuffer, which is drained
+ * at the beginning of every exclusive section, or by the reader that filled its stripe. Entry promoted less
+ * than bump_interval milliseconds ago is not recorded again, so hot entries cost nothing but the lookup
+ *
+ * Once started, storage runs maintenance thread that keeps headroom bytes free: whenever a write leaves less
+ * than that, thread evicts least recently used entries ahead of demand, few at a time, releasing the lock
+ * between batches. So writers only evict by themselves if they outrun the thread or value is larger than the
+ * headroom. Thread also wakes up periodically to drain promotions recorded by readers.
+ *
+ * Only hot_size bytes of the most recently used entries are kept as they are, values of older ones are compressed
+ * by LzCompress once they fall behind that, so that memory limit holds more entries when only a few of them are
+ * hot. Limit applies to compressed size. Readers decompress value into their own copy, entry is stored
+ * uncompressed again once it gets promoted, which may take storage over the limit until the next write evicts.
+ * The most recent entry is never compressed, so writers always change uncompressed value.
+ *
+ * Expired entries are invisible right away. Readers can't remove them under shared lock, so an expired entry is
+ * removed by the next writer that comes across it, or evicted once it reaches the end of the list.
+ */
 class MapBasedGlobalLockImpl : public Afina::Storage {
 public:
-    MapBasedGlobalLockImpl(size_t max_size = 1024) : _max_size(max_size), _size(0), _list(new Dl_list()) {}
-    ~MapBasedGlobalLockImpl() { delete (_list); }
+    // Entries evicted by maintenance thread under one lock acquisition
+    static const size_t EvictBatch = 32;
+
+    // Shorter values are not worth compressing
+    static const size_t MinCompressSize = 64;
+
+    MapBasedGlobalLockImpl(size_t max_size = 1024, uint32_t bump_interval = 100, size_t headroom = 0,
+                           size_t hot_size = SIZE_MAX);
+    ~MapBasedGlobalLockImpl();
+
+    // Implements Afina::Storage interface
+    void Start() override;
+
+    // Implements Afina::Storage interface
+    void Stop() override;
+
+    // Implements Afina::Storage interface
+    bool Put(const std::string &key, const std::string &value) override { return Put(key, value, 0); }
+
+    // Implements Afina::Storage interface
+    bool Put(const std::string &key, const std::string &value, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool PutIfAbsent(const std::string &key, const std::string &value) override {
+        return PutIfAbsent(key, value, 0);
+    }
+
+    // Implements Afina::Storage interface
+    bool PutIfAbsent(const std::string &key, const std::string &value, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool Set(const std::string &key, const std::string &value) override { return Set(key, value, 0); }
+
+    // Implements Afina::Storage interface
+    bool Set(const std::string &key, const std::string &value, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool SupportsExpiration() const override { return true; }
+
+    // Implements Afina::Storage interface
+    bool Append(const std::string &key, const std::string &data) override;
 
     // Implements Afina::Storage interface
-    bool Put(const std::string &key, const std::string &value) override;
+    bool Prepend(const std::string &key, const std::string &data) override;
 
     // Implements Afina::Storage interface
-    bool PutIfAbsent(const std::string &key, const std::string &value) override;
+    bool Increment(const std::string &key, uint64_t delta, uint64_t &result) override;
 
     // Implements Afina::Storage interface
-    bool Set(const std::string &key, const std::string &value) override;
+    bool Decrement(const std::string &key, uint64_t delta, uint64_t &result) override;
 
     // Implements Afina::Storage interface
     bool Delete(const std::string &key) override;
@@ -62,16 +143,142 @@ public:
     // Implements Afina::Storage interface
     bool Get(const std::string &key, std::string &value) const override;
 
+    // Implements Afina::Storage interface
+    size_t GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const override;
+
+    // Implements Afina::Storage interface
+    size_t Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                std::vector<uint64_t> &versions) const override;
+
+    // Implements Afina::Storage interface
+    CasResult Cas(const std::string &key, const std::string &value, uint64_t version, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    size_t Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                const std::vector<time_t> &expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool Range(const std::string &prefix, const std::string &after, size_t limit, std::vector<std::string> &keys,
+               std::vector<ValueRef> *values) const override;
+
+    // Implements Afina::Storage interface
+    bool Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const override;
+
+    // Implements Afina::Storage interface
+    void Freeze(const std::function<void()> &f) override;
+
+    // Implements Afina::Storage interface
+    void ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const override;
+
+    // Implements Afina::Storage interface
+    void GetStats(std::vector<std::pair<std::string, std::string>> &stats) const override;
+
 private:
     size_t _max_size;
-    size_t _size;
-    mutable std::mutex _lock;
+
+    // Promotion of compressed entry changes size, so even const methods change it
+    mutable size_t _size;
+    uint64_t _version;
+    mutable SharedMutex _lock;
+
+    // Promotions recorded by readers, applied once list is owned exclusively
+    uint32_t _bump_interval;
+    mutable BumpBuffer<Node> _bumps;
+    mutable size_t _bumps_applied;
+
+    typedef std::map<std::reference_wrapper<const std::string>, Node *, std::less<const std::string>> Index;
 
     Dl_list *_list;
-    std::map<std::reference_wrapper<const std::string>, Node *, std::less<const std::string>> _backend;
+    Index _backend;
+
+    // Bytes maintenance thread keeps free, not more than max_size
+    size_t _headroom;
+
+    // Key and value bytes of the most recent entries kept uncompressed, and bytes they take now
+    size_t _hot_size;
+    mutable size_t _hot;
+
+    // The most recent of the cold entries, nullptr if there are none
+    mutable Node *_cold;
+
+    // Entries compressed now, with their values before and after compression
+    mutable size_t _compressed;
+    mutable size_t _compressed_raw;
+    mutable size_t _compressed_bytes;
+
+    // Thread CPU time spent on compression, and by readers on decompression
+    mutable uint64_t _compress_nsec;
+    mutable StripedCounter _decompress_nsec;
+
+    // Hits on all entries and on compressed ones
+    mutable StripedCounter _hits;
+    mutable StripedCounter _compressed_hits;
 
-    bool exists(const std::string &key) const;
+    // Evicted entries, all and only those evicted by writers themselves
+    size_t _evictions;
+    size_t _foreground_evictions;
+
+    // Expired entries removed by writers
+    size_t _reclaimed;
+
+    bool _running;
+    std::thread _maintainer;
+    std::mutex _maintainer_lock;
+    std::condition_variable _maintainer_wakeup;
+
+    // Moves node of the given key to the front of the list, must be called under exclusive lock. Expired node
+    // is removed instead
+    bool exists(const std::string &key);
+
+    // Takes lock exclusively and applies pending promotions, so that list is up to date
+    std::unique_lock<SharedMutex> exclusive() const;
+
+    // Returns node of the given key and records the hit, must be called under shared lock. Flag is set if
+    // buffer has to be drained once shared lock is released
+    Node *hit(const std::string &key, bool &drain) const;
+
+    // Moves node to the front of the list, value of cold node is decompressed back. Never evicts, so that nodes
+    // pending in the bump buffer stay alive. Must be called under exclusive lock
+    void promote(Node *node) const;
+
+    // Compresses entries falling behind the hot part of the list
+    void cool() const;
+
+    // Takes node out of hot and cold accounting before it is removed from the list
+    void detach(Node *node);
+
+    // Value of the node as it was put
+    std::string value_of(const Node *node) const;
+
+    // Replaces value and expiration time of the node in front of the list
+    bool update(const std::string &key, const std::string &value, time_t expire_at);
+
+    // Adds new node in front of the list, key must be absent
+    bool insert(const std::string &key, const std::string &value, time_t expire_at);
+
+    // Unlinks node of the given map entry from everywhere and frees it
+    void remove(Index::iterator it);
+
+    // Adds data to the value of existing key, to the beginning if front is set
+    bool extend(const std::string &key, const std::string &data, bool front);
+
+    // Applies incr/decr to the value of existing key
+    bool change(const std::string &key, uint64_t delta, bool decrement, uint64_t &result);
     bool free_space(size_t);
+
+    // Removes least recently used entry, must be called under exclusive lock
+    void evict();
+
+    // Evicts one batch while free space is below headroom, returns true if there is more to evict
+    bool evict_batch();
+
+    // Body of the maintenance thread
+    void maintain();
+
+    // Clock is read only for nodes that expire at all
+    static bool expired(const Node *node) { return node->expire_at != 0 && node->expire_at <= now(); }
+
+    static uint32_t now() { return uint32_t(time(nullptr)); }
 };
 
 } // namespace Backend
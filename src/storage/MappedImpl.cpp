@@ -0,0 +1,894 @@
+#include "MappedImpl.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Counter.h"
+#include "Crc32c.h"
+#include "Cursor.h"
+#include "Hash.h"
+
+namespace Afina {
+namespace Backend {
+
+static const char Magic[8] = {'A', 'F', 'N', 'A', 'R', 'E', 'N', 'A'};
+static const uint32_t Layout = 1;
+
+// Chunks are aligned the same way Allocator::Slab aligns them
+static const size_t ChunkAlign = 16;
+
+static uint64_t align(uint64_t size, uint64_t to) { return (size + to - 1) & ~(to - 1); }
+
+// See MappedImpl.h
+MappedImpl::MappedImpl(const std::string &path, size_t max_size, size_t page_size)
+    : _path(path), _fd(-1), _size(max_size), _base(nullptr), _header(nullptr), _frozen(nullptr), _frozen_size(0),
+      _attach_ms(0), _dropped(0), _reassigned(0) {
+    auto started = std::chrono::steady_clock::now();
+    Header geometry = layout(max_size, page_size);
+
+    _fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        throw std::runtime_error("Failed to open " + path + ": " + strerror(errno));
+    }
+    if (flock(_fd, LOCK_EX | LOCK_NB) != 0) {
+        close(_fd);
+        throw std::runtime_error("File " + path + " is used by another process");
+    }
+
+    struct stat st;
+    bool fits = fstat(_fd, &st) == 0 && uint64_t(st.st_size) == max_size;
+    if (!fits && ftruncate(_fd, off_t(max_size)) != 0) {
+        close(_fd);
+        throw std::runtime_error("Failed to resize " + path + ": " + strerror(errno));
+    }
+
+    void *base = mmap(nullptr, max_size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+    if (base == MAP_FAILED) {
+        close(_fd);
+        throw std::runtime_error("Failed to mmap " + path + ": " + strerror(errno));
+    }
+    _base = static_cast<char *>(base);
+    _header = reinterpret_cast<Header *>(_base);
+
+    if (!fits || !attach(geometry)) {
+        format(geometry);
+        _attach = "new";
+    }
+    _header->clean = 0;
+    sync_header();
+    _attach_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started)
+                     .count();
+}
+
+// See MappedImpl.h
+MappedImpl::~MappedImpl() {
+    Stop();
+    munmap(_base, _size);
+    close(_fd);
+}
+
+// See MappedImpl.h
+void MappedImpl::Start() {
+    std::unique_lock<std::mutex> guard(_lock);
+    _header->clean = 0;
+    sync_header();
+}
+
+// Data reaches the file before the clean flag does, otherwise writeback could store the flag first and crash in
+// between would leave file marked clean with half of the changes
+void MappedImpl::Stop() {
+    std::unique_lock<std::mutex> guard(_lock);
+    if (_header->clean == 0) {
+        msync(_base, _size, MS_SYNC);
+        _header->clean = 1;
+        sync_header();
+    }
+}
+
+// Header is at the beginning of the mapping, which is page aligned
+void MappedImpl::sync_header() const {
+    size_t page = size_t(sysconf(_SC_PAGESIZE));
+    msync(_base, align(sizeof(Header), page), MS_SYNC);
+}
+
+// See MappedImpl.h
+bool MappedImpl::Put(const std::string &key, const std::string &value) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    uint64_t hash = Hash(key.data(), key.size());
+    Item *item = find(hash, key);
+    if (item != nullptr) {
+        return update(item, value);
+    }
+    return insert(hash, key, value);
+}
+
+// See MappedImpl.h
+bool MappedImpl::PutIfAbsent(const std::string &key, const std::string &value) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    uint64_t hash = Hash(key.data(), key.size());
+    if (find(hash, key) != nullptr) {
+        return false;
+    }
+    return insert(hash, key, value);
+}
+
+// See MappedImpl.h
+bool MappedImpl::Set(const std::string &key, const std::string &value) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(Hash(key.data(), key.size()), key);
+    if (item == nullptr) {
+        return false;
+    }
+    return update(item, value);
+}
+
+// See MappedImpl.h
+bool MappedImpl::Delete(const std::string &key) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = lookup(Hash(key.data(), key.size()), key.data(), key.size());
+    if (item == nullptr) {
+        return false;
+    }
+    remove(item);
+    return true;
+}
+
+// See MappedImpl.h
+bool MappedImpl::Append(const std::string &key, const std::string &data) { return extend(key, data, false); }
+
+// See MappedImpl.h
+bool MappedImpl::Prepend(const std::string &key, const std::string &data) { return extend(key, data, true); }
+
+// See MappedImpl.h
+bool MappedImpl::Increment(const std::string &key, uint64_t delta, uint64_t &result) {
+    return change(key, delta, false, result);
+}
+
+// See MappedImpl.h
+bool MappedImpl::Decrement(const std::string &key, uint64_t delta, uint64_t &result) {
+    return change(key, delta, true, result);
+}
+
+// See MappedImpl.h
+bool MappedImpl::Get(const std::string &key, std::string &value) const {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(Hash(key.data(), key.size()), key);
+    if (item == nullptr) {
+        return false;
+    }
+    value.assign(item->value(), item->value_size);
+    return true;
+}
+
+// See MappedImpl.h
+size_t MappedImpl::GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const {
+    return get_many(keys, values, nullptr);
+}
+
+// See MappedImpl.h
+size_t MappedImpl::Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                        std::vector<uint64_t> &versions) const {
+    versions.assign(keys.size(), 0);
+    return get_many(keys, values, versions.data());
+}
+
+// Expiration is not supported by this storage, so it is ignored as in other TTL overloads
+Storage::CasResult MappedImpl::Cas(const std::string &key, const std::string &value, uint64_t version,
+                                   time_t expire_at) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(Hash(key.data(), key.size()), key);
+    if (item == nullptr) {
+        return CasResult::NotFound;
+    } else if (item->version != version) {
+        return CasResult::Exists;
+    }
+    return update(item, value) ? CasResult::Stored : CasResult::NotStored;
+}
+
+// Chunks could only be allocated under the lock, so just hashes are computed before it is taken
+size_t MappedImpl::Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                        const std::vector<time_t> &expire_at) {
+    std::vector<uint64_t> hashes(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        hashes[i] = Hash(keys[i].data(), keys[i].size());
+    }
+
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t stored = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (lookup(hashes[i], keys[i].data(), keys[i].size()) == nullptr && insert(hashes[i], keys[i], values[i])) {
+            stored++;
+        }
+    }
+    return stored;
+}
+
+// Number of buckets never changes while file is attached, so cursor is simply the next bucket to visit
+bool MappedImpl::Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const {
+    uint64_t b = ParsePosition(cursor);
+    std::unique_lock<std::mutex> guard(_lock);
+    if (b >= _header->buckets) {
+        throw std::invalid_argument("bad cursor");
+    }
+
+    size_t first = keys.size();
+    for (size_t visited = 0; b < _header->buckets && keys.size() - first < count && visited < count; visited++) {
+        for (uint64_t off = bucket(b++); off != 0; off = item(off)->chain) {
+            keys.emplace_back(item(off)->key(), item(off)->key_size);
+        }
+    }
+
+    cursor = b == _header->buckets ? "0" : std::to_string(b);
+    return true;
+}
+
+// Offsets don't depend on where memory is, so the private copy is walked exactly the same way as the mapping
+void MappedImpl::Freeze(const std::function<void()> &f) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t used = _header->first_page + _header->pages_used * _header->page_size;
+    void *copy = mmap(nullptr, used, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (copy == MAP_FAILED) {
+        throw std::runtime_error("Failed to allocate copy of the mapped storage");
+    }
+    std::memcpy(copy, _base, used);
+    _frozen = static_cast<char *>(copy);
+    _frozen_size = used;
+
+    try {
+        f();
+    } catch (...) {
+        munmap(copy, used);
+        _frozen = nullptr;
+        throw;
+    }
+    munmap(copy, used);
+    _frozen = nullptr;
+}
+
+// Each class is walked from the least recently used item, so loading the output keeps LRU order
+void MappedImpl::ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const {
+    const char *base = _frozen != nullptr ? _frozen : _base;
+    const Header *header = reinterpret_cast<const Header *>(base);
+    for (unsigned cls = 0; cls < header->classes; cls++) {
+        for (uint64_t off = header->cls[cls].lru_tail; off != 0;) {
+            const Item *item = reinterpret_cast<const Item *>(base + off);
+            f(std::string(item->key(), item->key_size), std::string(item->value(), item->value_size), 0);
+            off = item->prev;
+        }
+    }
+}
+
+// Per class metrics use memcached "stats slabs" naming
+void MappedImpl::GetStats(std::vector<std::pair<std::string, std::string>> &stats) const {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t evictions = 0;
+    for (unsigned i = 0; i < _header->classes; i++) {
+        evictions += _header->cls[i].evictions;
+    }
+
+    stats.emplace_back("curr_items", std::to_string(_header->items));
+    stats.emplace_back("bytes", std::to_string(_header->bytes));
+    stats.emplace_back("limit_maxbytes", std::to_string(_size));
+    stats.emplace_back("evictions", std::to_string(evictions));
+    stats.emplace_back("slabs_moved", std::to_string(_reassigned));
+    stats.emplace_back("free_pages", std::to_string(_header->pages_total - _header->pages_used));
+    stats.emplace_back("arena_attach", _attach);
+    stats.emplace_back("arena_attach_ms", std::to_string(_attach_ms));
+    stats.emplace_back("arena_dropped", std::to_string(_dropped));
+
+    for (unsigned i = 0; i < _header->classes; i++) {
+        const Class &c = _header->cls[i];
+        if (c.pages == 0) {
+            continue;
+        }
+
+        std::string prefix = std::to_string(i) + ":";
+        stats.emplace_back(prefix + "chunk_size", std::to_string(c.chunk_size));
+        stats.emplace_back(prefix + "total_pages", std::to_string(c.pages));
+        stats.emplace_back(prefix + "used_chunks", std::to_string(c.items));
+        stats.emplace_back(prefix + "free_chunks",
+                           std::to_string(c.free_count + (c.page_end - c.page_pos) / c.chunk_size));
+        stats.emplace_back(prefix + "evictions", std::to_string(c.evictions));
+    }
+}
+
+// See MappedImpl.h
+bool MappedImpl::attach(const Header &geometry) {
+    const Header &h = *_header;
+    if (std::memcmp(h.magic, geometry.magic, sizeof(h.magic)) != 0 || h.layout != geometry.layout ||
+        h.size != geometry.size || h.page_size != geometry.page_size || h.pages_total != geometry.pages_total ||
+        h.buckets != geometry.buckets || h.page_classes != geometry.page_classes || h.index != geometry.index ||
+        h.first_page != geometry.first_page || h.classes != geometry.classes || h.pages_used > h.pages_total) {
+        return false;
+    }
+    for (unsigned i = 0; i < h.classes; i++) {
+        if (h.cls[i].chunk_size != geometry.cls[i].chunk_size) {
+            return false;
+        }
+    }
+    for (uint64_t page = 0; page < h.pages_used; page++) {
+        if (page_class(page) >= h.classes) {
+            return false;
+        }
+    }
+
+    if (h.clean == 1 && validate()) {
+        _attach = "clean";
+    } else {
+        recover();
+        _attach = "recovered";
+    }
+    return true;
+}
+
+// Every walk is bounded by the counter it is checked against, so cycles are caught as well
+bool MappedImpl::validate() const {
+    const Header &h = *_header;
+    uint64_t items = 0, bytes = 0;
+    for (unsigned cls = 0; cls < h.classes; cls++) {
+        const Class &c = h.cls[cls];
+        if (c.page_pos > c.page_end || (c.page_end != 0 && !chunk_of(c.page_pos - c.chunk_size, cls))) {
+            return false;
+        }
+
+        uint64_t n = 0, prev = 0;
+        for (uint64_t off = c.lru_head; off != 0; off = item(off)->next) {
+            const Item *it = item(off);
+            if (n++ == c.items || !chunk_of(off, cls) || it->state.load() != Live || it->prev != prev ||
+                sizeof(Item) + it->key_size + it->capacity != c.chunk_size || it->value_size > it->capacity) {
+                return false;
+            }
+            bytes += it->key_size + it->value_size;
+            prev = off;
+        }
+        if (n != c.items || c.lru_tail != prev) {
+            return false;
+        }
+        items += n;
+
+        n = 0;
+        prev = 0;
+        for (uint64_t off = c.free_list; off != 0; off = item(off)->prev) {
+            if (n++ == c.free_count || !chunk_of(off, cls) || item(off)->state.load() == Live ||
+                item(off)->next != prev) {
+                return false;
+            }
+            prev = off;
+        }
+        if (n != c.free_count) {
+            return false;
+        }
+    }
+    if (items != h.items || bytes != h.bytes) {
+        return false;
+    }
+
+    uint64_t indexed = 0;
+    for (uint64_t b = 0; b < h.buckets; b++) {
+        for (uint64_t off = reinterpret_cast<const uint64_t *>(_base + h.index)[b]; off != 0;
+             off = item(off)->chain) {
+            if (indexed++ == items || off < h.first_page ||
+                !chunk_of(off, page_class((off - h.first_page) / h.page_size)) || item(off)->state.load() != Live ||
+                (item(off)->hash & (h.buckets - 1)) != b) {
+                return false;
+            }
+        }
+    }
+    return indexed == items;
+}
+
+// Item could be found twice if process has died while moving it to another chunk, the newer version wins
+void MappedImpl::recover() {
+    Header &h = *_header;
+    std::memset(_base + h.index, 0, h.buckets * sizeof(uint64_t));
+    for (unsigned cls = 0; cls < h.classes; cls++) {
+        Class &c = h.cls[cls];
+        c.pages = c.free_list = c.free_count = c.page_pos = c.page_end = 0;
+        c.lru_head = c.lru_tail = c.items = 0;
+    }
+    h.items = h.bytes = 0;
+    _dropped = 0;
+
+    std::vector<std::pair<uint64_t, uint64_t>> live;
+    for (uint64_t page = 0; page < h.pages_used; page++) {
+        unsigned cls = page_class(page);
+        Class &c = h.cls[cls];
+        c.pages++;
+
+        uint64_t start = h.first_page + page * h.page_size;
+        for (uint64_t off = start; off + c.chunk_size <= start + h.page_size; off += c.chunk_size) {
+            Item *it = item(off);
+            bool valid = it->state.load() == Live && sizeof(Item) + it->key_size + it->capacity == c.chunk_size &&
+                         it->value_size <= it->capacity && it->hash == Hash(it->key(), it->key_size) &&
+                         it->crc == Crc32c(it->value(), it->value_size, Crc32c(it->key(), it->key_size));
+            if (valid) {
+                live.emplace_back(it->version, off);
+                h.version = std::max(h.version, it->version);
+            } else {
+                _dropped += it->state.load() == Live;
+                free(cls, it);
+            }
+        }
+    }
+
+    std::sort(live.begin(), live.end());
+    for (auto &l : live) {
+        Item *it = item(l.second);
+        Item *older = lookup(it->hash, it->key(), it->key_size);
+        if (older != nullptr) {
+            remove(older);
+            _dropped++;
+        }
+
+        Class &c = h.cls[class_of(it)];
+        index_insert(it);
+        lru_push_front(c, it);
+        c.items++;
+        h.items++;
+        h.bytes += it->key_size + it->value_size;
+    }
+}
+
+// Pages are not touched, each one is cleared once it is given to a class
+void MappedImpl::format(const Header &geometry) {
+    std::memset(_base, 0, geometry.first_page);
+    std::memcpy(_header, &geometry, sizeof(Header));
+    std::memset(_base + geometry.page_classes, NoClass, geometry.pages_total);
+    _dropped = 0;
+}
+
+// Metadata size depends on number of pages and the other way around, but the second pass gets it settled
+MappedImpl::Header MappedImpl::layout(size_t size, size_t page_size) {
+    Header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, Magic, sizeof(Magic));
+    h.layout = Layout;
+    h.size = size;
+    h.page_size = page_size;
+
+    size_t chunk = align(std::max(size_t(64), sizeof(Item)), ChunkAlign);
+    while (chunk < page_size / 2 && h.classes < MaxClasses - 1) {
+        h.cls[h.classes++].chunk_size = chunk;
+        chunk = align(std::max(size_t(chunk * 1.25), chunk + 1), ChunkAlign);
+    }
+    h.cls[h.classes++].chunk_size = page_size;
+
+    h.buckets = 16;
+    while (h.buckets * 2 <= size / 256) {
+        h.buckets *= 2;
+    }
+
+    h.page_classes = align(sizeof(Header), 64);
+    h.pages_total = size / page_size;
+    for (int pass = 0; pass < 2; pass++) {
+        h.index = align(h.page_classes + h.pages_total, 64);
+        h.first_page = align(h.index + h.buckets * sizeof(uint64_t), 4096);
+        h.pages_total = size > h.first_page ? (size - h.first_page) / page_size : 0;
+    }
+    if (h.pages_total == 0) {
+        throw std::invalid_argument("Mapped storage doesn't fit a single page");
+    }
+    return h;
+}
+
+// See MappedImpl.h
+bool MappedImpl::chunk_of(uint64_t offset, unsigned cls) const {
+    const Header &h = *_header;
+    if (offset < h.first_page || offset >= h.first_page + h.pages_used * h.page_size) {
+        return false;
+    }
+    uint64_t page = (offset - h.first_page) / h.page_size;
+    uint64_t in_page = (offset - h.first_page) % h.page_size;
+    return page_class(page) == cls && in_page % h.cls[cls].chunk_size == 0 &&
+           in_page + h.cls[cls].chunk_size <= h.page_size;
+}
+
+// See MappedImpl.h
+MappedImpl::Item *MappedImpl::lookup(uint64_t hash, const char *key, size_t size) const {
+    for (uint64_t off = bucket(hash); off != 0;) {
+        Item *it = item(off);
+        if (it->hash == hash && it->key_size == size && std::memcmp(it->key(), key, size) == 0) {
+            return it;
+        }
+        off = it->chain;
+    }
+    return nullptr;
+}
+
+// See MappedImpl.h
+MappedImpl::Item *MappedImpl::find(uint64_t hash, const std::string &key) const {
+    Item *it = lookup(hash, key.data(), key.size());
+    if (it != nullptr && _header->cls[class_of(it)].lru_head != offset(it)) {
+        Class &c = _header->cls[class_of(it)];
+        lru_erase(c, it);
+        lru_push_front(c, it);
+    }
+    return it;
+}
+
+// Chunks get reused once lock is released, so values are copied out
+size_t MappedImpl::get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                            uint64_t *versions) const {
+    std::vector<uint64_t> hashes(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        hashes[i] = Hash(keys[i].data(), keys[i].size());
+    }
+    values.clear();
+    values.resize(keys.size());
+
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t found = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        Item *it = find(hashes[i], keys[i]);
+        if (it == nullptr) {
+            continue;
+        }
+        values[i] = ValueRef(std::string(it->value(), it->value_size));
+        if (versions != nullptr) {
+            versions[i] = it->version;
+        }
+        found++;
+    }
+    return found;
+}
+
+// Same as SlabImpl::update: in place if value fits chunk slack, otherwise item moves to the chunk of another
+// class, old one stays intact until the new one is linked
+bool MappedImpl::update(Item *it, const std::string &value) {
+    Header &h = *_header;
+    if (value.size() <= it->capacity) {
+        h.bytes -= it->value_size;
+        std::memcpy(it->value(), value.data(), value.size());
+        it->value_size = uint32_t(value.size());
+        seal(it);
+        it->version = ++h.version;
+        h.bytes += it->value_size;
+        return true;
+    }
+
+    unsigned cls = class_of(it);
+    lru_erase(h.cls[cls], it);
+
+    Item *fresh = allocate(it->hash, it->key(), it->key_size, value);
+    if (fresh == nullptr) {
+        lru_push_front(h.cls[cls], it);
+        return false;
+    }
+
+    fresh->version = ++h.version;
+    index_replace(it, fresh);
+    h.cls[cls].items--;
+    h.items--;
+    h.bytes -= it->key_size + it->value_size;
+    free(cls, it);
+    return true;
+}
+
+// Checksum of appended value continues the old one, prepend has to recompute it
+bool MappedImpl::extend(const std::string &key, const std::string &data, bool front) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *it = find(Hash(key.data(), key.size()), key);
+    if (it == nullptr) {
+        return false;
+    }
+
+    if (it->value_size + data.size() <= it->capacity) {
+        if (front) {
+            std::memmove(it->value() + data.size(), it->value(), it->value_size);
+            std::memcpy(it->value(), data.data(), data.size());
+            it->value_size += uint32_t(data.size());
+            seal(it);
+        } else {
+            std::memcpy(it->value() + it->value_size, data.data(), data.size());
+            it->value_size += uint32_t(data.size());
+            it->crc = Crc32c(data.data(), data.size(), it->crc);
+        }
+        it->version = ++_header->version;
+        _header->bytes += data.size();
+        return true;
+    }
+
+    std::string value(it->value(), it->value_size);
+    if (front) {
+        value.insert(0, data);
+    } else {
+        value.append(data);
+    }
+    return update(it, value);
+}
+
+// See MappedImpl.h
+bool MappedImpl::change(const std::string &key, uint64_t delta, bool decrement, uint64_t &result) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *it = find(Hash(key.data(), key.size()), key);
+    if (it == nullptr) {
+        return false;
+    }
+
+    result = ApplyDelta(ParseCounter(it->value(), it->value_size), delta, decrement);
+    return update(it, std::to_string(result));
+}
+
+// See MappedImpl.h
+bool MappedImpl::insert(uint64_t hash, const std::string &key, const std::string &value) {
+    Item *it = allocate(hash, key.data(), key.size(), value);
+    if (it == nullptr) {
+        return false;
+    }
+    it->version = ++_header->version;
+    index_insert(it);
+    return true;
+}
+
+// Item is marked live only once it is complete, so recovery never picks up a half written one
+MappedImpl::Item *MappedImpl::allocate(uint64_t hash, const char *key, size_t key_size, const std::string &value) {
+    Header &h = *_header;
+    size_t need = sizeof(Item) + key_size + value.size();
+    if (key_size > UINT16_MAX || need > h.page_size) {
+        return nullptr;
+    }
+
+    unsigned cls = class_for(need);
+    Class &c = h.cls[cls];
+
+    uint64_t off;
+    while ((off = alloc(cls)) == 0) {
+        if (c.lru_tail == 0) {
+            // Class has nothing to evict and there are no free pages left, so it gets a page of another class
+            if (!reassign(cls)) {
+                return nullptr;
+            }
+            continue;
+        }
+        remove(item(c.lru_tail));
+        c.evictions++;
+    }
+
+    Item *it = item(off);
+    new (&it->state) std::atomic<uint16_t>(0);
+    it->prev = it->next = it->chain = 0;
+    it->hash = hash;
+    it->version = 0;
+    it->key_size = uint16_t(key_size);
+    it->capacity = uint32_t(c.chunk_size - sizeof(Item) - key_size);
+    it->value_size = uint32_t(value.size());
+    std::memcpy(const_cast<char *>(it->key()), key, key_size);
+    std::memcpy(it->value(), value.data(), value.size());
+    seal(it);
+    it->state.store(Live, std::memory_order_release);
+
+    lru_push_front(c, it);
+    c.items++;
+    h.items++;
+    h.bytes += key_size + value.size();
+    return it;
+}
+
+// See MappedImpl.h
+void MappedImpl::remove(Item *it) {
+    unsigned cls = class_of(it);
+    Class &c = _header->cls[cls];
+    index_erase(it);
+    lru_erase(c, it);
+    c.items--;
+    _header->items--;
+    _header->bytes -= it->key_size + it->value_size;
+    free(cls, it);
+}
+
+// See MappedImpl.h
+void MappedImpl::seal(Item *it) const {
+    it->crc = Crc32c(it->value(), it->value_size, Crc32c(it->key(), it->key_size));
+}
+
+// Classes are sorted by chunk size, so binary search finds the first that fits
+unsigned MappedImpl::class_for(size_t size) const {
+    unsigned lo = 0, hi = _header->classes - 1;
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        if (_header->cls[mid].chunk_size < size) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// See MappedImpl.h
+unsigned MappedImpl::class_of(const Item *it) const {
+    return page_class((offset(it) - _header->first_page) / _header->page_size);
+}
+
+// Free list first, then the rest of the current page, then a new page. Page gets its class before it is counted
+// as used, so recovery never sees used page without class
+uint64_t MappedImpl::alloc(unsigned cls) {
+    Header &h = *_header;
+    Class &c = h.cls[cls];
+    if (c.free_list != 0) {
+        uint64_t off = c.free_list;
+        free_erase(c, item(off));
+        return off;
+    }
+
+    if (c.page_pos + c.chunk_size > c.page_end) {
+        if (h.pages_used == h.pages_total) {
+            return 0;
+        }
+        uint64_t start = h.first_page + h.pages_used * h.page_size;
+        std::memset(_base + start, 0, h.page_size);
+        page_class(h.pages_used) = uint8_t(cls);
+        std::atomic_signal_fence(std::memory_order_seq_cst);
+        h.pages_used++;
+        c.pages++;
+        c.page_pos = start;
+        c.page_end = start + h.page_size / c.chunk_size * c.chunk_size;
+    }
+
+    uint64_t off = c.page_pos;
+    c.page_pos += c.chunk_size;
+    return off;
+}
+
+// Chunk stops being live before it is linked into the free list through its header
+void MappedImpl::free(unsigned cls, Item *it) {
+    Class &c = _header->cls[cls];
+    it->state.store(0, std::memory_order_release);
+    it->prev = c.free_list;
+    it->next = 0;
+    if (c.free_list != 0) {
+        item(c.free_list)->next = offset(it);
+    }
+    c.free_list = offset(it);
+    c.free_count++;
+}
+
+// See MappedImpl.h
+void MappedImpl::free_erase(Class &c, Item *it) {
+    if (it->next != 0) {
+        item(it->next)->prev = it->prev;
+    } else {
+        c.free_list = it->prev;
+    }
+    if (it->prev != 0) {
+        item(it->prev)->next = it->next;
+    }
+    it->prev = it->next = 0;
+    c.free_count--;
+}
+
+// Items of the page are gone before the page is cleared and gets its new class, so recovery after crash at any
+// point sees either the donor page with some of its items or an empty page of either class
+bool MappedImpl::reassign(unsigned cls) {
+    Header &h = *_header;
+    unsigned donor = h.classes;
+    for (unsigned i = 0; i < h.classes; i++) {
+        if (i != cls && h.cls[i].lru_tail != 0 &&
+            (donor == h.classes || item(h.cls[i].lru_tail)->version < item(h.cls[donor].lru_tail)->version)) {
+            donor = i;
+        }
+    }
+    if (donor == h.classes) {
+        return false;
+    }
+
+    Class &d = h.cls[donor];
+    uint64_t page = (d.lru_tail - h.first_page) / h.page_size;
+    uint64_t start = h.first_page + page * h.page_size;
+    uint64_t end = start + h.page_size / d.chunk_size * d.chunk_size;
+    if (d.page_pos >= start && d.page_pos < end) {
+        // Chunks past the bump pointer have never been handed out
+        end = d.page_pos;
+    }
+
+    // Item being moved by update is live, but out of the LRU until the move is done
+    for (uint64_t off = start; off < end; off += d.chunk_size) {
+        Item *it = item(off);
+        if (it->state.load() == Live && it->prev == 0 && d.lru_head != off) {
+            return false;
+        }
+    }
+
+    for (uint64_t off = start; off < end; off += d.chunk_size) {
+        Item *it = item(off);
+        if (it->state.load() == Live) {
+            remove(it);
+            d.evictions++;
+        }
+        free_erase(d, it);
+    }
+    if (d.page_end > start && d.page_end <= start + h.page_size) {
+        d.page_pos = d.page_end = 0;
+    }
+    d.pages--;
+
+    Class &c = h.cls[cls];
+    std::memset(_base + start, 0, h.page_size);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    page_class(page) = uint8_t(cls);
+    std::atomic_signal_fence(std::memory_order_seq_cst);
+    c.pages++;
+    c.page_pos = start;
+    c.page_end = start + h.page_size / c.chunk_size * c.chunk_size;
+    _reassigned++;
+    return true;
+}
+
+// See MappedImpl.h
+void MappedImpl::lru_push_front(Class &c, Item *it) const {
+    uint64_t off = offset(it);
+    it->prev = 0;
+    it->next = c.lru_head;
+    if (c.lru_head != 0) {
+        item(c.lru_head)->prev = off;
+    } else {
+        c.lru_tail = off;
+    }
+    c.lru_head = off;
+}
+
+// See MappedImpl.h
+void MappedImpl::lru_erase(Class &c, Item *it) const {
+    if (it->prev != 0) {
+        item(it->prev)->next = it->next;
+    } else {
+        c.lru_head = it->next;
+    }
+    if (it->next != 0) {
+        item(it->next)->prev = it->prev;
+    } else {
+        c.lru_tail = it->prev;
+    }
+    it->prev = it->next = 0;
+}
+
+// See MappedImpl.h
+void MappedImpl::index_insert(Item *it) {
+    uint64_t &head = bucket(it->hash);
+    it->chain = head;
+    head = offset(it);
+}
+
+// Chains are short, so predecessor is found by walking the bucket
+void MappedImpl::index_erase(Item *it) {
+    uint64_t *link = &bucket(it->hash);
+    while (*link != offset(it)) {
+        link = &item(*link)->chain;
+    }
+    *link = it->chain;
+}
+
+// See MappedImpl.h
+void MappedImpl::index_replace(Item *old_item, Item *it) {
+    uint64_t *link = &bucket(old_item->hash);
+    while (*link != offset(old_item)) {
+        link = &item(*link)->chain;
+    }
+    it->chain = old_item->chain;
+    *link = offset(it);
+}
+
+} // namespace Backend
+} // namespace Afina
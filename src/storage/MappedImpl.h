@@ -0,0 +1,291 @@
+#ifndef AFINA_STORAGE_MAPPED_IMPL_H
+#define AFINA_STORAGE_MAPPED_IMPL_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <afina/Storage.h>
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Restartable slab storage in a memory mapped file
+ * Same design as SlabImpl: memory is split into pages, pages are handed out to size classes, each class has its
+ * own LRU and evicts its own items, class that has nothing to evict takes over the page holding the oldest item
+ * of another class. But everything, including the allocator state, LRU lists and hash index,
+ * lives in a shared mapping of the given file and refers to other parts by offsets from the beginning of the
+ * mapping instead of pointers. So restarted process maps the same file wherever it lands and continues with the
+ * items as they were, without reading them from anywhere. File in /dev/shm survives restarts of the process,
+ * file on disk survives reboots as well, once storage has been destroyed orderly.
+ *
+ * Layout of the file:
+ *
+ * | header | class of each page: u8 | index buckets: u64 | pages |
+ *
+ * On attach geometry in the header must match the one requested, otherwise file is formatted anew. File closed
+ * orderly has clean flag set, its structure is walked and checked before use. After crash file could have any
+ * operation half done, so index, LRU lists and free lists are rebuilt by scanning pages: only items marked live
+ * whose checksum of key and value matches are kept, LRU order is restored by item versions.
+ *
+ * Values are kept as text, expiration is not supported. File is locked, so only one process could use it.
+ */
+class MappedImpl : public Afina::Storage {
+public:
+    /**
+     * @param path of the file to keep items in, created if missing
+     * @param max_size size of the file
+     * @param page_size size of the page, defines the largest possible item
+     */
+    MappedImpl(const std::string &path, size_t max_size = 64 * 1024 * 1024, size_t page_size = 1024 * 1024);
+
+    // Stops storage if it has not been stopped yet and unmaps the file
+    ~MappedImpl();
+
+    // Marks file dirty, so crash from now on makes the next attach rebuild it
+    void Start() override;
+
+    // Marks file clean and syncs it, storage must not be modified after that
+    void Stop() override;
+
+    // Implements Afina::Storage interface
+    bool Put(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool PutIfAbsent(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Set(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Append(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Prepend(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Increment(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Decrement(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Delete(const std::string &key) override;
+
+    // Implements Afina::Storage interface
+    bool Get(const std::string &key, std::string &value) const override;
+
+    // Implements Afina::Storage interface
+    size_t GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const override;
+
+    // Implements Afina::Storage interface
+    size_t Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                std::vector<uint64_t> &versions) const override;
+
+    // Implements Afina::Storage interface
+    CasResult Cas(const std::string &key, const std::string &value, uint64_t version, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    size_t Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                const std::vector<time_t> &expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const override;
+
+    /**
+     * Implements Afina::Storage interface. Mapping is shared, so child process of fork() would see all the
+     * changes made after it. Instead used part of the mapping is copied to private memory, which ForEach walks
+     * while frozen, so storage is frozen for as long as copying takes, about 10ms per 100MB used
+     */
+    void Freeze(const std::function<void()> &f) override;
+
+    // Implements Afina::Storage interface
+    void ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const override;
+
+    // Implements Afina::Storage interface
+    void GetStats(std::vector<std::pair<std::string, std::string>> &stats) const override;
+
+    /**
+     * How the file has been attached: "new" if it has been formatted, "clean" if it was closed orderly and
+     * "recovered" if it has been rebuilt after crash
+     */
+    const std::string &Attach() const { return _attach; }
+
+private:
+    static const size_t MaxClasses = 64;
+    static const uint8_t NoClass = 0xff;
+
+    // Item header, key and value follow it
+    struct Item {
+        // LRU list links
+        uint64_t prev;
+        uint64_t next;
+
+        // Next item in the index bucket
+        uint64_t chain;
+
+        uint64_t hash;
+        uint64_t version;
+        uint32_t value_size;
+        uint32_t capacity;
+
+        // Checksum of key and value
+        uint32_t crc;
+
+        uint16_t key_size;
+
+        // Set to Live once item is complete, chunk is free otherwise
+        std::atomic<uint16_t> state;
+
+        const char *key() const { return reinterpret_cast<const char *>(this + 1); }
+        char *value() { return reinterpret_cast<char *>(this + 1) + key_size; }
+        const char *value() const { return reinterpret_cast<const char *>(this + 1) + key_size; }
+    };
+
+    static const uint16_t Live = 0x4c56;
+
+    // Allocator state and LRU list of a single slab class
+    struct Class {
+        uint64_t chunk_size;
+        uint64_t pages;
+
+        // Freed chunks linked through prev of the item header, next links back so that chunks of a page taken
+        // away from the class are unlinked without walking the list
+        uint64_t free_list;
+        uint64_t free_count;
+
+        // Bump pointer over the last page assigned to the class
+        uint64_t page_pos;
+        uint64_t page_end;
+
+        uint64_t lru_head;
+        uint64_t lru_tail;
+        uint64_t items;
+        uint64_t evictions;
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t layout;
+        uint32_t clean;
+
+        // Geometry
+        uint64_t size;
+        uint64_t page_size;
+        uint64_t pages_total;
+        uint64_t buckets;
+        uint64_t page_classes;
+        uint64_t index;
+        uint64_t first_page;
+        uint32_t classes;
+
+        uint64_t pages_used;
+        uint64_t items;
+        uint64_t bytes;
+        uint64_t version;
+        Class cls[MaxClasses];
+    };
+
+    mutable std::mutex _lock;
+
+    std::string _path;
+    int _fd;
+    size_t _size;
+    char *_base;
+    Header *_header;
+
+    // Private copy of the mapping ForEach walks while storage is frozen
+    char *_frozen;
+    size_t _frozen_size;
+
+    std::string _attach;
+    size_t _attach_ms;
+    size_t _dropped;
+
+    // Number of pages moved between classes since start
+    size_t _reassigned;
+
+    // Checks whether file has the given geometry and valid structure, rebuilds it if it was not closed orderly.
+    // Returns false if file has to be formatted
+    bool attach(const Header &geometry);
+
+    // Walks LRU lists, free lists and index, returns false at the first inconsistency
+    bool validate() const;
+
+    // Rebuilds everything but pages from the items found in pages
+    void recover();
+
+    // Initializes empty storage of the given geometry
+    void format(const Header &geometry);
+
+    // Writes pages of the header to the file and waits for it
+    void sync_header() const;
+
+    // Geometry of the file of the given size
+    static Header layout(size_t size, size_t page_size);
+
+    Item *item(uint64_t offset) const { return reinterpret_cast<Item *>(_base + offset); }
+    uint64_t offset(const Item *item) const { return reinterpret_cast<const char *>(item) - _base; }
+    uint64_t &bucket(uint64_t hash) const {
+        return reinterpret_cast<uint64_t *>(_base + _header->index)[hash & (_header->buckets - 1)];
+    }
+    uint8_t &page_class(uint64_t page) const {
+        return reinterpret_cast<uint8_t *>(_base + _header->page_classes)[page];
+    }
+
+    // Whether offset could be the beginning of an item of the given class
+    bool chunk_of(uint64_t offset, unsigned cls) const;
+
+    // Returns item for the given key or nullptr if there is no such
+    Item *lookup(uint64_t hash, const char *key, size_t size) const;
+
+    // Returns item for the given key and moves it to the beginning of its class LRU list
+    Item *find(uint64_t hash, const std::string &key) const;
+
+    // Looks up batch of keys, versions are filled in if given
+    size_t get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values, uint64_t *versions) const;
+
+    bool update(Item *item, const std::string &value);
+    bool extend(const std::string &key, const std::string &data, bool front);
+    bool change(const std::string &key, uint64_t delta, bool decrement, uint64_t &result);
+    bool insert(uint64_t hash, const std::string &key, const std::string &value);
+
+    // Allocates complete live item linked into its class LRU, but not into index, evicting items of the same
+    // class if needed. Returns nullptr if item doesn't fit a page or no page could be given to its class
+    Item *allocate(uint64_t hash, const char *key, size_t key_size, const std::string &value);
+
+    // Unlinks item from everywhere and frees its chunk
+    void remove(Item *item);
+
+    // Recomputes checksum once value has changed
+    void seal(Item *item) const;
+
+    unsigned class_for(size_t size) const;
+    unsigned class_of(const Item *item) const;
+
+    uint64_t alloc(unsigned cls);
+    void free(unsigned cls, Item *item);
+
+    // Unlinks free chunk from the free list of the class
+    void free_erase(Class &c, Item *item);
+
+    // Evicts items of the page holding the oldest tail among the other classes and gives the page to the given
+    // class. Only chunks of that page are walked. Returns false if there is no such page or it holds an item
+    // being moved right now
+    bool reassign(unsigned cls);
+
+    void lru_push_front(Class &c, Item *item) const;
+    void lru_erase(Class &c, Item *item) const;
+
+    void index_insert(Item *item);
+    void index_erase(Item *item);
+    void index_replace(Item *old_item, Item *item);
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_MAPPED_IMPL_H
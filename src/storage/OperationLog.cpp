@@ -0,0 +1,391 @@
+#include "OperationLog.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Crc32c.h"
+
+namespace Afina {
+namespace Backend {
+
+// Size and checksum of the record payload
+static const size_t RecordHeaderSize = 8;
+
+// See OperationLog.h
+static void put_varint(std::string &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(char(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+// See OperationLog.h
+static bool get_varint(const char *in, size_t size, size_t &pos, uint64_t &value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64 && pos < size; shift += 7) {
+        uint8_t byte = uint8_t(in[pos++]);
+        value |= uint64_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Integers are stored the way little endian host keeps them in memory
+static uint32_t get_u32(const char *in) {
+    uint32_t value;
+    std::memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+// See OperationLog.h
+OperationLog::OperationLog(const std::string &dir, std::chrono::milliseconds window)
+    : _dir(dir), _window(window), _fd(-1), _segment(0), _segment_bytes(0), _running(false), _added(0), _synced(0),
+      _bytes(0), _syncs(0) {}
+
+// See OperationLog.h
+OperationLog::~OperationLog() { Stop(); }
+
+// Payload is verified against its checksum before anything is taken out of it, so torn record is never replayed
+size_t OperationLog::Replay(uint64_t from, const Replayer &f) {
+    size_t replayed = 0;
+    std::string key, value;
+    for (uint64_t segment : List(_dir, "log.")) {
+        if (segment < from) {
+            continue;
+        }
+
+        std::string file = path(segment);
+        int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd < 0 || fstat(fd, &st) != 0) {
+            std::string error = strerror(errno);
+            if (fd >= 0) {
+                close(fd);
+            }
+            throw std::runtime_error("Failed to open operation log " + file + ": " + error);
+        }
+        std::string data(size_t(st.st_size), '\0');
+        size_t size = 0;
+        while (size < data.size()) {
+            ssize_t n = read(fd, &data[size], data.size() - size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            } else if (n <= 0) {
+                close(fd);
+                throw std::runtime_error("Failed to read operation log " + file);
+            }
+            size += n;
+        }
+        close(fd);
+
+        size_t pos = 0;
+        while (data.size() - pos >= RecordHeaderSize) {
+            uint32_t length = get_u32(&data[pos]);
+            const char *payload = &data[pos + RecordHeaderSize];
+            if (length > data.size() - pos - RecordHeaderSize || Crc32c(payload, length) != get_u32(&data[pos + 4])) {
+                break;
+            }
+
+            size_t p = 1;
+            uint64_t key_size, value_size, number;
+            if (length < 1 || !get_varint(payload, length, p, key_size) ||
+                !get_varint(payload, length, p, value_size) || !get_varint(payload, length, p, number) ||
+                key_size > length - p || value_size != length - p - key_size) {
+                break;
+            }
+            key.assign(payload + p, key_size);
+            value.assign(payload + p + key_size, value_size);
+            f(Op(payload[0]), key, value, number);
+
+            replayed++;
+            pos += RecordHeaderSize + length;
+        }
+
+        if (pos < data.size() && truncate(file.c_str(), off_t(pos)) != 0) {
+            throw std::runtime_error("Failed to truncate operation log " + file + ": " + strerror(errno));
+        }
+    }
+    return replayed;
+}
+
+// See OperationLog.h
+void OperationLog::Start() {
+    std::vector<uint64_t> segments = List(_dir, "log.");
+    uint64_t segment = segments.empty() ? 1 : segments.back() + 1;
+
+    std::unique_lock<std::mutex> guard(_lock);
+    _fd = open(path(segment).c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+    if (_fd < 0) {
+        throw std::runtime_error("Failed to create operation log " + path(segment) + ": " + strerror(errno));
+    }
+    SyncDir(_dir);
+
+    _segment = segment;
+    _segment_bytes = 0;
+    _running = true;
+    if (_window.count() > 0) {
+        _flusher = std::thread(&OperationLog::flusher, this);
+    }
+}
+
+// See OperationLog.h
+void OperationLog::Stop() {
+    {
+        std::unique_lock<std::mutex> guard(_lock);
+        _running = false;
+        _added_cv.notify_all();
+    }
+    if (_flusher.joinable()) {
+        _flusher.join();
+    }
+
+    std::unique_lock<std::mutex> guard(_lock);
+    if (_fd >= 0) {
+        flush(guard);
+        close(_fd);
+        _fd = -1;
+    }
+}
+
+// Record is encoded right into the batch, so value is copied once on its way to disk
+uint64_t OperationLog::Add(Op op, const std::string &key, const std::string &value, uint64_t number) {
+    std::unique_lock<std::mutex> guard(_lock);
+    if (!_error.empty()) {
+        throw std::runtime_error("Operation log has failed: " + _error);
+    } else if (_fd < 0) {
+        throw std::runtime_error("Operation log is not open");
+    }
+
+    size_t start = _batch.size();
+    _batch.append(RecordHeaderSize, '\0');
+    _batch.push_back(char(op));
+    put_varint(_batch, key.size());
+    put_varint(_batch, value.size());
+    put_varint(_batch, number);
+    _batch.append(key);
+    _batch.append(value);
+
+    uint32_t length = uint32_t(_batch.size() - start - RecordHeaderSize);
+    uint32_t crc = Crc32c(&_batch[start + RecordHeaderSize], length);
+    std::memcpy(&_batch[start], &length, sizeof(length));
+    std::memcpy(&_batch[start + 4], &crc, sizeof(crc));
+    _bytes += RecordHeaderSize + length;
+    _segment_bytes += RecordHeaderSize + length;
+    uint64_t sequence = ++_added;
+
+    if (_window.count() == 0) {
+        // Writer syncs its own record holding the lock, so records are synced strictly one by one
+        std::unique_lock<std::mutex> io(_io);
+        try {
+            write(_batch);
+        } catch (std::exception &e) {
+            _error = e.what();
+            _batch.clear();
+            throw;
+        }
+        _batch.clear();
+        _synced = sequence;
+        _syncs++;
+    } else if (start == 0) {
+        _batch_started = std::chrono::steady_clock::now();
+        _added_cv.notify_one();
+    }
+    return sequence;
+}
+
+// See OperationLog.h
+void OperationLog::Sync(uint64_t sequence) {
+    std::unique_lock<std::mutex> guard(_lock);
+    while (_synced < sequence) {
+        if (!_error.empty()) {
+            throw std::runtime_error("Operation log has failed: " + _error);
+        } else if (!_running && !_batch.empty()) {
+            flush(guard);
+            continue;
+        }
+        _synced_cv.wait(guard);
+    }
+}
+
+// Writers are stalled while pending records are synced and segment is switched, which is one fdatasync
+uint64_t OperationLog::Rotate() {
+    std::unique_lock<std::mutex> guard(_lock);
+    std::unique_lock<std::mutex> io(_io);
+    if (_fd < 0) {
+        throw std::runtime_error("Operation log is not open");
+    }
+
+    if (!_batch.empty()) {
+        try {
+            write(_batch);
+        } catch (std::exception &e) {
+            _error = e.what();
+            _synced_cv.notify_all();
+            throw;
+        }
+        _batch.clear();
+        _synced = _added;
+        _syncs++;
+        _synced_cv.notify_all();
+    }
+
+    int fd = open(path(_segment + 1).c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create operation log " + path(_segment + 1) + ": " + strerror(errno));
+    }
+    SyncDir(_dir);
+
+    close(_fd);
+    _fd = fd;
+    _segment++;
+    _segment_bytes = 0;
+    return _segment;
+}
+
+// See OperationLog.h
+void OperationLog::Drop(uint64_t before) {
+    for (uint64_t segment : List(_dir, "log.")) {
+        if (segment < before) {
+            unlink(path(segment).c_str());
+        }
+    }
+    SyncDir(_dir);
+}
+
+// See OperationLog.h
+uint64_t OperationLog::SegmentBytes() const {
+    std::unique_lock<std::mutex> guard(_lock);
+    return _segment_bytes;
+}
+
+// See OperationLog.h
+void OperationLog::GetStats(std::vector<std::pair<std::string, std::string>> &stats) const {
+    std::unique_lock<std::mutex> guard(_lock);
+    stats.emplace_back("wal_segment", std::to_string(_segment));
+    stats.emplace_back("wal_segment_bytes", std::to_string(_segment_bytes));
+    stats.emplace_back("wal_records", std::to_string(_added));
+    stats.emplace_back("wal_bytes", std::to_string(_bytes));
+    stats.emplace_back("wal_syncs", std::to_string(_syncs));
+    stats.emplace_back("wal_records_per_sync", std::to_string(_syncs > 0 ? double(_synced) / _syncs : 0.0));
+    stats.emplace_back("wal_window_ms", std::to_string(_window.count()));
+}
+
+// See OperationLog.h
+std::vector<uint64_t> OperationLog::List(const std::string &dir, const std::string &prefix) {
+    std::vector<uint64_t> numbers;
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) {
+        throw std::runtime_error("Failed to open directory " + dir + ": " + strerror(errno));
+    }
+
+    while (struct dirent *entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+            name.find_first_not_of("0123456789", prefix.size()) == std::string::npos) {
+            numbers.push_back(std::strtoull(name.c_str() + prefix.size(), nullptr, 10));
+        }
+    }
+    closedir(d);
+
+    std::sort(numbers.begin(), numbers.end());
+    return numbers;
+}
+
+// See OperationLog.h
+void OperationLog::SyncDir(const std::string &dir) {
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || fsync(fd) != 0) {
+        std::string error = strerror(errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        throw std::runtime_error("Failed to sync directory " + dir + ": " + error);
+    }
+    close(fd);
+}
+
+// Batch gathers records till window passes since the first one came, then the next batch starts filling up
+// while this one is being written
+void OperationLog::flusher() {
+    std::unique_lock<std::mutex> guard(_lock);
+    while (_running) {
+        if (_batch.empty()) {
+            _added_cv.wait(guard);
+            continue;
+        }
+
+        auto deadline = _batch_started + _window;
+        if (std::chrono::steady_clock::now() < deadline) {
+            _added_cv.wait_until(guard, deadline);
+            continue;
+        }
+        flush(guard);
+    }
+}
+
+// Rotate could switch segment while lock is released, so synced sequence only moves forward
+void OperationLog::flush(std::unique_lock<std::mutex> &guard) {
+    if (_batch.empty() || !_error.empty()) {
+        return;
+    }
+
+    std::string batch;
+    batch.swap(_batch);
+    uint64_t sequence = _added;
+    std::string error;
+
+    std::unique_lock<std::mutex> io(_io);
+    guard.unlock();
+    try {
+        write(batch);
+    } catch (std::exception &e) {
+        error = e.what();
+    }
+    io.unlock();
+    guard.lock();
+
+    if (!error.empty()) {
+        _error = error;
+    } else {
+        _synced = std::max(_synced, sequence);
+        _syncs++;
+    }
+    _synced_cv.notify_all();
+}
+
+// See OperationLog.h
+void OperationLog::write(const std::string &data) {
+    const char *p = data.data();
+    size_t size = data.size();
+    while (size > 0) {
+        ssize_t n = ::write(_fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            throw std::runtime_error(std::string("Failed to write operation log: ") + strerror(errno));
+        }
+        p += n;
+        size -= n;
+    }
+
+    if (fdatasync(_fd) != 0) {
+        throw std::runtime_error(std::string("Failed to sync operation log: ") + strerror(errno));
+    }
+}
+
+// See OperationLog.h
+std::string OperationLog::path(uint64_t segment) const { return _dir + "/log." + std::to_string(segment); }
+
+} // namespace Backend
+} // namespace Afina
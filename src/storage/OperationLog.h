@@ -0,0 +1,156 @@
+#ifndef AFINA_STORAGE_OPERATION_LOG_H
+#define AFINA_STORAGE_OPERATION_LOG_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Append only log of storage modifications
+ * Log is a sequence of segment files <dir>/log.<N>, each started on Start or Rotate. Every record is framed as
+ *
+ * | payload size: u32 | crc32c of payload: u32 | op: u8 | key size: varint | value size: varint |
+ * | number: varint | key | value |
+ *
+ * where number is expiration time for Put and delta for Increment and Decrement. Record is written only after
+ * modification has been applied, so log has nothing but what storage has seen.
+ *
+ * Group commit: Add only appends record to the in-memory batch and returns its sequence number. Background
+ * flusher writes the batch out and syncs it once window has passed since the first record of the batch came,
+ * and Sync blocks the caller till its record is on disk. So every writer waits for at most window plus one
+ * fdatasync, while the cost of fdatasync is shared by all writers that came within the window. Window of zero
+ * disables batching: every record is written and synced by Add itself.
+ */
+class OperationLog {
+public:
+    enum class Op : uint8_t { Put = 1, Append = 2, Prepend = 3, Increment = 4, Decrement = 5, Delete = 6 };
+
+    using Replayer = std::function<void(Op, const std::string &, const std::string &, uint64_t)>;
+
+    /**
+     * @param dir to keep segments in, must exist
+     * @param window how long batch gathers records before it is synced
+     */
+    OperationLog(const std::string &dir, std::chrono::milliseconds window);
+
+    // Syncs whatever is left, see Stop
+    ~OperationLog();
+
+    /**
+     * Calls f(op, key, value, number) for every record in segments starting from the given one, in the order
+     * records have been added. Segment ending with torn or corrupted record, the way it is left by crash in the
+     * middle of a write, is truncated right before that record. Returns number of records replayed, throws
+     * std::runtime_error if segment can't be read
+     */
+    size_t Replay(uint64_t from, const Replayer &f);
+
+    /**
+     * Opens new segment after the last one present and starts flusher. Throws std::runtime_error if segment
+     * could not be created
+     */
+    void Start();
+
+    /**
+     * Syncs records added so far, stops flusher and closes segment
+     */
+    void Stop();
+
+    /**
+     * Adds record to the current batch, returns its sequence number to Sync on. Throws std::runtime_error once
+     * log has failed to write
+     */
+    uint64_t Add(Op op, const std::string &key, const std::string &value, uint64_t number);
+
+    /**
+     * Blocks until record with the given sequence number and all before it are on disk. Throws
+     * std::runtime_error if they could not be written
+     */
+    void Sync(uint64_t sequence);
+
+    /**
+     * Syncs records added so far to the current segment and starts the next one, returns its number. Records
+     * added after the call go to the new segment
+     */
+    uint64_t Rotate();
+
+    /**
+     * Removes segments before the given one
+     */
+    void Drop(uint64_t before);
+
+    // Bytes in the current segment
+    uint64_t SegmentBytes() const;
+
+    /**
+     * Appends log metrics, same way as Storage::GetStats does
+     */
+    void GetStats(std::vector<std::pair<std::string, std::string>> &stats) const;
+
+    /**
+     * Numbers of files named <prefix><number> in the given directory, ascending
+     */
+    static std::vector<uint64_t> List(const std::string &dir, const std::string &prefix);
+
+    /**
+     * Makes creation, rename and removal of files in the directory durable
+     */
+    static void SyncDir(const std::string &dir);
+
+private:
+    std::string _dir;
+    std::chrono::milliseconds _window;
+    std::thread _flusher;
+
+    // Guards everything below
+    mutable std::mutex _lock;
+
+    // Signaled once batch gets its first record and on stop
+    std::condition_variable _added_cv;
+
+    // Signaled once batch is synced
+    std::condition_variable _synced_cv;
+
+    // Held while segment is written or switched, taken after _lock
+    std::mutex _io;
+
+    int _fd;
+    uint64_t _segment;
+    uint64_t _segment_bytes;
+    bool _running;
+    std::string _error;
+
+    // Records not written yet and the moment the first of them was added
+    std::string _batch;
+    std::chrono::steady_clock::time_point _batch_started;
+
+    // Sequence numbers of the last record added and of the last one synced
+    uint64_t _added;
+    uint64_t _synced;
+
+    uint64_t _bytes;
+    uint64_t _syncs;
+
+    void flusher();
+
+    // Writes and syncs the batch, lock is released meanwhile
+    void flush(std::unique_lock<std::mutex> &guard);
+
+    // Writes data to the current segment and syncs it, throws std::runtime_error on failure
+    void write(const std::string &data);
+
+    std::string path(uint64_t segment) const;
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_OPERATION_LOG_H
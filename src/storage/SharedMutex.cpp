@@ -0,0 +1,56 @@
+#include "SharedMutex.h"
+
+#include <thread>
+
+namespace Afina {
+namespace Backend {
+
+// Threads get slots round robin in order of their first lock_shared call
+size_t SharedMutex::slot() {
+    static std::atomic<size_t> next(0);
+    thread_local size_t self = next.fetch_add(1) % Slots;
+    return self;
+}
+
+// See SharedMutex.h
+void SharedMutex::lock() {
+    _writers.lock();
+
+    // Flag store and counters loads must not be reordered, otherwise reader and writer could both miss each other,
+    // so all operations are sequentially consistent
+    _writer.store(true);
+    for (auto &r : _readers) {
+        while (r.count.load() != 0) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// See SharedMutex.h
+void SharedMutex::unlock() {
+    _writer.store(false);
+    _writers.unlock();
+}
+
+// See SharedMutex.h
+void SharedMutex::lock_shared() {
+    std::atomic<int> &count = _readers[slot()].count;
+    for (;;) {
+        count.fetch_add(1);
+        if (!_writer.load()) {
+            return;
+        }
+
+        // Writer is active or waits for readers to drain, step back and let it go
+        count.fetch_sub(1);
+        while (_writer.load()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+// See SharedMutex.h
+void SharedMutex::unlock_shared() { _readers[slot()].count.fetch_sub(1, std::memory_order_release); }
+
+} // namespace Backend
+} // namespace Afina
@@ -0,0 +1,76 @@
+#ifndef AFINA_STORAGE_SHARED_MUTEX_H
+#define AFINA_STORAGE_SHARED_MUTEX_H
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Reader-writer lock with distributed reader counters
+ * Unlike shared_mutex from lectures (materials/09-advanced-synchronization) readers don't take any internal
+ * mutex and don't even share a counter: each thread increments a counter on its own cache line, so readers
+ * on different cores never block each other nor bounce cache lines.
+ *
+ * Writer raises a flag and waits until all reader counters drop to zero. Readers that see the flag step back
+ * and wait until writer is done, so writers can't be starved by a stream of readers. Writers are serialized
+ * with each other by a regular mutex.
+ *
+ * Waiting is done by spinning with yield, lock is meant to protect short critical sections.
+ */
+class SharedMutex {
+public:
+    SharedMutex() : _writer(false) {
+        for (auto &r : _readers) {
+            r.count.store(0);
+        }
+    }
+
+    SharedMutex(const SharedMutex &) = delete;
+    SharedMutex &operator=(const SharedMutex &) = delete;
+
+    // Exclusive ownership
+    void lock();
+    void unlock();
+
+    // Shared ownership
+    void lock_shared();
+    void unlock_shared();
+
+private:
+    static const size_t Slots = 64;
+
+    // Each counter occupies its own cache line
+    struct alignas(64) Reader {
+        std::atomic<int> count;
+    };
+
+    // Returns counter slot of the calling thread
+    static size_t slot();
+
+    Reader _readers[Slots];
+    alignas(64) std::atomic<bool> _writer;
+    std::mutex _writers;
+};
+
+/**
+ * RAII wrapper for shared ownership, exclusive one is done by std::unique_lock
+ */
+class SharedLock {
+public:
+    explicit SharedLock(SharedMutex &m) : _m(m) { _m.lock_shared(); }
+    ~SharedLock() { _m.unlock_shared(); }
+
+    SharedLock(const SharedLock &) = delete;
+    SharedLock &operator=(const SharedLock &) = delete;
+
+private:
+    SharedMutex &_m;
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_SHARED_MUTEX_H
@@ -0,0 +1,667 @@
+#include "SkipListImpl.h"
+
+#include <algorithm>
+#include <new>
+#include <thread>
+
+#include <time.h>
+
+#include "Counter.h"
+#include "Cursor.h"
+
+namespace Afina {
+namespace Backend {
+
+const unsigned SkipListImpl::MaxHeight;
+const size_t SkipListImpl::EvictionSamples;
+const size_t SkipListImpl::EvictionPoolSize;
+const size_t SkipListImpl::EvictionPools;
+const uintptr_t SkipListImpl::Mark;
+const uint8_t SkipListImpl::Inserted;
+const uint8_t SkipListImpl::Removed;
+
+// Eviction attempts in a row that may find nothing to evict before writer gives up
+static const size_t EvictionMisses = 64;
+
+// Nodes sampling walk counts on one level, gaps are 4 nodes long on average
+static const size_t MaxSampleGap = 64;
+
+// Sampling walk starts from the highest level that has at least that many nodes, and counts no more than
+// MaxSampleRun of them
+static const size_t MinSampleRun = 16;
+static const size_t MaxSampleRun = 256;
+
+// Thread local xorshift, seeded by thread id so that threads don't sample the same nodes
+static uint32_t next_random() {
+    thread_local uint64_t state = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return uint32_t(state >> 32);
+}
+
+// Each level has a quarter of nodes of the level below
+static unsigned random_height() {
+    unsigned height = 1;
+    for (uint32_t r = next_random(); height < SkipListImpl::MaxHeight && (r & 3) == 0; r >>= 2) {
+        height++;
+    }
+    return height;
+}
+
+// Coarse clock is read without a syscall and is precise enough to tell recent accesses from old ones
+static uint32_t access_clock() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return uint32_t(uint64_t(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000);
+}
+
+// See SkipListImpl.h
+SkipListImpl::SkipListImpl(size_t max_size)
+    : _max_size(max_size), _head(create(std::string(), MaxHeight)), _version(0), _items(0), _size(0),
+      _evictions(0) {}
+
+// Nobody could be inside operation any more, so every node still linked at the bottom level is live
+SkipListImpl::~SkipListImpl() {
+    Node *node = ptr(_head->links()[0].load());
+    while (node != nullptr) {
+        Node *next = ptr(node->links()[0].load());
+        delete node->value.load();
+        destroy(node);
+        node = next;
+    }
+    destroy(_head);
+}
+
+// See SkipListImpl.h
+bool SkipListImpl::Put(const std::string &key, const std::string &value) {
+    if (key.size() + value.size() > _max_size) {
+        return false;
+    }
+
+    Epoch::Guard guard(_epoch);
+    SharedLock writers(_freeze);
+    std::unique_ptr<Value> fresh(new Value{++_version, value});
+    return link(key, fresh, true);
+}
+
+// See SkipListImpl.h
+bool SkipListImpl::PutIfAbsent(const std::string &key, const std::string &value) {
+    if (key.size() + value.size() > _max_size) {
+        return false;
+    }
+
+    Epoch::Guard guard(_epoch);
+    SharedLock writers(_freeze);
+    if (lookup(key) != nullptr) {
+        return false;
+    }
+    std::unique_ptr<Value> fresh(new Value{++_version, value});
+    return link(key, fresh, false);
+}
+
+// See SkipListImpl.h
+bool SkipListImpl::Set(const std::string &key, const std::string &value) {
+    return modify(key, [&value](const Value &, std::string &out) {
+        out = value;
+        return true;
+    }) == CasResult::Stored;
+}
+
+// See SkipListImpl.h
+bool SkipListImpl::Append(const std::string &key, const std::string &data) {
+    return modify(key, [&data](const Value &current, std::string &out) {
+        out = current.data + data;
+        return true;
+    }) == CasResult::Stored;
+}
+
+// See SkipListImpl.h
+bool SkipListImpl::Prepend(const std::string &key, const std::string &data) {
+    return modify(key, [&data](const Value &current, std::string &out) {
+        out = data + current.data;
+        return true;
+    }) == CasResult::Stored;
+}
+
+// Counters are kept as text, values are immutable anyway
+bool SkipListImpl::Increment(const std::string &key, uint64_t delta, uint64_t &result) {
+    return modify(key, [delta, &result](const Value &current, std::string &out) {
+        result = ApplyDelta(ParseCounter(current.data.data(), current.data.size()), delta, false);
+        out = std::to_string(result);
+        return true;
+    }) == CasResult::Stored;
+}
+
+// See SkipListImpl.h
+bool SkipListImpl::Decrement(const std::string &key, uint64_t delta, uint64_t &result) {
+    return modify(key, [delta, &result](const Value &current, std::string &out) {
+        result = ApplyDelta(ParseCounter(current.data.data(), current.data.size()), delta, true);
+        out = std::to_string(result);
+        return true;
+    }) == CasResult::Stored;
+}
+
+// Node removed by somebody else in the meantime is gone all the same
+bool SkipListImpl::Delete(const std::string &key) {
+    Epoch::Guard guard(_epoch);
+    SharedLock writers(_freeze);
+    Node *node = lookup(key);
+    return node != nullptr && remove(node);
+}
+
+// See SkipListImpl.h
+bool SkipListImpl::Get(const std::string &key, std::string &value) const {
+    Epoch::Guard guard(_epoch);
+    Node *node = lookup(key);
+    if (node == nullptr) {
+        return false;
+    }
+
+    const Value *current = node->value.load(std::memory_order_acquire);
+    if (current == nullptr) {
+        return false;
+    }
+    value = current->data;
+    touch(node);
+    return true;
+}
+
+// See SkipListImpl.h
+size_t SkipListImpl::GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const {
+    std::vector<uint64_t> versions;
+    return Gets(keys, values, versions);
+}
+
+// Values are copied out, node could be gone right after the guard is left
+size_t SkipListImpl::Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                          std::vector<uint64_t> &versions) const {
+    values.clear();
+    values.resize(keys.size());
+    versions.assign(keys.size(), 0);
+
+    Epoch::Guard guard(_epoch);
+    size_t found = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        Node *node = lookup(keys[i]);
+        const Value *current = node != nullptr ? node->value.load(std::memory_order_acquire) : nullptr;
+        if (current != nullptr) {
+            values[i] = ValueRef(std::string(current->data));
+            versions[i] = current->version;
+            touch(node);
+            found++;
+        }
+    }
+    return found;
+}
+
+// Expiration is not supported by this storage, so it is ignored as in other TTL overloads
+Storage::CasResult SkipListImpl::Cas(const std::string &key, const std::string &value, uint64_t version,
+                                     time_t expire_at) {
+    return modify(key, [&value, version](const Value &current, std::string &out) {
+        if (current.version != version) {
+            return false;
+        }
+        out = value;
+        return true;
+    });
+}
+
+// See SkipListImpl.h
+size_t SkipListImpl::Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                          const std::vector<time_t> &expire_at) {
+    size_t stored = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (PutIfAbsent(keys[i], values[i])) {
+            stored++;
+        }
+    }
+    return stored;
+}
+
+// Walk follows bottom links without any lock. Keys inserted or removed meanwhile may or may not be seen, but key
+// present for the whole walk is not missed: removed node still links to the node that followed it
+bool SkipListImpl::Range(const std::string &prefix, const std::string &after, size_t limit,
+                         std::vector<std::string> &keys, std::vector<ValueRef> *values) const {
+    Epoch::Guard guard(_epoch);
+
+    size_t taken = 0;
+    for (Node *node = seek(std::max(prefix, after)); node != nullptr && taken < limit; node = next_live(node)) {
+        if (node->key.compare(0, prefix.size(), prefix) != 0) {
+            break;
+        }
+        const Value *current = node->value.load(std::memory_order_acquire);
+        if (current == nullptr || (!after.empty() && node->key == after)) {
+            continue;
+        }
+
+        keys.push_back(node->key);
+        if (values != nullptr) {
+            values->emplace_back(std::string(current->data));
+        }
+        taken++;
+    }
+    return true;
+}
+
+// See SkipListImpl.h
+bool SkipListImpl::Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const {
+    return RangeScan(*this, cursor, count, keys);
+}
+
+// See SkipListImpl.h
+void SkipListImpl::Freeze(const std::function<void()> &f) {
+    std::unique_lock<SharedMutex> guard(_freeze);
+    f();
+}
+
+// Keys go in key order, access times are not worth keeping across restart
+void SkipListImpl::ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const {
+    Epoch::Guard guard(_epoch);
+    for (Node *node = next_live(_head); node != nullptr; node = next_live(node)) {
+        const Value *current = node->value.load(std::memory_order_acquire);
+        if (current != nullptr) {
+            f(node->key, current->data, 0);
+        }
+    }
+}
+
+// See SkipListImpl.h
+void SkipListImpl::GetStats(std::vector<std::pair<std::string, std::string>> &stats) const {
+    stats.emplace_back("curr_items", std::to_string(_items.load()));
+    stats.emplace_back("bytes", std::to_string(_size.load()));
+    stats.emplace_back("limit_maxbytes", std::to_string(_max_size));
+    stats.emplace_back("evictions", std::to_string(_evictions.load()));
+    stats.emplace_back("epoch", std::to_string(_epoch.Current()));
+    stats.emplace_back("reclaim_pending", std::to_string(_epoch.Pending()));
+}
+
+// See SkipListImpl.h
+SkipListImpl::Node *SkipListImpl::create(const std::string &key, unsigned height) {
+    void *mem = ::operator new(sizeof(Node) + height * sizeof(std::atomic<uintptr_t>));
+    Node *node = new (mem) Node(key, height);
+    for (unsigned level = 0; level < height; level++) {
+        new (&node->links()[level]) std::atomic<uintptr_t>(0);
+    }
+    return node;
+}
+
+// Links are trivially destructible
+void SkipListImpl::destroy(void *node) {
+    static_cast<Node *>(node)->~Node();
+    ::operator delete(node);
+}
+
+// See SkipListImpl.h
+void SkipListImpl::drop_value(void *value) { delete static_cast<Value *>(value); }
+
+// See SkipListImpl.h
+bool SkipListImpl::find(const std::string &key, Node **preds, Node **succs) const {
+    while (!search(key, preds, succs)) {
+    }
+    return succs[0] != nullptr && succs[0]->key == key;
+}
+
+// Marked node is snipped by CAS on the link of its predecessor, which fails if predecessor got removed itself or
+// something was inserted in between, then the search starts over from the head
+bool SkipListImpl::search(const std::string &key, Node **preds, Node **succs) const {
+    Node *pred = _head;
+    for (int level = MaxHeight - 1; level >= 0; level--) {
+        Node *curr = ptr(pred->links()[level].load());
+        while (curr != nullptr) {
+            uintptr_t next = curr->links()[level].load();
+            if (marked(next)) {
+                uintptr_t expected = uintptr_t(curr);
+                if (!pred->links()[level].compare_exchange_strong(expected, next & ~Mark)) {
+                    return false;
+                }
+                curr = ptr(next);
+            } else if (curr->key < key) {
+                pred = curr;
+                curr = ptr(next);
+            } else {
+                break;
+            }
+        }
+        preds[level] = pred;
+        succs[level] = curr;
+    }
+    return true;
+}
+
+// Removed nodes are stepped over rather than snipped, readers never write links
+SkipListImpl::Node *SkipListImpl::seek(const std::string &key) const {
+    Node *pred = _head;
+    Node *curr = nullptr;
+    for (int level = MaxHeight - 1; level >= 0; level--) {
+        curr = ptr(pred->links()[level].load(std::memory_order_acquire));
+        while (curr != nullptr) {
+            uintptr_t next = curr->links()[level].load(std::memory_order_acquire);
+            if (!marked(next) && !(curr->key < key)) {
+                break;
+            } else if (!marked(next)) {
+                pred = curr;
+            }
+            curr = ptr(next);
+        }
+    }
+    return curr;
+}
+
+// See SkipListImpl.h
+SkipListImpl::Node *SkipListImpl::lookup(const std::string &key) const {
+    Node *node = seek(key);
+    return node != nullptr && node->key == key ? node : nullptr;
+}
+
+// See SkipListImpl.h
+SkipListImpl::Node *SkipListImpl::next_live(Node *node) {
+    Node *next = ptr(node->links()[0].load(std::memory_order_acquire));
+    while (next != nullptr && marked(next->links()[0].load(std::memory_order_acquire))) {
+        next = ptr(next->links()[0].load(std::memory_order_acquire));
+    }
+    return next;
+}
+
+// Bottom level link decides whether the key is there, upper levels are only shortcuts and are linked afterwards
+// one by one, giving up as soon as node gets removed
+bool SkipListImpl::link(const std::string &key, std::unique_ptr<Value> &value, bool replace) {
+    Node *preds[MaxHeight], *succs[MaxHeight];
+    Node *node = nullptr;
+    size_t size = key.size() + value->data.size();
+
+    for (;;) {
+        if (find(key, preds, succs)) {
+            if (!replace) {
+                break;
+            }
+
+            // Sizes go up before the swap and down after it, same as for new node below
+            Node *found = succs[0];
+            _size += value->data.size();
+            Value *current = found->value.load();
+            while (current != nullptr && !found->value.compare_exchange_weak(current, value.get())) {
+            }
+            if (current == nullptr) {
+                // Removed meanwhile, next find snips it
+                _size -= value->data.size();
+                continue;
+            }
+
+            value.release();
+            _size -= current->data.size();
+            _epoch.Retire(current, drop_value);
+            touch(found);
+            if (node != nullptr) {
+                destroy(node);
+            }
+            free_space(found);
+            return true;
+        }
+
+        if (node == nullptr) {
+            node = create(key, random_height());
+        }
+        for (unsigned level = 0; level < node->height; level++) {
+            node->links()[level].store(uintptr_t(succs[level]), std::memory_order_relaxed);
+        }
+        node->value.store(value.get(), std::memory_order_relaxed);
+        node->access.store(access_clock(), std::memory_order_relaxed);
+
+        // Counted before the node is visible, so that its removal can't make the size go below zero
+        _size += size;
+        _items++;
+        uintptr_t expected = uintptr_t(succs[0]);
+        if (preds[0]->links()[0].compare_exchange_strong(expected, uintptr_t(node))) {
+            value.release();
+            break;
+        }
+        _size -= size;
+        _items--;
+    }
+
+    if (value) {
+        // Key is already there
+        if (node != nullptr) {
+            destroy(node);
+        }
+        return false;
+    }
+
+    for (unsigned level = 1; level < node->height; level++) {
+        for (;;) {
+            uintptr_t next = node->links()[level].load();
+            if (marked(next)) {
+                break;
+            }
+
+            // Only the remover changes links of a level node is not linked at yet, and it only marks them
+            if (ptr(next) != succs[level] &&
+                !node->links()[level].compare_exchange_strong(next, uintptr_t(succs[level]))) {
+                break;
+            }
+            uintptr_t expected = uintptr_t(succs[level]);
+            if (preds[level]->links()[level].compare_exchange_strong(expected, uintptr_t(node))) {
+                break;
+            }
+            if (!find(key, preds, succs) || succs[0] != node) {
+                break;
+            }
+        }
+        if (marked(node->links()[level].load())) {
+            break;
+        }
+    }
+
+    finish(node, Inserted);
+    free_space(node);
+    return true;
+}
+
+// Value is built outside of any lock and swapped in unless somebody else has changed it first, then it is
+// rebuilt from the newer value
+Storage::CasResult SkipListImpl::modify(const std::string &key,
+                                        const std::function<bool(const Value &, std::string &)> &f) {
+    Epoch::Guard guard(_epoch);
+    SharedLock writers(_freeze);
+    Node *node = lookup(key);
+    if (node == nullptr) {
+        return CasResult::NotFound;
+    }
+
+    std::unique_ptr<Value> fresh(new Value{0, std::string()});
+    Value *current = node->value.load();
+    for (;;) {
+        if (current == nullptr) {
+            return CasResult::NotFound;
+        } else if (!f(*current, fresh->data)) {
+            return CasResult::Exists;
+        } else if (key.size() + fresh->data.size() > _max_size) {
+            return CasResult::NotStored;
+        }
+
+        fresh->version = ++_version;
+        _size += fresh->data.size();
+        if (node->value.compare_exchange_strong(current, fresh.get())) {
+            break;
+        }
+        _size -= fresh->data.size();
+    }
+
+    _size -= current->data.size();
+    fresh.release();
+    _epoch.Retire(current, drop_value);
+    touch(node);
+    free_space(node);
+    return CasResult::Stored;
+}
+
+// Upper levels are marked first, so that node is not found through them once the bottom one says it is gone
+bool SkipListImpl::remove(Node *node) {
+    for (int level = int(node->height) - 1; level >= 1; level--) {
+        uintptr_t next = node->links()[level].load();
+        while (!marked(next) && !node->links()[level].compare_exchange_weak(next, next | Mark)) {
+        }
+    }
+
+    uintptr_t next = node->links()[0].load();
+    for (;;) {
+        if (marked(next)) {
+            return false;
+        } else if (node->links()[0].compare_exchange_weak(next, next | Mark)) {
+            break;
+        }
+    }
+
+    Value *current = node->value.exchange(nullptr);
+    _size -= node->key.size() + current->data.size();
+    _items--;
+    _epoch.Retire(current, drop_value);
+    finish(node, Removed);
+    return true;
+}
+
+// Inserter links upper levels until it is done or sees the node removed, so while it is still at work node could
+// get linked at one more level after the remover has snipped it everywhere. Whoever finishes second snips it once
+// more, when nothing could link it any longer, and only then the node is unreachable and could be retired
+void SkipListImpl::finish(Node *node, uint8_t flag) {
+    Node *preds[MaxHeight], *succs[MaxHeight];
+    uint8_t before = node->state.fetch_or(flag);
+    if (flag == Removed || before != 0) {
+        find(node->key, preds, succs);
+    }
+    if (before != 0) {
+        _epoch.Retire(node, destroy);
+    }
+}
+
+// Stamp is written only when it changes, so hot keys don't bounce cache line of the node on every read
+void SkipListImpl::touch(Node *node) {
+    uint32_t now = access_clock();
+    if (node->access.load(std::memory_order_relaxed) != now) {
+        node->access.store(now, std::memory_order_relaxed);
+    }
+}
+
+// Walk starts by picking one of the nodes of a level that has enough of them, or the head standing for nodes in
+// front of the first one. Starting from the top would let a couple of tall nodes split the list into parts
+// picked equally often however different their sizes are. On each level below the walk picks one of the nodes
+// between where it came down and the next node of the level above, then goes down from it. Every node can be
+// reached, though not with the same chance: parts of the list under long gaps of upper levels are picked less
+// often. Exact uniform pick would need subtree sizes or many rejected walks, both too costly for a path every
+// write could take
+SkipListImpl::Node *SkipListImpl::sample() const {
+    int top = MaxHeight - 1;
+    size_t run = 0;
+    for (;; top--) {
+        run = 0;
+        for (Node *next = ptr(_head->links()[top].load(std::memory_order_acquire));
+             next != nullptr && run < MaxSampleRun; next = ptr(next->links()[top].load(std::memory_order_acquire))) {
+            run++;
+        }
+        if (run >= MinSampleRun || top == 0) {
+            break;
+        }
+    }
+    if (run == 0) {
+        return nullptr;
+    }
+
+    // Head is not a node to return from the bottom level
+    Node *node = _head;
+    size_t first = top == 0 ? 1 : 0;
+    for (size_t steps = first + next_random() % (run + 1 - first); steps > 0; steps--) {
+        Node *next = ptr(node->links()[top].load(std::memory_order_acquire));
+        if (next == nullptr) {
+            break;
+        }
+        node = next;
+    }
+
+    for (int level = top - 1; level >= 0; level--) {
+        // Head is not a node to return, but descending from it on upper levels is a valid pick
+        size_t first = level == 0 && node == _head ? 1 : 0;
+        size_t gap = 1;
+        for (Node *next = ptr(node->links()[level].load(std::memory_order_acquire));
+             next != nullptr && next->height <= unsigned(level) + 1 && gap < MaxSampleGap;
+             next = ptr(next->links()[level].load(std::memory_order_acquire))) {
+            gap++;
+        }
+        if (gap == first) {
+            return nullptr;
+        }
+
+        for (size_t steps = first + next_random() % (gap - first); steps > 0; steps--) {
+            Node *next = ptr(node->links()[level].load(std::memory_order_acquire));
+            if (next == nullptr) {
+                break;
+            }
+            node = next;
+        }
+    }
+    return node == _head ? nullptr : node;
+}
+
+// See SkipListImpl.h
+void SkipListImpl::refill(EvictionPool &pool, const Node *keep) const {
+    auto &candidates = pool.candidates;
+    for (size_t i = 0; i < EvictionSamples; i++) {
+        Node *node = sample();
+        if (node == nullptr || node == keep || marked(node->links()[0].load())) {
+            continue;
+        }
+
+        // Stamps are compared by difference, so that wrap around of the clock doesn't matter
+        typedef std::pair<uint32_t, std::string> Candidate;
+        uint32_t access = node->access.load(std::memory_order_relaxed);
+        auto pos = std::lower_bound(candidates.begin(), candidates.end(), access,
+                                    [](const Candidate &c, uint32_t a) { return int32_t(c.first - a) < 0; });
+        auto same = [node](const Candidate &c) { return c.second == node->key; };
+        if (pos == candidates.end() && candidates.size() == EvictionPoolSize) {
+            continue;
+        } else if (std::find_if(candidates.begin(), candidates.end(), same) != candidates.end()) {
+            continue;
+        }
+
+        candidates.emplace(pos, access, node->key);
+        if (candidates.size() > EvictionPoolSize) {
+            candidates.pop_back();
+        }
+    }
+}
+
+// Several writers could evict at once and overshoot a little, which is fine for an approximate LRU. Candidate
+// whose stamp changed since it got into the pool was accessed meanwhile and is dropped
+void SkipListImpl::free_space(const Node *keep) {
+    if (_size.load() <= _max_size) {
+        return;
+    }
+
+    static std::atomic<size_t> next(0);
+    thread_local size_t self = next.fetch_add(1) % EvictionPools;
+    EvictionPool &pool = _pools[self];
+    std::unique_lock<std::mutex> guard(pool.lock);
+
+    size_t misses = 0;
+    while (_size.load() > _max_size && misses < EvictionMisses) {
+        refill(pool, keep);
+        if (pool.candidates.empty()) {
+            misses++;
+            continue;
+        }
+
+        std::pair<uint32_t, std::string> victim = std::move(pool.candidates.front());
+        pool.candidates.erase(pool.candidates.begin());
+        Node *node = lookup(victim.second);
+        if (node != nullptr && node != keep && node->access.load(std::memory_order_relaxed) == victim.first &&
+            remove(node)) {
+            _evictions++;
+            misses = 0;
+        } else {
+            misses++;
+        }
+    }
+}
+
+} // namespace Backend
+} // namespace Afina
@@ -0,0 +1,230 @@
+#ifndef AFINA_STORAGE_SKIP_LIST_IMPL_H
+#define AFINA_STORAGE_SKIP_LIST_IMPL_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <afina/Storage.h>
+
+#include "Epoch.h"
+#include "SharedMutex.h"
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Lock-free skiplist
+ * Keys are ordered as in MapBasedGlobalLockImpl, so storage supports Range and Scan, but no operation takes a
+ * global lock. Nodes are linked by atomic pointers and changed by CAS only, as in the lock-free list of Harris
+ * and the skiplist of Herlihy and Shavit: removal marks low bits of node links top down, the thread that marks
+ * the bottom link owns the removal, and marked nodes are snipped out by whoever walks past them.
+ *
+ * Value is an immutable object hanging off the node. Every update builds new value and swaps it in by CAS, so
+ * readers copy the value they got without any lock and counters, appends and cas retry on conflict. Removal swaps
+ * the value out for nullptr, which tells writers racing with it that the node is gone.
+ *
+ * Unlinked nodes and replaced values are freed through Epoch once no reader could be looking at them. Node is
+ * retired by whichever of its inserter and remover finishes last and only after it has snipped the node out
+ * of every level, otherwise late link of an upper level could make retired node reachable again.
+ *
+ * There is no LRU list to keep up to date. Node keeps the time of its last access instead, written only if it
+ * changed, and once memory runs out writer samples a few random nodes and evicts the one accessed longest ago,
+ * as Redis does. Random node is found by a walk down from the head that picks random node on each level. Walk
+ * doesn't pick all nodes with the same chance, so as in Redis best candidates are kept in a pool between
+ * evictions, and candidate is evicted only if it was not accessed since it got sampled.
+ *
+ * Freeze must stop every writer, so writers hold SharedMutex in shared mode, which doesn't make them wait for
+ * each other. Readers and Range take no lock at all. Expiration is not supported.
+ */
+class SkipListImpl : public Afina::Storage {
+public:
+    static const unsigned MaxHeight = 16;
+
+    // Nodes writer samples each time it looks for an eviction victim
+    static const size_t EvictionSamples = 5;
+
+    // Best eviction candidates kept between evictions
+    static const size_t EvictionPoolSize = 16;
+
+    // Writers pick eviction pools round robin, so that they don't wait for each other
+    static const size_t EvictionPools = 16;
+
+    SkipListImpl(size_t max_size = 1024);
+    ~SkipListImpl();
+
+    // Implements Afina::Storage interface
+    bool Put(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool PutIfAbsent(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Set(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Append(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Prepend(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Increment(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Decrement(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Delete(const std::string &key) override;
+
+    // Implements Afina::Storage interface
+    bool Get(const std::string &key, std::string &value) const override;
+
+    // Implements Afina::Storage interface
+    size_t GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const override;
+
+    // Implements Afina::Storage interface
+    size_t Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                std::vector<uint64_t> &versions) const override;
+
+    // Implements Afina::Storage interface
+    CasResult Cas(const std::string &key, const std::string &value, uint64_t version, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    size_t Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                const std::vector<time_t> &expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool Range(const std::string &prefix, const std::string &after, size_t limit, std::vector<std::string> &keys,
+               std::vector<ValueRef> *values) const override;
+
+    // Implements Afina::Storage interface
+    bool Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const override;
+
+    // Implements Afina::Storage interface
+    void Freeze(const std::function<void()> &f) override;
+
+    // Implements Afina::Storage interface
+    void ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const override;
+
+    // Implements Afina::Storage interface
+    void GetStats(std::vector<std::pair<std::string, std::string>> &stats) const override;
+
+private:
+    // Low bit of a link marks the node holding it as removed from that level
+    static const uintptr_t Mark = 1;
+
+    // Node state flags, see finish()
+    static const uint8_t Inserted = 1;
+    static const uint8_t Removed = 2;
+
+    struct Value {
+        uint64_t version;
+        std::string data;
+    };
+
+    struct Node {
+        Node(const std::string &key, unsigned height) : key(key), value(nullptr), access(0), state(0), height(height) {}
+
+        // Links of all levels are allocated right after the node
+        std::atomic<uintptr_t> *links() { return reinterpret_cast<std::atomic<uintptr_t> *>(this + 1); }
+
+        const std::string key;
+
+        // Current value, nullptr once node is removed
+        std::atomic<Value *> value;
+
+        // Coarse clock in milliseconds at the last access
+        std::atomic<uint32_t> access;
+
+        // Inserted and Removed flags
+        std::atomic<uint8_t> state;
+
+        const unsigned height;
+    };
+
+    static Node *ptr(uintptr_t link) { return reinterpret_cast<Node *>(link & ~Mark); }
+    static bool marked(uintptr_t link) { return (link & Mark) != 0; }
+
+    // Allocates node with links of the given number of levels, all of them null
+    static Node *create(const std::string &key, unsigned height);
+
+    // Frees node, but not its value. Takes void * to serve as Epoch deleter
+    static void destroy(void *node);
+    static void drop_value(void *value);
+
+    size_t _max_size;
+
+    // Head node of MaxHeight levels, its key is never compared
+    Node *_head;
+
+    mutable Epoch _epoch;
+
+    // Held shared by writers, exclusively by Freeze
+    SharedMutex _freeze;
+
+    std::atomic<uint64_t> _version;
+    std::atomic<size_t> _items;
+    std::atomic<size_t> _size;
+    std::atomic<size_t> _evictions;
+
+    // Sampled nodes that were accessed longest ago, oldest first. Keys and access times are kept rather than
+    // nodes, which could be freed meanwhile
+    struct alignas(64) EvictionPool {
+        std::mutex lock;
+        std::vector<std::pair<uint32_t, std::string>> candidates;
+    };
+    EvictionPool _pools[EvictionPools];
+
+    // Fills preds and succs with nodes around the key on every level, snipping removed nodes met on the way.
+    // Returns true if succs[0] holds the key
+    bool find(const std::string &key, Node **preds, Node **succs) const;
+
+    // Single pass of find, returns false if it has to start over
+    bool search(const std::string &key, Node **preds, Node **succs) const;
+
+    // Returns the first node that is not removed and whose key is not less than the given one, changes nothing
+    Node *seek(const std::string &key) const;
+
+    // Returns node of the key if it is there, changes nothing
+    Node *lookup(const std::string &key) const;
+
+    // Next node at the bottom level that is not removed
+    static Node *next_live(Node *node);
+
+    // Links the value under the key, replacing the current one if replace is set. Value is taken over if stored
+    bool link(const std::string &key, std::unique_ptr<Value> &value, bool replace);
+
+    // Replaces value of the existing key by the one f makes out of the current value. Returns Exists if f refuses
+    // to change it
+    CasResult modify(const std::string &key, const std::function<bool(const Value &, std::string &)> &f);
+
+    // Marks node removed, returns false if somebody else has removed it first
+    bool remove(Node *node);
+
+    // Sets the flag of node insertion or removal being done. The one that comes second snips node out of all
+    // levels and retires it
+    void finish(Node *node, uint8_t flag);
+
+    // Records access to the node
+    static void touch(Node *node);
+
+    // Returns random node, or nullptr if list is empty
+    Node *sample() const;
+
+    // Adds freshly sampled nodes to the pool if they were accessed earlier than its candidates
+    void refill(EvictionPool &pool, const Node *keep) const;
+
+    // Evicts nodes accessed longest ago among sampled until storage fits into memory limit, never evicts keep
+    void free_space(const Node *keep);
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_SKIP_LIST_IMPL_H
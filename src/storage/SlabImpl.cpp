@@ -0,0 +1,411 @@
+#include "SlabImpl.h"
+
+#include <stdexcept>
+
+#include <sys/mman.h>
+
+#include "Counter.h"
+#include "Cursor.h"
+
+namespace Afina {
+namespace Backend {
+
+// Reserves address space without committing memory, pages become resident only once allocator touches them
+static void *map_arena(size_t size) {
+    void *arena = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (arena == MAP_FAILED) {
+        throw std::runtime_error("Failed to mmap slab arena");
+    }
+    return arena;
+}
+
+// See SlabImpl.h
+SlabImpl::SlabImpl(size_t max_size, size_t page_size)
+    : _arena_size(max_size), _arena(map_arena(max_size)), _slab(_arena, max_size, 64, 1.25, page_size), _size(0),
+      _version(0), _reassigned(0) {
+    _classes.resize(_slab.classes(), Class{ItemList(), 0, 0});
+}
+
+// Items live in the arena, so there is nothing to free one by one
+SlabImpl::~SlabImpl() { munmap(_arena, _arena_size); }
+
+// See SlabImpl.h
+bool SlabImpl::Put(const std::string &key, const std::string &value) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    uint64_t hash = Hash(key.data(), key.size());
+    Item *item = find(hash, key);
+    if (item != nullptr) {
+        return update(item, value);
+    }
+    return insert(hash, key, value);
+}
+
+// See SlabImpl.h
+bool SlabImpl::PutIfAbsent(const std::string &key, const std::string &value) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    uint64_t hash = Hash(key.data(), key.size());
+    if (find(hash, key) != nullptr) {
+        return false;
+    }
+    return insert(hash, key, value);
+}
+
+// See SlabImpl.h
+bool SlabImpl::Set(const std::string &key, const std::string &value) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(Hash(key.data(), key.size()), key);
+    if (item == nullptr) {
+        return false;
+    }
+    return update(item, value);
+}
+
+// See SlabImpl.h
+bool SlabImpl::Delete(const std::string &key) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = _index.Find(Hash(key.data(), key.size()), key.data(), key.size());
+    if (item == nullptr) {
+        return false;
+    }
+    remove(item);
+    return true;
+}
+
+// See SlabImpl.h
+bool SlabImpl::Append(const std::string &key, const std::string &data) { return extend(key, data, false); }
+
+// See SlabImpl.h
+bool SlabImpl::Prepend(const std::string &key, const std::string &data) { return extend(key, data, true); }
+
+// See SlabImpl.h
+bool SlabImpl::Increment(const std::string &key, uint64_t delta, uint64_t &result) {
+    return change(key, delta, false, result);
+}
+
+// See SlabImpl.h
+bool SlabImpl::Decrement(const std::string &key, uint64_t delta, uint64_t &result) {
+    return change(key, delta, true, result);
+}
+
+// See SlabImpl.h
+bool SlabImpl::Get(const std::string &key, std::string &value) const {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(Hash(key.data(), key.size()), key);
+    if (item == nullptr) {
+        return false;
+    }
+    value.assign(item->value(), item->value_size);
+    return true;
+}
+
+// See SlabImpl.h
+size_t SlabImpl::GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const {
+    return get_many(keys, values, nullptr);
+}
+
+// See SlabImpl.h
+size_t SlabImpl::Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                      std::vector<uint64_t> &versions) const {
+    versions.assign(keys.size(), 0);
+    return get_many(keys, values, versions.data());
+}
+
+// Expiration is not supported by this storage, so it is ignored as in other TTL overloads
+Storage::CasResult SlabImpl::Cas(const std::string &key, const std::string &value, uint64_t version,
+                                 time_t expire_at) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(Hash(key.data(), key.size()), key);
+    if (item == nullptr) {
+        return CasResult::NotFound;
+    } else if (item->version != version) {
+        return CasResult::Exists;
+    }
+    return update(item, value) ? CasResult::Stored : CasResult::NotStored;
+}
+
+// Chunks could only be allocated under the lock, so just hashes are computed before it is taken
+size_t SlabImpl::Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                      const std::vector<time_t> &expire_at) {
+    std::vector<uint64_t> hashes(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        hashes[i] = Hash(keys[i].data(), keys[i].size());
+    }
+
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t stored = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (_index.Find(hashes[i], keys[i].data(), keys[i].size()) == nullptr &&
+            insert(hashes[i], keys[i], values[i])) {
+            stored++;
+        }
+    }
+    return stored;
+}
+
+// Same as FlatHashImpl::Scan
+bool SlabImpl::Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const {
+    uint64_t position = ParsePosition(cursor);
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t first = keys.size(), groups = 0;
+    do {
+        position = _index.Scan(position, [&keys](Item *item) { keys.emplace_back(item->key(), item->key_size); });
+    } while (position != 0 && keys.size() - first < count && ++groups < count);
+
+    cursor = std::to_string(position);
+    return true;
+}
+
+// See SlabImpl.h
+void SlabImpl::Freeze(const std::function<void()> &f) {
+    std::unique_lock<std::mutex> guard(_lock);
+    f();
+}
+
+// See SlabImpl.h
+void SlabImpl::ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const {
+    _index.ForEach([&f](Item *item) {
+        f(std::string(item->key(), item->key_size), std::string(item->value(), item->value_size), 0);
+    });
+}
+
+// Chunks get reused once lock is released, so values are copied out
+size_t SlabImpl::get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                          uint64_t *versions) const {
+    std::vector<uint64_t> hashes(keys.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        hashes[i] = Hash(keys[i].data(), keys[i].size());
+    }
+    values.clear();
+    values.resize(keys.size());
+
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t found = 0;
+    _index.FindMany(hashes.data(), keys.data(), keys.size(), [this, &values, versions, &found](size_t i, Item *item) {
+        if (item == nullptr) {
+            return;
+        }
+        _classes[class_of(item)].lru.move_to_front(item);
+        values[i] = ValueRef(std::string(item->value(), item->value_size));
+        if (versions != nullptr) {
+            versions[i] = item->version;
+        }
+        found++;
+    });
+    return found;
+}
+
+// Per class metrics use memcached "stats slabs" naming
+void SlabImpl::GetStats(std::vector<std::pair<std::string, std::string>> &stats) const {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    size_t evictions = 0;
+    for (unsigned i = 0; i < _classes.size(); i++) {
+        evictions += _classes[i].evictions;
+    }
+
+    stats.emplace_back("curr_items", std::to_string(_index.Size()));
+    stats.emplace_back("bytes", std::to_string(_size));
+    stats.emplace_back("limit_maxbytes", std::to_string(_arena_size));
+    stats.emplace_back("evictions", std::to_string(evictions));
+    stats.emplace_back("free_pages", std::to_string(_slab.free_pages()));
+    stats.emplace_back("slabs_moved", std::to_string(_reassigned));
+
+    for (unsigned i = 0; i < _classes.size(); i++) {
+        Allocator::Slab::ClassStats s = _slab.stats(i);
+        if (s.pages == 0) {
+            continue;
+        }
+
+        std::string prefix = std::to_string(i) + ":";
+        stats.emplace_back(prefix + "chunk_size", std::to_string(s.chunk_size));
+        stats.emplace_back(prefix + "total_pages", std::to_string(s.pages));
+        stats.emplace_back(prefix + "used_chunks", std::to_string(s.used_chunks));
+        stats.emplace_back(prefix + "free_chunks", std::to_string(s.free_chunks));
+        stats.emplace_back(prefix + "evictions", std::to_string(_classes[i].evictions));
+    }
+}
+
+// See SlabImpl.h
+Item *SlabImpl::find(uint64_t hash, const std::string &key) const {
+    Item *item = _index.Find(hash, key.data(), key.size());
+    if (item != nullptr) {
+        _classes[class_of(item)].lru.move_to_front(item);
+    }
+    return item;
+}
+
+// Value fits into chunk slack, so could be overwritten in place. Otherwise item moves to the chunk of
+// another class. Old item is unlinked from its LRU while new chunk is allocated, so it couldn't be evicted to
+// make room for itself and stays intact if allocation fails
+bool SlabImpl::update(Item *item, const std::string &value) {
+    if (value.size() <= item->capacity) {
+        _size -= item->value_size;
+        item->Assign(value.data(), value.size());
+        item->version = ++_version;
+        _size += item->value_size;
+        return true;
+    }
+
+    unsigned cls = class_of(item);
+    _classes[cls].lru.erase(item);
+
+    Item *fresh = allocate(item->hash, item->key(), item->key_size, value);
+    if (fresh == nullptr) {
+        _classes[cls].lru.push_front(item);
+        return false;
+    }
+
+    fresh->version = ++_version;
+    _index.Replace(item->hash, item->key(), item->key_size, fresh);
+    _classes[cls].items--;
+    _size -= item->Size();
+    item->flags &= ~Item::Allocated;
+    _slab.free(cls, item);
+    return true;
+}
+
+// Data goes right into chunk slack when there is enough, otherwise value moves to a chunk of larger class
+bool SlabImpl::extend(const std::string &key, const std::string &data, bool front) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(Hash(key.data(), key.size()), key);
+    if (item == nullptr) {
+        return false;
+    }
+
+    if (item->value_size + data.size() <= item->capacity) {
+        item->Extend(data.data(), data.size(), front);
+        item->version = ++_version;
+        _size += data.size();
+        return true;
+    }
+
+    std::string value(item->value(), item->value_size);
+    if (front) {
+        value.insert(0, data);
+    } else {
+        value.append(data);
+    }
+    return update(item, value);
+}
+
+// Items live in shared arena chunks, so value is kept as text and rewritten in place when it fits
+bool SlabImpl::change(const std::string &key, uint64_t delta, bool decrement, uint64_t &result) {
+    std::unique_lock<std::mutex> guard(_lock);
+
+    Item *item = find(Hash(key.data(), key.size()), key);
+    if (item == nullptr) {
+        return false;
+    }
+
+    result = ApplyDelta(ParseCounter(item->value(), item->value_size), delta, decrement);
+    return update(item, std::to_string(result));
+}
+
+// See SlabImpl.h
+bool SlabImpl::insert(uint64_t hash, const std::string &key, const std::string &value) {
+    Item *item = allocate(hash, key.data(), key.size(), value);
+    if (item == nullptr) {
+        return false;
+    }
+    item->version = ++_version;
+    _index.Insert(hash, item);
+    return true;
+}
+
+// See SlabImpl.h
+Item *SlabImpl::allocate(uint64_t hash, const char *key, size_t key_size, const std::string &value) {
+    size_t need = Item::AllocSize(key_size, value.size());
+    if (need > _slab.chunk_size(_slab.classes() - 1)) {
+        return nullptr;
+    }
+
+    unsigned cls = _slab.class_for(need);
+    Class &c = _classes[cls];
+
+    void *mem;
+    while ((mem = _slab.alloc(cls)) == nullptr) {
+        Item *victim = c.lru.back();
+        if (victim == nullptr) {
+            // Class has no pages and there are no free pages left
+            if (!reassign(cls)) {
+                return nullptr;
+            }
+            continue;
+        }
+        remove(victim);
+        c.evictions++;
+    }
+
+    // Whole chunk is given to the item, slack after value could be used by later updates
+    size_t capacity = _slab.chunk_size(cls) - sizeof(Item) - key_size;
+    Item *item = Item::Init(mem, hash, key, key_size, value.data(), value.size(), capacity);
+    item->flags |= Item::Allocated;
+    c.lru.push_front(item);
+    c.items++;
+    _size += item->Size();
+    return item;
+}
+
+// Donor is the class whose least recently used item was written the earliest, and the page is the one that item
+// lives on. Page is walked chunk by chunk, so the cost doesn't depend on the number of items of the donor. Item
+// being updated is out of its LRU list, page holding it can't be emptied and is left alone
+bool SlabImpl::reassign(unsigned cls) {
+    Item *oldest = nullptr;
+    unsigned donor = 0;
+    for (unsigned i = 0; i < _classes.size(); i++) {
+        Item *tail = _classes[i].lru.back();
+        if (i != cls && tail != nullptr && (oldest == nullptr || tail->version < oldest->version)) {
+            oldest = tail;
+            donor = i;
+        }
+    }
+    if (oldest == nullptr) {
+        return false;
+    }
+
+    size_t page = _slab.page_of(oldest);
+    char *begin = static_cast<char *>(_slab.page_begin(page));
+    size_t chunk_size = _slab.chunk_size(donor);
+    size_t chunks = _slab.page_chunks(page);
+    for (size_t i = 0; i < chunks; i++) {
+        Item *item = reinterpret_cast<Item *>(begin + i * chunk_size);
+        if ((item->flags & Item::Allocated) && !_classes[donor].lru.contains(item)) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < chunks; i++) {
+        Item *item = reinterpret_cast<Item *>(begin + i * chunk_size);
+        if (item->flags & Item::Allocated) {
+            remove(item);
+            _classes[donor].evictions++;
+        }
+    }
+    _slab.release(page);
+    _reassigned++;
+    return true;
+}
+
+// See SlabImpl.h
+void SlabImpl::remove(Item *item) {
+    unsigned cls = class_of(item);
+    _index.Erase(item->hash, item->key(), item->key_size);
+    _classes[cls].lru.erase(item);
+    _classes[cls].items--;
+    _size -= item->Size();
+    item->flags &= ~Item::Allocated;
+    _slab.free(cls, item);
+}
+
+} // namespace Backend
+} // namespace Afina
@@ -0,0 +1,155 @@
+#ifndef AFINA_STORAGE_SLAB_IMPL_H
+#define AFINA_STORAGE_SLAB_IMPL_H
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <afina/Storage.h>
+#include <afina/allocator/Slab.h>
+
+#include "FlatIndex.h"
+#include "Hash.h"
+#include "Item.h"
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Slab allocated implementation with per class LRU
+ * Items are placed into chunks of Allocator::Slab working over a single preallocated memory area of
+ * max_size bytes, so memory limit is enforced by the allocator itself rather than by counting key and value
+ * sizes. Each slab class has its own LRU list: once class runs out of chunks, the least recently used item of
+ * the same class gets evicted, which frees exactly the chunk needed.
+ *
+ * Class that has nothing to evict, because all pages went to other classes before it got any, takes a page
+ * from another class the way memcached slab rebalancer does: all items of the page holding the oldest tail among
+ * other classes are evicted and the page is reassigned.
+ *
+ * Memory of the area is reserved, but not touched on start, so process RSS grows up to max_size as pages get
+ * assigned to classes and then stays there. Only the hash index lives outside of the area.
+ */
+class SlabImpl : public Afina::Storage {
+public:
+    SlabImpl(size_t max_size = 64 * 1024 * 1024, size_t page_size = 1024 * 1024);
+    ~SlabImpl();
+
+    // Implements Afina::Storage interface
+    bool Put(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool PutIfAbsent(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Set(const std::string &key, const std::string &value) override;
+
+    // Implements Afina::Storage interface
+    bool Append(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Prepend(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Increment(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Decrement(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Delete(const std::string &key) override;
+
+    // Implements Afina::Storage interface
+    bool Get(const std::string &key, std::string &value) const override;
+
+    // Implements Afina::Storage interface
+    size_t GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const override;
+
+    // Implements Afina::Storage interface
+    size_t Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                std::vector<uint64_t> &versions) const override;
+
+    // Implements Afina::Storage interface
+    CasResult Cas(const std::string &key, const std::string &value, uint64_t version, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    size_t Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                const std::vector<time_t> &expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const override;
+
+    // Implements Afina::Storage interface
+    void Freeze(const std::function<void()> &f) override;
+
+    // Implements Afina::Storage interface
+    void ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const override;
+
+    // Implements Afina::Storage interface
+    void GetStats(std::vector<std::pair<std::string, std::string>> &stats) const override;
+
+private:
+    // LRU list and counters of a single slab class
+    struct Class {
+        ItemList lru;
+        size_t items;
+        size_t evictions;
+    };
+
+    mutable std::mutex _lock;
+
+    // Memory area all items are allocated from
+    size_t _arena_size;
+    void *_arena;
+
+    Allocator::Slab _slab;
+    FlatIndex<Item, ItemTraits> _index;
+    mutable std::vector<Class> _classes;
+
+    // Bytes of keys and values stored
+    size_t _size;
+
+    // Last version assigned to an item
+    uint64_t _version;
+
+    // Pages taken from one class and given to another
+    size_t _reassigned;
+
+    // Returns item for the given key and moves it to the beginning of its class LRU list
+    Item *find(uint64_t hash, const std::string &key) const;
+
+    // Looks up batch of keys, versions are filled in if given
+    size_t get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values, uint64_t *versions) const;
+
+    // Replaces value of the existing item
+    bool update(Item *item, const std::string &value);
+
+    // Adds data to the value of existing key, to the beginning if front is set
+    bool extend(const std::string &key, const std::string &data, bool front);
+
+    // Applies incr/decr to the value of existing key
+    bool change(const std::string &key, uint64_t delta, bool decrement, uint64_t &result);
+
+    // Adds new item for the given key, key must be absent
+    bool insert(uint64_t hash, const std::string &key, const std::string &value);
+
+    // Allocates and links new item into its class LRU, evicting items of the same class if needed. Returns
+    // nullptr if item is larger than a page or no memory could be freed for it
+    Item *allocate(uint64_t hash, const char *key, size_t key_size, const std::string &value);
+
+    // Evicts all items of a page of some class other than cls and releases the page. Returns false if there is
+    // no such page
+    bool reassign(unsigned cls);
+
+    // Unlinks item from everywhere and returns its chunk to the allocator
+    void remove(Item *item);
+
+    // Slab class item was allocated from
+    unsigned class_of(const Item *item) const {
+        return _slab.class_for(Item::AllocSize(item->key_size, item->capacity));
+    }
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_SLAB_IMPL_H
@@ -0,0 +1,362 @@
+#include "Snapshot.h"
+
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Crc32c.h"
+
+namespace Afina {
+namespace Backend {
+
+const char SnapshotFormat::Magic[8] = {'A', 'F', 'N', 'S', 'N', 'A', 'P', '\0'};
+
+// Integers are stored the way little endian host keeps them in memory
+template <typename T> static void put(char *out, T value) { std::memcpy(out, &value, sizeof(value)); }
+
+template <typename T> static T get(const char *in) {
+    T value;
+    std::memcpy(&value, in, sizeof(value));
+    return value;
+}
+
+// See SnapshotFormat
+static void put_varint(std::string &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(char(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(char(value));
+}
+
+// See SnapshotFormat
+static uint64_t get_varint(const char *in, size_t size, size_t &pos) {
+    uint64_t value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        if (pos >= size) {
+            throw std::runtime_error("Snapshot item is truncated");
+        }
+        uint8_t byte = uint8_t(in[pos++]);
+        value |= uint64_t(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Snapshot item is corrupted");
+}
+
+// See Snapshot.h
+uint64_t SnapshotFormat::ParseHeader(const char *header) {
+    if (std::memcmp(header, Magic, sizeof(Magic)) != 0) {
+        throw std::runtime_error("Not a snapshot file");
+    }
+    if (get<uint32_t>(header + 8) != Version) {
+        throw std::runtime_error("Unsupported snapshot format version " + std::to_string(get<uint32_t>(header + 8)));
+    }
+    return get<uint64_t>(header + 12);
+}
+
+// See Snapshot.h
+SnapshotFormat::BlockHeader SnapshotFormat::ParseBlockHeader(const char *header) {
+    BlockHeader block{get<uint32_t>(header), get<uint32_t>(header + 4), get<uint32_t>(header + 8)};
+    if (!block.end() && (block.size > MaxBlockSize || block.items == 0)) {
+        throw std::runtime_error("Snapshot block header is corrupted");
+    }
+    return block;
+}
+
+// Every size is checked against the block bounds before it is used
+void SnapshotFormat::ParseBlock(const BlockHeader &header, const char *payload, std::vector<std::string> &keys,
+                                std::vector<std::string> &values, std::vector<time_t> &expire_at) {
+    if (Crc32c(payload, header.size) != header.crc) {
+        throw std::runtime_error("Snapshot block checksum mismatch");
+    }
+
+    size_t pos = 0, size = header.size;
+    for (uint32_t i = 0; i < header.items; i++) {
+        uint64_t key_size = get_varint(payload, size, pos);
+        uint64_t value_size = get_varint(payload, size, pos);
+        uint64_t expire = get_varint(payload, size, pos);
+        if (key_size > size - pos || value_size > size - pos - key_size || expire > UINT32_MAX) {
+            throw std::runtime_error("Snapshot item is corrupted");
+        }
+
+        keys.emplace_back(payload + pos, key_size);
+        values.emplace_back(payload + pos + key_size, value_size);
+        expire_at.push_back(time_t(expire));
+        pos += key_size + value_size;
+    }
+    if (pos != size) {
+        throw std::runtime_error("Snapshot block has less items than declared");
+    }
+}
+
+// See Snapshot.h
+SnapshotWriter::SnapshotWriter(int fd) : _fd(fd), _block_items(0), _items(0), _checksum(0) {
+    char header[SnapshotFormat::HeaderSize];
+    std::memcpy(header, SnapshotFormat::Magic, sizeof(SnapshotFormat::Magic));
+    put<uint32_t>(header + 8, SnapshotFormat::Version);
+    put<uint64_t>(header + 12, uint64_t(time(nullptr)));
+    write(header, sizeof(header));
+
+    _block.reserve(SnapshotFormat::BlockSize + SnapshotFormat::BlockSize / 2);
+}
+
+// Block gets a bit over BlockSize, item is never split between blocks
+void SnapshotWriter::Add(const std::string &key, const std::string &value, uint32_t expire_at) {
+    put_varint(_block, key.size());
+    put_varint(_block, value.size());
+    put_varint(_block, expire_at);
+    _block.append(key);
+    _block.append(value);
+    _block_items++;
+    _items++;
+
+    if (_block.size() >= SnapshotFormat::BlockSize) {
+        flush();
+    }
+}
+
+// See Snapshot.h
+void SnapshotWriter::Finish() {
+    flush();
+
+    char end[SnapshotFormat::BlockHeaderSize];
+    put<uint32_t>(end, 0);
+    put<uint32_t>(end + 4, 0);
+    put<uint32_t>(end + 8, _checksum);
+    write(end, sizeof(end));
+}
+
+// See Snapshot.h
+void SnapshotWriter::flush() {
+    if (_block_items == 0) {
+        return;
+    }
+
+    char header[SnapshotFormat::BlockHeaderSize];
+    uint32_t crc = Crc32c(_block.data(), _block.size());
+    put<uint32_t>(header, uint32_t(_block.size()));
+    put<uint32_t>(header + 4, _block_items);
+    put<uint32_t>(header + 8, crc);
+    write(header, sizeof(header));
+    write(_block.data(), _block.size());
+
+    _checksum = Crc32c(header + 8, sizeof(crc), _checksum);
+    _block.clear();
+    _block_items = 0;
+}
+
+// See Snapshot.h
+void SnapshotWriter::write(const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(_fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            throw std::runtime_error(std::string("Failed to write snapshot: ") + strerror(errno));
+        }
+        data += n;
+        size -= n;
+    }
+}
+
+// See Snapshot.h
+SnapshotReader::SnapshotReader(const std::string &path) : _pos(0), _checksum(0), _finished(false) {
+    _fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_fd < 0) {
+        throw std::runtime_error("Failed to open snapshot " + path + ": " + strerror(errno));
+    }
+
+    try {
+        char header[SnapshotFormat::HeaderSize];
+        read(header, sizeof(header));
+        _created_at = SnapshotFormat::ParseHeader(header);
+    } catch (...) {
+        close(_fd);
+        throw;
+    }
+}
+
+// See Snapshot.h
+SnapshotReader::~SnapshotReader() { close(_fd); }
+
+// See Snapshot.h
+bool SnapshotReader::Next(std::string &key, std::string &value, uint32_t &expire_at) {
+    if (_pos == _keys.size() && !next_block()) {
+        return false;
+    }
+
+    key.swap(_keys[_pos]);
+    value.swap(_values[_pos]);
+    expire_at = uint32_t(_expire_at[_pos]);
+    _pos++;
+    return true;
+}
+
+// See Snapshot.h
+bool SnapshotReader::next_block() {
+    if (_finished) {
+        return false;
+    }
+
+    char buffer[SnapshotFormat::BlockHeaderSize];
+    read(buffer, sizeof(buffer));
+    SnapshotFormat::BlockHeader header = SnapshotFormat::ParseBlockHeader(buffer);
+    if (header.end()) {
+        if (header.crc != _checksum) {
+            throw std::runtime_error("Snapshot blocks are lost or out of order");
+        }
+        _finished = true;
+        return false;
+    }
+
+    _block.resize(header.size);
+    read(&_block[0], header.size);
+    _keys.clear();
+    _values.clear();
+    _expire_at.clear();
+    SnapshotFormat::ParseBlock(header, _block.data(), _keys, _values, _expire_at);
+    _checksum = Crc32c(&header.crc, sizeof(header.crc), _checksum);
+    _pos = 0;
+    return true;
+}
+
+// See Snapshot.h
+void SnapshotReader::read(char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::read(_fd, data, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            throw std::runtime_error(std::string("Failed to read snapshot: ") + strerror(errno));
+        } else if (n == 0) {
+            throw std::runtime_error("Snapshot is truncated");
+        }
+        data += n;
+        size -= n;
+    }
+}
+
+// See Snapshot.h
+Snapshot::Snapshot(Afina::Storage &storage, const std::string &path)
+    : _storage(storage), _path(path), _pid(0), _completed(0), _succeeded(false), _stall(0), _duration(0) {}
+
+// See Snapshot.h
+Snapshot::~Snapshot() { Wait(); }
+
+// Stall counts from the moment freeze is requested, as storage with several locks gets fully frozen only once
+// it has taken the last one, while the first ones are held already
+bool Snapshot::Start() {
+    if (_pid > 0) {
+        return false;
+    }
+
+    pid_t pid = -1;
+    int error = 0;
+    auto started = std::chrono::steady_clock::now();
+    _storage.Freeze([this, &pid, &error]() {
+        pid = fork();
+        if (pid == 0) {
+            write_image();
+        }
+        error = errno;
+    });
+    _stall = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+
+    if (pid < 0) {
+        throw std::runtime_error(std::string("Failed to start snapshot process: ") + strerror(error));
+    }
+    _pid = pid;
+    _started = started;
+    return true;
+}
+
+// See Snapshot.h
+bool Snapshot::Poll() {
+    if (_pid <= 0) {
+        return false;
+    }
+
+    int status = 0;
+    pid_t pid = waitpid(_pid, &status, WNOHANG);
+    if (pid == 0 || (pid < 0 && errno == EINTR)) {
+        return false;
+    }
+    finished(pid == _pid ? status : -1);
+    return true;
+}
+
+// See Snapshot.h
+void Snapshot::Wait() {
+    if (_pid <= 0) {
+        return;
+    }
+
+    int status = 0;
+    pid_t pid;
+    while ((pid = waitpid(_pid, &status, 0)) < 0 && errno == EINTR) {
+    }
+    finished(pid == _pid ? status : -1);
+}
+
+// See Snapshot.h
+void Snapshot::GetStats(std::vector<std::pair<std::string, std::string>> &stats) const {
+    stats.emplace_back("snapshot_in_progress", Running() ? "1" : "0");
+    stats.emplace_back("snapshots_completed", std::to_string(_completed));
+    stats.emplace_back("snapshot_last_status", _completed == 0 ? "none" : (_succeeded ? "ok" : "failed"));
+    stats.emplace_back("snapshot_last_stall_us", std::to_string(_stall.count()));
+    stats.emplace_back("snapshot_last_duration_ms", std::to_string(_duration.count()));
+}
+
+// Child has only the thread that has forked, and inherits locks held by others in whatever state they were,
+// so it never takes a lock and never writes to std::cout. Descriptors of the parent, client connections most of
+// all, are closed first, so that connections closed by the parent don't stay open while child is running
+void Snapshot::write_image() {
+#ifdef SYS_close_range
+    if (syscall(SYS_close_range, 3, ~0U, 0) != 0)
+#endif
+    {
+        for (long fd = 3, max = sysconf(_SC_OPEN_MAX); fd < max; fd++) {
+            close(int(fd));
+        }
+    }
+
+    std::string tmp = _path + ".tmp";
+    int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        _exit(1);
+    }
+
+    try {
+        SnapshotWriter writer(fd);
+        _storage.ForEach([&writer](const std::string &key, const std::string &value, time_t expire_at) {
+            writer.Add(key, value, uint32_t(expire_at));
+        });
+        writer.Finish();
+    } catch (...) {
+        _exit(1);
+    }
+
+    if (fsync(fd) != 0 || close(fd) != 0 || rename(tmp.c_str(), _path.c_str()) != 0) {
+        _exit(1);
+    }
+    _exit(0);
+}
+
+// See Snapshot.h
+void Snapshot::finished(int status) {
+    _succeeded = status >= 0 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    _duration = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - _started);
+    _completed++;
+    _pid = 0;
+}
+
+} // namespace Backend
+} // namespace Afina
@@ -0,0 +1,220 @@
+#ifndef AFINA_STORAGE_SNAPSHOT_H
+#define AFINA_STORAGE_SNAPSHOT_H
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+#include <vector>
+
+#include <afina/Storage.h>
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Snapshot file format
+ * All integers are little endian:
+ *
+ * | magic "AFNSNAP\0" | format version: u32 | created at, unix time: u64 |
+ * | block | block | ... | end |
+ *
+ * block: | payload size: u32 | items: u32 | crc32c of payload: u32 | item | item | ... |
+ * item:  | key size: varint | value size: varint | expire at: varint | key | value |
+ * end:   | 0: u32 | 0: u32 | crc32c of all block checksums: u32 |
+ *
+ * Varints are LEB128, so small keys and values cost a byte or two of framing. Blocks are up to BlockSize
+ * bytes of payload and checked one by one, checksum in the end catches lost or reordered blocks.
+ */
+struct SnapshotFormat {
+    static const char Magic[8];
+    static const uint32_t Version = 1;
+    static const size_t HeaderSize = 20;
+    static const size_t BlockHeaderSize = 12;
+    static const size_t BlockSize = 64 * 1024;
+
+    // Size in the block header isn't covered by checksum, larger one means header is corrupted
+    static const uint32_t MaxBlockSize = 1u << 30;
+
+    struct BlockHeader {
+        uint32_t size;
+        uint32_t items;
+        uint32_t crc;
+
+        // Whether it is the end of the file rather than a block
+        bool end() const { return size == 0 && items == 0; }
+    };
+
+    /**
+     * Checks file header, returns unix time snapshot has been taken at. Throws std::runtime_error if it is not a
+     * snapshot or has unknown format version
+     */
+    static uint64_t ParseHeader(const char *header);
+
+    /**
+     * Decodes block header, throws std::runtime_error if it is obviously corrupted
+     */
+    static BlockHeader ParseBlockHeader(const char *header);
+
+    /**
+     * Verifies block payload against its header and appends its items to the given vectors. Throws
+     * std::runtime_error if payload is corrupted
+     */
+    static void ParseBlock(const BlockHeader &header, const char *payload, std::vector<std::string> &keys,
+                           std::vector<std::string> &values, std::vector<time_t> &expire_at);
+};
+
+/**
+ * # Writes snapshot file
+ * Items are buffered into block and written out once block is full. Throws std::runtime_error on IO errors
+ */
+class SnapshotWriter {
+public:
+    /**
+     * Writes file header
+     * @param fd file descriptor open for writing, not closed by writer
+     */
+    SnapshotWriter(int fd);
+
+    void Add(const std::string &key, const std::string &value, uint32_t expire_at);
+
+    /**
+     * Writes the last block and end of the file
+     */
+    void Finish();
+
+    // Number of items written
+    uint64_t Items() const { return _items; }
+
+private:
+    int _fd;
+    std::string _block;
+    uint32_t _block_items;
+    uint64_t _items;
+
+    // Checksum of the checksums of the blocks written so far
+    uint32_t _checksum;
+
+    void flush();
+    void write(const char *data, size_t size);
+};
+
+/**
+ * # Reads snapshot file sequentially
+ * Every block is verified before items are taken out of it. Throws std::runtime_error if file can't be read,
+ * is truncated, corrupted or has unknown format version
+ */
+class SnapshotReader {
+public:
+    SnapshotReader(const std::string &path);
+    ~SnapshotReader();
+
+    /**
+     * Reads next item, returns false once the whole file has been read and verified
+     */
+    bool Next(std::string &key, std::string &value, uint32_t &expire_at);
+
+    // Unix time snapshot has been taken at
+    uint64_t CreatedAt() const { return _created_at; }
+
+private:
+    int _fd;
+    uint64_t _created_at;
+
+    // Items of the current block and the next one to return
+    std::vector<std::string> _keys;
+    std::vector<std::string> _values;
+    std::vector<time_t> _expire_at;
+    size_t _pos;
+
+    std::string _block;
+    uint32_t _checksum;
+    bool _finished;
+
+    // Reads next block, returns false at the end of the file
+    bool next_block();
+    void read(char *data, size_t size);
+};
+
+/**
+ * # Point in time snapshot of the storage taken in background
+ * Storage is frozen only for the fork() call. Child process gets copy-on-write view of the whole memory as it
+ * was at that moment and writes it out with SnapshotWriter, while parent keeps serving. So writers are stalled
+ * for as long as fork() takes, which is copying page tables of the process: it grows with resident memory,
+ * about 10ms per GB with 4KB pages. Pages modified while child is writing get copied by kernel, so memory
+ * could grow by the amount of data changed meanwhile.
+ *
+ * Image goes to a temporary file, which is synced and renamed over the given path only once complete, so path
+ * always has the last complete snapshot. Not thread safe.
+ */
+class Snapshot {
+public:
+    /**
+     * @param storage to take snapshots of
+     * @param path of the snapshot file
+     */
+    Snapshot(Afina::Storage &storage, const std::string &path);
+
+    // Waits for the snapshot in progress
+    ~Snapshot();
+
+    /**
+     * Starts background snapshot. Returns false if one is in progress already, throws std::runtime_error
+     * if child process could not be started
+     */
+    bool Start();
+
+    /**
+     * Collects snapshot process if it has finished, never blocks. Returns true if snapshot has just completed,
+     * see Succeeded
+     */
+    bool Poll();
+
+    /**
+     * Blocks until snapshot in progress, if any, finishes
+     */
+    void Wait();
+
+    // Whether snapshot is in progress
+    bool Running() const { return _pid > 0; }
+
+    // Whether the last snapshot completed has been written successfully
+    bool Succeeded() const { return _succeeded; }
+
+    // How long storage was frozen for the last snapshot started
+    std::chrono::microseconds Stall() const { return _stall; }
+
+    // How long the last snapshot completed took, as observed by Poll and Wait
+    std::chrono::milliseconds Duration() const { return _duration; }
+
+    /**
+     * Appends snapshot metrics, same way as Storage::GetStats does
+     */
+    void GetStats(std::vector<std::pair<std::string, std::string>> &stats) const;
+
+private:
+    Afina::Storage &_storage;
+    std::string _path;
+
+    // Child process writing snapshot, 0 if there is none
+    pid_t _pid;
+    std::chrono::steady_clock::time_point _started;
+
+    size_t _completed;
+    bool _succeeded;
+    std::chrono::microseconds _stall;
+    std::chrono::milliseconds _duration;
+
+    // Runs in child process, never returns
+    void write_image();
+
+    // Records exit status of the child
+    void finished(int status);
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_SNAPSHOT_H
@@ -0,0 +1,152 @@
+#include "SnapshotLoader.h"
+
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "Crc32c.h"
+
+namespace Afina {
+namespace Backend {
+
+// See SnapshotLoader.h
+SnapshotLoader::SnapshotLoader(Afina::Storage &storage, const std::string &path, size_t threads)
+    : _storage(storage), _path(path), _workers(threads > 0 ? threads : 1), _fd(-1), _running(0), _items(0),
+      _stored(0), _bytes(0), _elapsed_ms(0), _offset(0), _checksum(0), _finished(false) {}
+
+// See SnapshotLoader.h
+SnapshotLoader::~SnapshotLoader() {
+    for (auto &w : _workers) {
+        if (w.joinable()) {
+            w.join();
+        }
+    }
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+// See SnapshotLoader.h
+void SnapshotLoader::Start() {
+    _fd = open(_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_fd < 0) {
+        throw std::runtime_error("Failed to open snapshot " + _path + ": " + strerror(errno));
+    }
+
+    char header[SnapshotFormat::HeaderSize];
+    pread_all(header, sizeof(header), 0);
+    SnapshotFormat::ParseHeader(header);
+
+    _offset = SnapshotFormat::HeaderSize;
+    _started = std::chrono::steady_clock::now();
+    _running.store(_workers.size());
+    for (auto &w : _workers) {
+        w = std::thread(&SnapshotLoader::worker, this);
+    }
+}
+
+// See SnapshotLoader.h
+void SnapshotLoader::Wait() {
+    for (auto &w : _workers) {
+        if (w.joinable()) {
+            w.join();
+        }
+    }
+
+    std::unique_lock<std::mutex> guard(_lock);
+    if (!_error.empty()) {
+        throw std::runtime_error(_error);
+    }
+}
+
+// See SnapshotLoader.h
+std::chrono::milliseconds SnapshotLoader::Elapsed() const {
+    if (Done()) {
+        return std::chrono::milliseconds(_elapsed_ms.load());
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - _started);
+}
+
+// Buffers are reused from block to block, so worker allocates only for the items themselves
+void SnapshotLoader::worker() {
+    std::string block;
+    std::vector<std::string> keys, values;
+    std::vector<time_t> expire_at;
+
+    try {
+        uint64_t offset;
+        SnapshotFormat::BlockHeader header;
+        while (next(offset, header)) {
+            block.resize(header.size);
+            pread_all(&block[0], header.size, offset);
+
+            keys.clear();
+            values.clear();
+            expire_at.clear();
+            SnapshotFormat::ParseBlock(header, block.data(), keys, values, expire_at);
+
+            _stored += _storage.Load(keys, values, expire_at);
+            _items += keys.size();
+            _bytes += SnapshotFormat::BlockHeaderSize + header.size;
+        }
+    } catch (std::exception &e) {
+        std::unique_lock<std::mutex> guard(_lock);
+        if (_error.empty()) {
+            _error = e.what();
+        }
+        _finished = true;
+    }
+
+    if (--_running == 0) {
+        _elapsed_ms.store(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+                                                                                 _started)
+                              .count());
+    }
+}
+
+// Checksums of the blocks are chained in the order blocks are taken, which is the file order
+bool SnapshotLoader::next(uint64_t &offset, SnapshotFormat::BlockHeader &header) {
+    std::unique_lock<std::mutex> guard(_lock);
+    if (_finished) {
+        return false;
+    }
+
+    char buffer[SnapshotFormat::BlockHeaderSize];
+    pread_all(buffer, sizeof(buffer), _offset);
+    header = SnapshotFormat::ParseBlockHeader(buffer);
+    if (header.end()) {
+        _finished = true;
+        if (header.crc != _checksum) {
+            throw std::runtime_error("Snapshot blocks are lost or out of order");
+        }
+        return false;
+    }
+
+    offset = _offset + SnapshotFormat::BlockHeaderSize;
+    _offset = offset + header.size;
+    _checksum = Crc32c(&header.crc, sizeof(header.crc), _checksum);
+    return true;
+}
+
+// See SnapshotLoader.h
+void SnapshotLoader::pread_all(char *data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        ssize_t n = pread(_fd, data, size, off_t(offset));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            throw std::runtime_error(std::string("Failed to read snapshot: ") + strerror(errno));
+        } else if (n == 0) {
+            throw std::runtime_error("Snapshot is truncated");
+        }
+        data += n;
+        size -= n;
+        offset += n;
+    }
+}
+
+} // namespace Backend
+} // namespace Afina
@@ -0,0 +1,107 @@
+#ifndef AFINA_STORAGE_SNAPSHOT_LOADER_H
+#define AFINA_STORAGE_SNAPSHOT_LOADER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <afina/Storage.h>
+
+#include "Snapshot.h"
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Parallel loader of snapshot files
+ * Workers share a cursor over the file: each one takes the next block header under the lock, moves cursor past
+ * the block and then reads, verifies and parses the block on its own with pread. Items of the block go to the
+ * storage by a single Storage::Load call, so the storage lock is taken once per block instead of once per item
+ * and loaded items are not counted as accessed. Blocks are taken in the file order, so load streams through the
+ * file and items become visible while it goes.
+ *
+ * Keys present in the storage already are not overwritten, so loader could run while server is serving clients.
+ */
+class SnapshotLoader {
+public:
+    /**
+     * @param storage to load items into
+     * @param path of the snapshot file
+     * @param threads number of workers
+     */
+    SnapshotLoader(Afina::Storage &storage, const std::string &path, size_t threads);
+
+    // Waits for the workers
+    ~SnapshotLoader();
+
+    /**
+     * Opens the file, checks its header and starts workers. Throws std::runtime_error if file could not be opened
+     * or is not a snapshot
+     */
+    void Start();
+
+    /**
+     * Whether all workers have finished
+     */
+    bool Done() const { return _running.load() == 0; }
+
+    /**
+     * Waits for the workers. Throws std::runtime_error if file is corrupted, items read before the damaged place
+     * stay loaded
+     */
+    void Wait();
+
+    // Items read from the file so far
+    uint64_t Items() const { return _items.load(); }
+
+    // Items stored, keys present already and items that didn't fit are not counted
+    uint64_t Stored() const { return _stored.load(); }
+
+    // Bytes of the file read so far
+    uint64_t Bytes() const { return _bytes.load(); }
+
+    // Time from the start till all workers finished, or till now if they haven't yet
+    std::chrono::milliseconds Elapsed() const;
+
+private:
+    Afina::Storage &_storage;
+    std::string _path;
+    std::vector<std::thread> _workers;
+    int _fd;
+
+    std::atomic<size_t> _running;
+    std::atomic<uint64_t> _items;
+    std::atomic<uint64_t> _stored;
+    std::atomic<uint64_t> _bytes;
+    std::chrono::steady_clock::time_point _started;
+    std::atomic<int64_t> _elapsed_ms;
+
+    // Guards everything below
+    std::mutex _lock;
+
+    // Offset of the next block header
+    uint64_t _offset;
+
+    // Checksum of the checksums of the blocks taken so far
+    uint32_t _checksum;
+
+    // End of the file has been reached or some worker has failed
+    bool _finished;
+    std::string _error;
+
+    void worker();
+
+    // Takes the next block, returns false once there are no more
+    bool next(uint64_t &offset, SnapshotFormat::BlockHeader &header);
+
+    void pread_all(char *data, size_t size, uint64_t offset);
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_SNAPSHOT_LOADER_H
@@ -0,0 +1,55 @@
+#ifndef AFINA_STORAGE_STRIPED_COUNTER_H
+#define AFINA_STORAGE_STRIPED_COUNTER_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Counter bumped by concurrent readers
+ * Each thread adds to its own stripe, picked round robin on first use the same way BumpBuffer picks them, so
+ * readers counting hits on different cores don't bounce a shared cache line. Load sums all stripes up, it is
+ * exact once writers are done and close enough while they run.
+ */
+class StripedCounter {
+public:
+    static const size_t Stripes = 64;
+
+    StripedCounter() {}
+
+    StripedCounter(const StripedCounter &) = delete;
+    StripedCounter &operator=(const StripedCounter &) = delete;
+
+    void Add(size_t n = 1) { _stripes[slot()].value.fetch_add(n, std::memory_order_relaxed); }
+
+    size_t Load() const {
+        size_t sum = 0;
+        for (auto &s : _stripes) {
+            sum += s.value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+private:
+    struct alignas(64) Stripe {
+        Stripe() : value(0) {}
+
+        std::atomic<size_t> value;
+    };
+
+    // Returns stripe of the calling thread
+    static size_t slot() {
+        static std::atomic<size_t> next(0);
+        thread_local size_t self = next.fetch_add(1) % Stripes;
+        return self;
+    }
+
+    Stripe _stripes[Stripes];
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_STRIPED_COUNTER_H
@@ -0,0 +1,257 @@
+#include "StripedLockImpl.h"
+
+#include <stdexcept>
+
+#include "Cursor.h"
+#include "MapBasedGlobalLockImpl.h"
+
+namespace Afina {
+namespace Backend {
+
+// See StripedLockImpl.h
+StripedLockImpl::StripedLockImpl(size_t max_size, size_t shards, size_t headroom) {
+    if (shards == 0) {
+        throw std::invalid_argument("Number of shards must be positive");
+    }
+
+    _shards.reserve(shards);
+    for (size_t i = 0; i < shards; i++) {
+        _shards.emplace_back(new MapBasedGlobalLockImpl(max_size / shards, 100, headroom / shards));
+    }
+}
+
+// See StripedLockImpl.h
+void StripedLockImpl::Start() {
+    for (auto &s : _shards) {
+        s->Start();
+    }
+}
+
+// See StripedLockImpl.h
+void StripedLockImpl::Stop() {
+    for (auto &s : _shards) {
+        s->Stop();
+    }
+}
+
+// See StripedLockImpl.h
+bool StripedLockImpl::Put(const std::string &key, const std::string &value, time_t expire_at) {
+    return shard(key).Put(key, value, expire_at);
+}
+
+// See StripedLockImpl.h
+bool StripedLockImpl::PutIfAbsent(const std::string &key, const std::string &value, time_t expire_at) {
+    return shard(key).PutIfAbsent(key, value, expire_at);
+}
+
+// See StripedLockImpl.h
+bool StripedLockImpl::Set(const std::string &key, const std::string &value, time_t expire_at) {
+    return shard(key).Set(key, value, expire_at);
+}
+
+// See StripedLockImpl.h
+bool StripedLockImpl::Append(const std::string &key, const std::string &data) {
+    return shard(key).Append(key, data);
+}
+
+// See StripedLockImpl.h
+bool StripedLockImpl::Prepend(const std::string &key, const std::string &data) {
+    return shard(key).Prepend(key, data);
+}
+
+// See StripedLockImpl.h
+bool StripedLockImpl::Increment(const std::string &key, uint64_t delta, uint64_t &result) {
+    return shard(key).Increment(key, delta, result);
+}
+
+// See StripedLockImpl.h
+bool StripedLockImpl::Decrement(const std::string &key, uint64_t delta, uint64_t &result) {
+    return shard(key).Decrement(key, delta, result);
+}
+
+// See StripedLockImpl.h
+bool StripedLockImpl::Delete(const std::string &key) { return shard(key).Delete(key); }
+
+// See StripedLockImpl.h
+bool StripedLockImpl::Get(const std::string &key, std::string &value) const { return shard(key).Get(key, value); }
+
+// See StripedLockImpl.h
+bool StripedLockImpl::GetRef(const std::string &key, ValueRef &value) const {
+    return shard(key).GetRef(key, value);
+}
+
+// See StripedLockImpl.h
+size_t StripedLockImpl::GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const {
+    return get_many(keys, values, nullptr);
+}
+
+// See StripedLockImpl.h
+size_t StripedLockImpl::Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                             std::vector<uint64_t> &versions) const {
+    versions.assign(keys.size(), 0);
+    return get_many(keys, values, &versions);
+}
+
+// Versions are assigned by each shard on its own, that is fine as they are only compared for the same key
+Storage::CasResult StripedLockImpl::Cas(const std::string &key, const std::string &value, uint64_t version,
+                                        time_t expire_at) {
+    return shard(key).Cas(key, value, version, expire_at);
+}
+
+// Batch is split by shard, so that each shard lock is taken once and loaders working on different parts of the
+// dump mostly hit different shards
+size_t StripedLockImpl::Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                             const std::vector<time_t> &expire_at) {
+    std::vector<std::vector<size_t>> positions(_shards.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        positions[_hash(keys[i]) % _shards.size()].push_back(i);
+    }
+
+    size_t stored = 0;
+    std::vector<std::string> shard_keys, shard_values;
+    std::vector<time_t> shard_expire_at;
+    for (size_t s = 0; s < _shards.size(); s++) {
+        if (positions[s].empty()) {
+            continue;
+        }
+
+        shard_keys.clear();
+        shard_values.clear();
+        shard_expire_at.clear();
+        for (size_t i : positions[s]) {
+            shard_keys.push_back(keys[i]);
+            shard_values.push_back(values[i]);
+            shard_expire_at.push_back(expire_at[i]);
+        }
+        stored += _shards[s]->Load(shard_keys, shard_values, shard_expire_at);
+    }
+    return stored;
+}
+
+// Shards are scanned one after another, one shard per call. Cursor is shard number and cursor of that shard
+// joined with a dot
+bool StripedLockImpl::Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const {
+    size_t shard = 0;
+    std::string inner = "0";
+    if (cursor != "0") {
+        size_t dot = cursor.find('.');
+        if (dot == std::string::npos) {
+            throw std::invalid_argument("bad cursor");
+        }
+        shard = ParsePosition(cursor.substr(0, dot));
+        inner = cursor.substr(dot + 1);
+        if (shard >= _shards.size()) {
+            throw std::invalid_argument("bad cursor");
+        }
+    }
+
+    if (!_shards[shard]->Scan(inner, count, keys)) {
+        return false;
+    }
+    if (inner == "0") {
+        shard++;
+    }
+    cursor = shard == _shards.size() ? "0" : std::to_string(shard) + "." + inner;
+    return true;
+}
+
+// Shards are frozen one inside another, so f runs with all of them frozen
+void StripedLockImpl::Freeze(const std::function<void()> &f) { freeze(0, f); }
+
+// See StripedLockImpl.h
+void StripedLockImpl::ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const {
+    for (auto &s : _shards) {
+        s->ForEach(f);
+    }
+}
+
+// Shards are instances of the same storage, so they report the same metrics in the same order
+void StripedLockImpl::GetStats(std::vector<std::pair<std::string, std::string>> &stats) const {
+    std::vector<std::pair<std::string, uint64_t>> total;
+    std::vector<std::pair<std::string, std::string>> shard_stats;
+    for (auto &s : _shards) {
+        shard_stats.clear();
+        s->GetStats(shard_stats);
+        for (size_t i = 0; i < shard_stats.size(); i++) {
+            if (i == total.size()) {
+                total.emplace_back(shard_stats[i].first, 0);
+            }
+            total[i].second += std::stoull(shard_stats[i].second);
+        }
+    }
+
+    auto sum = [&total](const std::string &name) {
+        for (auto &t : total) {
+            if (t.first == name) {
+                return t.second;
+            }
+        }
+        return uint64_t(0);
+    };
+    auto percent = [](uint64_t part, uint64_t whole) { return std::to_string(whole == 0 ? 0 : 100 * part / whole); };
+
+    stats.emplace_back("shards", std::to_string(_shards.size()));
+    for (auto &t : total) {
+        if (t.first == "compressed_hit_percent") {
+            stats.emplace_back(t.first, percent(sum("compressed_hits"), sum("get_hits")));
+        } else if (t.first == "compressed_percent") {
+            stats.emplace_back(t.first, percent(sum("compressed_bytes"), sum("compressed_raw_bytes")));
+        } else {
+            stats.emplace_back(t.first, std::to_string(t.second));
+        }
+    }
+}
+
+// See StripedLockImpl.h
+void StripedLockImpl::freeze(size_t from, const std::function<void()> &f) {
+    if (from == _shards.size()) {
+        f();
+    } else {
+        _shards[from]->Freeze([this, from, &f]() { freeze(from + 1, f); });
+    }
+}
+
+// Keys are grouped by shard, so each shard is asked once with its own part of the batch
+size_t StripedLockImpl::get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                                 std::vector<uint64_t> *versions) const {
+    std::vector<std::vector<size_t>> positions(_shards.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        positions[_hash(keys[i]) % _shards.size()].push_back(i);
+    }
+    values.clear();
+    values.resize(keys.size());
+
+    size_t found = 0;
+    std::vector<std::string> shard_keys;
+    std::vector<ValueRef> shard_values;
+    std::vector<uint64_t> shard_versions;
+    for (size_t s = 0; s < _shards.size(); s++) {
+        if (positions[s].empty()) {
+            continue;
+        }
+
+        shard_keys.clear();
+        for (size_t i : positions[s]) {
+            shard_keys.push_back(keys[i]);
+        }
+        if (versions == nullptr) {
+            found += _shards[s]->GetMany(shard_keys, shard_values);
+        } else {
+            found += _shards[s]->Gets(shard_keys, shard_values, shard_versions);
+        }
+        for (size_t j = 0; j < positions[s].size(); j++) {
+            values[positions[s][j]] = std::move(shard_values[j]);
+            if (versions != nullptr) {
+                (*versions)[positions[s][j]] = shard_versions[j];
+            }
+        }
+    }
+    return found;
+}
+
+// Hash is taken modulo number of shards. Shards don't use hash internally, so there is no correlation between
+// shard selection and in-shard placement
+Afina::Storage &StripedLockImpl::shard(const std::string &key) const { return *_shards[_hash(key) % _shards.size()]; }
+
+} // namespace Backend
+} // namespace Afina
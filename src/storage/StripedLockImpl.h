@@ -0,0 +1,131 @@
+#ifndef AFINA_STORAGE_STRIPED_LOCK_IMPL_H
+#define AFINA_STORAGE_STRIPED_LOCK_IMPL_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <afina/Storage.h>
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Lock striped storage
+ * Key space is partitioned by hash into N shards, each one is an independent storage instance with its own
+ * lock, its own LRU and its own slice of the memory budget. Commands for keys in different shards never
+ * contend with each other, so throughput scales with number of workers as long as keys are spread uniformly.
+ *
+ * Note that eviction is per shard: once shard runs out of its max_size / N bytes it evicts its own least
+ * recently used entries even if other shards still have free space. Single entry could not be larger than
+ * one shard budget. Headroom kept free by maintenance threads is split between shards the same way.
+ */
+class StripedLockImpl : public Afina::Storage {
+public:
+    StripedLockImpl(size_t max_size = 1024, size_t shards = 16, size_t headroom = 0);
+    ~StripedLockImpl() {}
+
+    // Implements Afina::Storage interface
+    void Start() override;
+
+    // Implements Afina::Storage interface
+    void Stop() override;
+
+    // Implements Afina::Storage interface
+    bool Put(const std::string &key, const std::string &value) override { return Put(key, value, 0); }
+
+    // Implements Afina::Storage interface
+    bool Put(const std::string &key, const std::string &value, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool PutIfAbsent(const std::string &key, const std::string &value) override {
+        return PutIfAbsent(key, value, 0);
+    }
+
+    // Implements Afina::Storage interface
+    bool PutIfAbsent(const std::string &key, const std::string &value, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool Set(const std::string &key, const std::string &value) override { return Set(key, value, 0); }
+
+    // Implements Afina::Storage interface
+    bool Set(const std::string &key, const std::string &value, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool SupportsExpiration() const override { return true; }
+
+    // Implements Afina::Storage interface
+    bool Append(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Prepend(const std::string &key, const std::string &data) override;
+
+    // Implements Afina::Storage interface
+    bool Increment(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Decrement(const std::string &key, uint64_t delta, uint64_t &result) override;
+
+    // Implements Afina::Storage interface
+    bool Delete(const std::string &key) override;
+
+    // Implements Afina::Storage interface
+    bool Get(const std::string &key, std::string &value) const override;
+
+    // Implements Afina::Storage interface
+    bool GetRef(const std::string &key, ValueRef &value) const override;
+
+    // Implements Afina::Storage interface
+    size_t GetMany(const std::vector<std::string> &keys, std::vector<ValueRef> &values) const override;
+
+    // Implements Afina::Storage interface
+    size_t Gets(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                std::vector<uint64_t> &versions) const override;
+
+    // Implements Afina::Storage interface
+    CasResult Cas(const std::string &key, const std::string &value, uint64_t version, time_t expire_at) override;
+
+    // Implements Afina::Storage interface
+    size_t Load(const std::vector<std::string> &keys, const std::vector<std::string> &values,
+                const std::vector<time_t> &expire_at) override;
+
+    // Implements Afina::Storage interface
+    bool Scan(std::string &cursor, size_t count, std::vector<std::string> &keys) const override;
+
+    // Implements Afina::Storage interface
+    void Freeze(const std::function<void()> &f) override;
+
+    // Implements Afina::Storage interface
+    void ForEach(const std::function<void(const std::string &, const std::string &, time_t)> &f) const override;
+
+    /**
+     * Implements Afina::Storage interface. Metrics of all shards are summed up, percentages are computed from the
+     * sums, so they are weighted by shard load
+     */
+    void GetStats(std::vector<std::pair<std::string, std::string>> &stats) const override;
+
+    /**
+     * Number of shards key space is partitioned into
+     */
+    size_t Shards() const { return _shards.size(); }
+
+private:
+    // Returns shard responsible for the given key
+    Afina::Storage &shard(const std::string &key) const;
+
+    // Freezes shards starting from the given one and calls f
+    void freeze(size_t from, const std::function<void()> &f);
+
+    // Looks up batch of keys shard by shard, versions are filled in if given
+    size_t get_many(const std::vector<std::string> &keys, std::vector<ValueRef> &values,
+                    std::vector<uint64_t> *versions) const;
+
+    std::hash<std::string> _hash;
+    std::vector<std::unique_ptr<Afina::Storage>> _shards;
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_STRIPED_LOCK_IMPL_H
@@ -0,0 +1,77 @@
+#include "TimingWheel.h"
+
+#include <algorithm>
+
+namespace Afina {
+namespace Backend {
+
+// See TimingWheel.h
+TimingWheel::TimingWheel(uint32_t now) : _now(now), _size(0) {
+    std::fill(&_slots[0][0], &_slots[0][0] + Levels * (1 << SlotBits), nullptr);
+}
+
+// Current level 0 slot has fired already, so the earliest item could go is the next second
+void TimingWheel::Schedule(Item *item) { place(item, std::max(item->expire_at, _now + 1)); }
+
+// Slots are indexed by absolute time bits of the level, and the level is the lowest one where item is less than
+// a round ahead, so item lands right into the slot that becomes current exactly when its expiration time gets
+// into range of the level below, and never into the current slot that has been cascaded already
+void TimingWheel::place(Item *item, uint32_t expire) {
+    unsigned level = 0;
+    while (level < Levels - 1 && (expire >> (SlotBits * level)) - (_now >> (SlotBits * level)) > SlotMask) {
+        level++;
+    }
+
+    unsigned shift = SlotBits * level;
+    if ((expire >> shift) - (_now >> shift) > SlotMask) {
+        // Out of the wheel range, park it in the last slot of the top level to be rescheduled from there
+        expire = ((_now >> shift) + SlotMask) << shift;
+    }
+
+    link(_slots[level][(expire >> shift) & SlotMask], item);
+    _size++;
+}
+
+// See TimingWheel.h
+void TimingWheel::Cancel(Item *item) {
+    TimerLinks *links = TimerLinks::Of(item);
+    *links->pprev = links->next;
+    if (links->next != nullptr) {
+        TimerLinks::Of(links->next)->pprev = links->pprev;
+    }
+    links->next = nullptr;
+    links->pprev = nullptr;
+    _size--;
+}
+
+// See TimingWheel.h
+void TimingWheel::link(Item *&slot, Item *item) {
+    TimerLinks *links = TimerLinks::Of(item);
+    links->next = slot;
+    links->pprev = &slot;
+    if (slot != nullptr) {
+        TimerLinks::Of(slot)->pprev = &links->next;
+    }
+    slot = item;
+}
+
+// Upper levels go first, so that items they cascade never land into a slot of the level below that has
+// already been cascaded this second
+void TimingWheel::cascade() {
+    unsigned levels = 0;
+    while (levels < Levels - 1 && ((_now >> (SlotBits * levels)) & SlotMask) == 0) {
+        levels++;
+    }
+
+    for (unsigned level = levels; level > 0; level--) {
+        Item *&slot = _slots[level][(_now >> (SlotBits * level)) & SlotMask];
+        while (slot != nullptr) {
+            Item *item = slot;
+            Cancel(item);
+            place(item, std::max(item->expire_at, _now));
+        }
+    }
+}
+
+} // namespace Backend
+} // namespace Afina
@@ -0,0 +1,85 @@
+#ifndef AFINA_STORAGE_TIMING_WHEEL_H
+#define AFINA_STORAGE_TIMING_WHEEL_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Item.h"
+
+namespace Afina {
+namespace Backend {
+
+/**
+ * # Hierarchical timing wheel of item expiration
+ * Four levels of 64 slots each with one second resolution. Level 0 slot holds items expiring in that exact
+ * second of the next 64 seconds, slots of level N cover 64^N seconds each. Every time lower level completes a
+ * round, the next slot of the level above is cascaded down, so each item is moved at most three times before it
+ * fires. Items expiring later than 64^4 seconds (about 194 days) are parked in the top level and rescheduled
+ * when they get there.
+ *
+ * Schedule, Cancel and firing cost O(1) per item, wheel never looks at items that are not due. Items are linked
+ * through their TimerLinks, so they must be created with timer. Not thread safe.
+ */
+class TimingWheel {
+public:
+    /**
+     * @param now current unix time, wheel starts at
+     */
+    TimingWheel(uint32_t now);
+
+    /**
+     * Links item by its expire_at, items already expired fire on the next second
+     */
+    void Schedule(Item *item);
+
+    /**
+     * Unlinks scheduled item
+     */
+    void Cancel(Item *item);
+
+    /**
+     * Advances wheel up to the given time, calling f(Item *) for every item expired meanwhile. Items are unlinked
+     * from the wheel before f is called and f is free to schedule or cancel other items
+     */
+    template <typename F> void Advance(uint32_t now, F f) {
+        while (_now < now) {
+            _now++;
+            cascade();
+
+            Item *&slot = _slots[0][_now & SlotMask];
+            while (slot != nullptr) {
+                Item *item = slot;
+                Cancel(item);
+                f(item);
+            }
+        }
+    }
+
+    // Number of items scheduled
+    size_t Size() const { return _size; }
+
+    // Time wheel has been advanced to
+    uint32_t Now() const { return _now; }
+
+private:
+    static const unsigned Levels = 4;
+    static const unsigned SlotBits = 6;
+    static const uint32_t SlotMask = (1 << SlotBits) - 1;
+
+    Item *_slots[Levels][1 << SlotBits];
+    uint32_t _now;
+    size_t _size;
+
+    void link(Item *&slot, Item *item);
+
+    // Links item into the slot of given expiration time, which must not be earlier than now
+    void place(Item *item, uint32_t expire);
+
+    // Moves items of the slots of upper levels that have just become current one level down
+    void cascade();
+};
+
+} // namespace Backend
+} // namespace Afina
+
+#endif // AFINA_STORAGE_TIMING_WHEEL_H
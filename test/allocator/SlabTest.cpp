@@ -0,0 +1,128 @@
+#include "gtest/gtest.h"
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+#include <afina/allocator/Error.h>
+#include <afina/allocator/Slab.h>
+
+using namespace std;
+using namespace Afina::Allocator;
+
+static char slab_buf[4 * 65536];
+
+TEST(SlabTest, ClassesGrow) {
+    Slab a(slab_buf, sizeof(slab_buf), 64, 1.25, 65536);
+
+    EXPECT_EQ(a.chunk_size(0), 64);
+    for (unsigned i = 1; i < a.classes(); i++) {
+        EXPECT_GT(a.chunk_size(i), a.chunk_size(i - 1));
+        EXPECT_EQ(a.chunk_size(i) % 16, 0);
+    }
+    EXPECT_EQ(a.chunk_size(a.classes() - 1), 65536);
+
+    EXPECT_EQ(a.class_for(1), 0);
+    EXPECT_EQ(a.class_for(64), 0);
+    EXPECT_EQ(a.class_for(65), 1);
+    EXPECT_EQ(a.class_for(65536), a.classes() - 1);
+    EXPECT_THROW(a.class_for(65537), AllocError);
+}
+
+TEST(SlabTest, AllocInRange) {
+    Slab a(slab_buf, sizeof(slab_buf), 64, 1.25, 65536);
+
+    unsigned cls = a.class_for(100);
+    set<char *> chunks;
+    for (int i = 0; i < 100; i++) {
+        char *p = static_cast<char *>(a.alloc(cls));
+        ASSERT_NE(p, nullptr);
+        EXPECT_GE(p, slab_buf);
+        EXPECT_LE(p + a.chunk_size(cls), slab_buf + sizeof(slab_buf));
+        chunks.insert(p);
+    }
+    EXPECT_EQ(chunks.size(), 100);
+
+    Slab::ClassStats s = a.stats(cls);
+    EXPECT_EQ(s.pages, 1);
+    EXPECT_EQ(s.used_chunks, 100);
+    EXPECT_EQ(s.used_chunks + s.free_chunks, 65536 / a.chunk_size(cls));
+}
+
+TEST(SlabTest, PagesExhausted) {
+    Slab a(slab_buf, sizeof(slab_buf), 64, 1.25, 65536);
+
+    // Each page is a single chunk of the largest class
+    unsigned big = a.classes() - 1;
+    vector<void *> chunks;
+    for (int i = 0; i < 4; i++) {
+        chunks.push_back(a.alloc(big));
+        ASSERT_NE(chunks.back(), nullptr);
+    }
+    EXPECT_EQ(a.free_pages(), 0);
+    EXPECT_EQ(a.alloc(big), nullptr);
+    EXPECT_EQ(a.alloc(0), nullptr);
+
+    // Freed chunk is reused by the same class only
+    a.free(big, chunks[2]);
+    EXPECT_EQ(a.alloc(0), nullptr);
+    EXPECT_EQ(a.alloc(big), chunks[2]);
+}
+
+TEST(SlabTest, PageRelease) {
+    Slab a(slab_buf, sizeof(slab_buf), 64, 1.25, 65536);
+
+    unsigned big = a.classes() - 1;
+    vector<void *> chunks;
+    for (int i = 0; i < 4; i++) {
+        chunks.push_back(a.alloc(big));
+    }
+
+    // Page with chunk in use can't be released
+    size_t page = a.page_of(chunks[1]);
+    EXPECT_EQ(a.page_used(page), 1);
+    EXPECT_THROW(a.release(page), std::invalid_argument);
+
+    // Released page goes to another class
+    a.free(big, chunks[1]);
+    a.release(page);
+    EXPECT_EQ(a.free_pages(), 1);
+    EXPECT_EQ(a.stats(big).pages, 3);
+
+    char *p = static_cast<char *>(a.alloc(0));
+    EXPECT_EQ(a.page_of(p), page);
+    EXPECT_EQ(a.alloc(big), nullptr);
+    EXPECT_EQ(a.stats(0).pages, 1);
+}
+
+TEST(SlabTest, PageReleaseKeepsFreeList) {
+    Slab a(slab_buf, sizeof(slab_buf), 64, 1.25, 65536);
+
+    // Fill two pages of the smallest class, then free chunks of both of them interleaved
+    size_t per_page = 65536 / a.chunk_size(0);
+    vector<void *> chunks;
+    for (size_t i = 0; i < 2 * per_page; i++) {
+        chunks.push_back(a.alloc(0));
+    }
+    size_t first = a.page_of(chunks.front());
+    size_t second = a.page_of(chunks.back());
+    EXPECT_EQ(a.page_chunks(first), per_page);
+    EXPECT_EQ(a.page_begin(first), chunks.front());
+    for (size_t i = 0; i < per_page; i++) {
+        a.free(0, chunks[i]);
+        if (i % 2 == 0) {
+            a.free(0, chunks[per_page + i]);
+        }
+    }
+
+    // Only chunks of the released page leave the free list
+    a.release(first);
+    EXPECT_EQ(a.stats(0).free_chunks, (per_page + 1) / 2);
+    set<void *> reused;
+    for (size_t i = 0; i < (per_page + 1) / 2; i++) {
+        void *p = a.alloc(0);
+        EXPECT_EQ(a.page_of(p), second);
+        reused.insert(p);
+    }
+    EXPECT_EQ(reused.size(), (per_page + 1) / 2);
+    EXPECT_EQ(a.page_used(second), per_page);
+}
@@ -0,0 +1,53 @@
+#include "gtest/gtest.h"
+#include <string>
+#include <vector>
+
+#include <afina/execute/Get.h>
+#include <afina/execute/Response.h>
+#include <storage/FlatHashImpl.h>
+#include <storage/MapBasedGlobalLockImpl.h>
+
+using namespace Afina::Backend;
+using namespace Afina::Execute;
+using namespace std;
+
+// Storage with native GetRef and one falling back to copy must respond the same
+template <typename T> class GetTest : public ::testing::Test {};
+typedef ::testing::Types<MapBasedGlobalLockImpl, FlatHashImpl> Storages;
+TYPED_TEST_CASE(GetTest, Storages);
+
+TYPED_TEST(GetTest, Respond) {
+    TypeParam storage(4096);
+    storage.Put("KEY1", "val1");
+    storage.Put("KEY2", std::string(1000, 'v'));
+
+    Get get({"KEY1", "KEY3", "KEY2"});
+    Response response;
+    get.Respond(storage, "", response);
+
+    // Response keeps values it was built with
+    storage.Put("KEY2", std::string(1000, 'x'));
+
+    // Values are separate buffers of the response
+    std::vector<struct iovec> buffers;
+    response.Buffers(buffers);
+    EXPECT_EQ(5, buffers.size());
+    EXPECT_EQ(1000, buffers[3].iov_len);
+
+    std::string expected = "VALUE KEY1 0 4\r\nval1\r\nVALUE KEY2 0 1000\r\n" + std::string(1000, 'v') + "\r\nEND";
+    EXPECT_EQ(expected, response.str());
+    EXPECT_EQ(expected.size(), response.Size());
+
+    std::string out;
+    get.Execute(storage, "", out);
+    EXPECT_EQ("VALUE KEY1 0 4\r\nval1\r\nVALUE KEY2 0 1000\r\n" + std::string(1000, 'x') + "\r\nEND", out);
+}
+
+TYPED_TEST(GetTest, RespondMissing) {
+    TypeParam storage;
+
+    Get get({"KEY1"});
+    Response response;
+    get.Respond(storage, "", response);
+    EXPECT_EQ("END", response.str());
+}
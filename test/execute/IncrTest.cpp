@@ -0,0 +1,33 @@
+#include "gtest/gtest.h"
+#include <string>
+
+#include <afina/execute/Decr.h>
+#include <afina/execute/Incr.h>
+#include <storage/ClockRWLockImpl.h>
+#include <storage/FlatHashImpl.h>
+#include <storage/MapBasedGlobalLockImpl.h>
+
+using namespace Afina::Backend;
+using namespace Afina::Execute;
+using namespace std;
+
+// Storage keeping counters as text and ones keeping them as native numbers must respond the same
+template <typename T> class IncrTest : public ::testing::Test {};
+typedef ::testing::Types<MapBasedGlobalLockImpl, FlatHashImpl, ClockRWLockImpl> Storages;
+TYPED_TEST_CASE(IncrTest, Storages);
+
+TYPED_TEST(IncrTest, Execute) {
+    TypeParam storage(4096);
+    storage.Put("counter", "41");
+    storage.Put("text", "forty one");
+
+    std::string out;
+    Incr(std::string("counter"), 1).Execute(storage, "", out);
+    EXPECT_EQ("42", out);
+    Decr(std::string("counter"), 50).Execute(storage, "", out);
+    EXPECT_EQ("0", out);
+    Decr(std::string("missing"), 1).Execute(storage, "", out);
+    EXPECT_EQ("NOT_FOUND", out);
+    Incr(std::string("text"), 1).Execute(storage, "", out);
+    EXPECT_EQ("CLIENT_ERROR cannot increment or decrement non-numeric value", out);
+}
@@ -0,0 +1,53 @@
+#include "gtest/gtest.h"
+#include <string>
+
+#include <afina/execute/Keys.h>
+#include <afina/execute/Response.h>
+#include <storage/ArtImpl.h>
+#include <storage/FlatHashImpl.h>
+
+using namespace Afina::Backend;
+using namespace Afina::Execute;
+using namespace std;
+
+// Listing longer than one batch comes out whole and in order
+TEST(KeysTest, Batches) {
+    ArtImpl storage(1 << 20);
+    size_t count = 2 * Keys::BatchSize + 10;
+    for (size_t i = 0; i < count; i++) {
+        storage.Put("user:" + std::to_string(100000 + i), "v");
+    }
+    storage.Put("other", "v");
+
+    Keys keys("user:", false);
+    std::string out;
+    keys.Execute(storage, "", out);
+
+    std::string expected;
+    for (size_t i = 0; i < count; i++) {
+        expected += "KEY user:" + std::to_string(100000 + i) + "\r\n";
+    }
+    EXPECT_EQ(expected + "END", out);
+}
+
+TEST(KeysTest, Values) {
+    ArtImpl storage(4096);
+    storage.Put("a:1", "val1");
+    storage.Put("a:2", "val22");
+    storage.Put("b:1", "val3");
+
+    Keys keys("a:", true);
+    Response response;
+    keys.Respond(storage, "", response);
+    EXPECT_EQ("VALUE a:1 0 4\r\nval1\r\nVALUE a:2 0 5\r\nval22\r\nEND", response.str());
+}
+
+TEST(KeysTest, Unordered) {
+    FlatHashImpl storage(4096);
+    storage.Put("a:1", "val1");
+
+    Keys keys("a:", false);
+    std::string out;
+    keys.Execute(storage, "", out);
+    EXPECT_EQ("SERVER_ERROR storage doesn't support key ranges", out);
+}
@@ -0,0 +1,52 @@
+#include "gtest/gtest.h"
+#include <set>
+#include <string>
+
+#include <afina/execute/Scan.h>
+#include <storage/FlatHashImpl.h>
+#include <storage/MapBasedGlobalLockImpl.h>
+
+using namespace Afina::Backend;
+using namespace Afina::Execute;
+using namespace std;
+
+// Follows cursors until iteration is over and collects keys
+template <typename T> class ScanTest : public ::testing::Test {};
+typedef ::testing::Types<MapBasedGlobalLockImpl, FlatHashImpl> Storages;
+TYPED_TEST_CASE(ScanTest, Storages);
+
+TYPED_TEST(ScanTest, Iterate) {
+    TypeParam storage(1 << 20);
+    for (int i = 0; i < 50; i++) {
+        storage.Put("KEY" + std::to_string(i), "v");
+    }
+
+    std::set<std::string> seen;
+    std::string cursor = "0";
+    size_t calls = 0;
+    do {
+        std::string out;
+        Scan(cursor, 8).Execute(storage, "", out);
+        ASSERT_EQ(0, out.find("CURSOR "));
+        ASSERT_EQ(out.size() - 3, out.rfind("END"));
+
+        size_t eol = out.find("\r\n");
+        cursor = out.substr(7, eol - 7);
+        for (size_t pos = eol + 2; out.compare(pos, 4, "KEY ") == 0;) {
+            size_t end = out.find("\r\n", pos);
+            seen.insert(out.substr(pos + 4, end - pos - 4));
+            pos = end + 2;
+        }
+        calls++;
+    } while (cursor != "0" && calls < 1000);
+
+    EXPECT_EQ(50, seen.size());
+    EXPECT_GT(calls, 1);
+}
+
+TYPED_TEST(ScanTest, BadCursor) {
+    TypeParam storage(1 << 20);
+    std::string out;
+    Scan("k0x", 10).Execute(storage, "", out);
+    EXPECT_EQ("CLIENT_ERROR bad cursor", out);
+}
@@ -0,0 +1,49 @@
+#include "gtest/gtest.h"
+#include <string>
+
+#include <afina/execute/Add.h>
+#include <afina/execute/Cas.h>
+#include <afina/execute/Replace.h>
+#include <afina/execute/Set.h>
+#include <storage/ClockRWLockImpl.h>
+#include <storage/MapBasedGlobalLockImpl.h>
+
+using namespace Afina::Backend;
+using namespace Afina::Execute;
+using namespace std;
+
+// Default storage honors exptime, negative one expires the key right away
+TEST(SetTest, Expiration) {
+    MapBasedGlobalLockImpl storage(1 << 20);
+    std::string out, value;
+    Set("KEY1", 0, 3600).Execute(storage, "val1", out);
+    EXPECT_EQ("STORED", out);
+    EXPECT_TRUE(storage.Get("KEY1", value));
+
+    Replace("KEY1", 0, -1).Execute(storage, "val2", out);
+    EXPECT_EQ("STORED", out);
+    EXPECT_FALSE(storage.Get("KEY1", value));
+    Add("KEY1", 0, 0).Execute(storage, "val3", out);
+    EXPECT_EQ("STORED", out);
+}
+
+// Storage that would keep the key forever fails commands asking for exptime and leaves the key as it was
+TEST(SetTest, ExpirationNotSupported) {
+    ClockRWLockImpl storage(1 << 20);
+    std::string out, value;
+    Set("KEY1", 0, 0).Execute(storage, "val1", out);
+    EXPECT_EQ("STORED", out);
+
+    Set("KEY1", 0, 3600).Execute(storage, "val2", out);
+    EXPECT_EQ("SERVER_ERROR storage doesn't support expiration", out);
+    Add("KEY2", 0, -1).Execute(storage, "val2", out);
+    EXPECT_EQ(0, out.find("SERVER_ERROR"));
+    Replace("KEY1", 0, 10).Execute(storage, "val2", out);
+    EXPECT_EQ(0, out.find("SERVER_ERROR"));
+    Cas("KEY1", 0, 10, 1).Execute(storage, "val2", out);
+    EXPECT_EQ(0, out.find("SERVER_ERROR"));
+
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("val1", value);
+    EXPECT_FALSE(storage.Get("KEY2", value));
+}
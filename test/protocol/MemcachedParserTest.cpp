@@ -4,7 +4,13 @@
 #include <string>
 
 #include <afina/execute/Add.h>
+#include <afina/execute/Cas.h>
 #include <afina/execute/Get.h>
+#include <afina/execute/Gets.h>
+#include <afina/execute/Incr.h>
+#include <afina/execute/Keys.h>
+#include <afina/execute/Prepend.h>
+#include <afina/execute/Scan.h>
 #include <afina/execute/Set.h>
 #include <afina/execute/Stats.h>
 
@@ -58,6 +64,206 @@ TEST(MemcachedParserTest, SimpleAdd) {
     ASSERT_EQ(-1, tmp->expire());
 }
 
+// Verify simple prepend command passed in a single string
+TEST(MemcachedParserTest, SimplePrepend) {
+    Protocol::Parser parser;
+
+    size_t consumed = 0;
+    bool cmd_avail = parser.Parse("prepend baz 0 0 3\r\npre\r\n", consumed);
+    ASSERT_TRUE(cmd_avail);
+    ASSERT_EQ(19, consumed);
+    ASSERT_EQ("prepend", parser.Name());
+
+    uint32_t value_size;
+    std::unique_ptr<Execute::Command> cmd = parser.Build(value_size);
+    ASSERT_FALSE(cmd == nullptr);
+    ASSERT_EQ(3, value_size);
+
+    Execute::Prepend *tmp = dynamic_cast<Execute::Prepend *>(cmd.get());
+    ASSERT_FALSE(tmp == nullptr);
+    ASSERT_EQ("baz", tmp->key());
+}
+
+// Verify multi digit expiration time
+TEST(MemcachedParserTest, ExpireTime) {
+    Protocol::Parser parser;
+
+    size_t consumed = 0;
+    ASSERT_TRUE(parser.Parse("set foo 0 3600 6\r\nfooval\r\n", consumed));
+
+    uint32_t value_size;
+    std::unique_ptr<Execute::Command> cmd = parser.Build(value_size);
+    Execute::Set *tmp = reinterpret_cast<Execute::Set *>(cmd.get());
+    ASSERT_EQ(3600, tmp->expire());
+
+    parser.Reset();
+    ASSERT_TRUE(parser.Parse("set foo 0 -120 6\r\nfooval\r\n", consumed));
+    cmd = parser.Build(value_size);
+    tmp = reinterpret_cast<Execute::Set *>(cmd.get());
+    ASSERT_EQ(-120, tmp->expire());
+}
+
+// Verify simple incr command passed in a single string
+TEST(MemcachedParserTest, SimpleIncr) {
+    Protocol::Parser parser;
+
+    size_t consumed = 0;
+    bool cmd_avail = parser.Parse("incr counter 18446744073709551615\r\n", consumed);
+    ASSERT_TRUE(cmd_avail);
+    ASSERT_EQ(35, consumed);
+    ASSERT_EQ("incr", parser.Name());
+
+    uint32_t value_size;
+    std::unique_ptr<Execute::Command> cmd = parser.Build(value_size);
+    ASSERT_FALSE(cmd == nullptr);
+    ASSERT_EQ(0, value_size);
+
+    Execute::Incr *tmp = dynamic_cast<Execute::Incr *>(cmd.get());
+    ASSERT_FALSE(tmp == nullptr);
+    ASSERT_EQ("counter", tmp->key());
+    ASSERT_EQ(UINT64_MAX, tmp->value());
+}
+
+// Key of incr/decr ends on \r as well, value must be a non empty number
+TEST(MemcachedParserTest, IncrBadValue) {
+    size_t consumed = 0;
+    for (std::string line : {"incr key\r\n", "decr key \r\n", "incr key 1a2\r\n", "incr key -1\r\n"}) {
+        Protocol::Parser parser;
+        EXPECT_THROW(parser.Parse(line, consumed), Protocol::ClientError) << line;
+    }
+
+    // Error is reported as soon as bad char comes, no matter how input is split
+    Protocol::Parser parser;
+    EXPECT_FALSE(parser.Parse("incr key 1", consumed));
+    EXPECT_THROW(parser.Parse("a\r\n", consumed), Protocol::ClientError);
+
+    try {
+        Protocol::Parser other;
+        other.Parse("incr key\r\n", consumed);
+        ADD_FAILURE() << "Value is missing, but no error";
+    } catch (Protocol::ClientError &e) {
+        EXPECT_EQ(std::string("bad command line format"), e.what());
+    }
+}
+
+TEST(MemcachedParserTest, SimpleCas) {
+    Protocol::Parser parser;
+
+    size_t consumed = 0;
+    bool cmd_avail = parser.Parse("cas foo 0 0 3 18446744073709551615\r\n", consumed);
+    ASSERT_TRUE(cmd_avail);
+    ASSERT_EQ(36, consumed);
+    ASSERT_EQ("cas", parser.Name());
+
+    uint32_t value_size;
+    std::unique_ptr<Execute::Command> cmd = parser.Build(value_size);
+    ASSERT_FALSE(cmd == nullptr);
+    ASSERT_EQ(3, value_size);
+
+    Execute::Cas *tmp = dynamic_cast<Execute::Cas *>(cmd.get());
+    ASSERT_FALSE(tmp == nullptr);
+    ASSERT_EQ("foo", tmp->key());
+    ASSERT_EQ(UINT64_MAX, tmp->version());
+}
+
+// Only cas takes <cas unique>, and it must be there
+TEST(MemcachedParserTest, CasUnique) {
+    size_t consumed = 0;
+    for (std::string line : {"cas foo 0 0 3\r\n", "cas foo 0 0 3 \r\n", "cas foo 0 0 3 1x\r\n"}) {
+        Protocol::Parser parser;
+        EXPECT_THROW(parser.Parse(line, consumed), Protocol::ClientError) << line;
+    }
+
+    Protocol::Parser parser;
+    ASSERT_TRUE(parser.Parse("set foo 0 0 3 noreply\r\n", consumed));
+    uint32_t value_size;
+    std::unique_ptr<Execute::Command> cmd = parser.Build(value_size);
+    EXPECT_EQ(3, value_size);
+    EXPECT_FALSE(dynamic_cast<Execute::Set *>(cmd.get()) == nullptr);
+}
+
+TEST(MemcachedParserTest, SimpleGets) {
+    Protocol::Parser parser;
+
+    size_t consumed = 0;
+    bool cmd_avail = parser.Parse("gets foo bar\r\n", consumed);
+    ASSERT_TRUE(cmd_avail);
+    ASSERT_EQ(14, consumed);
+
+    uint32_t value_size;
+    std::unique_ptr<Execute::Command> cmd = parser.Build(value_size);
+    Execute::Gets *tmp = dynamic_cast<Execute::Gets *>(cmd.get());
+    ASSERT_FALSE(tmp == nullptr);
+    ASSERT_EQ(2, tmp->keys().size());
+    ASSERT_EQ("bar", tmp->keys()[1]);
+}
+
+TEST(MemcachedParserTest, Keys) {
+    Protocol::Parser parser;
+
+    size_t consumed = 0;
+    ASSERT_TRUE(parser.Parse("keys user:1:\r\n", consumed));
+    ASSERT_EQ(14, consumed);
+
+    uint32_t value_size;
+    std::unique_ptr<Execute::Command> cmd = parser.Build(value_size);
+    Execute::Keys *tmp = dynamic_cast<Execute::Keys *>(cmd.get());
+    ASSERT_FALSE(tmp == nullptr);
+    EXPECT_EQ("user:1:", tmp->prefix());
+    EXPECT_FALSE(tmp->values());
+
+    // Without prefix all keys are listed
+    parser.Reset();
+    ASSERT_TRUE(parser.Parse("keys\r\n", consumed));
+    ASSERT_EQ(6, consumed);
+    cmd = parser.Build(value_size);
+    tmp = dynamic_cast<Execute::Keys *>(cmd.get());
+    ASSERT_FALSE(tmp == nullptr);
+    EXPECT_EQ("", tmp->prefix());
+
+    parser.Reset();
+    ASSERT_TRUE(parser.Parse("keys p values\r\n", consumed));
+    cmd = parser.Build(value_size);
+    tmp = dynamic_cast<Execute::Keys *>(cmd.get());
+    ASSERT_FALSE(tmp == nullptr);
+    EXPECT_EQ("p", tmp->prefix());
+    EXPECT_TRUE(tmp->values());
+
+    parser.Reset();
+    ASSERT_TRUE(parser.Parse("keys p all\r\n", consumed));
+    EXPECT_THROW(parser.Build(value_size), std::runtime_error);
+}
+
+TEST(MemcachedParserTest, Scan) {
+    Protocol::Parser parser;
+
+    size_t consumed = 0;
+    ASSERT_TRUE(parser.Parse("scan 0\r\n", consumed));
+    ASSERT_EQ(8, consumed);
+
+    uint32_t value_size;
+    std::unique_ptr<Execute::Command> cmd = parser.Build(value_size);
+    Execute::Scan *tmp = dynamic_cast<Execute::Scan *>(cmd.get());
+    ASSERT_FALSE(tmp == nullptr);
+    EXPECT_EQ("0", tmp->cursor());
+    EXPECT_EQ(Execute::Scan::DefaultCount, tmp->count());
+
+    parser.Reset();
+    ASSERT_TRUE(parser.Parse("scan 1.k6b 500\r\n", consumed));
+    cmd = parser.Build(value_size);
+    tmp = dynamic_cast<Execute::Scan *>(cmd.get());
+    ASSERT_FALSE(tmp == nullptr);
+    EXPECT_EQ("1.k6b", tmp->cursor());
+    EXPECT_EQ(500, tmp->count());
+
+    parser.Reset();
+    ASSERT_TRUE(parser.Parse("scan 0 many\r\n", consumed));
+    EXPECT_THROW(parser.Build(value_size), std::runtime_error);
+
+    parser.Reset();
+    EXPECT_THROW(parser.Parse("scan\r\n", consumed), std::runtime_error);
+}
+
 // Verify simple get command passed in a single string
 TEST(MemcachedParserTest, SimpleGet) {
     Protocol::Parser parser;
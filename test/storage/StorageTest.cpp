@@ -1,22 +1,54 @@
 #include "gtest/gtest.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <random>
 #include <set>
 #include <vector>
 #include <iomanip>
+#include <thread>
+#include <dirent.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
 
+#include <storage/ArtImpl.h>
+#include <storage/ClockRWLockImpl.h>
+#include <storage/CuckooImpl.h>
+#include <storage/FlatHashImpl.h>
+#include <storage/LogStructuredImpl.h>
+#include <storage/LoggedStorage.h>
+#include <storage/Crc32c.h>
+#include <storage/Lz.h>
 #include <storage/MapBasedGlobalLockImpl.h>
+#include <storage/MappedImpl.h>
+#include <storage/SkipListImpl.h>
+#include <storage/SlabImpl.h>
+#include <storage/Snapshot.h>
+#include <storage/SnapshotLoader.h>
+#include <storage/StripedLockImpl.h>
+#include <storage/TimingWheel.h>
 #include <afina/execute/Get.h>
 #include <afina/execute/Set.h>
 #include <afina/execute/Add.h>
 #include <afina/execute/Append.h>
 #include <afina/execute/Delete.h>
 
+using namespace Afina;
 using namespace Afina::Backend;
 using namespace Afina::Execute;
 using namespace std;
 
-TEST(StorageTest, PutGet) {
-    MapBasedGlobalLockImpl storage;
+// Storages that have a single global LRU, all of them must behave exactly the same
+template <typename T> class StorageTest : public ::testing::Test {};
+typedef ::testing::Types<MapBasedGlobalLockImpl, FlatHashImpl, ArtImpl> LRUStorages;
+TYPED_TEST_CASE(StorageTest, LRUStorages);
+
+TYPED_TEST(StorageTest, PutGet) {
+    TypeParam storage;
 
     storage.Put("KEY1", "val1");
     storage.Put("KEY2", "val2");
@@ -29,8 +61,8 @@ TEST(StorageTest, PutGet) {
     EXPECT_TRUE(value == "val2");
 }
 
-TEST(StorageTest, PutOverwrite) {
-    MapBasedGlobalLockImpl storage;
+TYPED_TEST(StorageTest, PutOverwrite) {
+    TypeParam storage;
 
     storage.Put("KEY1", "val1");
     storage.Put("KEY1", "val2");
@@ -40,8 +72,8 @@ TEST(StorageTest, PutOverwrite) {
     EXPECT_TRUE(value == "val2");
 }
 
-TEST(StorageTest, PutIfAbsent) {
-    MapBasedGlobalLockImpl storage;
+TYPED_TEST(StorageTest, PutIfAbsent) {
+    TypeParam storage;
 
     storage.Put("KEY1", "val1");
     storage.PutIfAbsent("KEY1", "val2");
@@ -59,9 +91,9 @@ pad_space(const std::string &s, size_t length)
     return result;
 }
 
-TEST(StorageTest, BigTest) {
+TYPED_TEST(StorageTest, BigTest) {
     const size_t length = 20;
-    MapBasedGlobalLockImpl storage(2 * 10000 * length);
+    TypeParam storage(2 * 10000 * length);
 
     for(long i=0; i<10000; ++i)
     {
@@ -83,9 +115,9 @@ TEST(StorageTest, BigTest) {
 
 }
 
-TEST(StorageTest, MaxTest) {
+TYPED_TEST(StorageTest, MaxTest) {
     const size_t length = 20;
-    MapBasedGlobalLockImpl storage(2 * 1000 * length);
+    TypeParam storage(2 * 1000 * length);
 
     std::stringstream ss;
 
@@ -115,3 +147,2536 @@ TEST(StorageTest, MaxTest) {
         EXPECT_FALSE(storage.Get(key, res));
     }
 }
+
+TYPED_TEST(StorageTest, Delete) {
+    TypeParam storage;
+
+    storage.Put("KEY1", "val1");
+    storage.Put("KEY2", "val2");
+    EXPECT_TRUE(storage.Delete("KEY1"));
+    EXPECT_FALSE(storage.Delete("KEY1"));
+
+    std::string value;
+    EXPECT_FALSE(storage.Get("KEY1", value));
+    EXPECT_TRUE(storage.Get("KEY2", value));
+    EXPECT_TRUE(value == "val2");
+
+    EXPECT_TRUE(storage.PutIfAbsent("KEY1", "val3"));
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_TRUE(value == "val3");
+}
+
+TYPED_TEST(StorageTest, GetRefreshesLRU) {
+    // Room for exactly three entries
+    TypeParam storage(3 * 8);
+
+    storage.Put("KEY1", "val1");
+    storage.Put("KEY2", "val2");
+    storage.Put("KEY3", "val3");
+
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    storage.Put("KEY4", "val4");
+
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_FALSE(storage.Get("KEY2", value));
+    EXPECT_TRUE(storage.Get("KEY3", value));
+    EXPECT_TRUE(storage.Get("KEY4", value));
+}
+
+TYPED_TEST(StorageTest, Churn) {
+    const size_t length = 20;
+    TypeParam storage(2 * 1000 * length);
+
+    // Keep about 500 live keys while inserting and deleting a lot more
+    for (long i = 0; i < 20000; ++i) {
+        auto key = pad_space("Key " + std::to_string(i), length);
+        auto val = pad_space("Val " + std::to_string(i), length);
+        EXPECT_TRUE(storage.Put(key, val));
+        if (i >= 500) {
+            EXPECT_TRUE(storage.Delete(pad_space("Key " + std::to_string(i - 500), length)));
+        }
+    }
+
+    for (long i = 0; i < 20000; ++i) {
+        auto key = pad_space("Key " + std::to_string(i), length);
+        auto val = pad_space("Val " + std::to_string(i), length);
+
+        std::string res;
+        if (i < 20000 - 500) {
+            EXPECT_FALSE(storage.Get(key, res));
+        } else {
+            EXPECT_TRUE(storage.Get(key, res));
+            EXPECT_TRUE(val == res);
+        }
+    }
+}
+
+TYPED_TEST(StorageTest, GetRefOutlivesEntry) {
+    TypeParam storage(3 * 8);
+
+    storage.Put("KEY1", "val1");
+    storage.Put("KEY2", "val2");
+
+    ValueRef ref1, ref2;
+    EXPECT_TRUE(storage.GetRef("KEY1", ref1));
+    EXPECT_TRUE(storage.GetRef("KEY2", ref2));
+    EXPECT_FALSE(storage.GetRef("KEY3", ref2));
+    EXPECT_EQ("val2", ref2.str());
+
+    // Value fits in place, but view must not see it changing
+    storage.Put("KEY1", "VAL1");
+    storage.Delete("KEY2");
+    EXPECT_EQ("val1", ref1.str());
+    EXPECT_EQ("val2", ref2.str());
+
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("VAL1", value);
+
+    // Shared entry still could be evicted
+    storage.Put("KEY3", "val3");
+    storage.Put("KEY4", "val4");
+    storage.Put("KEY5", "val5");
+    EXPECT_FALSE(storage.Get("KEY1", value));
+    EXPECT_EQ("val1", ref1.str());
+}
+
+TYPED_TEST(StorageTest, GetMany) {
+    TypeParam storage(1024);
+
+    std::vector<std::string> keys;
+    for (long i = 0; i < 40; ++i) {
+        keys.push_back("Key " + std::to_string(i));
+        if (i % 3 != 0) {
+            EXPECT_TRUE(storage.Put(keys.back(), "Val " + std::to_string(i)));
+        }
+    }
+    keys.push_back("Key 1");
+
+    std::vector<ValueRef> values;
+    EXPECT_EQ(27, storage.GetMany(keys, values));
+    ASSERT_EQ(keys.size(), values.size());
+    for (long i = 0; i < 40; ++i) {
+        EXPECT_EQ(i % 3 != 0, values[i].valid());
+        if (i % 3 != 0) {
+            EXPECT_EQ("Val " + std::to_string(i), values[i].str());
+        }
+    }
+    EXPECT_EQ("Val 1", values.back().str());
+
+    // Empty value is still found
+    EXPECT_TRUE(storage.Put("Key 0", ""));
+    EXPECT_EQ(28, storage.GetMany(keys, values));
+    EXPECT_TRUE(values[0].valid());
+}
+
+TYPED_TEST(StorageTest, AppendPrepend) {
+    TypeParam storage(1024);
+
+    EXPECT_FALSE(storage.Append("KEY1", "tail"));
+    EXPECT_FALSE(storage.Prepend("KEY1", "head"));
+
+    EXPECT_TRUE(storage.Put("KEY1", "val"));
+    ValueRef ref;
+    EXPECT_TRUE(storage.GetRef("KEY1", ref));
+
+    EXPECT_TRUE(storage.Append("KEY1", "ue"));
+    EXPECT_TRUE(storage.Prepend("KEY1", "my "));
+    for (int i = 0; i < 100; i++) {
+        EXPECT_TRUE(storage.Append("KEY1", "!"));
+    }
+
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("my value" + std::string(100, '!'), value);
+    EXPECT_EQ("val", ref.str());
+
+    // Doesn't fit at all
+    EXPECT_FALSE(storage.Append("KEY1", std::string(1024, 'x')));
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("my value" + std::string(100, '!'), value);
+}
+
+TYPED_TEST(StorageTest, ConcurrentAppend) {
+    TypeParam storage(1 << 20);
+    EXPECT_TRUE(storage.Put("KEY", ""));
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.emplace_back([&storage]() {
+            for (int i = 0; i < 1000; i++) {
+                storage.Append("KEY", "x");
+            }
+        });
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+
+    // No append is lost
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY", value));
+    EXPECT_EQ(4000, value.size());
+}
+
+TYPED_TEST(StorageTest, IncrDecr) {
+    TypeParam storage(1024);
+    uint64_t result;
+
+    EXPECT_FALSE(storage.Increment("KEY1", 1, result));
+    EXPECT_TRUE(storage.Put("KEY1", "val"));
+    EXPECT_THROW(storage.Increment("KEY1", 1, result), std::invalid_argument);
+    EXPECT_TRUE(storage.Put("KEY1", "18446744073709551616"));
+    EXPECT_THROW(storage.Decrement("KEY1", 1, result), std::invalid_argument);
+
+    EXPECT_TRUE(storage.Put("KEY1", "7"));
+    ValueRef ref;
+    EXPECT_TRUE(storage.GetRef("KEY1", ref));
+    EXPECT_TRUE(storage.Increment("KEY1", 1000, result));
+    EXPECT_EQ(1007, result);
+    EXPECT_TRUE(storage.Decrement("KEY1", 7, result));
+    EXPECT_EQ(1000, result);
+    EXPECT_EQ("7", ref.str());
+
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("1000", value);
+    EXPECT_TRUE(storage.GetRef("KEY1", ref));
+    EXPECT_TRUE(storage.Increment("KEY1", 1, result));
+    EXPECT_EQ("1000", ref.str());
+
+    // Decrement stops at 0, increment wraps around
+    EXPECT_TRUE(storage.Decrement("KEY1", 5000, result));
+    EXPECT_EQ(0, result);
+    EXPECT_TRUE(storage.Put("KEY1", "18446744073709551615"));
+    EXPECT_TRUE(storage.Increment("KEY1", 2, result));
+    EXPECT_EQ(1, result);
+
+    // Counter is text again for append and put
+    EXPECT_TRUE(storage.Append("KEY1", "0"));
+    EXPECT_TRUE(storage.Prepend("KEY1", "2"));
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("210", value);
+    EXPECT_TRUE(storage.Increment("KEY1", 1, result));
+    EXPECT_EQ(211, result);
+    EXPECT_TRUE(storage.Put("KEY1", "x"));
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("x", value);
+}
+
+TYPED_TEST(StorageTest, Cas) {
+    TypeParam storage(1024);
+    std::vector<ValueRef> values;
+    std::vector<uint64_t> versions;
+
+    EXPECT_TRUE(storage.Cas("KEY1", "val", 1, 0) == Storage::CasResult::NotFound);
+    EXPECT_TRUE(storage.Put("KEY1", "val1"));
+    EXPECT_TRUE(storage.Put("KEY2", "val2"));
+    EXPECT_EQ(2, storage.Gets({"KEY1", "KEY3", "KEY2"}, values, versions));
+    ASSERT_EQ(3, versions.size());
+    EXPECT_EQ("val1", values[0].str());
+    EXPECT_EQ(0, versions[1]);
+    EXPECT_NE(versions[0], versions[2]);
+
+    // Every modification changes version
+    uint64_t version = versions[0];
+    uint64_t result;
+    EXPECT_TRUE(storage.Append("KEY1", "0"));
+    storage.Gets({"KEY1"}, values, versions);
+    EXPECT_NE(version, versions[0]);
+    version = versions[0];
+    EXPECT_TRUE(storage.Put("KEY1", "5"));
+    EXPECT_TRUE(storage.Cas("KEY1", "6", version, 0) == Storage::CasResult::Exists);
+    storage.Gets({"KEY1"}, values, versions);
+    version = versions[0];
+    EXPECT_TRUE(storage.Increment("KEY1", 1, result));
+    EXPECT_TRUE(storage.Cas("KEY1", "7", version, 0) == Storage::CasResult::Exists);
+
+    // Reads don't
+    storage.Gets({"KEY1"}, values, versions);
+    version = versions[0];
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("6", value);
+    EXPECT_TRUE(storage.Cas("KEY1", "7", version, 0) == Storage::CasResult::Stored);
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("7", value);
+    EXPECT_TRUE(storage.Cas("KEY1", "8", version, 0) == Storage::CasResult::Exists);
+
+    EXPECT_TRUE(storage.Delete("KEY1"));
+    EXPECT_TRUE(storage.Cas("KEY1", "8", version, 0) == Storage::CasResult::NotFound);
+}
+
+TYPED_TEST(StorageTest, Load) {
+    TypeParam storage(30);
+
+    EXPECT_TRUE(storage.Put("KEY1", "val1"));
+    EXPECT_EQ(2, storage.Load({"KEY1", "KEY2", "KEY3"}, {"new1", "val2", "val3"}, {0, 0, 0}));
+
+    // Existing key is neither overwritten nor counted as accessed, so it goes first
+    EXPECT_TRUE(storage.Put("KEY4", "val4"));
+    std::string value;
+    EXPECT_FALSE(storage.Get("KEY1", value));
+    EXPECT_TRUE(storage.Get("KEY2", value));
+    EXPECT_EQ("val2", value);
+    EXPECT_TRUE(storage.Get("KEY4", value));
+
+    // Too large to fit
+    EXPECT_EQ(0, storage.Load({"KEY5"}, {std::string(100, 'x')}, {0}));
+}
+
+// Mapped storage over a file that is gone once storage is destroyed
+static MappedImpl *anonymous_arena(size_t pages, size_t page_size = 65536) {
+    std::string path = "/tmp/afina_arena_test_" + std::to_string(getpid());
+    unlink(path.c_str());
+    MappedImpl *storage = new MappedImpl(path, (pages + 1) * page_size, page_size);
+    unlink(path.c_str());
+    return storage;
+}
+
+// Counters of the engines that are not covered by typed tests
+TEST(IncrDecrTest, OtherEngines) {
+    std::vector<std::unique_ptr<Afina::Storage>> storages;
+    storages.emplace_back(new StripedLockImpl(4096, 4));
+    storages.emplace_back(new ClockRWLockImpl(4096));
+    storages.emplace_back(new SlabImpl(65536, 65536));
+    storages.emplace_back(anonymous_arena(1));
+    storages.emplace_back(new CuckooImpl(65536, 65536));
+    storages.emplace_back(new SkipListImpl(4096));
+    storages.emplace_back(new LogStructuredImpl(4 * 16384, 16384));
+
+    for (auto &storage : storages) {
+        uint64_t result;
+        EXPECT_FALSE(storage->Increment("KEY1", 1, result));
+        EXPECT_TRUE(storage->Put("KEY1", "99"));
+        EXPECT_TRUE(storage->Increment("KEY1", 1, result));
+        EXPECT_EQ(100, result);
+        EXPECT_TRUE(storage->Decrement("KEY1", 200, result));
+        EXPECT_EQ(0, result);
+        EXPECT_TRUE(storage->Append("KEY1", "7"));
+
+        std::string value;
+        EXPECT_TRUE(storage->Get("KEY1", value));
+        EXPECT_EQ("07", value);
+        EXPECT_TRUE(storage->Increment("KEY1", 1, result));
+        EXPECT_EQ(8, result);
+
+        EXPECT_TRUE(storage->Put("KEY1", "val"));
+        EXPECT_THROW(storage->Increment("KEY1", 1, result), std::invalid_argument);
+    }
+}
+
+TEST(IncrDecrTest, ConcurrentCounter) {
+    ClockRWLockImpl storage(4096);
+    EXPECT_TRUE(storage.Put("KEY", "0"));
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.emplace_back([&storage, t]() {
+            uint64_t result;
+            for (int i = 0; i < 10000; i++) {
+                if (t % 2 == 0) {
+                    storage.Increment("KEY", 3, result);
+                } else {
+                    storage.Increment("KEY", 1, result);
+                }
+            }
+        });
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+
+    // No update is lost
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY", value));
+    EXPECT_EQ("80000", value);
+}
+
+// Versions of the engines that are not covered by typed tests
+TEST(CasTest, OtherEngines) {
+    std::vector<std::unique_ptr<Afina::Storage>> storages;
+    storages.emplace_back(new StripedLockImpl(4096, 4));
+    storages.emplace_back(new ClockRWLockImpl(4096));
+    storages.emplace_back(new SlabImpl(2 * 65536, 65536));
+    storages.emplace_back(anonymous_arena(2));
+    storages.emplace_back(new CuckooImpl(2 * 65536, 65536));
+    storages.emplace_back(new SkipListImpl(4096));
+    storages.emplace_back(new LogStructuredImpl(4 * 16384, 16384));
+
+    for (auto &storage : storages) {
+        std::vector<ValueRef> values;
+        std::vector<uint64_t> versions;
+        EXPECT_TRUE(storage->Cas("KEY1", "val", 1, 0) == Storage::CasResult::NotFound);
+        EXPECT_TRUE(storage->Put("KEY1", "1"));
+        EXPECT_TRUE(storage->Put("KEY2", "2"));
+        EXPECT_EQ(2, storage->Gets({"KEY1", "KEY2", "KEY3"}, values, versions));
+        EXPECT_EQ("2", values[1].str());
+        EXPECT_EQ(0, versions[2]);
+
+        uint64_t result;
+        EXPECT_TRUE(storage->Increment("KEY1", 1, result));
+        EXPECT_TRUE(storage->Cas("KEY1", "x", versions[0], 0) == Storage::CasResult::Exists);
+        storage->Gets({"KEY1"}, values, versions);
+        EXPECT_EQ("2", values[0].str());
+
+        // Slab item has to move into larger chunk
+        EXPECT_TRUE(storage->Cas("KEY1", std::string(1000, 'x'), versions[0], 0) == Storage::CasResult::Stored);
+        EXPECT_TRUE(storage->Cas("KEY1", "y", versions[0], 0) == Storage::CasResult::Exists);
+        storage->Gets({"KEY1"}, values, versions);
+        EXPECT_EQ(std::string(1000, 'x'), values[0].str());
+    }
+}
+
+// Writers read-modify-write the same key with gets/cas retry loop, counter values written by incr go in between
+TEST(CasTest, ConcurrentRetry) {
+    std::vector<std::unique_ptr<Afina::Storage>> storages;
+    storages.emplace_back(new FlatHashImpl(4096));
+    storages.emplace_back(new ClockRWLockImpl(4096));
+    storages.emplace_back(new SlabImpl(65536, 65536));
+    storages.emplace_back(anonymous_arena(1));
+    storages.emplace_back(new CuckooImpl(65536, 65536));
+    storages.emplace_back(new SkipListImpl(4096));
+    storages.emplace_back(new LogStructuredImpl(4 * 16384, 16384));
+
+    for (auto &storage : storages) {
+        EXPECT_TRUE(storage->Put("KEY", "0"));
+
+        std::vector<std::thread> workers;
+        for (int t = 0; t < 4; t++) {
+            workers.emplace_back([&storage, t]() {
+                std::vector<ValueRef> values;
+                std::vector<uint64_t> versions;
+                uint64_t result;
+                for (int i = 0; i < 2000; i++) {
+                    if (t == 0) {
+                        storage->Increment("KEY", 1, result);
+                        continue;
+                    }
+                    do {
+                        storage->Gets({"KEY"}, values, versions);
+                    } while (storage->Cas("KEY", std::to_string(std::stoull(values[0].str()) + 1), versions[0], 0) !=
+                             Storage::CasResult::Stored);
+                }
+            });
+        }
+        for (auto &w : workers) {
+            w.join();
+        }
+
+        // No update is lost
+        std::string value;
+        EXPECT_TRUE(storage->Get("KEY", value));
+        EXPECT_EQ("8000", value);
+    }
+}
+
+// Bulk insert of the engines that are not covered by typed tests
+TEST(LoadTest, OtherEngines) {
+    std::vector<std::unique_ptr<Afina::Storage>> storages;
+    storages.emplace_back(new StripedLockImpl(4096, 4));
+    storages.emplace_back(new ClockRWLockImpl(4096));
+    storages.emplace_back(new SlabImpl(4 * 65536, 65536));
+    storages.emplace_back(anonymous_arena(4));
+    storages.emplace_back(new CuckooImpl(4 * 65536, 65536));
+    storages.emplace_back(new SkipListImpl(4096));
+    storages.emplace_back(new LogStructuredImpl(4 * 16384, 16384));
+
+    for (auto &storage : storages) {
+        EXPECT_TRUE(storage->Put("KEY2", "old"));
+        std::vector<std::string> keys, values;
+        for (long i = 0; i < 20; ++i) {
+            keys.push_back("KEY" + std::to_string(i));
+            values.push_back("val" + std::to_string(i));
+        }
+        EXPECT_EQ(19, storage->Load(keys, values, std::vector<time_t>(keys.size(), 0)));
+
+        std::string value;
+        EXPECT_TRUE(storage->Get("KEY2", value));
+        EXPECT_EQ("old", value);
+        EXPECT_TRUE(storage->Get("KEY19", value));
+        EXPECT_EQ("val19", value);
+    }
+}
+
+// Batch lookup of the engines that are not covered by typed tests
+TEST(GetManyTest, OtherEngines) {
+    std::vector<std::unique_ptr<Afina::Storage>> storages;
+    storages.emplace_back(new StripedLockImpl(4096, 4));
+    storages.emplace_back(new ClockRWLockImpl(4096));
+    storages.emplace_back(new SlabImpl(65536, 65536));
+    storages.emplace_back(anonymous_arena(1));
+    storages.emplace_back(new CuckooImpl(65536, 65536));
+    storages.emplace_back(new SkipListImpl(4096));
+    storages.emplace_back(new LogStructuredImpl(4 * 16384, 16384));
+
+    std::vector<std::string> keys = {"KEY1", "KEY2", "KEY3", "KEY4", "KEY5", "KEY6"};
+    for (auto &storage : storages) {
+        for (size_t i = 0; i < keys.size(); i += 2) {
+            EXPECT_TRUE(storage->Put(keys[i], "val" + std::to_string(i)));
+        }
+
+        std::vector<ValueRef> values;
+        EXPECT_EQ(3, storage->GetMany(keys, values));
+        for (size_t i = 0; i < keys.size(); i++) {
+            EXPECT_EQ(i % 2 == 0, values[i].valid());
+            if (i % 2 == 0) {
+                EXPECT_EQ("val" + std::to_string(i), values[i].str());
+            }
+        }
+    }
+}
+
+// Append and prepend of the engines that are not covered by typed tests
+TEST(AppendTest, OtherEngines) {
+    std::vector<std::unique_ptr<Afina::Storage>> storages;
+    storages.emplace_back(new StripedLockImpl(4096, 4));
+    storages.emplace_back(new ClockRWLockImpl(4096));
+    storages.emplace_back(new SlabImpl(3 * 65536, 65536));
+    storages.emplace_back(anonymous_arena(3));
+    storages.emplace_back(new CuckooImpl(3 * 65536, 65536));
+    storages.emplace_back(new SkipListImpl(4096));
+    storages.emplace_back(new LogStructuredImpl(4 * 16384, 16384));
+
+    for (auto &storage : storages) {
+        EXPECT_FALSE(storage->Append("KEY1", "x"));
+        EXPECT_TRUE(storage->Put("KEY1", "val"));
+        EXPECT_TRUE(storage->Append("KEY1", "ue"));
+        EXPECT_TRUE(storage->Prepend("KEY1", "my "));
+
+        // Slab item has to move into larger chunk
+        EXPECT_TRUE(storage->Append("KEY1", std::string(1000, '!')));
+
+        std::string value;
+        EXPECT_TRUE(storage->Get("KEY1", value));
+        EXPECT_EQ("my value" + std::string(1000, '!'), value);
+    }
+}
+
+// Runs scan to the end, calling between after each batch
+static std::multiset<std::string> scan_all(const Afina::Storage &storage, size_t count,
+                                           const std::function<void()> &between = []() {}) {
+    std::multiset<std::string> seen;
+    std::string cursor = "0";
+    do {
+        std::vector<std::string> keys;
+        EXPECT_TRUE(storage.Scan(cursor, count, keys));
+        seen.insert(keys.begin(), keys.end());
+        between();
+    } while (cursor != "0");
+    return seen;
+}
+
+TEST(ScanTest, AllEngines) {
+    std::vector<std::unique_ptr<Afina::Storage>> storages;
+    storages.emplace_back(new MapBasedGlobalLockImpl(1 << 20));
+    storages.emplace_back(new StripedLockImpl(1 << 20, 4));
+    storages.emplace_back(new FlatHashImpl(1 << 20));
+    storages.emplace_back(new ArtImpl(1 << 20));
+    storages.emplace_back(new SkipListImpl(1 << 20));
+    storages.emplace_back(new LogStructuredImpl(4 * 16384, 16384));
+    storages.emplace_back(new ClockRWLockImpl(1 << 20));
+    storages.emplace_back(new SlabImpl(4 * 65536, 65536));
+    storages.emplace_back(anonymous_arena(4));
+
+    for (auto &storage : storages) {
+        std::set<std::string> expected;
+        for (int i = 0; i < 300; i++) {
+            EXPECT_TRUE(storage->Put("KEY" + std::to_string(i), "v"));
+            expected.insert("KEY" + std::to_string(i));
+        }
+
+        std::multiset<std::string> seen = scan_all(*storage, 7);
+        EXPECT_EQ(expected, std::set<std::string>(seen.begin(), seen.end()));
+        EXPECT_EQ(300, seen.size());
+
+        std::string cursor = "x";
+        std::vector<std::string> keys;
+        EXPECT_THROW(storage->Scan(cursor, 10, keys), std::invalid_argument);
+    }
+}
+
+// Keys present for the whole scan are returned even though table grows and gets rehashed in place meanwhile
+TEST(ScanTest, TableChanges) {
+    FlatHashImpl storage(1 << 24);
+    std::set<std::string> expected;
+    for (int i = 0; i < 1000; i++) {
+        storage.Put("KEY" + std::to_string(i), "v");
+        expected.insert("KEY" + std::to_string(i));
+    }
+
+    int next = 0;
+    std::multiset<std::string> seen = scan_all(storage, 10, [&storage, &next]() {
+        for (int i = 0; i < 300; i++, next++) {
+            storage.Put("NEW" + std::to_string(next), "v");
+            if (next % 3 != 0) {
+                storage.Delete("NEW" + std::to_string(next));
+            }
+        }
+    });
+
+    for (auto &key : expected) {
+        EXPECT_GT(seen.count(key), 0) << key;
+    }
+}
+
+// Every eviction policy flat_hash could be built with
+class EvictionPolicyTest : public ::testing::TestWithParam<std::string> {};
+INSTANTIATE_TEST_CASE_P(Policies, EvictionPolicyTest, ::testing::Values("lru", "slru", "arc", "tinylfu"));
+
+TEST_P(EvictionPolicyTest, Consistent) {
+    const size_t length = 20;
+    FlatHashImpl storage(100 * 2 * length, GetParam());
+
+    // Whatever policy evicts, storage must never return stale values or keys deleted
+    std::map<std::string, std::string> expected;
+    std::string res;
+    for (long i = 0; i < 20000; ++i) {
+        auto key = pad_space("Key " + std::to_string(i * 7919 % 300), length);
+        if (i % 3 == 0) {
+            auto val = std::string(i % 2 == 0 ? length : 2 * length, char('a' + i % 26));
+            EXPECT_TRUE(storage.Put(key, val));
+            expected[key] = val;
+        } else if (i % 17 == 0) {
+            storage.Delete(key);
+            expected.erase(key);
+        } else if (storage.Get(key, res)) {
+            EXPECT_EQ(expected[key], res);
+        }
+    }
+
+    size_t found = 0, size = 0;
+    for (long i = 0; i < 300; ++i) {
+        auto key = pad_space("Key " + std::to_string(i), length);
+        if (storage.Get(key, res)) {
+            EXPECT_EQ(expected[key], res);
+            found++;
+            size += key.size() + res.size();
+        }
+    }
+    EXPECT_LE(size, 100 * 2 * length);
+    EXPECT_GE(found, 60);
+}
+
+TEST_P(EvictionPolicyTest, ScanResistant) {
+    const size_t length = 20;
+    FlatHashImpl storage(100 * 2 * length, GetParam());
+
+    // Hot set is a third of the cache, each key is accessed a few times
+    std::string res;
+    for (int round = 0; round < 4; round++) {
+        for (long i = 0; i < 30; ++i) {
+            auto key = pad_space("Hot " + std::to_string(i), length);
+            if (!storage.Get(key, res)) {
+                storage.Put(key, pad_space("Val " + std::to_string(i), length));
+            }
+        }
+    }
+
+    // Scan twice as large as the cache
+    for (long i = 0; i < 200; ++i) {
+        storage.Put(pad_space("Cold " + std::to_string(i), length), pad_space("Val", length));
+    }
+
+    size_t found = 0;
+    for (long i = 0; i < 30; ++i) {
+        found += storage.Get(pad_space("Hot " + std::to_string(i), length), res) ? 1 : 0;
+    }
+    if (GetParam() == "lru") {
+        EXPECT_EQ(0, found);
+    } else {
+        EXPECT_EQ(30, found);
+    }
+}
+
+TEST(EvictionPolicyTest, Unknown) { EXPECT_THROW(FlatHashImpl(1024, "mru"), std::invalid_argument); }
+
+TEST(StripedStorageTest, PutGetDelete) {
+    StripedLockImpl storage(1024, 4);
+
+    EXPECT_TRUE(storage.Put("KEY1", "val1"));
+    EXPECT_TRUE(storage.Put("KEY2", "val2"));
+    EXPECT_FALSE(storage.PutIfAbsent("KEY1", "val3"));
+    EXPECT_TRUE(storage.Set("KEY2", "val4"));
+    EXPECT_FALSE(storage.Set("KEY3", "val5"));
+
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("val1", value);
+    EXPECT_TRUE(storage.Get("KEY2", value));
+    EXPECT_EQ("val4", value);
+
+    EXPECT_TRUE(storage.Delete("KEY1"));
+    EXPECT_FALSE(storage.Delete("KEY1"));
+    EXPECT_FALSE(storage.Get("KEY1", value));
+}
+
+TEST(StripedStorageTest, BigTest) {
+    const size_t length = 20;
+    const size_t shards = 8;
+    // Give each shard enough room for any skew in key distribution
+    StripedLockImpl storage(shards * 2 * 10000 * length, shards);
+
+    for (long i = 0; i < 10000; ++i) {
+        auto key = pad_space("Key " + std::to_string(i), length);
+        auto val = pad_space("Val " + std::to_string(i), length);
+        EXPECT_TRUE(storage.Put(key, val));
+    }
+
+    for (long i = 9999; i >= 0; --i) {
+        auto key = pad_space("Key " + std::to_string(i), length);
+        auto val = pad_space("Val " + std::to_string(i), length);
+
+        std::string res;
+        EXPECT_TRUE(storage.Get(key, res));
+        EXPECT_EQ(val, res);
+    }
+}
+
+TEST(StripedStorageTest, ShardBudget) {
+    const size_t length = 20;
+    const size_t shards = 4;
+    StripedLockImpl storage(shards * 2 * length, shards);
+
+    // Each shard fits exactly one entry, so the total can never exceed number of shards
+    for (long i = 0; i < 100; ++i) {
+        auto key = pad_space("Key " + std::to_string(i), length);
+        auto val = pad_space("Val " + std::to_string(i), length);
+        EXPECT_TRUE(storage.Put(key, val));
+    }
+
+    size_t found = 0;
+    for (long i = 0; i < 100; ++i) {
+        auto key = pad_space("Key " + std::to_string(i), length);
+        std::string res;
+        found += storage.Get(key, res) ? 1 : 0;
+    }
+    EXPECT_GE(shards, found);
+    EXPECT_LT(0, found);
+
+    // Entry larger than a shard budget doesn't fit even if total budget allows it
+    EXPECT_FALSE(storage.Put("big", std::string(3 * length, 'x')));
+}
+
+TEST(StripedStorageTest, Concurrent) {
+    const size_t threads = 4;
+    const size_t per_thread = 2000;
+    StripedLockImpl storage(1024 * 1024, 16);
+
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&storage, t]() {
+            for (size_t i = 0; i < per_thread; i++) {
+                auto key = "Key " + std::to_string(t) + ":" + std::to_string(i);
+                storage.Put(key, "Val " + std::to_string(i));
+
+                std::string res;
+                storage.Get(key, res);
+            }
+        });
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+
+    for (size_t t = 0; t < threads; t++) {
+        for (size_t i = 0; i < per_thread; i++) {
+            std::string res;
+            ASSERT_TRUE(storage.Get("Key " + std::to_string(t) + ":" + std::to_string(i), res));
+            EXPECT_EQ("Val " + std::to_string(i), res);
+        }
+    }
+}
+
+TEST(ClockStorageTest, PutGetDelete) {
+    ClockRWLockImpl storage;
+
+    EXPECT_TRUE(storage.Put("KEY1", "val1"));
+    EXPECT_TRUE(storage.Put("KEY2", "val2"));
+    EXPECT_FALSE(storage.PutIfAbsent("KEY1", "val3"));
+    EXPECT_TRUE(storage.Set("KEY2", "val4"));
+    EXPECT_FALSE(storage.Set("KEY3", "val5"));
+
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("val1", value);
+    EXPECT_TRUE(storage.Get("KEY2", value));
+    EXPECT_EQ("val4", value);
+
+    EXPECT_TRUE(storage.Delete("KEY1"));
+    EXPECT_FALSE(storage.Delete("KEY1"));
+    EXPECT_FALSE(storage.Get("KEY1", value));
+}
+
+TEST(ClockStorageTest, ReferencedSurvive) {
+    const size_t length = 20;
+    ClockRWLockImpl storage(2 * 100 * length);
+
+    for (long i = 0; i < 100; ++i) {
+        storage.Put(pad_space("Key " + std::to_string(i), length), pad_space("Val " + std::to_string(i), length));
+    }
+
+    // Touch every even key, then push another 10 entries in. Hand meets enough entries with clear reference
+    // bit long before it comes back to any even key, so all of them must survive
+    std::string res;
+    for (long i = 0; i < 100; i += 2) {
+        EXPECT_TRUE(storage.Get(pad_space("Key " + std::to_string(i), length), res));
+    }
+    for (long i = 100; i < 110; ++i) {
+        auto key = pad_space("Key " + std::to_string(i), length);
+        EXPECT_TRUE(storage.Put(key, pad_space("Val " + std::to_string(i), length)));
+    }
+
+    size_t found = 0;
+    for (long i = 0; i < 110; ++i) {
+        bool exists = storage.Get(pad_space("Key " + std::to_string(i), length), res);
+        if (i % 2 == 0 && i < 100) {
+            EXPECT_TRUE(exists);
+            EXPECT_EQ(pad_space("Val " + std::to_string(i), length), res);
+        }
+        found += exists ? 1 : 0;
+    }
+    EXPECT_EQ(100, found);
+}
+
+TEST(ClockStorageTest, ConcurrentReaders) {
+    const size_t length = 20;
+    const size_t keys = 1000;
+    ClockRWLockImpl storage(2 * keys * length);
+
+    for (size_t i = 0; i < keys; ++i) {
+        storage.Put(pad_space("Key " + std::to_string(i), length), pad_space("Val " + std::to_string(i), length));
+    }
+
+    std::atomic<size_t> errors(0);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < 4; t++) {
+        workers.emplace_back([&storage, &errors, t]() {
+            std::string res;
+            for (size_t i = 0; i < 20000; i++) {
+                size_t k = (i * 7 + t) % keys;
+                auto key = pad_space("Key " + std::to_string(k), length);
+                if (i % 10 == 0) {
+                    // Writer rewrites key with the same value, so readers always see an expected one
+                    storage.Put(key, pad_space("Val " + std::to_string(k), length));
+                } else if (!storage.Get(key, res) || res != pad_space("Val " + std::to_string(k), length)) {
+                    errors++;
+                }
+            }
+        });
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+    EXPECT_EQ(0, errors.load());
+}
+
+// Looks metric up in the list returned by GetStats
+static std::string stat(const Afina::Storage &storage, const std::string &name) {
+    std::vector<std::pair<std::string, std::string>> stats;
+    storage.GetStats(stats);
+    for (auto &s : stats) {
+        if (s.first == name) {
+            return s.second;
+        }
+    }
+    return "";
+}
+
+TEST(SlabStorageTest, PutGetDelete) {
+    SlabImpl storage(2 * 65536, 65536);
+
+    EXPECT_TRUE(storage.Put("KEY1", "val1"));
+    EXPECT_TRUE(storage.Put("KEY2", "val2"));
+    EXPECT_FALSE(storage.PutIfAbsent("KEY1", "val3"));
+    EXPECT_TRUE(storage.Set("KEY2", "val4"));
+    EXPECT_FALSE(storage.Set("KEY3", "val5"));
+
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("val1", value);
+    EXPECT_TRUE(storage.Get("KEY2", value));
+    EXPECT_EQ("val4", value);
+
+    // Value grows out of its chunk and moves to another class
+    std::string big(5000, 'b');
+    EXPECT_TRUE(storage.Put("KEY2", big));
+    EXPECT_TRUE(storage.Get("KEY2", value));
+    EXPECT_EQ(big, value);
+
+    EXPECT_TRUE(storage.Delete("KEY1"));
+    EXPECT_FALSE(storage.Delete("KEY1"));
+    EXPECT_FALSE(storage.Get("KEY1", value));
+
+    // Doesn't fit a page
+    EXPECT_FALSE(storage.Put("KEY4", std::string(65536, 'x')));
+    EXPECT_EQ("1", stat(storage, "curr_items"));
+}
+
+TEST(SlabStorageTest, PerClassEviction) {
+    // Two pages: the first one goes to small items, the second one to large items
+    SlabImpl storage(2 * 65536, 65536);
+
+    // Keys differ in length, value is long enough for all of them to share one class
+    for (long i = 0; i < 500; ++i) {
+        EXPECT_TRUE(storage.Put("Small " + std::to_string(i), "value"));
+    }
+    std::string large(1000, 'l');
+    for (long i = 0; i < 200; ++i) {
+        EXPECT_TRUE(storage.Put("Large " + std::to_string(i), large));
+    }
+
+    // Large items only evict each other, small ones are all there
+    std::string res;
+    for (long i = 0; i < 500; ++i) {
+        EXPECT_TRUE(storage.Get("Small " + std::to_string(i), res));
+    }
+    EXPECT_TRUE(storage.Get("Large 199", res));
+    EXPECT_FALSE(storage.Get("Large 0", res));
+
+    // Large class doesn't take small chunks neither, so the second page is the only one it has
+    EXPECT_EQ("0", stat(storage, "free_pages"));
+    EXPECT_NE("0", stat(storage, "evictions"));
+
+    size_t small_class = 0, large_class = 0;
+    std::vector<std::pair<std::string, std::string>> stats;
+    storage.GetStats(stats);
+    for (auto &s : stats) {
+        if (s.first.find(":total_pages") != std::string::npos) {
+            EXPECT_EQ("1", s.second);
+            std::string evictions = stat(storage, s.first.substr(0, s.first.find(':')) + ":evictions");
+            (evictions == "0" ? small_class : large_class)++;
+        }
+    }
+    EXPECT_EQ(1, small_class);
+    EXPECT_EQ(1, large_class);
+}
+
+TEST(SlabStorageTest, UpdateDoesntEvictItself) {
+    // Single page holding the item itself, so the large class can't get any memory
+    SlabImpl storage(65536, 65536);
+
+    EXPECT_TRUE(storage.Put("KEY1", "val1"));
+    EXPECT_FALSE(storage.Put("KEY1", std::string(1000, 'x')));
+
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("val1", value);
+}
+
+TEST(SlabStorageTest, PageReassign) {
+    SlabImpl storage(4 * 65536, 65536);
+
+    // Small items take all pages
+    std::string small(100, 's');
+    for (long i = 0; i < 5000; ++i) {
+        EXPECT_TRUE(storage.Put("Small " + std::to_string(i), small));
+    }
+    EXPECT_EQ("0", stat(storage, "free_pages"));
+    size_t before = std::stoul(stat(storage, "curr_items"));
+
+    // Large class gets the page of the oldest small item, small items of the other three pages stay
+    std::string large(10000, 'l');
+    EXPECT_TRUE(storage.Put("Large", large));
+    EXPECT_EQ("1", stat(storage, "slabs_moved"));
+
+    std::string res;
+    EXPECT_TRUE(storage.Get("Large", res));
+    EXPECT_EQ(large, res);
+    size_t after = 0;
+    for (long i = 0; i < 5000; ++i) {
+        if (storage.Get("Small " + std::to_string(i), res)) {
+            EXPECT_EQ(small, res);
+            after++;
+        }
+    }
+    EXPECT_EQ(before * 3 / 4, after);
+
+    // Next large items fit the same page
+    EXPECT_TRUE(storage.Put("Large 2", large));
+    EXPECT_EQ("1", stat(storage, "slabs_moved"));
+}
+
+// Room reserved for appends counts against the limit, value that shrinks a lot gives it back
+TEST(FlatHashStorageTest, AppendSlack) {
+    FlatHashImpl storage(1000);
+    EXPECT_TRUE(storage.Put("A", std::string(100, 'a')));
+    EXPECT_TRUE(storage.Append("A", "b"));
+    EXPECT_EQ("102", stat(storage, "bytes"));
+    EXPECT_EQ("101", stat(storage, "slack_bytes"));
+
+    // Would fit without the slack
+    EXPECT_TRUE(storage.Put("B", std::string(800, 'b')));
+    EXPECT_EQ("1", stat(storage, "evictions"));
+    EXPECT_EQ("0", stat(storage, "slack_bytes"));
+
+    EXPECT_TRUE(storage.Delete("B"));
+    EXPECT_TRUE(storage.Put("A", std::string(100, 'a')));
+    EXPECT_TRUE(storage.Append("A", "b"));
+    EXPECT_TRUE(storage.Set("A", "x"));
+    EXPECT_EQ("0", stat(storage, "slack_bytes"));
+
+    std::string value;
+    EXPECT_TRUE(storage.Get("A", value));
+    EXPECT_EQ("x", value);
+}
+
+// Metrics of the shards add up
+TEST(StripedStorageTest, Stats) {
+    const size_t shards = 4;
+    StripedLockImpl storage(shards * 1000, shards);
+    EXPECT_EQ("4", stat(storage, "shards"));
+    EXPECT_EQ("4000", stat(storage, "limit_maxbytes"));
+
+    for (long i = 0; i < 10; ++i) {
+        EXPECT_TRUE(storage.Put("Key" + std::to_string(i), "val"));
+    }
+    std::string value;
+    for (long i = 0; i < 20; ++i) {
+        storage.Get("Key" + std::to_string(i), value);
+    }
+    EXPECT_EQ("10", stat(storage, "curr_items"));
+    EXPECT_EQ("70", stat(storage, "bytes"));
+    EXPECT_EQ("10", stat(storage, "get_hits"));
+    EXPECT_EQ("0", stat(storage, "compressed_hit_percent"));
+
+    // Each shard holds 1000 bytes, so most of these push out something
+    for (long i = 0; i < 100; ++i) {
+        EXPECT_TRUE(storage.Put("Big" + std::to_string(i), std::string(500, 'x')));
+    }
+    size_t items = std::stoul(stat(storage, "curr_items"));
+    EXPECT_GE(2 * shards, items);
+    EXPECT_EQ(110 - items, std::stoul(stat(storage, "evictions")));
+}
+
+TEST(ClockStorageTest, Stats) {
+    const size_t length = 20;
+    ClockRWLockImpl storage(2 * 100 * length);
+    for (long i = 0; i < 110; ++i) {
+        storage.Put(pad_space("Key " + std::to_string(i), length), pad_space("Val " + std::to_string(i), length));
+    }
+    EXPECT_EQ("100", stat(storage, "curr_items"));
+    EXPECT_EQ("4000", stat(storage, "bytes"));
+    EXPECT_EQ("4000", stat(storage, "limit_maxbytes"));
+    EXPECT_EQ("10", stat(storage, "evictions"));
+}
+
+// Expired entries are invisible right away and removed by the writer that comes across them
+TEST(MapStorageTest, Expiration) {
+    std::vector<std::unique_ptr<Afina::Storage>> storages;
+    storages.emplace_back(new MapBasedGlobalLockImpl(1 << 20));
+    storages.emplace_back(new StripedLockImpl(1 << 20, 4));
+    time_t now = time(nullptr);
+
+    for (auto &storage : storages) {
+        EXPECT_TRUE(storage->SupportsExpiration());
+        EXPECT_TRUE(storage->Put("KEY1", "val1", now - 1));
+        EXPECT_TRUE(storage->Put("KEY2", "val2", now + 3600));
+        EXPECT_TRUE(storage->Put("KEY3", "val3"));
+
+        std::string value;
+        std::vector<ValueRef> values;
+        EXPECT_FALSE(storage->Get("KEY1", value));
+        EXPECT_EQ(2, storage->GetMany({"KEY1", "KEY2", "KEY3"}, values));
+        EXPECT_FALSE(storage->Append("KEY1", "!"));
+        EXPECT_TRUE(storage->PutIfAbsent("KEY1", "val4"));
+        EXPECT_TRUE(storage->Get("KEY1", value));
+        EXPECT_EQ("val4", value);
+
+        // Append keeps expiration, set replaces it
+        EXPECT_TRUE(storage->Append("KEY2", "!"));
+        EXPECT_TRUE(storage->Set("KEY3", "val5", now - 1));
+        EXPECT_FALSE(storage->Delete("KEY3"));
+        EXPECT_EQ(1, storage->Load({"KEY5", "KEY6"}, {"val6", "val7"}, {now - 1, now + 60}));
+
+        std::map<std::string, std::pair<std::string, time_t>> items;
+        storage->ForEach([&items](const std::string &key, const std::string &value, time_t expire_at) {
+            items[key] = std::make_pair(value, expire_at);
+        });
+        EXPECT_EQ(3, items.size());
+        EXPECT_EQ(std::make_pair(std::string("val2!"), now + 3600), items["KEY2"]);
+        EXPECT_EQ(std::make_pair(std::string("val7"), now + 60), items["KEY6"]);
+        EXPECT_EQ(0, items["KEY1"].second);
+    }
+    EXPECT_EQ("2", stat(*storages[0], "reclaimed"));
+}
+
+// Hits are applied to the list in batch by the next writer, entry hit recently is not promoted again
+TEST(MapStorageTest, BumpInterval) {
+    for (uint32_t interval : {0u, 60000u}) {
+        MapBasedGlobalLockImpl storage(3 * 8, interval);
+        storage.Put("KEY1", "val1");
+        storage.Put("KEY2", "val2");
+        storage.Put("KEY3", "val3");
+
+        std::string value;
+        EXPECT_TRUE(storage.Get("KEY1", value));
+        EXPECT_TRUE(storage.Get("KEY2", value));
+        EXPECT_TRUE(storage.Get("KEY1", value));
+        storage.Put("KEY4", "val4");
+        EXPECT_FALSE(storage.Get("KEY3", value));
+
+        // Without interval KEY1 has been promoted twice and is the most recent one
+        storage.Put("KEY5", "val5");
+        EXPECT_EQ(interval == 0 ? "3" : "2", stat(storage, "lru_bumps"));
+        EXPECT_EQ(interval == 0, storage.Get("KEY1", value));
+        EXPECT_EQ(interval != 0, storage.Get("KEY2", value));
+    }
+}
+
+// Readers record hits concurrently with writers evicting and deleting entries
+TEST(MapStorageTest, ConcurrentBumps) {
+    MapBasedGlobalLockImpl storage(100 * 12, 0);
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> hits(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 8; t++) {
+        readers.emplace_back([&storage, &stop, &hits, t]() {
+            std::string value;
+            for (int i = 0; !stop.load(); i++) {
+                if (storage.Get("KEY" + std::to_string((i * 7 + t) % 200), value)) {
+                    hits++;
+                }
+            }
+        });
+    }
+
+    for (int i = 0; i < 20000 || hits.load() < 10000; i++) {
+        storage.Put("KEY" + std::to_string(i % 200), "value");
+        if (i % 3 == 0) {
+            storage.Delete("KEY" + std::to_string((i + 100) % 200));
+        }
+    }
+    stop.store(true);
+    for (auto &r : readers) {
+        r.join();
+    }
+    EXPECT_NE("0", stat(storage, "lru_bumps"));
+}
+
+// Waits until maintenance thread gets storage back under its headroom
+static bool wait_bytes(const Afina::Storage &storage, size_t bytes) {
+    for (int i = 0; i < 500; i++) {
+        if (std::stoul(stat(storage, "bytes")) <= bytes) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+TEST(MapStorageTest, BackgroundEviction) {
+    MapBasedGlobalLockImpl storage(1000, 100, 300);
+    storage.Start();
+
+    // Each entry takes 100 bytes, last one crosses headroom but still fits
+    std::string value(96, 'v');
+    for (int i = 0; i < 8; i++) {
+        EXPECT_TRUE(storage.Put("KEY" + std::to_string(i), value));
+    }
+    ASSERT_TRUE(wait_bytes(storage, 700));
+    EXPECT_EQ("1", stat(storage, "evictions"));
+
+    std::string out;
+    EXPECT_FALSE(storage.Get("KEY0", out));
+    EXPECT_TRUE(storage.Get("KEY7", out));
+
+    EXPECT_TRUE(storage.Put("KEY8", value));
+    EXPECT_TRUE(storage.Put("KEY9", value));
+    ASSERT_TRUE(wait_bytes(storage, 700));
+    EXPECT_EQ("3", stat(storage, "evictions"));
+    EXPECT_EQ("0", stat(storage, "foreground_evictions"));
+    storage.Stop();
+
+    // Without maintenance thread writer frees space by itself
+    EXPECT_TRUE(storage.Put("KEY10", std::string(495, 'v')));
+    EXPECT_EQ("2", stat(storage, "foreground_evictions"));
+    EXPECT_TRUE(storage.Get("KEY7", out));
+}
+
+// JSON array of alike records, compresses several times the way typical cached documents do
+static std::string json_document(int i) {
+    std::string value = "[";
+    for (int r = 0; r < 8; r++) {
+        value += "{\"id\":" + std::to_string(i * 8 + r) + ",\"name\":\"user" + std::to_string(i) +
+                 "\",\"active\":true,\"roles\":[\"reader\",\"writer\"]},";
+    }
+    value.back() = ']';
+    return value;
+}
+
+TEST(MapStorageTest, ColdCompression) {
+    const size_t item_size = 6 + json_document(299).size();
+    MapBasedGlobalLockImpl storage(100 * item_size, 0, 0, 10 * item_size);
+
+    // Twice as many entries as fit uncompressed, all but the most recent ten get compressed
+    for (int i = 100; i < 300; i++) {
+        EXPECT_TRUE(storage.Put("KEY" + std::to_string(i), json_document(i)));
+    }
+    EXPECT_EQ("0", stat(storage, "evictions"));
+    EXPECT_EQ("190", stat(storage, "compressed_items"));
+    EXPECT_GT(40, std::stoi(stat(storage, "compressed_percent")));
+    EXPECT_GE(100 * item_size, std::stoul(stat(storage, "bytes")));
+
+    // Cold entry is decompressed for the reader and stored uncompressed once promoted
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY100", value));
+    EXPECT_EQ(json_document(100), value);
+    EXPECT_EQ("1", stat(storage, "compressed_hits"));
+    EXPECT_TRUE(storage.Get("KEY100", value));
+    EXPECT_EQ(json_document(100), value);
+    EXPECT_EQ("1", stat(storage, "compressed_hits"));
+    EXPECT_EQ("50", stat(storage, "compressed_hit_percent"));
+    EXPECT_EQ("190", stat(storage, "compressed_items"));
+
+    EXPECT_TRUE(storage.Append("KEY101", "!"));
+    EXPECT_TRUE(storage.Get("KEY101", value));
+    EXPECT_EQ(json_document(101) + "!", value);
+    EXPECT_TRUE(storage.Put("short", "value"));
+
+    // Evicted and deleted entries leave nothing behind in the accounting
+    for (int i = 300; i < 1000; i++) {
+        EXPECT_TRUE(storage.Put("KEY" + std::to_string(i), json_document(i)));
+    }
+    EXPECT_NE("0", stat(storage, "evictions"));
+    EXPECT_TRUE(storage.Get("KEY999", value));
+    EXPECT_EQ(json_document(999), value);
+
+    for (auto &key : scan_all(storage, 100)) {
+        EXPECT_TRUE(storage.Delete(key));
+    }
+    EXPECT_EQ("0", stat(storage, "bytes"));
+    EXPECT_EQ("0", stat(storage, "compressed_items"));
+    EXPECT_EQ("0", stat(storage, "compressed_raw_bytes"));
+    EXPECT_EQ("0", stat(storage, "compressed_bytes"));
+}
+
+TEST(CuckooStorageTest, PutGetDelete) {
+    CuckooImpl storage(4 * 65536, 65536);
+    EXPECT_TRUE(storage.Put("KEY1", "val1"));
+    EXPECT_TRUE(storage.Put("KEY2", "val2"));
+    EXPECT_FALSE(storage.PutIfAbsent("KEY1", "val3"));
+    EXPECT_FALSE(storage.Set("KEY3", "val3"));
+    EXPECT_TRUE(storage.Set("KEY2", "value2"));
+
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("val1", value);
+    EXPECT_TRUE(storage.Get("KEY2", value));
+    EXPECT_EQ("value2", value);
+
+    EXPECT_TRUE(storage.Delete("KEY1"));
+    EXPECT_FALSE(storage.Delete("KEY1"));
+    EXPECT_FALSE(storage.Get("KEY1", value));
+    EXPECT_TRUE(storage.PutIfAbsent("KEY1", "val3"));
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("val3", value);
+    EXPECT_EQ("2", stat(storage, "curr_items"));
+
+    std::string cursor = "0";
+    std::vector<std::string> keys;
+    EXPECT_FALSE(storage.Scan(cursor, 10, keys));
+}
+
+// Table of 2048 slots filled up to 85% needs cuckoo moves, but doesn't lose anything
+TEST(CuckooStorageTest, Displacement) {
+    CuckooImpl storage(4 * 65536, 65536);
+    ASSERT_EQ("2048", stat(storage, "table_slots"));
+
+    for (int i = 0; i < 1740; i++) {
+        EXPECT_TRUE(storage.Put("KEY" + std::to_string(i), "val" + std::to_string(i)));
+    }
+    EXPECT_EQ("1740", stat(storage, "curr_items"));
+    EXPECT_EQ("0", stat(storage, "table_evictions"));
+    EXPECT_EQ("0", stat(storage, "evictions"));
+    EXPECT_NE("0", stat(storage, "displacements"));
+
+    std::string value;
+    for (int i = 0; i < 1740; i++) {
+        ASSERT_TRUE(storage.Get("KEY" + std::to_string(i), value));
+        EXPECT_EQ("val" + std::to_string(i), value);
+    }
+}
+
+// Table never grows, once it is full new keys take place of the old ones
+TEST(CuckooStorageTest, TableFull) {
+    CuckooImpl storage(4 * 65536, 65536);
+    for (int i = 0; i < 3000; i++) {
+        EXPECT_TRUE(storage.Put("KEY" + std::to_string(i), "v"));
+    }
+    EXPECT_NE("0", stat(storage, "table_evictions"));
+    EXPECT_GE(2048, std::stoi(stat(storage, "curr_items")));
+
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY2999", value));
+}
+
+// Once slab runs out of chunks, the oldest written items go first, reads don't matter
+TEST(CuckooStorageTest, Eviction) {
+    CuckooImpl storage(2 * 65536, 65536);
+    std::string value;
+    for (int i = 0; i < 200; i++) {
+        EXPECT_TRUE(storage.Put("KEY" + std::to_string(i), std::string(1000, 'v')));
+        storage.Get("KEY0", value);
+    }
+    EXPECT_NE("0", stat(storage, "evictions"));
+    EXPECT_FALSE(storage.Get("KEY0", value));
+    EXPECT_TRUE(storage.Get("KEY199", value));
+    EXPECT_FALSE(storage.Put("KEY", std::string(65536, 'v')));
+}
+
+// Large item gets a page of small ones once they took all memory
+TEST(CuckooStorageTest, PageReassign) {
+    CuckooImpl storage(4 * 65536, 65536);
+    for (int i = 0; i < 5000; i++) {
+        EXPECT_TRUE(storage.Put("KEY" + std::to_string(i), std::string(100, 's')));
+    }
+
+    std::string large(10000, 'l'), value;
+    EXPECT_TRUE(storage.Put("LARGE", large));
+    EXPECT_EQ("1", stat(storage, "slabs_moved"));
+    EXPECT_TRUE(storage.Get("LARGE", value));
+    EXPECT_EQ(large, value);
+    EXPECT_TRUE(storage.Put("LARGE2", large));
+    EXPECT_EQ("1", stat(storage, "slabs_moved"));
+}
+
+// Keys present all the time are never missed, even though writers move them between buckets
+TEST(CuckooStorageTest, ConcurrentMoves) {
+    CuckooImpl storage(4 * 65536, 65536);
+    for (int i = 0; i < 700; i++) {
+        EXPECT_TRUE(storage.Put("STABLE" + std::to_string(i), "v"));
+    }
+
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> misses(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&storage, &stop, &misses, t]() {
+            std::string value;
+            for (int i = t; !stop.load(); i++) {
+                if (!storage.Get("STABLE" + std::to_string(i % 700), value)) {
+                    misses++;
+                }
+            }
+        });
+    }
+
+    for (int i = 0; i < 100000; i++) {
+        std::string key = "KEY" + std::to_string(i % 800);
+        if ((i / 800) % 2 == 0) {
+            storage.Put(key, "v");
+        } else {
+            storage.Delete(key);
+        }
+    }
+    stop.store(true);
+    for (auto &r : readers) {
+        r.join();
+    }
+    EXPECT_EQ(0, misses.load());
+    EXPECT_NE("0", stat(storage, "displacements"));
+    EXPECT_EQ("0", stat(storage, "table_evictions"));
+}
+
+// Readers never see value torn by writers that update in place, reallocate and delete entries
+TEST(CuckooStorageTest, ConcurrentReaders) {
+    CuckooImpl storage(64 * 65536, 65536);
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> hits(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&storage, &stop, &hits, t]() {
+            std::string value;
+            for (int i = t; !stop.load(); i++) {
+                std::string key = "KEY" + std::to_string(i % 1500);
+                if (storage.Get(key, value)) {
+                    hits++;
+                    ASSERT_FALSE(value.empty());
+                    ASSERT_EQ(std::string(value.size(), value[0]), value);
+                    ASSERT_EQ(size_t(value[0] - 'a' + 1) * 100, value.size());
+                }
+            }
+        });
+    }
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 2; t++) {
+        writers.emplace_back([&storage, t]() {
+            for (int i = 0; i < 30000; i++) {
+                std::string key = "KEY" + std::to_string((i * 7 + t) % 1500);
+                size_t n = (i + t) % 26;
+                if (i % 5 == 0) {
+                    storage.Delete(key);
+                } else {
+                    storage.Put(key, std::string((n + 1) * 100, char('a' + n)));
+                }
+            }
+        });
+    }
+    for (auto &w : writers) {
+        w.join();
+    }
+    while (hits.load() < 10000) {
+        std::this_thread::yield();
+    }
+    stop.store(true);
+    for (auto &r : readers) {
+        r.join();
+    }
+}
+
+static std::string arena_path() {
+    std::string path = "/tmp/afina_arena_test_" + std::to_string(getpid());
+    unlink(path.c_str());
+    return path;
+}
+
+TEST(MappedStorageTest, PutGetDelete) {
+    std::string path = arena_path();
+    MappedImpl storage(path, 3 * 65536, 65536);
+    EXPECT_EQ("new", storage.Attach());
+
+    EXPECT_TRUE(storage.Put("KEY1", "val1"));
+    EXPECT_TRUE(storage.Put("KEY2", "val2"));
+    EXPECT_FALSE(storage.PutIfAbsent("KEY1", "val3"));
+    EXPECT_TRUE(storage.Set("KEY2", "val4"));
+    EXPECT_FALSE(storage.Set("KEY3", "val5"));
+
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("val1", value);
+    EXPECT_TRUE(storage.Get("KEY2", value));
+    EXPECT_EQ("val4", value);
+
+    // Value grows out of its chunk and moves to another class
+    std::string big(5000, 'b');
+    EXPECT_TRUE(storage.Put("KEY2", big));
+    EXPECT_TRUE(storage.Get("KEY2", value));
+    EXPECT_EQ(big, value);
+
+    EXPECT_TRUE(storage.Delete("KEY1"));
+    EXPECT_FALSE(storage.Delete("KEY1"));
+    EXPECT_FALSE(storage.Get("KEY1", value));
+
+    // Doesn't fit a page
+    EXPECT_FALSE(storage.Put("KEY4", std::string(65536, 'x')));
+    EXPECT_EQ("1", stat(storage, "curr_items"));
+
+    // File is used by this storage already
+    EXPECT_THROW(MappedImpl(path, 3 * 65536, 65536), std::runtime_error);
+    unlink(path.c_str());
+}
+
+// Storage destroyed orderly is attached as is, LRU order and versions go on from where they were
+TEST(MappedStorageTest, ReattachClean) {
+    std::string path = arena_path();
+    std::vector<uint64_t> before;
+    {
+        MappedImpl storage(path, 3 * 65536, 65536);
+        for (long i = 0; i < 700; ++i) {
+            EXPECT_TRUE(storage.Put("Key" + std::to_string(i), "val" + std::to_string(i)));
+        }
+        std::string value;
+        EXPECT_TRUE(storage.Get("Key0", value));
+
+        std::vector<ValueRef> values;
+        EXPECT_EQ(1, storage.Gets({"Key0"}, values, before));
+    }
+
+    MappedImpl storage(path, 3 * 65536, 65536);
+    EXPECT_EQ("clean", storage.Attach());
+    EXPECT_EQ("700", stat(storage, "curr_items"));
+
+    std::string value;
+    for (long i = 0; i < 700; ++i) {
+        ASSERT_TRUE(storage.Get("Key" + std::to_string(i), value));
+        EXPECT_EQ("val" + std::to_string(i), value);
+    }
+
+    std::vector<ValueRef> values;
+    std::vector<uint64_t> after;
+    EXPECT_TRUE(storage.Append("Key0", "!"));
+    EXPECT_EQ(1, storage.Gets({"Key0"}, values, after));
+    EXPECT_GT(after[0], before[0]);
+    EXPECT_EQ("val0!", values[0].str());
+    unlink(path.c_str());
+}
+
+// Process dies without destroying storage, items are found by scanning pages and damaged ones are dropped
+TEST(MappedStorageTest, RecoverAfterCrash) {
+    std::string path = arena_path();
+    pid_t child = fork();
+    if (child == 0) {
+        MappedImpl storage(path, 4 * 65536, 65536);
+        for (long i = 0; i < 300; ++i) {
+            storage.Put("Key" + std::to_string(i), "val" + std::to_string(i));
+        }
+        // Moves into larger class, the old chunk is freed
+        storage.Put("Key1", std::string(1000, 'm'));
+        storage.Put("Damaged", "intact-value");
+        storage.Append("Key2", "-appended");
+        _exit(0);
+    }
+    int status;
+    ASSERT_EQ(child, waitpid(child, &status, 0));
+    ASSERT_EQ(0, WEXITSTATUS(status));
+
+    // Flip a byte of the value right in the file
+    int fd = open(path.c_str(), O_RDWR);
+    ASSERT_GE(fd, 0);
+    std::string data(4 * 65536, '\0');
+    ASSERT_EQ(data.size(), pread(fd, &data[0], data.size(), 0));
+    size_t pos = data.find("intact-value");
+    ASSERT_NE(std::string::npos, pos);
+    ASSERT_EQ(1, pwrite(fd, "X", 1, pos));
+    close(fd);
+
+    MappedImpl storage(path, 4 * 65536, 65536);
+    EXPECT_EQ("recovered", storage.Attach());
+    EXPECT_EQ("1", stat(storage, "arena_dropped"));
+    EXPECT_EQ("300", stat(storage, "curr_items"));
+
+    std::string value;
+    EXPECT_FALSE(storage.Get("Damaged", value));
+    EXPECT_TRUE(storage.Get("Key1", value));
+    EXPECT_EQ(std::string(1000, 'm'), value);
+    EXPECT_TRUE(storage.Get("Key2", value));
+    EXPECT_EQ("val2-appended", value);
+    EXPECT_TRUE(storage.Get("Key299", value));
+    EXPECT_EQ("val299", value);
+
+    // Rebuilt structure keeps working
+    for (long i = 0; i < 300; ++i) {
+        EXPECT_TRUE(storage.Put("New" + std::to_string(i), "val" + std::to_string(i)));
+    }
+    EXPECT_TRUE(storage.Delete("Key0"));
+    unlink(path.c_str());
+}
+
+// File of another geometry is formatted anew
+TEST(MappedStorageTest, GeometryChange) {
+    std::string path = arena_path();
+    {
+        MappedImpl storage(path, 3 * 65536, 65536);
+        EXPECT_TRUE(storage.Put("KEY1", "val1"));
+    }
+    {
+        MappedImpl storage(path, 3 * 65536, 32768);
+        EXPECT_EQ("new", storage.Attach());
+        EXPECT_EQ("0", stat(storage, "curr_items"));
+        EXPECT_TRUE(storage.Put("KEY2", "val2"));
+    }
+
+    MappedImpl storage(path, 3 * 65536, 32768);
+    EXPECT_EQ("clean", storage.Attach());
+    std::string value;
+    EXPECT_FALSE(storage.Get("KEY1", value));
+    EXPECT_TRUE(storage.Get("KEY2", value));
+    unlink(path.c_str());
+}
+
+// Class that has nothing to evict takes over the page of the oldest item, which survives reattach
+TEST(MappedStorageTest, PageReassign) {
+    std::string path = arena_path();
+    {
+        MappedImpl storage(path, 8 * 1024 * 1024);
+        std::string small(100, 's');
+        for (long i = 0; i < 100000; ++i) {
+            EXPECT_TRUE(storage.Put("Small " + std::to_string(i), small));
+        }
+        EXPECT_EQ("0", stat(storage, "free_pages"));
+        EXPECT_NE("0", stat(storage, "evictions"));
+
+        std::string large(3000, 'l'), value;
+        for (long i = 0; i < 100; ++i) {
+            EXPECT_TRUE(storage.Put("Large " + std::to_string(i), large));
+        }
+        EXPECT_EQ("1", stat(storage, "slabs_moved"));
+        EXPECT_TRUE(storage.Get("Large 0", value));
+        EXPECT_EQ(large, value);
+    }
+
+    MappedImpl storage(path, 8 * 1024 * 1024);
+    EXPECT_EQ("clean", storage.Attach());
+    std::string value;
+    EXPECT_TRUE(storage.Get("Large 99", value));
+    EXPECT_EQ(std::string(3000, 'l'), value);
+    EXPECT_TRUE(storage.Put("Small 0", std::string(100, 's')));
+    unlink(path.c_str());
+}
+
+// Keys sharing long prefixes, prefixes of each other and bytes above 127, enough of them to make every node size
+static std::vector<std::string> art_keys() {
+    std::vector<std::string> keys = {"", "a", "ab", "abc", "\xff", "\x80\x01", std::string(40, 'p')};
+    for (int i = 0; i < 3000; i++) {
+        keys.push_back("user:" + std::to_string(i % 300) + ":session:" + std::to_string(i));
+        keys.push_back(std::string(1, char(i % 256)) + std::to_string(i / 256));
+    }
+    for (int i = 0; i < 50; i++) {
+        keys.push_back(std::string(40, 'p') + std::string(i, 'q'));
+        keys.push_back("node48:" + std::string(1, char('0' + i % 40)) + std::to_string(i));
+    }
+    return keys;
+}
+
+TEST(ArtIndexTest, MatchesMap) {
+    std::vector<std::string> keys = art_keys();
+    std::mt19937 gen(7);
+    std::shuffle(keys.begin(), keys.end(), gen);
+
+    ArtIndex index;
+    std::map<std::string, Item *> expected;
+    auto check = [&]() {
+        ASSERT_EQ(expected.size(), index.Size());
+        for (auto &it : expected) {
+            ASSERT_EQ(it.second, index.Find(it.first.data(), it.first.size())) << it.first;
+        }
+
+        // Walks from existing key, from missing one and from the very beginning
+        for (std::string from : {std::string(), std::string("user:1"), std::string("user:150:session:1500"),
+                                 std::string(40, 'p') + "qq", std::string("\x80")}) {
+            auto it = expected.lower_bound(from);
+            index.Walk(from, [&](Item *item) {
+                EXPECT_TRUE(it != expected.end());
+                EXPECT_EQ(it->second, item);
+                ++it;
+                return it != expected.end();
+            });
+            EXPECT_TRUE(it == expected.end());
+        }
+    };
+
+    for (auto &key : keys) {
+        if (expected.count(key) == 0) {
+            Item *item = Item::Create(0, key, "v");
+            index.Insert(item);
+            expected[key] = item;
+        }
+    }
+    check();
+
+    // Replaced item is found in place of the old one
+    Item *fresh = Item::Create(0, "abc", "w");
+    index.Replace(fresh);
+    Item::Release(expected["abc"]);
+    expected["abc"] = fresh;
+
+    // Removing most keys shrinks nodes back
+    for (size_t i = 0; i < keys.size(); i += 1 + i % 7) {
+        auto it = expected.find(keys[i]);
+        if (it != expected.end()) {
+            EXPECT_EQ(it->second, index.Erase(keys[i].data(), keys[i].size()));
+            Item::Release(it->second);
+            expected.erase(it);
+        }
+    }
+    EXPECT_EQ(nullptr, index.Erase("missing", 7));
+    check();
+
+    for (auto &it : expected) {
+        EXPECT_EQ(it.second, index.Erase(it.first.data(), it.first.size()));
+        Item::Release(it.second);
+    }
+    EXPECT_EQ(0, index.Size());
+}
+
+TEST(ArtStorageTest, Range) {
+    ArtImpl storage(1 << 20);
+    for (int i = 0; i < 100; i++) {
+        storage.Put("user:" + std::to_string(i), "v" + std::to_string(i));
+    }
+    storage.Put("user", "none");
+    storage.Put("users", "none");
+    storage.Put("uses", "none");
+
+    // Batches continue after the last key taken and come out short at the end
+    std::vector<std::string> keys, all;
+    std::vector<ValueRef> values;
+    std::string after;
+    do {
+        keys.clear();
+        ASSERT_TRUE(storage.Range("user:", after, 30, keys, &values));
+        all.insert(all.end(), keys.begin(), keys.end());
+        if (!keys.empty()) {
+            after = keys.back();
+        }
+    } while (keys.size() == 30);
+
+    ASSERT_EQ(100, all.size());
+    ASSERT_EQ(100, values.size());
+    EXPECT_TRUE(std::is_sorted(all.begin(), all.end()));
+    EXPECT_EQ("user:0", all[0]);
+    EXPECT_EQ("user:99", all[99]);
+    EXPECT_EQ("v99", std::string(values[99].data(), values[99].size()));
+
+    keys.clear();
+    ASSERT_TRUE(storage.Range("", "user:99", 10, keys, nullptr));
+    EXPECT_EQ(std::vector<std::string>({"users", "uses"}), keys);
+
+    keys.clear();
+    ASSERT_TRUE(storage.Range("nobody", "", 10, keys, nullptr));
+    EXPECT_TRUE(keys.empty());
+
+    // Unordered storage doesn't support it
+    FlatHashImpl unordered;
+    EXPECT_FALSE(static_cast<Afina::Storage &>(unordered).Range("", "", 10, keys, nullptr));
+}
+
+// Keys of the same length, so that all items cost the same
+static std::string fixed_key(int i) { return "KEY" + std::to_string(100000 + i); }
+
+TEST(SkipListStorageTest, PutGetDelete) {
+    SkipListImpl storage(1 << 20);
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_TRUE(storage.Put("KEY" + std::to_string(i), "val" + std::to_string(i)));
+    }
+    EXPECT_TRUE(storage.Put("KEY5", "new"));
+    EXPECT_FALSE(storage.PutIfAbsent("KEY6", "new"));
+    for (int i = 0; i < 1000; i += 2) {
+        EXPECT_TRUE(storage.Delete("KEY" + std::to_string(i)));
+    }
+    EXPECT_FALSE(storage.Delete("KEY0"));
+    EXPECT_FALSE(storage.Set("KEY0", "x"));
+    EXPECT_TRUE(storage.PutIfAbsent("KEY0", "back"));
+
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY0", value));
+    EXPECT_EQ("back", value);
+    EXPECT_TRUE(storage.Get("KEY5", value));
+    EXPECT_EQ("new", value);
+    EXPECT_FALSE(storage.Get("KEY6", value));
+    EXPECT_EQ("501", stat(storage, "curr_items"));
+
+    // Live keys come out in order
+    std::vector<std::string> keys;
+    ASSERT_TRUE(storage.Range("KEY1", "", 1000, keys, nullptr));
+    EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+    EXPECT_EQ(std::vector<std::string>({"KEY1", "KEY101", "KEY103", "KEY105"}),
+              std::vector<std::string>(keys.begin(), keys.begin() + 4));
+    EXPECT_EQ(56, keys.size());
+}
+
+// Keys read after the storage has been filled survive eviction, even though they were inserted first
+TEST(SkipListStorageTest, SampledEviction) {
+    SkipListImpl storage(1000 * 109);
+    for (int i = 0; i < 1000; i++) {
+        storage.Put(fixed_key(i), std::string(100, 'v'));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    std::string value;
+    for (int i = 0; i < 1000; i += 10) {
+        EXPECT_TRUE(storage.Get(fixed_key(i), value));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    for (int i = 1000; i < 1300; i++) {
+        storage.Put(fixed_key(i), std::string(100, 'v'));
+    }
+    EXPECT_EQ("300", stat(storage, "evictions"));
+    EXPECT_EQ(std::to_string(1000 * 109), stat(storage, "bytes"));
+
+    size_t hot = 0, cold = 0;
+    for (int i = 0; i < 1000; i++) {
+        if (storage.Get(fixed_key(i), value)) {
+            (i % 10 == 0 ? hot : cold)++;
+        }
+    }
+    EXPECT_LE(95, hot);
+    EXPECT_GE(610, cold);
+}
+
+// Retired values are freed as epochs go by instead of piling up
+TEST(SkipListStorageTest, Reclamation) {
+    SkipListImpl storage(1 << 20);
+    for (int i = 0; i < 100000; i++) {
+        storage.Put("KEY" + std::to_string(i % 100), std::to_string(i));
+    }
+    EXPECT_LT(1000, std::stoul(stat(storage, "epoch")));
+    EXPECT_GT(1000, std::stoul(stat(storage, "reclaim_pending")));
+}
+
+// Writers insert and delete their own keys concurrently, none of them is lost or left behind
+TEST(SkipListStorageTest, ConcurrentWriters) {
+    SkipListImpl storage(1 << 24);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; t++) {
+        writers.emplace_back([&storage, t]() {
+            for (int i = 0; i < 5000; i++) {
+                std::string key = fixed_key(i * 4 + t);
+                EXPECT_TRUE(storage.Put(key, std::string(i % 50, 'v')));
+                if (i % 2 == 1) {
+                    EXPECT_TRUE(storage.Delete(key));
+                }
+            }
+        });
+    }
+    for (auto &w : writers) {
+        w.join();
+    }
+
+    std::vector<std::string> keys;
+    std::vector<ValueRef> values;
+    ASSERT_TRUE(storage.Range("", "", 100000, keys, &values));
+    ASSERT_EQ(10000, keys.size());
+    EXPECT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+    EXPECT_EQ("10000", stat(storage, "curr_items"));
+
+    size_t bytes = 0;
+    for (size_t i = 0; i < keys.size(); i++) {
+        bytes += keys[i].size() + values[i].size();
+    }
+    EXPECT_EQ(std::to_string(bytes), stat(storage, "bytes"));
+}
+
+// Scans running along with writers see every key that stays put, in order and exactly once
+TEST(SkipListStorageTest, ConcurrentScan) {
+    SkipListImpl storage(1 << 24);
+    for (int i = 0; i < 2000; i += 2) {
+        storage.Put(fixed_key(i), "stable");
+    }
+
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 2; t++) {
+        writers.emplace_back([&storage, &stop, t]() {
+            for (int i = 0; !stop.load(); i++) {
+                std::string key = fixed_key((i * 2 + 1 + t * 1000) % 2000);
+                if (i % 3 == 0) {
+                    storage.Delete(key);
+                } else {
+                    storage.Put(key, std::string(i % 100, 'x'));
+                }
+            }
+        });
+    }
+
+    for (int round = 0; round < 20; round++) {
+        std::multiset<std::string> seen = scan_all(storage, 37);
+        size_t stable = 0;
+        for (auto it = seen.begin(); it != seen.end(); it = seen.upper_bound(*it)) {
+            ASSERT_EQ(1, seen.count(*it));
+            stable += std::stoi(it->substr(3)) % 2 == 0;
+        }
+        ASSERT_EQ(1000, stable);
+    }
+    stop.store(true);
+    for (auto &w : writers) {
+        w.join();
+    }
+}
+
+TEST(LogStructuredStorageTest, PutGetDelete) {
+    LogStructuredImpl storage(4 * 4096, 4096);
+
+    EXPECT_TRUE(storage.Put("KEY1", "val1"));
+    EXPECT_TRUE(storage.Put("KEY2", "val2"));
+    EXPECT_FALSE(storage.PutIfAbsent("KEY1", "val3"));
+    EXPECT_TRUE(storage.Set("KEY2", "val4"));
+    EXPECT_FALSE(storage.Set("KEY3", "val5"));
+
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("val1", value);
+    EXPECT_TRUE(storage.Get("KEY2", value));
+    EXPECT_EQ("val4", value);
+
+    EXPECT_TRUE(storage.Delete("KEY1"));
+    EXPECT_FALSE(storage.Delete("KEY1"));
+    EXPECT_FALSE(storage.Get("KEY1", value));
+
+    // Entry may take up to an eighth of a segment
+    EXPECT_FALSE(storage.Put("KEY2", std::string(500, 'x')));
+    EXPECT_TRUE(storage.Get("KEY2", value));
+    EXPECT_EQ("val4", value);
+    EXPECT_EQ("1", stat(storage, "curr_items"));
+    EXPECT_EQ("8", stat(storage, "bytes"));
+
+    EXPECT_THROW(LogStructuredImpl(3 * 4096, 4096), std::invalid_argument);
+    EXPECT_NO_THROW(LogStructuredImpl());
+}
+
+// Set that evicts the entry of its own key while making room for the new one doesn't bring the key back
+TEST(LogStructuredStorageTest, SetEvictsItsKey) {
+    std::string value(200, 'v'), out;
+    bool evicted = false;
+    for (int n = 0; n < 400 && !evicted; n++) {
+        // Key is in the oldest segment, the one to be evicted first
+        LogStructuredImpl storage(16 * 4096, 4096);
+        EXPECT_TRUE(storage.Put("KEY", value));
+        for (int i = 0; i < n; i++) {
+            EXPECT_TRUE(storage.Put("FILL" + std::to_string(1000 + i), value));
+        }
+        if (stat(storage, "evictions") != "0") {
+            break;
+        }
+
+        bool stored = storage.Set("KEY", value);
+        if (stat(storage, "evictions") != "0") {
+            evicted = true;
+            EXPECT_FALSE(stored);
+            EXPECT_FALSE(storage.Get("KEY", out));
+        } else {
+            EXPECT_TRUE(stored);
+        }
+    }
+    EXPECT_TRUE(evicted);
+}
+
+// Index keeps 32-bit offsets of entries, which have to point right after index grows and entries move
+TEST(LogStructuredStorageTest, CompactIndex) {
+    LogStructuredImpl storage(16 << 20);
+    for (int i = 0; i < 100000; i++) {
+        EXPECT_TRUE(storage.Put("KEY" + std::to_string(i), std::to_string(i)));
+    }
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < 100000; i += 2) {
+            EXPECT_TRUE(storage.Put("KEY" + std::to_string(i), "x" + std::to_string(i)));
+        }
+    }
+
+    // Five bytes per slot: control byte and offset
+    EXPECT_EQ(std::to_string(131072 * 5), stat(storage, "index_bytes"));
+    EXPECT_NE("0", stat(storage, "relocated_bytes"));
+    EXPECT_EQ(100000, scan_all(storage, 1000).size());
+    for (int i = 0; i < 100000; i++) {
+        std::string value;
+        EXPECT_TRUE(storage.Get("KEY" + std::to_string(i), value));
+        EXPECT_EQ((i % 2 == 0 ? "x" : "") + std::to_string(i), value);
+    }
+
+    // Offsets can't address more than 32G
+    EXPECT_THROW(LogStructuredImpl(size_t(33) << 30), std::invalid_argument);
+}
+
+TEST(LogStructuredStorageTest, WritersClean) {
+    // No cleaner thread, data takes about half of memory and is overwritten over and over. Values are large
+    // enough for entry headers not to matter
+    LogStructuredImpl storage(64 * 16384, 16384);
+    std::map<std::string, std::string> expected;
+    std::mt19937 random(1);
+    for (int i = 0; i < 20000; i++) {
+        std::string key = "KEY" + std::to_string(random() % 500);
+        std::string value = std::to_string(i) + std::string(500 + random() % 1000, 'v');
+        EXPECT_TRUE(storage.Put(key, value));
+        expected[key] = value;
+    }
+
+    EXPECT_EQ("0", stat(storage, "evictions"));
+    EXPECT_NE("0", stat(storage, "foreground_cleaned_segments"));
+    EXPECT_GE(std::stoul(stat(storage, "utilization")), 80);
+    EXPECT_EQ(std::to_string(expected.size()), stat(storage, "curr_items"));
+    for (auto &e : expected) {
+        std::string value;
+        EXPECT_TRUE(storage.Get(e.first, value));
+        EXPECT_EQ(e.second, value);
+    }
+}
+
+TEST(LogStructuredStorageTest, Eviction) {
+    LogStructuredImpl storage(16 * 4096, 4096);
+    std::string value(200, 'v');
+    EXPECT_TRUE(storage.Put("HOT", value));
+    for (int i = 0; i < 1000; i++) {
+        EXPECT_TRUE(storage.Put("KEY" + std::to_string(i), value));
+
+        // Read item is moved away from the segment being evicted instead of being dropped
+        std::string out;
+        EXPECT_TRUE(storage.Get("HOT", out));
+    }
+
+    std::string out;
+    EXPECT_FALSE(storage.Get("KEY0", out));
+    EXPECT_TRUE(storage.Get("KEY999", out));
+    EXPECT_NE("0", stat(storage, "evictions"));
+    EXPECT_NE("0", stat(storage, "relocated_bytes"));
+    EXPECT_EQ("1", stat(storage, "free_segments"));
+}
+
+TEST(LogStructuredStorageTest, BackgroundCleaner) {
+    LogStructuredImpl storage(16 * 4096, 4096);
+    storage.Start();
+
+    std::string value(200, 'v');
+    for (int i = 0; i < 200; i++) {
+        EXPECT_TRUE(storage.Put("KEY" + std::to_string(i), value));
+    }
+    size_t free = std::stoul(stat(storage, "free_segments"));
+
+    // Deletes don't open segments, so writers never clean and it is up to cleaner to give memory back
+    for (int i = 0; i < 200; i++) {
+        if (i % 4 != 0) {
+            EXPECT_TRUE(storage.Delete("KEY" + std::to_string(i)));
+        }
+    }
+    for (int i = 0; i < 500 && std::stoul(stat(storage, "free_segments")) < free + 5; i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_LE(free + 5, std::stoul(stat(storage, "free_segments")));
+    EXPECT_EQ("0", stat(storage, "foreground_cleaned_segments"));
+    storage.Stop();
+
+    for (int i = 0; i < 200; i++) {
+        std::string out;
+        EXPECT_EQ(i % 4 == 0, storage.Get("KEY" + std::to_string(i), out));
+    }
+}
+
+TEST(LogStructuredStorageTest, ConcurrentWriters) {
+    LogStructuredImpl storage(16 * 4096, 4096);
+    storage.Start();
+
+    // Each thread overwrites keys of its own and expects to read back what it wrote last, while cleaner moves
+    // entries around
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; t++) {
+        workers.emplace_back([&storage, t]() {
+            std::mt19937 random(t);
+            std::vector<std::string> last(30);
+            for (int i = 0; i < 5000; i++) {
+                size_t k = random() % last.size();
+                std::string key = "KEY" + std::to_string(t) + ":" + std::to_string(k);
+                last[k] = std::to_string(i) + std::string(random() % 150, 'v');
+                ASSERT_TRUE(storage.Put(key, last[k]));
+
+                std::string value;
+                ASSERT_TRUE(storage.Get(key, value));
+                ASSERT_EQ(last[k], value);
+            }
+        });
+    }
+    for (auto &w : workers) {
+        w.join();
+    }
+    storage.Stop();
+
+    EXPECT_EQ("0", stat(storage, "evictions"));
+    EXPECT_NE("0", stat(storage, "cleaned_segments"));
+}
+
+// Collects items fired by the wheel
+struct Fired {
+    std::vector<Item *> items;
+    void operator()(Item *item) { items.push_back(item); }
+};
+
+static Item *timer_item(const std::string &key, uint32_t expire_at) {
+    Item *item = Item::Create(0, key, "", 0, true);
+    item->expire_at = expire_at;
+    return item;
+}
+
+TEST(TimingWheelTest, FiresInOrder) {
+    TimingWheel wheel(1000);
+    Item *a = timer_item("a", 1003), *b = timer_item("b", 1001), *c = timer_item("c", 900);
+    wheel.Schedule(a);
+    wheel.Schedule(b);
+    wheel.Schedule(c);
+    EXPECT_EQ(3, wheel.Size());
+
+    std::vector<Item *> order;
+    for (uint32_t now = 1001; now <= 1003; now++) {
+        wheel.Advance(now, [&order](Item *item) { order.push_back(item); });
+    }
+    // Already expired one fires on the next second along with b
+    ASSERT_EQ(3, order.size());
+    EXPECT_EQ(a, order[2]);
+    EXPECT_EQ(0, wheel.Size());
+
+    Item::Release(a);
+    Item::Release(b);
+    Item::Release(c);
+}
+
+TEST(TimingWheelTest, Cancel) {
+    TimingWheel wheel(1000);
+    Item *a = timer_item("a", 1010), *b = timer_item("b", 1010);
+    wheel.Schedule(a);
+    wheel.Schedule(b);
+    wheel.Cancel(a);
+
+    Fired fired;
+    wheel.Advance(1100, std::ref(fired));
+    ASSERT_EQ(1, fired.items.size());
+    EXPECT_EQ(b, fired.items[0]);
+
+    Item::Release(a);
+    Item::Release(b);
+}
+
+TEST(TimingWheelTest, Cascade) {
+    const uint32_t start = 4000000;
+    TimingWheel wheel(start);
+
+    // One item per level plus one beyond the wheel range
+    std::vector<uint32_t> delays = {5, 100, 5000, 300000, 20000000};
+    std::vector<Item *> items;
+    for (auto delay : delays) {
+        items.push_back(timer_item(std::to_string(delay), start + delay));
+        wheel.Schedule(items.back());
+    }
+
+    // Each item fires exactly at its second, never earlier
+    for (size_t i = 0; i < delays.size(); i++) {
+        SCOPED_TRACE(delays[i]);
+        Fired fired;
+        wheel.Advance(start + delays[i] - 1, std::ref(fired));
+        EXPECT_TRUE(fired.items.empty());
+
+        wheel.Advance(start + delays[i], std::ref(fired));
+        ASSERT_EQ(1, fired.items.size());
+        EXPECT_EQ(items[i], fired.items[0]);
+    }
+    EXPECT_EQ(0, wheel.Size());
+
+    for (auto item : items) {
+        Item::Release(item);
+    }
+}
+
+TEST(FlatHashTTLTest, ExpiredInvisible) {
+    FlatHashImpl storage;
+    time_t now = time(nullptr);
+
+    EXPECT_TRUE(storage.Put("KEY1", "val1", now - 1));
+    EXPECT_TRUE(storage.Put("KEY2", "val2", now + 3600));
+    EXPECT_TRUE(storage.Put("KEY3", "val3"));
+
+    std::string value;
+    EXPECT_FALSE(storage.Get("KEY1", value));
+    EXPECT_TRUE(storage.Get("KEY2", value));
+    EXPECT_EQ("val2", value);
+    EXPECT_FALSE(storage.Delete("KEY1"));
+    EXPECT_TRUE(storage.PutIfAbsent("KEY1", "val4"));
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("val4", value);
+
+    // Expiration is replaced along with value
+    EXPECT_TRUE(storage.Set("KEY2", "val5"));
+    EXPECT_TRUE(storage.Set("KEY3", "val6", now - 1));
+    EXPECT_TRUE(storage.Get("KEY2", value));
+    EXPECT_FALSE(storage.Get("KEY3", value));
+    EXPECT_EQ("0", stat(storage, "expiring_items"));
+}
+
+TEST(FlatHashTTLTest, AppendKeepsExpiration) {
+    FlatHashImpl storage(1 << 20);
+    time_t now = time(nullptr);
+
+    EXPECT_TRUE(storage.Put("KEY1", "val", now + 3600));
+    EXPECT_TRUE(storage.Put("KEY2", "val", now - 1));
+
+    // Item gets reallocated, timer goes along with it
+    EXPECT_TRUE(storage.Append("KEY1", std::string(1000, 'x')));
+    EXPECT_TRUE(storage.Prepend("KEY1", "my "));
+    EXPECT_FALSE(storage.Append("KEY2", "ue"));
+    EXPECT_EQ("1", stat(storage, "expiring_items"));
+
+    std::string value;
+    EXPECT_TRUE(storage.Get("KEY1", value));
+    EXPECT_EQ("my val" + std::string(1000, 'x'), value);
+}
+
+TEST(FlatHashTTLTest, ReaperReclaims) {
+    FlatHashImpl storage;
+    storage.Start();
+
+    time_t now = time(nullptr);
+    for (long i = 0; i < 10; ++i) {
+        EXPECT_TRUE(storage.Put("Key" + std::to_string(i), "val", i % 2 == 0 ? now + 1 : 0));
+    }
+    EXPECT_EQ("10", stat(storage, "curr_items"));
+    EXPECT_EQ("5", stat(storage, "expiring_items"));
+
+    // Nobody reads expired items, yet they are gone
+    std::this_thread::sleep_for(std::chrono::milliseconds(3500));
+    EXPECT_EQ("5", stat(storage, "curr_items"));
+    EXPECT_EQ("5", stat(storage, "reclaimed"));
+    EXPECT_EQ("0", stat(storage, "expiring_items"));
+    storage.Stop();
+}
+
+// Reads all items of the snapshot file
+static std::map<std::string, std::pair<std::string, uint32_t>> read_snapshot(const std::string &path) {
+    std::map<std::string, std::pair<std::string, uint32_t>> items;
+    SnapshotReader reader(path);
+    std::string key, value;
+    uint32_t expire_at;
+    while (reader.Next(key, value, expire_at)) {
+        items[key] = std::make_pair(value, expire_at);
+    }
+    return items;
+}
+
+TEST(SnapshotTest, Crc32c) {
+    EXPECT_EQ(0xe3069283, Crc32c("123456789", 9));
+    EXPECT_EQ(0xe3069283, Crc32c("6789", 4, Crc32c("12345", 5)));
+    EXPECT_EQ(0, Crc32c("", 0));
+}
+
+TEST(LzTest, RoundTrip) {
+    std::mt19937 random(1);
+    std::string noise(100000, ' ');
+    for (auto &c : noise) {
+        c = char(random());
+    }
+    std::string text;
+    for (int i = 0; i < 1000; i++) {
+        text += "{\"id\":" + std::to_string(i) + ",\"name\":\"user\"},";
+    }
+
+    std::string block, restored;
+    for (const std::string &data : {std::string(), std::string("abc"), std::string(100000, 'a'), noise, text}) {
+        LzCompress(data.data(), data.size(), block);
+        EXPECT_EQ(data.size(), LzOriginalSize(block.data(), block.size()));
+        EXPECT_TRUE(LzDecompress(block.data(), block.size(), restored));
+        EXPECT_EQ(data, restored);
+    }
+
+    LzCompress(text.data(), text.size(), block);
+    EXPECT_GT(text.size() / 4, block.size());
+    LzCompress(std::string(100000, 'a').data(), 100000, block);
+    EXPECT_GT(1000, block.size());
+
+    // Truncated block or distance out of the data is refused
+    EXPECT_FALSE(LzDecompress(block.data(), block.size() / 2, restored));
+    EXPECT_FALSE(LzDecompress("\x08\x10" "a\x02\x00", 5, restored));
+    EXPECT_TRUE(LzDecompress("\x05\x10" "a\x01\x00", 5, restored));
+    EXPECT_EQ("aaaaa", restored);
+}
+
+// Image is taken at the moment Start returns, changes made while child is writing it don't get there
+TEST(SnapshotTest, PointInTime) {
+    std::string path = "/tmp/afina_snapshot_test_" + std::to_string(getpid());
+
+    std::vector<std::unique_ptr<Afina::Storage>> storages;
+    storages.emplace_back(new MapBasedGlobalLockImpl(1 << 20));
+    storages.emplace_back(new StripedLockImpl(1 << 20, 4));
+    storages.emplace_back(new FlatHashImpl(1 << 20));
+    storages.emplace_back(new ClockRWLockImpl(1 << 20));
+    storages.emplace_back(new SlabImpl(1 << 20, 65536));
+    storages.emplace_back(anonymous_arena(16));
+
+    for (auto &storage : storages) {
+        for (long i = 0; i < 5000; ++i) {
+            EXPECT_TRUE(storage->Put("Key" + std::to_string(i), "val" + std::to_string(i)));
+        }
+        uint64_t result;
+        EXPECT_TRUE(storage->Put("Counter", "1"));
+        EXPECT_TRUE(storage->Increment("Counter", 41, result));
+
+        Snapshot snapshot(*storage, path);
+        ASSERT_TRUE(snapshot.Start());
+        EXPECT_FALSE(snapshot.Start());
+        EXPECT_TRUE(storage->Put("Key0", "changed"));
+        EXPECT_TRUE(storage->Delete("Key1"));
+        EXPECT_TRUE(storage->Put("New", "val"));
+        EXPECT_TRUE(storage->Increment("Counter", 1, result));
+
+        snapshot.Wait();
+        EXPECT_FALSE(snapshot.Running());
+        ASSERT_TRUE(snapshot.Succeeded());
+
+        auto items = read_snapshot(path);
+        EXPECT_EQ(5001, items.size());
+        EXPECT_EQ("val0", items["Key0"].first);
+        EXPECT_EQ("val1", items["Key1"].first);
+        EXPECT_EQ("val4999", items["Key4999"].first);
+        EXPECT_EQ("42", items["Counter"].first);
+        EXPECT_EQ(0, items.count("New"));
+    }
+    unlink(path.c_str());
+}
+
+TEST(SnapshotTest, KeepsExpiration) {
+    std::string path = "/tmp/afina_snapshot_test_" + std::to_string(getpid());
+    FlatHashImpl storage;
+
+    time_t now = time(nullptr);
+    EXPECT_TRUE(storage.Put("KEY1", "val1", now + 100));
+    EXPECT_TRUE(storage.Put("KEY2", "val2", 0));
+    EXPECT_TRUE(storage.Put("KEY3", "val3", now - 1));
+
+    Snapshot snapshot(storage, path);
+    EXPECT_TRUE(snapshot.Start());
+    snapshot.Wait();
+    EXPECT_TRUE(snapshot.Succeeded());
+
+    std::vector<std::pair<std::string, std::string>> stats;
+    snapshot.GetStats(stats);
+    EXPECT_EQ("snapshot_last_status", stats[2].first);
+    EXPECT_EQ("ok", stats[2].second);
+
+    // Expired item is not written
+    auto items = read_snapshot(path);
+    EXPECT_EQ(2, items.size());
+    EXPECT_EQ(uint32_t(now + 100), items["KEY1"].second);
+    EXPECT_EQ(0, items["KEY2"].second);
+    unlink(path.c_str());
+}
+
+TEST(SnapshotTest, Corrupted) {
+    std::string path = "/tmp/afina_snapshot_test_" + std::to_string(getpid());
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE(fd, 0);
+    SnapshotWriter writer(fd);
+    for (long i = 0; i < 20000; ++i) {
+        writer.Add("Key" + std::to_string(i), std::string(10, 'v'), 0);
+    }
+    writer.Finish();
+    EXPECT_EQ(20000, writer.Items());
+    close(fd);
+    EXPECT_EQ(20000, read_snapshot(path).size());
+
+    // Single bit flipped
+    fd = open(path.c_str(), O_RDWR);
+    off_t size = lseek(fd, 0, SEEK_END);
+    char c;
+    EXPECT_EQ(1, pread(fd, &c, 1, size / 2));
+    c ^= 1;
+    EXPECT_EQ(1, pwrite(fd, &c, 1, size / 2));
+    EXPECT_THROW(read_snapshot(path), std::runtime_error);
+    c ^= 1;
+    EXPECT_EQ(1, pwrite(fd, &c, 1, size / 2));
+    close(fd);
+    EXPECT_EQ(20000, read_snapshot(path).size());
+
+    // End of the file lost
+    EXPECT_EQ(0, truncate(path.c_str(), size - 12));
+    EXPECT_THROW(read_snapshot(path), std::runtime_error);
+
+    EXPECT_THROW(read_snapshot(path + ".missing"), std::runtime_error);
+    unlink(path.c_str());
+}
+
+// Snapshot of one engine is loaded into every engine by several workers
+TEST(SnapshotLoaderTest, RoundTrip) {
+    std::string path = "/tmp/afina_snapshot_test_" + std::to_string(getpid());
+    FlatHashImpl source(1 << 24);
+    time_t expire = time(nullptr) + 1000;
+    for (long i = 0; i < 50000; ++i) {
+        EXPECT_TRUE(source.Put("Key" + std::to_string(i), std::string(i % 300, 'v'), i % 10 == 0 ? expire : 0));
+    }
+    Snapshot snapshot(source, path);
+    EXPECT_TRUE(snapshot.Start());
+    snapshot.Wait();
+    ASSERT_TRUE(snapshot.Succeeded());
+
+    std::vector<std::unique_ptr<Afina::Storage>> storages;
+    storages.emplace_back(new MapBasedGlobalLockImpl(1 << 24));
+    storages.emplace_back(new StripedLockImpl(1 << 24, 8));
+    storages.emplace_back(new FlatHashImpl(1 << 24));
+    storages.emplace_back(new ClockRWLockImpl(1 << 24));
+    storages.emplace_back(new SlabImpl(1 << 26, 1 << 20));
+    storages.emplace_back(anonymous_arena(64, 1 << 20));
+
+    for (auto &storage : storages) {
+        EXPECT_TRUE(storage->Put("Key7", "changed"));
+
+        SnapshotLoader loader(*storage, path, 4);
+        loader.Start();
+        loader.Wait();
+        EXPECT_TRUE(loader.Done());
+        EXPECT_EQ(50000, loader.Items());
+        EXPECT_EQ(49999, loader.Stored());
+
+        std::string value;
+        for (long i = 0; i < 50000; i += 7) {
+            ASSERT_TRUE(storage->Get("Key" + std::to_string(i), value));
+            EXPECT_EQ(i == 7 ? "changed" : std::string(i % 300, 'v'), value);
+        }
+    }
+
+    // Expiration goes along
+    FlatHashImpl target(1 << 24);
+    SnapshotLoader loader(target, path, 2);
+    loader.Start();
+    loader.Wait();
+    EXPECT_EQ("5000", stat(target, "expiring_items"));
+    unlink(path.c_str());
+}
+
+TEST(SnapshotLoaderTest, Corrupted) {
+    std::string path = "/tmp/afina_snapshot_test_" + std::to_string(getpid());
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE(fd, 0);
+    SnapshotWriter writer(fd);
+    for (long i = 0; i < 50000; ++i) {
+        writer.Add("Key" + std::to_string(i), std::string(10, 'v'), 0);
+    }
+    writer.Finish();
+    off_t size = lseek(fd, 0, SEEK_CUR);
+    close(fd);
+
+    // Whatever is before the end is loaded
+    EXPECT_EQ(0, truncate(path.c_str(), size - 12));
+    MapBasedGlobalLockImpl storage(1 << 24);
+    SnapshotLoader loader(storage, path, 4);
+    loader.Start();
+    EXPECT_THROW(loader.Wait(), std::runtime_error);
+    EXPECT_EQ(50000, loader.Items());
+
+    SnapshotLoader missing(storage, path + ".missing", 4);
+    EXPECT_THROW(missing.Start(), std::runtime_error);
+    unlink(path.c_str());
+}
+
+// Empty directory for the operation log
+static std::string wal_dir() {
+    std::string dir = "/tmp/afina_wal_test_" + std::to_string(getpid());
+    if (DIR *d = opendir(dir.c_str())) {
+        while (struct dirent *entry = readdir(d)) {
+            unlink((dir + "/" + entry->d_name).c_str());
+        }
+        closedir(d);
+        rmdir(dir.c_str());
+    }
+    return dir;
+}
+
+static std::map<std::string, std::pair<std::string, time_t>> contents(const Afina::Storage &storage) {
+    std::map<std::string, std::pair<std::string, time_t>> items;
+    storage.ForEach([&items](const std::string &key, const std::string &value, time_t expire_at) {
+        items[key] = std::make_pair(value, expire_at);
+    });
+    return items;
+}
+
+TEST(LoggedStorageTest, Replay) {
+    std::string dir = wal_dir();
+    time_t expire = time(nullptr) + 1000;
+    std::map<std::string, std::pair<std::string, time_t>> expected;
+    {
+        LoggedStorage storage(std::make_shared<FlatHashImpl>(1 << 20), dir, std::chrono::milliseconds(1));
+        storage.Start();
+        uint64_t result;
+        EXPECT_TRUE(storage.Put("KEY1", "val1"));
+        EXPECT_TRUE(storage.Set("KEY1", "new1", expire));
+        EXPECT_TRUE(storage.PutIfAbsent("KEY2", "val2"));
+        EXPECT_FALSE(storage.PutIfAbsent("KEY2", "lost"));
+        EXPECT_FALSE(storage.Set("KEY3", "lost"));
+        EXPECT_TRUE(storage.Append("KEY2", ">>"));
+        EXPECT_TRUE(storage.Prepend("KEY2", "<<"));
+        EXPECT_TRUE(storage.Put("NUM", "10"));
+        EXPECT_TRUE(storage.Increment("NUM", 5, result));
+        EXPECT_TRUE(storage.Decrement("NUM", 3, result));
+        EXPECT_TRUE(storage.Put("KEY4", "val4"));
+        EXPECT_TRUE(storage.Delete("KEY4"));
+
+        std::vector<ValueRef> values;
+        std::vector<uint64_t> versions;
+        EXPECT_TRUE(storage.Put("CAS", "old"));
+        EXPECT_EQ(1, storage.Gets({"CAS"}, values, versions));
+        EXPECT_EQ(Afina::Storage::CasResult::Stored, storage.Cas("CAS", "new", versions[0], 0));
+        EXPECT_EQ(Afina::Storage::CasResult::Exists, storage.Cas("CAS", "lost", versions[0], 0));
+        expected = contents(storage);
+        storage.Stop();
+    }
+    EXPECT_EQ("<<val2>>", expected["KEY2"].first);
+    EXPECT_EQ("12", expected["NUM"].first);
+
+    LoggedStorage storage(std::make_shared<FlatHashImpl>(1 << 20), dir, std::chrono::milliseconds(1));
+    storage.Start();
+    EXPECT_EQ(expected, contents(storage));
+    EXPECT_EQ("12", stat(storage, "wal_replayed"));
+    EXPECT_EQ("2", stat(storage, "wal_segment"));
+}
+
+// Crash in the middle of a write leaves part of the record, it is cut off on the next start
+TEST(LoggedStorageTest, TornTail) {
+    std::string dir = wal_dir();
+    {
+        LoggedStorage storage(std::make_shared<MapBasedGlobalLockImpl>(), dir, std::chrono::milliseconds(1));
+        storage.Start();
+        EXPECT_TRUE(storage.Put("KEY1", "val1"));
+        EXPECT_TRUE(storage.Put("KEY2", "val2"));
+    }
+
+    std::string segment = dir + "/log.1";
+    struct stat st;
+    ASSERT_EQ(0, ::stat(segment.c_str(), &st));
+    for (off_t cut : {off_t(3), off_t(11)}) {
+        ASSERT_EQ(0, truncate(segment.c_str(), st.st_size - cut));
+        LoggedStorage storage(std::make_shared<MapBasedGlobalLockImpl>(), dir, std::chrono::milliseconds(1));
+        storage.Start();
+        std::string value;
+        EXPECT_TRUE(storage.Get("KEY1", value));
+        EXPECT_FALSE(storage.Get("KEY2", value));
+        EXPECT_EQ("1", stat(storage, "wal_replayed"));
+        storage.Stop();
+
+        struct stat truncated;
+        ASSERT_EQ(0, ::stat(segment.c_str(), &truncated));
+        EXPECT_EQ(st.st_size / 2, truncated.st_size);
+        st.st_size = truncated.st_size * 2;
+        ASSERT_EQ(0, truncate(segment.c_str(), st.st_size));
+    }
+}
+
+// Appends are not idempotent, so those done before compaction must not be replayed twice
+TEST(LoggedStorageTest, Compaction) {
+    std::string dir = wal_dir();
+    std::map<std::string, std::pair<std::string, time_t>> expected;
+    {
+        LoggedStorage storage(std::make_shared<StripedLockImpl>(1 << 24, 4), dir, std::chrono::milliseconds(1),
+                              1 << 30);
+        storage.Start();
+        EXPECT_TRUE(storage.Put("LOG", ""));
+        for (long i = 0; i < 300; ++i) {
+            EXPECT_TRUE(storage.Put("KEY" + std::to_string(i % 100), std::to_string(i)));
+            EXPECT_TRUE(storage.Append("LOG", "+"));
+            if (i == 150) {
+                EXPECT_TRUE(storage.Compact());
+                EXPECT_EQ(std::vector<uint64_t>{2}, OperationLog::List(dir, "log."));
+                EXPECT_EQ(std::vector<uint64_t>{2}, OperationLog::List(dir, "snapshot."));
+            }
+        }
+        EXPECT_TRUE(storage.Compact());
+        EXPECT_TRUE(storage.Delete("KEY0"));
+        EXPECT_EQ("2", stat(storage, "wal_compactions"));
+        expected = contents(storage);
+    }
+    EXPECT_EQ(std::string(300, '+'), expected["LOG"].first);
+    EXPECT_EQ(std::vector<uint64_t>{3}, OperationLog::List(dir, "snapshot."));
+
+    LoggedStorage storage(std::make_shared<StripedLockImpl>(1 << 24, 4), dir, std::chrono::milliseconds(1));
+    storage.Start();
+    EXPECT_EQ(expected, contents(storage));
+    EXPECT_EQ("1", stat(storage, "wal_replayed"));
+    EXPECT_EQ((std::vector<uint64_t>{3, 4}), OperationLog::List(dir, "log."));
+}
+
+// Concurrent writers share syncs, unless every write is synced on its own
+TEST(LoggedStorageTest, GroupCommit) {
+    for (long window : {0, 5}) {
+        std::string dir = wal_dir();
+        {
+            LoggedStorage storage(std::make_shared<ClockRWLockImpl>(1 << 24), dir,
+                                  std::chrono::milliseconds(window));
+            storage.Start();
+            std::vector<std::thread> writers;
+            for (long t = 0; t < 8; ++t) {
+                writers.emplace_back([&storage, t]() {
+                    for (long i = 0; i < 50; ++i) {
+                        EXPECT_TRUE(storage.Put("Key" + std::to_string(t) + "_" + std::to_string(i), "value"));
+                    }
+                });
+            }
+            for (auto &w : writers) {
+                w.join();
+            }
+
+            EXPECT_EQ("400", stat(storage, "wal_records"));
+            if (window == 0) {
+                EXPECT_EQ("400", stat(storage, "wal_syncs"));
+            } else {
+                EXPECT_GT(200, std::stol(stat(storage, "wal_syncs")));
+            }
+        }
+
+        LoggedStorage storage(std::make_shared<ClockRWLockImpl>(1 << 24), dir, std::chrono::milliseconds(window));
+        storage.Start();
+        EXPECT_EQ(400, contents(storage).size());
+    }
+    wal_dir();
+}